@@ -11,9 +11,11 @@
  * - Creating a global NVSConfigBus instance
  * - Loading configuration with default value application
  * - Modifying values and persisting changes
+ * - Reloading into a document sized exactly for the stored data
  */
 
 #include <NVSConfigBus.h>
+#include <NVSJsonArena.h>
 #include <ArduinoJson.h>
 
 // Create a global configuration bus instance
@@ -100,9 +102,15 @@ void setup() {
   Serial.println();
   Serial.println("Verifying saved configuration...");
   
-  // Reload to verify
-  DynamicJsonDocument verifyDoc(1024);
-  if (configBus.loadModuleConfig("pulsfan", verifyDoc)) {
+  // Reload to verify - no capacity guess needed: the scoped document
+  // measures the stored data and sizes its memory before parsing
+  Serial.print("  -> Required document memory: ");
+  Serial.print(configBus.requiredCapacity("pulsfan"));
+  Serial.println(" bytes");
+
+  NVSScopedDocument verify(configBus);
+  if (verify.load("pulsfan")) {
+    JsonDocument& verifyDoc = verify.doc();
     Serial.println("  -> Configuration verified:");
     Serial.print("     Heart Rate Min: ");
     Serial.println(verifyDoc["heartRateMin"].as<int>());
@@ -9,6 +9,7 @@
  * - Multiple modules using the same bus instance
  * - Module isolation (clearing one doesn't affect the other)
  * - Factory reset functionality (clearAll)
+ * - Dumping all module configs at once (exportAll)
  * - Helper functions for module-specific load/save operations
  */
 
@@ -235,6 +236,18 @@ void setup() {
     Serial.println("SmartMiFan: ERROR - not found");
   }
 
+  // ========================================================================
+  // Export all modules (e.g. for a support dump)
+  // ========================================================================
+  
+  Serial.println();
+  Serial.println("--- Export All Modules ---");
+  if (!configBus.exportAll(Serial)) {
+    Serial.println();
+    Serial.println("  -> ERROR: Export incomplete");
+  }
+  Serial.println();
+
   Serial.println();
   Serial.println("=== Example complete ===");
   Serial.println("Both modules are isolated and can be managed independently.");
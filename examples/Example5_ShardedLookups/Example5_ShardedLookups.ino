@@ -0,0 +1,117 @@
+/**
+ * @file Example5_ShardedLookups.ino
+ * @brief Benchmark module load latency with one namespace vs. sharded namespaces
+ *
+ * This example demonstrates:
+ * - Spreading modules over several namespaces with setShards()
+ * - Moving existing modules with rebalance() after the shard count changed
+ * - Load latency of many modules in a single namespace vs. 4 shards
+ *
+ * Both buses store the same MODULE_COUNT modules. Every module is then loaded
+ * LOAD_ROUNDS times and the average / worst load time is reported. Finally the
+ * single-namespace store is resharded in place to show the rebalance cost.
+ */
+
+#include <NVSConfigBus.h>
+#include <ArduinoJson.h>
+
+// Both namespaces must leave room for the ".<shard>" suffix (max 13 characters)
+NVSConfigBus flatBus("shflat");
+NVSConfigBus shardedBus("shsplit");
+
+const int MODULE_COUNT = 120;
+const int LOAD_ROUNDS = 5;
+const uint8_t SHARD_COUNT = 4;
+
+struct LoadStats {
+  unsigned long totalUs;
+  unsigned long maxUs;
+  int failures;
+};
+
+void moduleName(int index, char* buf, size_t bufSize) {
+  snprintf(buf, bufSize, "mod%03d", index);
+}
+
+void populate(NVSConfigBus& bus) {
+  JsonDocument doc;
+  char moduleId[16];
+  for (int i = 0; i < MODULE_COUNT; i++) {
+    moduleName(i, moduleId, sizeof(moduleId));
+    doc.clear();
+    doc["index"] = i;
+    doc["enabled"] = (i % 2) == 0;
+    doc["label"] = moduleId;
+    bus.saveModuleConfig(moduleId, doc);
+  }
+}
+
+LoadStats measureLoads(NVSConfigBus& bus) {
+  LoadStats stats = {0, 0, 0};
+  JsonDocument doc;
+  char moduleId[16];
+  for (int round = 0; round < LOAD_ROUNDS; round++) {
+    for (int i = 0; i < MODULE_COUNT; i++) {
+      moduleName(i, moduleId, sizeof(moduleId));
+      unsigned long start = micros();
+      bool ok = bus.loadModuleConfig(moduleId, doc);
+      unsigned long elapsed = micros() - start;
+      stats.totalUs += elapsed;
+      stats.maxUs = max(stats.maxUs, elapsed);
+      stats.failures += ok ? 0 : 1;
+    }
+  }
+  return stats;
+}
+
+void printStats(const char* label, const LoadStats& stats) {
+  Serial.printf("%-22s avg %6lu us  max %6lu us  failures %d\n", label,
+                stats.totalUs / (MODULE_COUNT * LOAD_ROUNDS), stats.maxUs, stats.failures);
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("=== NVSConfigBus Sharded Lookups Benchmark ===");
+  Serial.printf("%d modules, %d load rounds\n\n", MODULE_COUNT, LOAD_ROUNDS);
+
+  flatBus.clearAll();
+  shardedBus.setShards(SHARD_COUNT);
+  shardedBus.rebalance();  // Records the layout; nothing to move in an empty store
+  shardedBus.clearAll();
+
+  Serial.println("Populating...");
+  populate(flatBus);
+  populate(shardedBus);
+
+  // The first load builds the module directory; measure steady-state loads
+  JsonDocument doc;
+  flatBus.loadModuleConfig("mod000", doc);
+  shardedBus.loadModuleConfig("mod000", doc);
+
+  LoadStats flat = measureLoads(flatBus);
+  LoadStats sharded = measureLoads(shardedBus);
+
+  Serial.println("\nLoad latency:");
+  printStats("1 namespace", flat);
+  char label[32];
+  snprintf(label, sizeof(label), "%u shards", SHARD_COUNT);
+  printStats(label, sharded);
+
+  // Reshard the single-namespace store in place
+  Serial.println("\nResharding the single-namespace store...");
+  flatBus.setShards(SHARD_COUNT);
+  unsigned long start = millis();
+  bool ok = flatBus.rebalance();
+  Serial.printf("rebalance(): %s in %lu ms\n", ok ? "ok" : "FAILED", millis() - start);
+
+  LoadStats resharded = measureLoads(flatBus);
+  printStats("after rebalance", resharded);
+
+  Serial.println("\nBenchmark complete.");
+}
+
+void loop() {
+  delay(10000);
+}
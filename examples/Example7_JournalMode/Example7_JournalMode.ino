@@ -0,0 +1,91 @@
+/**
+ * @file Example7_JournalMode.ino
+ * @brief Compare flash usage of full saves vs. journal mode for a busy module
+ *
+ * This example demonstrates:
+ * - Switching a frequently saved module to journal mode with setJournal()
+ * - Folding the journal into a new checkpoint from loop() with compactJournals()
+ * - NVS entries written and save time per save, full rewrite vs. journal
+ *
+ * Every save changes one counter in an otherwise static module. A full save
+ * rewrites the whole `<id>:mp` blob each time; in journal mode a save appends
+ * a small record with only the changed member, so far fewer 32-byte NVS
+ * entries are consumed and pages need erasing less often.
+ */
+
+#include <NVSConfigBus.h>
+#include <ArduinoJson.h>
+#include <nvs.h>
+
+NVSConfigBus fullBus("jfull");
+NVSConfigBus journalBus("jlog");
+
+const int SAVES = 200;
+const uint8_t JOURNAL_SLOTS = 8;
+
+// Module with a static part (calibration table) and one changing counter
+void fillModule(JsonDocument& doc, int counter) {
+  doc.clear();
+  doc["counter"] = counter;
+  doc["device"] = "sensor-node-17";
+  JsonArray table = doc["calibration"].to<JsonArray>();
+  for (int i = 0; i < 24; i++) {
+    table.add(1000 + i * 37);
+  }
+}
+
+size_t usedEntries() {
+  nvs_stats_t stats;
+  return nvs_get_stats(NULL, &stats) == ESP_OK ? stats.used_entries : 0;
+}
+
+void measure(const char* label, NVSConfigBus& bus) {
+  JsonDocument doc;
+  fillModule(doc, 0);
+  bus.saveModuleConfig("meter", doc);  // Initial full save / checkpoint
+
+  size_t entriesBefore = usedEntries();
+  unsigned long totalUs = 0;
+  unsigned long maxUs = 0;
+  for (int i = 1; i <= SAVES; i++) {
+    fillModule(doc, i);
+    unsigned long start = micros();
+    bus.saveModuleConfig("meter", doc);
+    unsigned long elapsed = micros() - start;
+    totalUs += elapsed;
+    maxUs = elapsed > maxUs ? elapsed : maxUs;
+  }
+  // Used entries shrink again when page GC reclaims erased ones, so this is
+  // a lower bound of what was written
+  size_t entriesAfter = usedEntries();
+
+  Serial.printf("%-8s module %4u bytes  avg %5lu us  max %6lu us  entries used %+d\n", label,
+                (unsigned)bus.sizeOf("meter"), totalUs / SAVES, maxUs,
+                (int)entriesAfter - (int)entriesBefore);
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("=== NVSConfigBus Journal Mode Example ===");
+  Serial.printf("%d saves, %u journal slots\n\n", SAVES, JOURNAL_SLOTS);
+
+  fullBus.clearAll();
+  journalBus.clearAll();
+  journalBus.setJournal("meter", JOURNAL_SLOTS);
+
+  measure("full", fullBus);
+  measure("journal", journalBus);
+
+  // Loads replay the journal transparently
+  JsonDocument doc;
+  journalBus.loadModuleConfig("meter", doc);
+  Serial.printf("\nJournal load: counter = %d\n", doc["counter"].as<int>());
+}
+
+void loop() {
+  // Checkpoint half-full journals while nothing else is going on
+  journalBus.compactJournals();
+  delay(10000);
+}
@@ -0,0 +1,64 @@
+/**
+ * @file Example8_CompiledDefaults.ino
+ * @brief Default configurations compiled from JSON files instead of built in code
+ *
+ * This example demonstrates:
+ * - Default documents kept as JSON files (defaults/pulsfan.json, defaults/smartmifan.json)
+ * - config_defaults.h generated from them by tools/json2msgpack.py: one
+ *   constexpr MessagePack array per file, stored in flash
+ * - loadModuleConfigOrDefault() falling back to those bytes when NVS is empty
+ *
+ * Compared to Example2, no code assigns default members one by one, and a
+ * first boot or factory reset neither builds the defaults twice nor writes
+ * them to NVS until a setting is actually changed.
+ *
+ * Regenerate the header after editing the JSON files:
+ *   python3 ../../tools/json2msgpack.py -o config_defaults.h defaults/pulsfan.json defaults/smartmifan.json
+ * In PlatformIO or CMake projects this runs automatically as a build step
+ * (tools/pio_json_defaults.py, tools/NVSConfigDefaults.cmake).
+ */
+
+#include <NVSConfigBus.h>
+#include <ArduinoJson.h>
+#include "config_defaults.h"
+
+NVSConfigBus configBus("appcfg");
+
+void printModule(const char* moduleId, const uint8_t* defaults, size_t defaultsSize) {
+  JsonDocument doc;
+  bool fromDefaults = false;
+  if (!configBus.loadModuleConfigOrDefault(moduleId, doc, defaults, defaultsSize, &fromDefaults)) {
+    Serial.printf("%s: load failed (error %d)\n", moduleId, (int)configBus.lastError());
+    return;
+  }
+  Serial.printf("%s (%s): ", moduleId, fromDefaults ? "compiled-in defaults" : "NVS");
+  serializeJson(doc, Serial);
+  Serial.println();
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("=== NVSConfigBus Compiled Defaults Example ===\n");
+  Serial.printf("Defaults in flash: pulsfan %u bytes, smartmifan %u bytes\n\n",
+                (unsigned)sizeof(pulsfan_defaults), (unsigned)sizeof(smartmifan_defaults));
+
+  configBus.clearAll();
+  printModule("pulsfan", pulsfan_defaults, sizeof(pulsfan_defaults));
+  printModule("smartmifan", smartmifan_defaults, sizeof(smartmifan_defaults));
+
+  // Only a changed setting is stored; the other module keeps using its defaults
+  JsonDocument doc;
+  configBus.loadModuleConfigOrDefault("pulsfan", doc, pulsfan_defaults, sizeof(pulsfan_defaults));
+  doc["heartRateMax"] = 175;
+  configBus.saveModuleConfig("pulsfan", doc);
+
+  Serial.println("\nAfter changing heartRateMax:");
+  printModule("pulsfan", pulsfan_defaults, sizeof(pulsfan_defaults));
+  printModule("smartmifan", smartmifan_defaults, sizeof(smartmifan_defaults));
+}
+
+void loop() {
+  delay(1000);
+}
@@ -0,0 +1,22 @@
+// Generated by json2msgpack.py from pulsfan.json, smartmifan.json - do not edit
+#pragma once
+
+#include <stdint.h>
+
+// pulsfan.json (61 bytes)
+constexpr uint8_t pulsfan_defaults[] = {
+  0x84, 0xac, 0x68, 0x65, 0x61, 0x72, 0x74, 0x52, 0x61, 0x74, 0x65, 0x4d,
+  0x69, 0x6e, 0x78, 0xac, 0x68, 0x65, 0x61, 0x72, 0x74, 0x52, 0x61, 0x74,
+  0x65, 0x4d, 0x61, 0x78, 0xcc, 0xb4, 0xaf, 0x66, 0x69, 0x72, 0x6d, 0x77,
+  0x61, 0x72, 0x65, 0x56, 0x65, 0x72, 0x73, 0x69, 0x6f, 0x6e, 0xa5, 0x31,
+  0x2e, 0x30, 0x2e, 0x30, 0xa7, 0x65, 0x6e, 0x61, 0x62, 0x6c, 0x65, 0x64,
+  0xc3,
+};
+
+// smartmifan.json (42 bytes)
+constexpr uint8_t smartmifan_defaults[] = {
+  0x84, 0xa5, 0x66, 0x61, 0x6e, 0x49, 0x50, 0xad, 0x31, 0x39, 0x32, 0x2e,
+  0x31, 0x36, 0x38, 0x2e, 0x31, 0x2e, 0x31, 0x30, 0x30, 0xa5, 0x74, 0x6f,
+  0x6b, 0x65, 0x6e, 0xa0, 0xa4, 0x70, 0x6f, 0x72, 0x74, 0xcd, 0xd4, 0x31,
+  0xa4, 0x66, 0x61, 0x6e, 0x73, 0x90,
+};
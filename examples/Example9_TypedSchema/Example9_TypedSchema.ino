@@ -0,0 +1,78 @@
+/**
+ * @file Example9_TypedSchema.ino
+ * @brief Configuration as a generated C++ struct instead of a JsonDocument
+ *
+ * This example demonstrates:
+ * - A module schema (pulsfan.schema.json) with types, defaults and a version
+ * - pulsfan_config.h generated from it by tools/schema2cpp.py: a plain struct
+ *   whose load()/save() encode the MessagePack blob directly, without a
+ *   JsonDocument or any heap allocation
+ * - Renamed keys (aliases) and a migration hook for older schema versions
+ *   (pulsfan_migrate.cpp, generated once and then edited by hand)
+ *
+ * Settings are ordinary struct members after load(), so the application
+ * reads them without string lookups. The stored blob is an ordinary module:
+ * loadModuleConfig(), export and import keep working.
+ *
+ * Regenerate the header after editing the schema:
+ *   python3 ../../tools/schema2cpp.py pulsfan.schema.json
+ */
+
+#include <NVSConfigBus.h>
+#include <ArduinoJson.h>
+#include "pulsfan_config.h"
+
+NVSConfigBus configBus("appcfg");
+
+void printConfig(const PulsfanConfig& cfg) {
+  Serial.printf("  enabled=%d hr=%u..%u minSpeed=%u name=%s curve=[%.2f, %.2f, %.2f]\n",
+                cfg.enabled, cfg.heartRateMin, cfg.heartRateMax, cfg.minSpeed, cfg.deviceName,
+                cfg.curve[0], cfg.curve[1], cfg.curve[2]);
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("=== NVSConfigBus Typed Schema Example ===\n");
+  configBus.clearAll();
+
+  // An older firmware stored version 1 with the short key names
+  JsonDocument old;
+  old["schema_version"] = 1;
+  old["hrMin"] = 90;
+  old["hrMax"] = 170;
+  uint8_t buf[128];
+  configBus.saveModuleConfigMsgPack("pulsfan", old, buf, sizeof(buf));
+
+  PulsfanConfig cfg;
+  Serial.println("Defaults:");
+  printConfig(cfg);
+
+  NVSCodec::LoadResult loaded = cfg.load(configBus);
+  if (loaded == NVSCodec::LoadResult::Loaded) {
+    Serial.println("Loaded version 1 blob (aliases + migrate()):");
+    printConfig(cfg);
+  } else if (loaded == NVSCodec::LoadResult::Unreadable) {
+    // Saving now would replace the stored settings with the defaults
+    Serial.println("Stored config unreadable, not saving");
+    return;
+  }
+
+  cfg.minSpeed = 30;
+  snprintf(cfg.deviceName, sizeof(cfg.deviceName), "%s", "Bike room");
+  if (!cfg.save(configBus)) {
+    Serial.printf("Save failed (error %d)\n", (int)configBus.lastError());
+  }
+
+  // The blob is still readable as a document
+  JsonDocument doc;
+  configBus.loadModuleConfig("pulsfan", doc);
+  Serial.print("\nStored as: ");
+  serializeJson(doc, Serial);
+  Serial.println();
+}
+
+void loop() {
+  delay(1000);
+}
@@ -0,0 +1,171 @@
+// Generated by schema2cpp.py from pulsfan.schema.json - do not edit
+#pragma once
+
+#include <NVSConfigBus.h>
+#include <NVSCodec.h>
+
+/**
+ * @brief Typed configuration of module "pulsfan" (schema version 2)
+ *
+ * Members start with their schema defaults. load() overwrites the ones
+ * stored in NVS and calls migrate() for blobs of an older schema version;
+ * save() stores all members as one MessagePack module. After an Unreadable
+ * load(), a save() would replace the stored module with the defaults.
+ */
+struct PulsfanConfig {
+  static constexpr const char* kModuleId = "pulsfan";
+  static constexpr uint16_t kSchemaVersion = 2;
+  static constexpr size_t kMaxEncodedSize = 126;  ///< encode() never needs more
+
+  bool enabled = true;
+  uint8_t heartRateMin = 100u;  ///< Fan starts above this rate (bpm)
+  uint8_t heartRateMax = 180u;  ///< Fan reaches full speed here (bpm)
+  uint8_t minSpeed = 20u;  ///< Percent
+  char deviceName[24] = "PulsFan";
+  float curve[3] = {0.0f, 1.0f, 0.5f};  ///< Speed curve coefficients
+
+  /**
+   * @brief Encode all members as a MessagePack map
+   * @return Bytes written, 0 if @p bufSize is too small
+   */
+  size_t encode(uint8_t* buf, size_t bufSize) const;
+
+  /**
+   * @brief Overwrite the members present in a MessagePack map
+   * @param version Receives the stored schema version (0 if absent)
+   * @return false if the data is not a well-formed map
+   */
+  bool decode(const uint8_t* data, size_t len, uint16_t& version);
+
+  /**
+   * @brief Load from NVS (members keep their defaults unless Loaded)
+   * @return Loaded, NotStored, or Unreadable if the module exists but could
+   *         not be read or decoded; do not save() over it in that case
+   */
+  NVSCodec::LoadResult load(NVSConfigBus& bus);
+
+  /** @brief Save all members to NVS */
+  bool save(NVSConfigBus& bus) const;
+
+  /**
+   * @brief Upgrade members decoded from an older schema version
+   *
+   * Implemented in pulsfan_migrate.cpp (generated once, then maintained by hand).
+   */
+  void migrate(uint16_t fromVersion);
+};
+
+inline size_t PulsfanConfig::encode(uint8_t* buf, size_t bufSize) const {
+  NVSMsgPack::BufferWriter w(buf, bufSize);
+  w.writeMapHeader(7);
+  w.writeStr("schema_version", 14);
+  w.writeUInt(kSchemaVersion);
+  w.writeStr("enabled", 7);
+  NVSCodec::write(w, enabled);
+  w.writeStr("heartRateMin", 12);
+  NVSCodec::write(w, heartRateMin);
+  w.writeStr("heartRateMax", 12);
+  NVSCodec::write(w, heartRateMax);
+  w.writeStr("minSpeed", 8);
+  NVSCodec::write(w, minSpeed);
+  w.writeStr("deviceName", 10);
+  NVSCodec::writeString(w, deviceName, sizeof(deviceName));
+  w.writeStr("curve", 5);
+  NVSCodec::writeArray(w, curve);
+  return w.overflowed() ? 0 : w.size();
+}
+
+inline bool PulsfanConfig::decode(const uint8_t* data, size_t len, uint16_t& version) {
+  const uint8_t* p = data;
+  const uint8_t* end = data + len;
+  NVSMsgPack::Token map;
+  version = 0;
+  if (!NVSMsgPack::readToken(p, end, map) || map.type != NVSMsgPack::Type::Map) {
+    return false;
+  }
+  for (uint32_t i = 0; i < map.length; i++) {
+    NVSMsgPack::Token key;
+    NVSMsgPack::Token value;
+    if (!NVSMsgPack::readToken(p, end, key)) {
+      return false;
+    }
+    const uint8_t* v = p;
+    if (!NVSMsgPack::readToken(v, end, value) || !NVSMsgPack::skipValue(p, end)) {
+      return false;
+    }
+    if (key.type != NVSMsgPack::Type::Str) {
+      continue;
+    }
+    switch (key.length) {
+      case 5:
+        if (NVSCodec::keyIs(key, "hrMin", 5)) {
+          NVSCodec::read(value, heartRateMin);
+        } else if (NVSCodec::keyIs(key, "hrMax", 5)) {
+          NVSCodec::read(value, heartRateMax);
+        } else if (NVSCodec::keyIs(key, "curve", 5)) {
+          NVSCodec::readArray(value, v, end, curve);
+        }
+        break;
+      case 7:
+        if (NVSCodec::keyIs(key, "enabled", 7)) {
+          NVSCodec::read(value, enabled);
+        }
+        break;
+      case 8:
+        if (NVSCodec::keyIs(key, "minSpeed", 8)) {
+          NVSCodec::read(value, minSpeed);
+        }
+        break;
+      case 10:
+        if (NVSCodec::keyIs(key, "deviceName", 10)) {
+          NVSCodec::readString(value, deviceName, sizeof(deviceName));
+        }
+        break;
+      case 12:
+        if (NVSCodec::keyIs(key, "heartRateMin", 12)) {
+          NVSCodec::read(value, heartRateMin);
+        } else if (NVSCodec::keyIs(key, "heartRateMax", 12)) {
+          NVSCodec::read(value, heartRateMax);
+        }
+        break;
+      case 14:
+        if (NVSCodec::keyIs(key, "schema_version", 14)) {
+          NVSCodec::read(value, version);
+        }
+        break;
+      default:
+        break;  // Unknown member (e.g. written by a newer firmware)
+    }
+  }
+  return true;
+}
+
+inline NVSCodec::LoadResult PulsfanConfig::load(NVSConfigBus& bus) {
+  // The stored bytes bound the merged document, which may hold more members
+  // than kMaxEncodedSize (newer firmware); sizeOf() is 0 for modules the
+  // directory cannot size, which get the largest module buffer
+  size_t stored = bus.sizeOf(kModuleId);
+  NVSScratchBuffer buf(bus.memoryBudget(), bus.allocator(),
+                       stored > 0 ? stored : NVS_CFG_MAX_MODULE_SIZE);
+  size_t len = buf ? bus.readModuleMsgPack(kModuleId, buf.data(), buf.size()) : 0;
+  PulsfanConfig loaded;
+  uint16_t version;
+  if (len == 0 && !bus.exists(kModuleId)) {
+    return NVSCodec::LoadResult::NotStored;
+  }
+  if (len == 0 || !loaded.decode(buf.data(), len, version)) {
+    NVS_CFG_LOG("PulsfanConfig: stored module unreadable");
+    return NVSCodec::LoadResult::Unreadable;
+  }
+  if (version < kSchemaVersion) {
+    loaded.migrate(version);
+  }
+  *this = loaded;
+  return NVSCodec::LoadResult::Loaded;
+}
+
+inline bool PulsfanConfig::save(NVSConfigBus& bus) const {
+  uint8_t buf[2 * kMaxEncodedSize];  // Second half: scratch for hot fields / journal records
+  size_t len = encode(buf, kMaxEncodedSize);
+  return len > 0 && bus.saveModuleMsgPack(kModuleId, buf, len, sizeof(buf));
+}
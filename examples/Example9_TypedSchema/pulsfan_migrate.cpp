@@ -0,0 +1,14 @@
+// Schema migration for PulsfanConfig - generated once by schema2cpp.py, then edited by hand
+#include "pulsfan_config.h"
+
+void PulsfanConfig::migrate(uint16_t fromVersion) {
+  // Members missing from the stored blob already hold their defaults, and
+  // renamed keys are read through their aliases. Convert values whose
+  // meaning changed here. fromVersion is 0 for blobs without a version.
+  if (fromVersion < 2) {
+    // Added in version 2: curve
+    // Version 1 started the fan at heartRateMin; keep that behaviour
+    curve[0] = 0.0f;
+  }
+  (void)fromVersion;
+}
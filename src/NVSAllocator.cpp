@@ -0,0 +1,208 @@
+#include "NVSAllocator.h"
+#include "NVSLock.h"
+#include <stdlib.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include <esp_memory_utils.h>
+#else
+#include <soc/soc_memory_layout.h>
+#endif
+#endif
+
+namespace {
+
+#ifdef ESP_PLATFORM
+const uint32_t kInternalCaps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+const uint32_t kPsramCaps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+#endif
+
+// Where a block landed; host builds have no PSRAM and report the policy's choice
+NVSMemoryRegion placedRegion(const void* ptr, size_t size, NVSMemoryClass memoryClass) {
+#ifdef ESP_PLATFORM
+  (void)size;
+  (void)memoryClass;
+  return esp_ptr_external_ram(ptr) ? NVSMemoryRegion::Psram : NVSMemoryRegion::Internal;
+#else
+  (void)ptr;
+  return NVSDefaultAllocator::preferredRegion(size, memoryClass);
+#endif
+}
+
+}  // namespace
+
+NVSAllocator& NVSAllocator::defaultAllocator() {
+  static NVSDefaultAllocator allocator;
+  return allocator;
+}
+
+// Large transient and cached blocks may leave internal RAM
+NVSMemoryRegion NVSDefaultAllocator::preferredRegion(size_t size, NVSMemoryClass memoryClass) {
+  return memoryClass != NVSMemoryClass::Metadata && size >= NVS_CFG_PSRAM_THRESHOLD ? NVSMemoryRegion::Psram
+                                                                                     : NVSMemoryRegion::Internal;
+}
+
+void* NVSDefaultAllocator::allocate(size_t size, NVSMemoryClass memoryClass) {
+#ifdef ESP_PLATFORM
+  if (preferredRegion(size, memoryClass) == NVSMemoryRegion::Psram) {
+    void* ptr = heap_caps_malloc(size, kPsramCaps);
+    if (ptr != nullptr) {
+      return ptr;
+    }
+    // No PSRAM fitted (or it is full): fall back to internal RAM
+  }
+  return heap_caps_malloc(size, kInternalCaps);
+#else
+  (void)memoryClass;
+  return malloc(size);
+#endif
+}
+
+void* NVSDefaultAllocator::reallocate(void* ptr, size_t size, NVSMemoryClass memoryClass) {
+#ifdef ESP_PLATFORM
+  if (preferredRegion(size, memoryClass) == NVSMemoryRegion::Psram) {
+    void* grown = heap_caps_realloc(ptr, size, kPsramCaps);
+    if (grown != nullptr) {
+      return grown;
+    }
+  }
+  return heap_caps_realloc(ptr, size, kInternalCaps);
+#else
+  (void)memoryClass;
+  return realloc(ptr, size);
+#endif
+}
+
+void NVSDefaultAllocator::deallocate(void* ptr, NVSMemoryClass memoryClass) {
+  (void)memoryClass;
+#ifdef ESP_PLATFORM
+  heap_caps_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+NVSTaggedAllocator::NVSTaggedAllocator(NVSAllocator* inner)
+    : _inner(inner != nullptr ? *inner : NVSAllocator::defaultAllocator()),
+      _lock(xSemaphoreCreateRecursiveMutex()), _mismatches(0) {
+  for (size_t i = 0; i < kClassCount; i++) {
+    _live[i] = 0;
+    _peak[i] = 0;
+    _count[i] = 0;
+  }
+  for (size_t i = 0; i < kRegionCount; i++) {
+    _regionLive[i] = 0;
+    _regionPeak[i] = 0;
+  }
+}
+
+NVSTaggedAllocator::~NVSTaggedAllocator() {
+  if (_lock != nullptr) {
+    vSemaphoreDelete(_lock);
+  }
+}
+
+void NVSTaggedAllocator::account(NVSMemoryClass memoryClass, size_t added, size_t removed) {
+  NVSLockGuard guard(_lock);
+  size_t i = (size_t)memoryClass;
+  _live[i] = _live[i] + added - removed;
+  if (_live[i] > _peak[i]) {
+    _peak[i] = _live[i];
+  }
+}
+
+void NVSTaggedAllocator::accountRegion(const Header* header, bool add) {
+  NVSLockGuard guard(_lock);
+  size_t i = header->region;
+  if (add) {
+    _regionLive[i] += header->size;
+    if (_regionLive[i] > _regionPeak[i]) {
+      _regionPeak[i] = _regionLive[i];
+    }
+  } else {
+    _regionLive[i] -= header->size;
+  }
+}
+
+void* NVSTaggedAllocator::allocate(size_t size, NVSMemoryClass memoryClass) {
+  Header* header = (Header*)_inner.allocate(sizeof(Header) + size, memoryClass);
+  if (header == nullptr) {
+    return nullptr;
+  }
+  header->size = (uint32_t)size;
+  header->memoryClass = (uint8_t)memoryClass;
+  header->region = (uint8_t)placedRegion(header, sizeof(Header) + size, memoryClass);
+  account(memoryClass, size, 0);
+  accountRegion(header, true);
+  {
+    NVSLockGuard guard(_lock);
+    _count[(size_t)memoryClass]++;
+  }
+  return header + 1;
+}
+
+void* NVSTaggedAllocator::reallocate(void* ptr, size_t size, NVSMemoryClass memoryClass) {
+  if (ptr == nullptr) {
+    return allocate(size, memoryClass);
+  }
+  Header* header = (Header*)ptr - 1;
+  NVSMemoryClass original = (NVSMemoryClass)header->memoryClass;
+  size_t oldSize = header->size;
+  if (original != memoryClass) {
+    NVSLockGuard guard(_lock);
+    _mismatches++;
+  }
+
+  Header removed = *header;
+  Header* grown = (Header*)_inner.reallocate(header, sizeof(Header) + size, original);
+  if (grown == nullptr) {
+    return nullptr;
+  }
+  grown->size = (uint32_t)size;
+  grown->region = (uint8_t)placedRegion(grown, sizeof(Header) + size, original);
+  account(original, size, oldSize);
+  accountRegion(&removed, false);
+  accountRegion(grown, true);
+  return grown + 1;
+}
+
+void NVSTaggedAllocator::deallocate(void* ptr, NVSMemoryClass memoryClass) {
+  if (ptr == nullptr) {
+    return;
+  }
+  Header* header = (Header*)ptr - 1;
+  NVSMemoryClass original = (NVSMemoryClass)header->memoryClass;
+  if (original != memoryClass) {
+    NVSLockGuard guard(_lock);
+    _mismatches++;
+  }
+  account(original, 0, header->size);
+  accountRegion(header, false);
+  _inner.deallocate(header, original);
+}
+
+size_t NVSTaggedAllocator::liveBytes(NVSMemoryClass memoryClass) const {
+  return _live[(size_t)memoryClass];
+}
+
+size_t NVSTaggedAllocator::peakBytes(NVSMemoryClass memoryClass) const {
+  return _peak[(size_t)memoryClass];
+}
+
+uint32_t NVSTaggedAllocator::allocations(NVSMemoryClass memoryClass) const {
+  return _count[(size_t)memoryClass];
+}
+
+size_t NVSTaggedAllocator::liveBytes(NVSMemoryRegion region) const {
+  return _regionLive[(size_t)region];
+}
+
+size_t NVSTaggedAllocator::peakBytes(NVSMemoryRegion region) const {
+  return _regionPeak[(size_t)region];
+}
+
+NVSMemoryRegion NVSTaggedAllocator::regionOf(const void* ptr) const {
+  return (NVSMemoryRegion)((const Header*)ptr - 1)->region;
+}
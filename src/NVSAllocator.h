@@ -0,0 +1,156 @@
+/**
+ * @file NVSAllocator.h
+ * @brief Memory placement policy for NVSConfigBus buffers
+ *
+ * On boards with PSRAM, internal DRAM is the scarce resource. NVSConfigBus
+ * tags every allocation with a memory class so an allocator can place large
+ * transient buffers and cached blobs in PSRAM while keeping the small, hot
+ * metadata (module directory) in internal RAM.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Buffers at least this large may go to PSRAM under NVSDefaultAllocator
+#ifndef NVS_CFG_PSRAM_THRESHOLD
+#define NVS_CFG_PSRAM_THRESHOLD 512
+#endif
+
+/**
+ * @brief What an allocation is used for
+ */
+enum class NVSMemoryClass : uint8_t {
+  Scratch = 0,  ///< Transient load/save/export/import buffers
+  Cache,        ///< Blobs kept in RAM across calls
+  Metadata      ///< Small, frequently accessed bookkeeping (module directory)
+};
+
+/**
+ * @brief Where a block lives
+ */
+enum class NVSMemoryRegion : uint8_t {
+  Internal = 0,  ///< Internal DRAM
+  Psram          ///< External PSRAM
+};
+
+/**
+ * @class NVSAllocator
+ * @brief Allocation policy interface used by NVSConfigBus
+ *
+ * Implementations must be thread-safe; buses may allocate from several tasks.
+ */
+class NVSAllocator {
+public:
+  virtual ~NVSAllocator() {}
+
+  /**
+   * @brief Allocate @p size bytes for @p memoryClass (nullptr on failure)
+   */
+  virtual void* allocate(size_t size, NVSMemoryClass memoryClass) = 0;
+
+  /**
+   * @brief Resize a block from allocate() (nullptr on failure, block unchanged)
+   */
+  virtual void* reallocate(void* ptr, size_t size, NVSMemoryClass memoryClass) = 0;
+
+  /**
+   * @brief Free a block from allocate() / reallocate() (nullptr is ignored)
+   */
+  virtual void deallocate(void* ptr, NVSMemoryClass memoryClass) = 0;
+
+  /**
+   * @brief Allocator used by buses that were not given one (NVSDefaultAllocator)
+   */
+  static NVSAllocator& defaultAllocator();
+};
+
+/**
+ * @class NVSDefaultAllocator
+ * @brief PSRAM-aware default policy
+ *
+ * Scratch and Cache blocks of at least NVS_CFG_PSRAM_THRESHOLD bytes are
+ * placed in PSRAM when it is available, falling back to internal RAM.
+ * Metadata and small blocks always use internal RAM. Without ESP-IDF heap
+ * capabilities (host builds) everything comes from malloc().
+ */
+class NVSDefaultAllocator : public NVSAllocator {
+public:
+  /**
+   * @brief Region this policy asks for first (the same on host builds)
+   */
+  static NVSMemoryRegion preferredRegion(size_t size, NVSMemoryClass memoryClass);
+
+  void* allocate(size_t size, NVSMemoryClass memoryClass) override;
+  void* reallocate(void* ptr, size_t size, NVSMemoryClass memoryClass) override;
+  void deallocate(void* ptr, NVSMemoryClass memoryClass) override;
+};
+
+/**
+ * @class NVSTaggedAllocator
+ * @brief Decorator that accounts allocations per memory class
+ *
+ * Each block carries a small header with its class, size and region, so
+ * placement can be checked on the host (or logged on the device) without
+ * relying on heap_caps queries. On the device the region is where the block
+ * actually landed; host builds have no PSRAM and record the region
+ * NVSDefaultAllocator::preferredRegion() would have picked.
+ *
+ * @example
+ * ```cpp
+ * NVSTaggedAllocator tagged;
+ * NVSConfigBus bus("appcfg", &tagged);
+ * bus.loadModuleConfig("wifi", doc);
+ * Serial.println(tagged.peakBytes(NVSMemoryClass::Scratch));
+ * ```
+ */
+class NVSTaggedAllocator : public NVSAllocator {
+public:
+  /**
+   * @param inner Allocator doing the real work (default: NVSAllocator::defaultAllocator())
+   */
+  explicit NVSTaggedAllocator(NVSAllocator* inner = nullptr);
+  ~NVSTaggedAllocator();
+
+  NVSTaggedAllocator(const NVSTaggedAllocator&) = delete;
+  NVSTaggedAllocator& operator=(const NVSTaggedAllocator&) = delete;
+
+  void* allocate(size_t size, NVSMemoryClass memoryClass) override;
+  void* reallocate(void* ptr, size_t size, NVSMemoryClass memoryClass) override;
+  void deallocate(void* ptr, NVSMemoryClass memoryClass) override;
+
+  size_t liveBytes(NVSMemoryClass memoryClass) const;   ///< Bytes currently allocated
+  size_t peakBytes(NVSMemoryClass memoryClass) const;   ///< Highest liveBytes() so far
+  uint32_t allocations(NVSMemoryClass memoryClass) const;  ///< Successful allocate() calls
+  uint32_t mismatches() const { return _mismatches; }   ///< Blocks freed/resized under another class
+
+  size_t liveBytes(NVSMemoryRegion region) const;       ///< Bytes currently allocated in @p region
+  size_t peakBytes(NVSMemoryRegion region) const;       ///< Highest liveBytes(region) so far
+  NVSMemoryRegion regionOf(const void* ptr) const;      ///< Region of a block from this allocator
+
+private:
+  struct alignas(8) Header {
+    uint32_t size;
+    uint8_t memoryClass;
+    uint8_t region;
+    uint8_t reserved[2];
+  };
+  static const size_t kClassCount = 3;
+  static const size_t kRegionCount = 2;
+
+  void account(NVSMemoryClass memoryClass, size_t added, size_t removed);
+  void accountRegion(const Header* header, bool add);
+
+  NVSAllocator& _inner;
+  SemaphoreHandle_t _lock;  ///< Guards the counters
+  size_t _live[kClassCount];
+  size_t _peak[kClassCount];
+  uint32_t _count[kClassCount];
+  size_t _regionLive[kRegionCount];
+  size_t _regionPeak[kRegionCount];
+  uint32_t _mismatches;
+};
@@ -0,0 +1,160 @@
+/**
+ * @file NVSCodec.h
+ * @brief Typed MessagePack readers and writers for generated config structs
+ *
+ * `tools/schema2cpp.py` turns a module schema into a plain C++ struct whose
+ * encode()/decode() walk the stored MessagePack blob directly. The generated
+ * code matches keys once while decoding; afterwards settings are ordinary
+ * struct members, so reading one costs no lookup at all.
+ *
+ * These helpers convert between MessagePack tokens and the member types. A
+ * value that does not fit its member (wrong type, out of range) is ignored,
+ * so the member keeps its default, like a missing key. Strings longer than
+ * their member are truncated.
+ *
+ * Like NVSMsgPack.h, this header only depends on the C standard library.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include "NVSMsgPack.h"
+
+namespace NVSCodec {
+
+/**
+ * @brief Outcome of a generated struct's load()
+ */
+enum class LoadResult : uint8_t {
+  Loaded,     ///< Stored members were decoded into the struct
+  NotStored,  ///< Nothing stored; the struct keeps its defaults
+  Unreadable  ///< Stored, but not readable or not a map; the struct keeps its defaults
+};
+
+template <typename T>
+bool readInteger(const NVSMsgPack::Token& t, T& out) {
+  const bool isSigned = (T)(-1) < (T)0;
+  if (t.type == NVSMsgPack::Type::UInt) {
+    T v = (T)t.u;
+    if ((uint64_t)v != t.u || (isSigned && (int64_t)v < 0)) {
+      return false;  // Out of range (or wrapped to negative)
+    }
+    out = v;
+    return true;
+  }
+  if (t.type == NVSMsgPack::Type::Int) {
+    T v = (T)t.i;
+    if (!isSigned || (int64_t)v != t.i) {
+      return false;  // Negative value for an unsigned member, or out of range
+    }
+    out = v;
+    return true;
+  }
+  return false;
+}
+
+inline bool read(const NVSMsgPack::Token& t, int8_t& out) { return readInteger(t, out); }
+inline bool read(const NVSMsgPack::Token& t, int16_t& out) { return readInteger(t, out); }
+inline bool read(const NVSMsgPack::Token& t, int32_t& out) { return readInteger(t, out); }
+inline bool read(const NVSMsgPack::Token& t, int64_t& out) { return readInteger(t, out); }
+inline bool read(const NVSMsgPack::Token& t, uint8_t& out) { return readInteger(t, out); }
+inline bool read(const NVSMsgPack::Token& t, uint16_t& out) { return readInteger(t, out); }
+inline bool read(const NVSMsgPack::Token& t, uint32_t& out) { return readInteger(t, out); }
+inline bool read(const NVSMsgPack::Token& t, uint64_t& out) { return readInteger(t, out); }
+
+inline bool read(const NVSMsgPack::Token& t, bool& out) {
+  if (t.type != NVSMsgPack::Type::Bool) {
+    return false;
+  }
+  out = t.b;
+  return true;
+}
+
+inline bool read(const NVSMsgPack::Token& t, double& out) {
+  switch (t.type) {
+    case NVSMsgPack::Type::Float: out = t.f; return true;
+    case NVSMsgPack::Type::Double: out = t.d; return true;
+    case NVSMsgPack::Type::UInt: out = (double)t.u; return true;
+    case NVSMsgPack::Type::Int: out = (double)t.i; return true;
+    default: return false;
+  }
+}
+
+inline bool read(const NVSMsgPack::Token& t, float& out) {
+  double d;
+  if (!read(t, d)) {
+    return false;
+  }
+  out = (float)d;
+  return true;
+}
+
+/**
+ * @brief Copy a string token into a fixed-size member (truncated, always terminated)
+ */
+inline bool readString(const NVSMsgPack::Token& t, char* out, size_t size) {
+  if (t.type != NVSMsgPack::Type::Str || size == 0) {
+    return false;
+  }
+  size_t n = t.length < size - 1 ? t.length : size - 1;
+  memcpy(out, t.data, n);
+  out[n] = '\0';
+  return true;
+}
+
+/**
+ * @brief Read array elements into a fixed-size member
+ *
+ * Elements beyond @p N are ignored; missing or mismatching elements keep
+ * their defaults.
+ *
+ * @param t Array header token
+ * @param p First element (right after the header)
+ */
+template <typename T, size_t N>
+bool readArray(const NVSMsgPack::Token& t, const uint8_t* p, const uint8_t* end, T (&out)[N]) {
+  if (t.type != NVSMsgPack::Type::Array) {
+    return false;
+  }
+  for (uint32_t k = 0; k < t.length && k < N; k++) {
+    const uint8_t* element = p;
+    NVSMsgPack::Token e;
+    if (!NVSMsgPack::readToken(element, end, e) || !NVSMsgPack::skipValue(p, end)) {
+      return false;
+    }
+    read(e, out[k]);
+  }
+  return true;
+}
+
+inline bool keyIs(const NVSMsgPack::Token& key, const char* name, size_t len) {
+  return key.length == len && memcmp(key.data, name, len) == 0;
+}
+
+inline void write(NVSMsgPack::BufferWriter& w, bool v) { w.writeBool(v); }
+inline void write(NVSMsgPack::BufferWriter& w, int8_t v) { w.writeInt(v); }
+inline void write(NVSMsgPack::BufferWriter& w, int16_t v) { w.writeInt(v); }
+inline void write(NVSMsgPack::BufferWriter& w, int32_t v) { w.writeInt(v); }
+inline void write(NVSMsgPack::BufferWriter& w, int64_t v) { w.writeInt(v); }
+inline void write(NVSMsgPack::BufferWriter& w, uint8_t v) { w.writeUInt(v); }
+inline void write(NVSMsgPack::BufferWriter& w, uint16_t v) { w.writeUInt(v); }
+inline void write(NVSMsgPack::BufferWriter& w, uint32_t v) { w.writeUInt(v); }
+inline void write(NVSMsgPack::BufferWriter& w, uint64_t v) { w.writeUInt(v); }
+inline void write(NVSMsgPack::BufferWriter& w, float v) { w.writeDouble(v); }
+inline void write(NVSMsgPack::BufferWriter& w, double v) { w.writeDouble(v); }
+
+inline void writeString(NVSMsgPack::BufferWriter& w, const char* s, size_t size) {
+  const void* nul = memchr(s, '\0', size);
+  w.writeStr(s, nul != nullptr ? (size_t)((const char*)nul - s) : size);
+}
+
+template <typename T, size_t N>
+void writeArray(NVSMsgPack::BufferWriter& w, const T (&values)[N]) {
+  w.writeArrayHeader((uint32_t)N);
+  for (size_t k = 0; k < N; k++) {
+    write(w, values[k]);
+  }
+}
+
+}  // namespace NVSCodec
@@ -1,10 +1,49 @@
 #include "NVSConfigBus.h"
+#include "NVSJsonArena.h"
+#include "NVSLock.h"
+#include "NVSMsgPack.h"
 #include <string.h>
 
-NVSConfigBus::NVSConfigBus(const char* nvsNamespace)
-    : _namespace(nvsNamespace) {
+const char* const NVSConfigBus::kGenerationKey = "__gen";
+const char* const NVSConfigBus::kResetKey = "__rst";
+const char* const NVSConfigBus::kShardsKey = "__shd";
+const char* const NVSConfigBus::kBootKey = "__boot";
+
+NVSConfigBus::NVSConfigBus(const char* nvsNamespace, NVSAllocator* allocator, const char* partition)
+    : _namespace(nvsNamespace), _partition(partition != nullptr ? partition : NVS_DEFAULT_PART_NAME),
+      _partitionReady(strcmp(_partition, NVS_DEFAULT_PART_NAME) == 0), _lastError(NVSConfigError::None),
+      _budget(&NVSMemoryBudget::shared()),
+      _allocator(allocator != nullptr ? allocator : &NVSAllocator::defaultAllocator()), _shards(1),
+      _lock(xSemaphoreCreateRecursiveMutex()), _dir(nullptr), _dirCount(0),
+      _dirCapacity(0), _dirLoaded(false), _rtc(nullptr), _rtcSize(0), _rtcChecked(false),
+      _prefetchTask(nullptr), _prefetchStop(false), _prefetchOrder(0) {
   // Constructor only stores the namespace; NVS is accessed on-demand
   // No initialization needed as Preferences handles NVS mounting automatically
+  // (a dedicated partition is mounted on first use)
+  // The module directory is built lazily on first lookup
+  memset(_hot, 0, sizeof(_hot));
+  memset(_journal, 0, sizeof(_journal));
+  memset(_persistence, 0, sizeof(_persistence));
+  memset(&_maintenance, 0, sizeof(_maintenance));
+  memset(_prefetch, 0, sizeof(_prefetch));
+  memset(&_prefetchStats, 0, sizeof(_prefetchStats));
+  memset(&_boot, 0, sizeof(_boot));
+}
+
+NVSConfigBus::~NVSConfigBus() {
+  if (_prefetchTask != nullptr) {
+    // The task may be inside an NVS read: let it finish and exit by itself
+    _prefetchStop = true;
+    xTaskNotifyGive(_prefetchTask);
+    while (_prefetchTask != nullptr) {
+      vTaskDelay(1);
+    }
+  }
+  dropPrefetched();
+  _allocator->deallocate(_dir, NVSMemoryClass::Metadata);
+  if (_lock != nullptr) {
+    vSemaphoreDelete(_lock);
+  }
 }
 
 bool NVSConfigBus::buildMsgPackKey(const char* moduleId, char* keyBuf, size_t keyBufSize) const {
@@ -33,80 +72,175 @@ bool NVSConfigBus::buildMsgPackKey(const char* moduleId, char* keyBuf, size_t ke
   return true;
 }
 
-bool NVSConfigBus::loadModuleConfig(const char* moduleId, DynamicJsonDocument& doc) {
+bool NVSConfigBus::buildKey(const char* moduleId, const char* suffix, char* keyBuf, size_t keyBufSize) {
+  if (moduleId == nullptr || keyBuf == nullptr) {
+    return false;
+  }
+  size_t moduleIdLen = strlen(moduleId);
+  size_t suffixLen = strlen(suffix);
+  if (moduleIdLen + suffixLen > 15 || moduleIdLen + suffixLen + 1 > keyBufSize) {
+    return false;
+  }
+  memcpy(keyBuf, moduleId, moduleIdLen);
+  memcpy(keyBuf + moduleIdLen, suffix, suffixLen + 1);
+  return true;
+}
+
+void NVSConfigBus::setMemoryBudget(NVSMemoryBudget& budget) {
+  _budget = &budget;
+}
+
+uint32_t NVSConfigBus::nextGeneration(Preferences& prefs, const char* moduleId) {
+  // The counter is bus-wide and lives in shard 0
+  Preferences base;
+  Preferences* counter = &prefs;
+  if (shardOf(moduleId) != 0) {
+    if (!openShard(base, 0, false)) {
+      NVS_CFG_LOG("nextGeneration: failed to open bus namespace");
+      return 0;
+    }
+    counter = &base;
+  }
+  uint32_t generation = counter->getUInt(kGenerationKey, 0) + 1;
+  if (counter->putUInt(kGenerationKey, generation) == 0) {
+    NVS_CFG_LOG("nextGeneration: failed to persist bus generation");
+  } else {
+    rtcSetGeneration(generation);  // Our own write: the other snapshot entries stay valid
+  }
+  if (counter == &base) {
+    base.end();
+  }
+  return generation;
+}
+
+uint32_t NVSConfigBus::generation() {
+  Preferences prefs;
+  if (!openShard(prefs, 0, true)) {
+    return 0;  // Namespace not created yet
+  }
+  uint32_t generation = prefs.getUInt(kGenerationKey, 0);
+  prefs.end();
+  return generation;
+}
+
+bool NVSConfigBus::loadModuleConfig(const char* moduleId, JsonDocument& doc) {
+  _lastError = NVSConfigError::None;
   if (moduleId == nullptr || strlen(moduleId) == 0) {
     NVS_CFG_LOG("loadModuleConfig: invalid moduleId");
+    _lastError = NVSConfigError::InvalidArgument;
     doc.clear();
     return false;
   }
+  recordBootLoad(moduleId);
 
-  // Use internal buffer for MessagePack operations (default size: 2048 bytes)
-  // This is a compromise - for better control, use loadModuleConfigMsgPack() with caller buffer
-  const size_t internalBufSize = 2048;
-  uint8_t* internalBuf = (uint8_t*)malloc(internalBufSize);
-  if (internalBuf == nullptr) {
-    NVS_CFG_LOG("loadModuleConfig: failed to allocate internal buffer, falling back to JSON");
-    // Fall through to JSON-only path
-  } else {
-    // Try MessagePack first
-    if (loadModuleConfigMsgPack(moduleId, doc, internalBuf, internalBufSize)) {
-      free(internalBuf);
+  // After a deep-sleep wake the snapshot answers without a directory scan
+  {
+    NVSLockGuard guard(_lock);
+    const uint8_t* snapshot;
+    size_t snapshotLen;
+    if (rtcFind(moduleId, snapshot, snapshotLen) && !deserializeMsgPack(doc, snapshot, snapshotLen)) {
       return true;
     }
-    free(internalBuf);
+  }
+
+  // The directory answers "not stored" without touching NVS or allocating
+  ModuleInfo info;
+  Lookup lookup = lookupModule(moduleId, info);
+  bool known = lookup == Lookup::Found;
+  if (lookup == Lookup::Missing || (known && info.format == NVSModuleFormat::None)) {
+    doc.clear();
+    return false;
+  }
+
+  // A blob read ahead by prefetch() only needs deserializing
+  if (known && info.format == NVSModuleFormat::MsgPack && takePrefetched(moduleId, info, doc)) {
+    return true;
+  }
+
+  if (!known || info.format == NVSModuleFormat::MsgPack) {
+    // Use internal buffer for MessagePack operations (exact stored size when
+    // known from the directory, otherwise the default of 2048 bytes)
+    // For better control, use loadModuleConfigMsgPack() with caller buffer
+    const size_t internalBufSize = (known && info.size > 0) ? storedBytes(info) : 2048;
+    NVSScratchBuffer internalBuf(*_budget, *_allocator, internalBufSize);
+    if (!internalBuf) {
+      if (internalBuf.error() == NVSConfigError::BudgetExhausted) {
+        NVS_CFG_LOG("loadModuleConfig: RAM budget exhausted");
+        _lastError = NVSConfigError::BudgetExhausted;
+        doc.clear();
+        return false;
+      }
+      NVS_CFG_LOG("loadModuleConfig: failed to allocate internal buffer, falling back to JSON");
+      // Fall through to JSON-only path
+    } else if (loadModuleConfigMsgPack(moduleId, doc, internalBuf.data(), internalBufSize)) {
+      // Try MessagePack first
+      return true;
+    }
+    internalBuf.release();
+
+    if (known && !info.legacyCopy) {
+      doc.clear();
+      return false;  // No JSON copy to fall back to
+    }
   }
 
   // Fallback to JSON bytes storage (or legacy JSON string)
   Preferences prefs;
-  if (!prefs.begin(_namespace, true)) {  // Read-only mode
+  if (!openModule(prefs, moduleId, true)) {  // Read-only mode
     NVS_CFG_LOG("loadModuleConfig: failed to open Preferences namespace");
     doc.clear();
     return false;
   }
 
+  // Layout of the JSON key is known from the directory unless only a legacy
+  // copy next to the MessagePack blob is left
+  bool layoutKnown = known && info.format != NVSModuleFormat::MsgPack;
+
   // Check if JSON key exists
-  if (!prefs.isKey(moduleId)) {
+  if (!layoutKnown && !prefs.isKey(moduleId)) {
     prefs.end();
     doc.clear();
     return false;
   }
 
   // Try to read as bytes first (new format)
-  size_t jsonSize = prefs.getBytesLength(moduleId);
+  size_t jsonSize = 0;
+  if (!layoutKnown || info.format == NVSModuleFormat::JsonBytes) {
+    jsonSize = (layoutKnown && info.size > 0) ? info.size : prefs.getBytesLength(moduleId);
+  }
   bool migratedFromString = false;
   
   if (jsonSize > 0) {
     // JSON stored as bytes (new format)
     const size_t jsonBufSize = 2048;
-    uint8_t* jsonBuf = (uint8_t*)malloc(jsonBufSize);
-    if (jsonBuf == nullptr) {
-      NVS_CFG_LOG("loadModuleConfig: failed to allocate JSON buffer");
+    if (jsonSize > jsonBufSize) {
+      NVS_CFG_LOG("loadModuleConfig: JSON buffer too small");
       prefs.end();
       doc.clear();
       return false;
     }
 
-    if (jsonSize > jsonBufSize) {
-      NVS_CFG_LOG("loadModuleConfig: JSON buffer too small");
+    NVSScratchBuffer jsonBuf(*_budget, *_allocator, jsonSize);
+    if (!jsonBuf) {
+      NVS_CFG_LOG("loadModuleConfig: failed to allocate JSON buffer");
+      _lastError = jsonBuf.error();
       prefs.end();
-      free(jsonBuf);
       doc.clear();
       return false;
     }
 
-    size_t bytesRead = prefs.getBytes(moduleId, jsonBuf, jsonSize);
+    size_t bytesRead = prefs.getBytes(moduleId, jsonBuf.data(), jsonSize);
     prefs.end();
 
     if (bytesRead != jsonSize) {
       NVS_CFG_LOG("loadModuleConfig: JSON read size mismatch");
-      free(jsonBuf);
       doc.clear();
       return false;
     }
 
     // Deserialize JSON from bytes (before freeing buffer)
-    DeserializationError error = deserializeJson(doc, jsonBuf, jsonSize);
-    free(jsonBuf);
+    DeserializationError error = deserializeJson(doc, jsonBuf.data(), jsonSize);
+    jsonBuf.release();
 
     if (error) {
       NVS_CFG_LOG("loadModuleConfig: JSON deserialization from bytes failed");
@@ -135,102 +269,187 @@ bool NVSConfigBus::loadModuleConfig(const char* moduleId, DynamicJsonDocument& d
     // Immediately migrate legacy string to bytes format
     migratedFromString = true;
     const size_t migrateBufSize = 2048;
-    uint8_t* migrateBuf = (uint8_t*)malloc(migrateBufSize);
-    if (migrateBuf != nullptr) {
+    NVSScratchBuffer migrateBuf(*_budget, *_allocator, migrateBufSize);
+    if (migrateBuf) {
       // Serialize JSON to bytes buffer
-      size_t jsonBytesSize = serializeJson(doc, migrateBuf, migrateBufSize);
+      size_t jsonBytesSize = serializeJson(doc, migrateBuf.data(), migrateBufSize);
       if (jsonBytesSize > 0 && jsonBytesSize < migrateBufSize) {
         Preferences prefsWrite;
-        if (prefsWrite.begin(_namespace, false)) {
+        if (openModule(prefsWrite, moduleId, false)) {
           // Remove old string key first
           prefsWrite.remove(moduleId);
           // Write as bytes (putBytes overwrites, so removing first ensures clean state)
-          size_t bytesWritten = prefsWrite.putBytes(moduleId, migrateBuf, jsonBytesSize);
+          size_t bytesWritten = prefsWrite.putBytes(moduleId, migrateBuf.data(), jsonBytesSize);
           prefsWrite.end();
           if (bytesWritten == jsonBytesSize) {
             NVS_CFG_LOG("loadModuleConfig: migrated JSON string to bytes");
+            if (layoutKnown) {
+              info.format = NVSModuleFormat::JsonBytes;
+              info.size = (uint16_t)jsonBytesSize;
+              info.crc = crc32(migrateBuf.data(), jsonBytesSize);
+              updateDirectory(moduleId, info);
+            }
           }
         }
       }
-      free(migrateBuf);
     }
   }
 
   // Migration: If we loaded from JSON and MessagePack doesn't exist, migrate to MessagePack
   // This is a one-time migration that happens automatically
-  char msgPackKey[64];
-  if (buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey))) {
-    Preferences prefsWrite;
-    if (prefsWrite.begin(_namespace, false)) {  // Read-write mode
-      if (!prefsWrite.isKey(msgPackKey)) {
-        // MessagePack doesn't exist, migrate from JSON to MessagePack
-        const size_t migrateBufSize = 2048;
-        uint8_t* migrateBuf = (uint8_t*)malloc(migrateBufSize);
-        if (migrateBuf != nullptr) {
-          if (saveModuleConfigMsgPack(moduleId, doc, migrateBuf, migrateBufSize)) {
-            NVS_CFG_LOG("loadModuleConfig: migrated JSON to MessagePack");
-          }
-          free(migrateBuf);
-        }
-      }
-      prefsWrite.end();
+  bool needsMsgPack = layoutKnown;
+  if (lookup == Lookup::Unavailable) {
+    char msgPackKey[64];
+    Preferences prefsRead;
+    if (buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey)) && openModule(prefsRead, moduleId, true)) {
+      needsMsgPack = !prefsRead.isKey(msgPackKey);
+      prefsRead.end();
+    }
+  }
+  if (needsMsgPack) {
+    // MessagePack doesn't exist, migrate from JSON to MessagePack
+    // (skipped, and retried on the next load, if the RAM budget is exhausted)
+    const size_t migrateBufSize = 2048;
+    NVSScratchBuffer migrateBuf(*_budget, *_allocator, migrateBufSize);
+    if (migrateBuf && saveModuleConfigMsgPack(moduleId, doc, migrateBuf.data(), migrateBufSize)) {
+      NVS_CFG_LOG("loadModuleConfig: migrated JSON to MessagePack");
     }
   }
 
   return true;
 }
 
-bool NVSConfigBus::saveModuleConfig(const char* moduleId, const DynamicJsonDocument& doc) {
+bool NVSConfigBus::loadModuleConfigOrDefault(const char* moduleId, JsonDocument& doc, const uint8_t* defaults,
+                                             size_t defaultsSize, bool* fromDefaults) {
+  if (fromDefaults != nullptr) {
+    *fromDefaults = false;
+  }
+  if (loadModuleConfig(moduleId, doc)) {
+    return true;
+  }
+  if (_lastError != NVSConfigError::None || exists(moduleId)) {
+    return false;  // Stored but unreadable: keep it rather than hand out defaults
+  }
+  if (defaults == nullptr || defaultsSize == 0) {
+    NVS_CFG_LOG("loadModuleConfigOrDefault: invalid defaults");
+    _lastError = NVSConfigError::InvalidArgument;
+    return false;
+  }
+
+  DeserializationError error = deserializeMsgPack(doc, defaults, defaultsSize);
+  if (error) {
+    NVS_CFG_LOG("loadModuleConfigOrDefault: defaults deserialization failed");
+    _lastError = error == DeserializationError::NoMemory ? NVSConfigError::OutOfMemory : NVSConfigError::ParseError;
+    doc.clear();
+    return false;
+  }
+  if (fromDefaults != nullptr) {
+    *fromDefaults = true;
+  }
+  return true;
+}
+
+bool NVSConfigBus::saveModuleConfig(const char* moduleId, const JsonDocument& doc) {
+  _lastError = NVSConfigError::None;
   if (moduleId == nullptr || strlen(moduleId) == 0) {
     NVS_CFG_LOG("saveModuleConfig: invalid moduleId");
+    _lastError = NVSConfigError::InvalidArgument;
     return false;
   }
 
   // Try to save as MessagePack first (preferred method)
   const size_t internalBufSize = 2048;
-  uint8_t* internalBuf = (uint8_t*)malloc(internalBufSize);
-  if (internalBuf != nullptr) {
-    if (saveModuleConfigMsgPack(moduleId, doc, internalBuf, internalBufSize)) {
-      free(internalBuf);
+  {
+    NVSScratchBuffer internalBuf(*_budget, *_allocator, internalBufSize);
+    if (internalBuf.error() == NVSConfigError::BudgetExhausted) {
+      // The JSON fallback would need the same budget
+      NVS_CFG_LOG("saveModuleConfig: RAM budget exhausted");
+      _lastError = NVSConfigError::BudgetExhausted;
+      return false;
+    }
+    if (internalBuf && saveModuleConfigMsgPack(moduleId, doc, internalBuf.data(), internalBufSize)) {
       return true;
     }
-    free(internalBuf);
+  }
+  const PersistenceConfig* persistence = persistenceOf(moduleId);
+  if (persistence != nullptr && persistence->mode == NVSPersistence::RtcOnly) {
+    return false;  // Never falls back to flash
   }
 
   // Fallback to JSON bytes storage if MessagePack fails
   const size_t jsonBufSize = 2048;
-  uint8_t* jsonBuf = (uint8_t*)malloc(jsonBufSize);
-  if (jsonBuf == nullptr) {
+  NVSScratchBuffer jsonBuf(*_budget, *_allocator, jsonBufSize);
+  if (!jsonBuf) {
     NVS_CFG_LOG("saveModuleConfig: failed to allocate JSON buffer");
+    _lastError = jsonBuf.error();
     return false;
   }
 
   // Serialize JSON document to bytes buffer
-  size_t jsonSize = serializeJson(doc, jsonBuf, jsonBufSize);
+  size_t jsonSize = serializeJson(doc, jsonBuf.data(), jsonBufSize);
   
   if (jsonSize == 0 || jsonSize >= jsonBufSize) {
     NVS_CFG_LOG("saveModuleConfig: JSON serialization failed or buffer too small");
-    free(jsonBuf);
     return false;
   }
 
   // Write JSON bytes to NVS
   Preferences prefs;
-  if (!prefs.begin(_namespace, false)) {  // Read-write mode
+  if (!openModule(prefs, moduleId, false)) {  // Read-write mode
     NVS_CFG_LOG("saveModuleConfig: failed to open Preferences namespace");
-    free(jsonBuf);
+    _lastError = NVSConfigError::NamespaceUnavailable;
     return false;
   }
 
-  size_t bytesWritten = prefs.putBytes(moduleId, jsonBuf, jsonSize);
-  prefs.end();
-  free(jsonBuf);
+  ModuleInfo previous;
+  Lookup lookup = lookupModule(moduleId, previous);
+  rtcRemove(moduleId);
+  ModuleInfo info = {nextGeneration(prefs, moduleId), false, false, NVSModuleFormat::JsonBytes,
+                     (uint16_t)jsonSize, crc32(jsonBuf.data(), jsonSize), 0, 0};
 
-  if (bytesWritten == 0 || bytesWritten != jsonSize) {
+  size_t bytesWritten = prefs.putBytes(moduleId, jsonBuf.data(), jsonSize);
+  jsonBuf.release();
+  bool ok = bytesWritten == jsonSize;
+  if (!ok) {
     NVS_CFG_LOG("saveModuleConfig: JSON write failed");
+    _lastError = NVSConfigError::WriteFailed;
+  }
+
+  // A previous MessagePack blob would shadow the JSON just written on load
+  char msgPackKey[64];
+  if (ok && buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey)) &&
+      ((lookup == Lookup::Found && previous.format == NVSModuleFormat::MsgPack) ||
+       (lookup == Lookup::Unavailable && prefs.isKey(msgPackKey)))) {
+    prefs.remove(msgPackKey);
+  }
+  // Hot fields are only split off MessagePack saves; the JSON holds them all
+  char hotKey[16];
+  if (ok && buildKey(moduleId, ":h", hotKey, sizeof(hotKey)) &&
+      ((lookup == Lookup::Found && previous.hotSize > 0) ||
+       (lookup == Lookup::Unavailable && prefs.isKey(hotKey)))) {
+    prefs.remove(hotKey);
+  }
+  if (ok && ((lookup == Lookup::Found && previous.journalSize > 0) || lookup == Lookup::Unavailable)) {
+    eraseJournal(prefs, moduleId);
+  }
+  if (ok && !writeModuleInfo(prefs, moduleId, info)) {
+    NVS_CFG_LOG("saveModuleConfig: failed to write module record");
+    _lastError = NVSConfigError::WriteFailed;
+    ok = false;
+  }
+  if (!ok) {
+    // Drop the old record, so the next directory scan measures the stored keys
+    char infoKey[16];
+    if (buildKey(moduleId, ":i", infoKey, sizeof(infoKey))) {
+      prefs.remove(infoKey);
+    }
+    prefs.end();
+    invalidateDirectory();
     return false;
   }
+  prefs.end();
 
+  updateDirectory(moduleId, info);
   return true;
 }
 
@@ -264,40 +483,159 @@ bool NVSConfigBus::saveModuleConfigMsgPack(const char* moduleId,
     return false;
   }
 
+  return storeModuleBlob(moduleId, buf, msgPackSize, bufSize);
+}
+
+bool NVSConfigBus::saveModuleMsgPack(const char* moduleId, uint8_t* buf, size_t len, size_t bufSize) {
+  _lastError = NVSConfigError::None;
+  if (!isValidModuleId(moduleId) || buf == nullptr || len == 0 || len > bufSize) {
+    NVS_CFG_LOG("saveModuleMsgPack: invalid moduleId or buffer");
+    _lastError = NVSConfigError::InvalidArgument;
+    return false;
+  }
+  if (len > NVS_CFG_MAX_MODULE_SIZE) {
+    _lastError = NVSConfigError::ModuleTooLarge;
+    return false;
+  }
+  if (!NVSMsgPack::validate(buf, len)) {
+    NVS_CFG_LOG("saveModuleMsgPack: blob is not valid MessagePack");
+    _lastError = NVSConfigError::ParseError;
+    return false;
+  }
+  if (!storeModuleBlob(moduleId, buf, len, bufSize)) {
+    _lastError = NVSConfigError::WriteFailed;
+    return false;
+  }
+  return true;
+}
+
+bool NVSConfigBus::storeModuleBlob(const char* moduleId, uint8_t* buf, size_t msgPackSize, size_t bufSize) {
+  // Volatile modules stay in the RTC snapshot (see setPersistence())
+  const PersistenceConfig* persistence = persistenceOf(moduleId);
+  if (persistence != nullptr) {
+    VolatileSave saved = saveVolatile(moduleId, *persistence, buf, msgPackSize);
+    if (saved != VolatileSave::WriteThrough) {
+      return saved == VolatileSave::Saved;
+    }
+  }
+  return writeModuleBlob(moduleId, buf, msgPackSize, bufSize);
+}
+
+bool NVSConfigBus::writeModuleBlob(const char* moduleId, uint8_t* buf, size_t msgPackSize, size_t bufSize) {
   // Build MessagePack key (using :mp suffix)
   char msgPackKey[64];
-  if (!buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey))) {
+  char hotKey[16];
+  if (!buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey)) ||
+      !buildKey(moduleId, ":h", hotKey, sizeof(hotKey))) {
     NVS_CFG_LOG("saveModuleConfigMsgPack: failed to build MessagePack key");
     return false;
   }
 
+  // Dropped before any write, so a failed save never leaves a stale snapshot
+  rtcRemove(moduleId);
+
+  // Journaled modules append the changed members instead (see setJournal())
+  uint8_t journalSlots = journalSlotsOf(moduleId);
+  if (journalSlots > 0) {
+    JournalSave journaled = saveJournalRecord(moduleId, journalSlots, buf, msgPackSize, bufSize);
+    if (journaled == JournalSave::Saved) {
+      rtcPut(moduleId, buf, msgPackSize);  // The record was built behind the document
+    }
+    if (journaled != JournalSave::FullSave) {
+      return journaled == JournalSave::Saved;
+    }
+  }
+
+  // Declared hot fields move to the `<id>:h` entry (in the unused buffer tail)
+  uint8_t* blob = buf;
+  size_t blobSize = msgPackSize;
+  uint8_t* hotEntry = nullptr;
+  size_t hotSize = 0;
+  const HotFields* hot = hotFieldsOf(moduleId);
+  if (hot != nullptr &&
+      !splitHotFields(*hot, buf, msgPackSize, bufSize, blob, blobSize, hotEntry, hotSize)) {
+    NVS_CFG_LOG("saveModuleConfigMsgPack: hot fields not split (not a map or buffer too small)");
+  }
+
   // Write to NVS using putBytes
   Preferences prefs;
-  if (!prefs.begin(_namespace, false)) {  // Read-write mode
+  if (!openModule(prefs, moduleId, false)) {  // Read-write mode
     NVS_CFG_LOG("saveModuleConfigMsgPack: failed to open Preferences namespace");
     return false;
   }
 
-  size_t bytesWritten = prefs.putBytes(msgPackKey, buf, msgPackSize);
-  prefs.end();
+  // A JSON `<id>` key written before the migration stays behind as a
+  // fallback copy; the directory remembers it so clears remove it as well
+  ModuleInfo previous;
+  Lookup lookup = lookupModule(moduleId, previous);
+  bool legacyCopy = lookup == Lookup::Found
+                        ? (previous.legacyCopy || previous.format == NVSModuleFormat::JsonBytes ||
+                           previous.format == NVSModuleFormat::JsonString)
+                        : lookup == Lookup::Unavailable && prefs.isKey(moduleId);
+
+  // Reserve the generation for delta sync before the data write (see
+  // nextGeneration()); the `<id>:i` record follows only once the data is
+  // stored, so it never describes a blob that was not written
+  ModuleInfo info = {nextGeneration(prefs, moduleId), false, legacyCopy, NVSModuleFormat::MsgPack,
+                     (uint16_t)blobSize, crc32(blob, blobSize), (uint16_t)hotSize, 0};
+
+  // An unchanged blob is not rewritten (typical when only hot fields changed)
+  bool unchanged = lookup == Lookup::Found && previous.format == NVSModuleFormat::MsgPack &&
+                   previous.size == info.size && previous.crc == info.crc;
+  size_t bytesWritten = unchanged ? blobSize : prefs.putBytes(msgPackKey, blob, blobSize);
 
   if (bytesWritten == 0) {
+    prefs.end();
     NVS_CFG_LOG("saveModuleConfigMsgPack: putBytes returned 0 (NVS might be full or key invalid)");
     return false;
   }
-  
-  if (bytesWritten != msgPackSize) {
+  if (bytesWritten != blobSize) {
+    prefs.end();
     char errorMsg[128];
-    snprintf(errorMsg, sizeof(errorMsg), "saveModuleConfigMsgPack: write size mismatch (expected %zu, got %zu)", msgPackSize, bytesWritten);
+    snprintf(errorMsg, sizeof(errorMsg), "saveModuleConfigMsgPack: write size mismatch (expected %zu, got %zu)", blobSize, bytesWritten);
     NVS_CFG_LOG(errorMsg);
     return false;
   }
 
+  bool ok = true;
+  if (hotSize > 0) {
+    ok = prefs.putBytes(hotKey, hotEntry, hotSize) == hotSize;
+    if (!ok) {
+      NVS_CFG_LOG("saveModuleConfigMsgPack: hot field write failed");
+    }
+  } else if ((lookup == Lookup::Found && previous.hotSize > 0) ||
+             (lookup == Lookup::Unavailable && prefs.isKey(hotKey))) {
+    prefs.remove(hotKey);  // All fields are in the blob now
+  }
+  if (ok && ((lookup == Lookup::Found && previous.journalSize > 0) || lookup == Lookup::Unavailable)) {
+    eraseJournal(prefs, moduleId);  // The blob is the new checkpoint
+  }
+  if (ok && !writeModuleInfo(prefs, moduleId, info)) {
+    NVS_CFG_LOG("saveModuleConfigMsgPack: failed to write module record");
+    ok = false;
+  }
+  if (!ok) {
+    // The old record no longer matches the stored entries: drop it, so the
+    // next directory scan measures the blob instead of trusting the record
+    char infoKey[16];
+    if (buildKey(moduleId, ":i", infoKey, sizeof(infoKey))) {
+      prefs.remove(infoKey);
+    }
+    prefs.end();
+    invalidateDirectory();
+    return false;
+  }
+  prefs.end();
+
+  updateDirectory(moduleId, info);
+  if (hotSize == 0) {
+    rtcPut(moduleId, blob, blobSize);  // A split blob is only half of the document
+  }
   return true;
 }
 
 bool NVSConfigBus::loadModuleConfigMsgPack(const char* moduleId,
-                                           DynamicJsonDocument& doc,
+                                           JsonDocument& doc,
                                            uint8_t* buf,
                                            size_t bufSize) {
   if (moduleId == nullptr || strlen(moduleId) == 0) {
@@ -312,58 +650,143 @@ bool NVSConfigBus::loadModuleConfigMsgPack(const char* moduleId,
     return false;
   }
 
+  size_t bytesRead = readModuleMsgPack(moduleId, buf, bufSize);
+  if (bytesRead == 0) {
+    doc.clear();
+    return false;  // MessagePack not present (caller should try JSON fallback) or unreadable
+  }
+
+  // Deserialize MessagePack (ArduinoJson 7 uses MessagePack format)
+  DeserializationError error = deserializeMsgPack(doc, buf, bytesRead);
+
+  if (error) {
+    NVS_CFG_LOG("loadModuleConfigMsgPack: MessagePack deserialization failed");
+    doc.clear();
+    return false;
+  }
+
+  return true;
+}
+
+size_t NVSConfigBus::readModuleMsgPack(const char* moduleId, uint8_t* buf, size_t bufSize) {
+  if (moduleId != nullptr && buf != nullptr) {
+    NVSLockGuard guard(_lock);
+    const uint8_t* snapshot;
+    size_t snapshotLen;
+    if (rtcFind(moduleId, snapshot, snapshotLen) && snapshotLen <= bufSize) {
+      memcpy(buf, snapshot, snapshotLen);
+      return snapshotLen;
+    }
+  }
+  JournalStatus status;
+  size_t len = readModuleState(moduleId, buf, bufSize, status);
+  if (len > 0) {
+    rtcPut(moduleId, buf, len);
+  }
+  return len;
+}
+
+size_t NVSConfigBus::readModuleState(const char* moduleId, uint8_t* buf, size_t bufSize, JournalStatus& status) {
+  status = JournalStatus{0, 0xff, 0, 0};
+  if (moduleId == nullptr || buf == nullptr || bufSize == 0) {
+    return 0;
+  }
+
   // Build MessagePack key (using :mp suffix)
   char msgPackKey[64];
   if (!buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey))) {
-    NVS_CFG_LOG("loadModuleConfigMsgPack: failed to build MessagePack key");
-    doc.clear();
-    return false;
+    NVS_CFG_LOG("readModuleMsgPack: failed to build MessagePack key");
+    return 0;
+  }
+
+  // Existence and size come from the directory when available
+  ModuleInfo info;
+  Lookup lookup = lookupModule(moduleId, info);
+  if (lookup == Lookup::Missing ||
+      (lookup == Lookup::Found && info.format != NVSModuleFormat::MsgPack)) {
+    return 0;  // MessagePack not present
   }
 
   Preferences prefs;
-  if (!prefs.begin(_namespace, true)) {  // Read-only mode
-    NVS_CFG_LOG("loadModuleConfigMsgPack: failed to open Preferences namespace");
-    doc.clear();
-    return false;
+  if (!openModule(prefs, moduleId, true)) {  // Read-only mode
+    NVS_CFG_LOG("readModuleMsgPack: failed to open Preferences namespace");
+    return 0;
   }
 
   // Check if MessagePack key exists
-  if (!prefs.isKey(msgPackKey)) {
+  if (lookup == Lookup::Unavailable && !prefs.isKey(msgPackKey)) {
     prefs.end();
-    doc.clear();
-    return false;  // MessagePack not present, caller should try JSON fallback
+    return 0;  // MessagePack not present
   }
 
-  // Get the size of stored MessagePack data
+  // Get the size of stored MessagePack data (and of the hot-field entry)
   // Note: getBytesLength() is available in ESP32 Arduino core
-  size_t storedSize = prefs.getBytesLength(msgPackKey);
-  if (storedSize == 0 || storedSize > bufSize) {
-    NVS_CFG_LOG("loadModuleConfigMsgPack: invalid stored size or buffer too small");
+  char hotKey[16];
+  buildKey(moduleId, ":h", hotKey, sizeof(hotKey));
+  size_t storedSize = (lookup == Lookup::Found && info.size > 0) ? info.size
+                                                                 : prefs.getBytesLength(msgPackKey);
+  size_t hotSize = lookup == Lookup::Found ? info.hotSize : prefs.getBytesLength(hotKey);
+  if (storedSize == 0 || storedSize + hotSize > bufSize) {
+    NVS_CFG_LOG("readModuleMsgPack: invalid stored size or buffer too small");
     prefs.end();
-    doc.clear();
-    return false;
+    return 0;
   }
 
-  // Read MessagePack data from NVS
-  size_t bytesRead = prefs.getBytes(msgPackKey, buf, storedSize);
-  prefs.end();
+  // Hot entry first, module blob right behind it, then merged into one map
+  size_t hotRead = hotSize > 0 ? prefs.getBytes(hotKey, buf, hotSize) : 0;
+  size_t bytesRead = prefs.getBytes(msgPackKey, buf + hotRead, storedSize);
+  if (bytesRead != storedSize || hotRead != hotSize) {
+    NVS_CFG_LOG("readModuleMsgPack: read size mismatch");
+    prefs.end();
+    return 0;
+  }
+  status.baseCrc = crc32(buf + hotRead, bytesRead);
+  size_t length = hotRead > 0 ? mergeHotFields(buf, hotRead, bytesRead) : bytesRead;
 
-  if (bytesRead != storedSize) {
-    NVS_CFG_LOG("loadModuleConfigMsgPack: read size mismatch");
-    doc.clear();
-    return false;
+  // Journal records on top of the checkpoint (see setJournal())
+  if (lookup == Lookup::Unavailable || info.journalSize > 0) {
+    length = replayJournal(prefs, moduleId, buf, length, bufSize, status);
   }
+  prefs.end();
+  return length;
+}
 
-  // Deserialize MessagePack (ArduinoJson 7 uses MessagePack format)
-  DeserializationError error = deserializeMsgPack(doc, buf, bytesRead);
+size_t NVSConfigBus::requiredCapacity(const char* moduleId) {
+  if (moduleId == nullptr || strlen(moduleId) == 0) {
+    return 0;
+  }
+  ModuleInfo info;
+  Lookup lookup = lookupModule(moduleId, info);
+  if (lookup == Lookup::Missing || (lookup == Lookup::Found && info.format == NVSModuleFormat::None)) {
+    return 0;
+  }
 
-  if (error) {
-    NVS_CFG_LOG("loadModuleConfigMsgPack: MessagePack deserialization failed");
-    doc.clear();
-    return false;
+  NVSMsgPack::Shape shape;
+  if (lookup == Lookup::Unavailable || info.format == NVSModuleFormat::MsgPack) {
+    size_t size = lookup == Lookup::Found && info.size > 0 ? storedBytes(info) : NVS_CFG_MAX_MODULE_SIZE;
+    NVSScratchBuffer buf(*_budget, *_allocator, size);
+    if (!buf) {
+      _lastError = buf.error();
+      return 0;
+    }
+    size_t len = readModuleMsgPack(moduleId, buf.data(), size);
+    if (len > 0) {
+      return NVSMsgPack::measureShape(buf.data(), len, shape) ? NVSScopedDocument::documentBytes(shape) : 0;
+    }
+    if (lookup == Lookup::Found) {
+      return 0;
+    }
   }
 
-  return true;
+  // Legacy JSON: bound every count by the text length (each value needs at
+  // least two characters, each member four, each string its two quotes)
+  size_t len = info.format == NVSModuleFormat::JsonBytes && info.size > 0 ? info.size : NVS_CFG_MAX_MODULE_SIZE;
+  shape.values = len / 2 + 1;
+  shape.members = len / 4 + 1;
+  shape.strings = len / 2;
+  shape.stringBytes = len;
+  shape.wideValues = len / 2 + 1;
+  return NVSScopedDocument::documentBytes(shape);
 }
 
 bool NVSConfigBus::clearModuleConfig(const char* moduleId) {
@@ -372,14 +795,25 @@ bool NVSConfigBus::clearModuleConfig(const char* moduleId) {
     return false;
   }
 
+  // Nothing to do (and no flash write) for modules the directory does not know
+  bool snapshotHeld = rtcRemove(moduleId);
+  ModuleInfo stored;
+  Lookup lookup = lookupModule(moduleId, stored);
+  if (lookup == Lookup::Missing || (lookup == Lookup::Found && stored.format == NVSModuleFormat::None)) {
+    return snapshotHeld;  // Only a volatile module can live in the snapshot alone
+  }
+
   Preferences prefs;
-  if (!prefs.begin(_namespace, false)) {  // Read-write mode
+  if (!openModule(prefs, moduleId, false)) {  // Read-write mode
     NVS_CFG_LOG("clearModuleConfig: failed to open Preferences namespace");
     return false;
   }
 
   // Check if JSON key exists before removing
-  bool jsonExisted = prefs.isKey(moduleId);
+  bool jsonExisted = lookup == Lookup::Found
+                         ? (stored.legacyCopy || stored.format == NVSModuleFormat::JsonBytes ||
+                            stored.format == NVSModuleFormat::JsonString)
+                         : prefs.isKey(moduleId);
   if (jsonExisted) {
     prefs.remove(moduleId);
   }
@@ -388,25 +822,74 @@ bool NVSConfigBus::clearModuleConfig(const char* moduleId) {
   char msgPackKey[64];
   bool msgPackExisted = false;
   if (buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey))) {
-    msgPackExisted = prefs.isKey(msgPackKey);
+    msgPackExisted = lookup == Lookup::Found ? stored.format == NVSModuleFormat::MsgPack
+                                             : prefs.isKey(msgPackKey);
     if (msgPackExisted) {
       prefs.remove(msgPackKey);
     }
   }
+  char hotKey[16];
+  if (buildKey(moduleId, ":h", hotKey, sizeof(hotKey)) &&
+      (lookup == Lookup::Found ? stored.hotSize > 0 : prefs.isKey(hotKey))) {
+    prefs.remove(hotKey);
+  }
+  if (lookup == Lookup::Unavailable || stored.journalSize > 0) {
+    eraseJournal(prefs, moduleId);
+  }
   
+  // Leave a tombstone so delta sync can report the removal
+  if (jsonExisted || msgPackExisted) {
+    ModuleInfo info = {nextGeneration(prefs, moduleId), true, false, NVSModuleFormat::None, 0, 0, 0, 0};
+    writeModuleInfo(prefs, moduleId, info);
+    updateDirectory(moduleId, info);
+  }
+
   prefs.end();
   return jsonExisted || msgPackExisted;  // Return true if either existed
 }
 
 bool NVSConfigBus::clearAll() {
+  // Derived shard namespaces first (every one that exists, so leftovers of
+  // another shard count are removed too); the bus namespace keeps the counters
+  bool success = true;
+  for (uint8_t shard = 1; shard < NVS_CFG_MAX_SHARDS; shard++) {
+    Preferences shardPrefs;
+    if (openShard(shardPrefs, shard, true)) {
+      shardPrefs.end();
+      success = openShard(shardPrefs, shard, false) && shardPrefs.clear() && success;
+      shardPrefs.end();
+    }
+  }
+
   Preferences prefs;
-  if (!prefs.begin(_namespace, false)) {  // Read-write mode
+  if (!openShard(prefs, 0, false)) {  // Read-write mode
     NVS_CFG_LOG("clearAll: failed to open Preferences namespace");
+    invalidateDirectory();
+    rtcReset(0);
     return false;
   }
 
-  bool success = prefs.clear();
+  // Keep the generation counter monotonic across the reset and remember where
+  // it happened, so delta sync clients know they need a full resync
+  uint32_t generation = prefs.getUInt(kGenerationKey, 0) + 1;
+  uint8_t layout = prefs.getUChar(kShardsKey, 0);
+  bool cleared = prefs.clear();
+  if (cleared) {
+    prefs.putUInt(kGenerationKey, generation);
+    prefs.putUInt(kResetKey, generation);
+    if (layout != 0) {
+      prefs.putUChar(kShardsKey, layout);
+    }
+  }
   prefs.end();
+  rtcReset(cleared ? generation : 0);
+
+  success = success && cleared;
+  if (success) {
+    resetDirectory();
+  } else {
+    invalidateDirectory();  // Partially cleared: rebuild from NVS on next use
+  }
   
   if (!success) {
     NVS_CFG_LOG("clearAll: clear operation failed");
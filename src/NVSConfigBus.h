@@ -15,7 +15,12 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <nvs.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "NVSMemoryBudget.h"
 
 // Optional debug logging macro
 #ifndef NVS_CFG_ENABLE_LOGGING
@@ -28,6 +33,158 @@
 #define NVS_CFG_LOG(msg) ((void)0)
 #endif
 
+// Largest single module blob handled by the internal buffers
+#ifndef NVS_CFG_MAX_MODULE_SIZE
+#define NVS_CFG_MAX_MODULE_SIZE 2048
+#endif
+
+// Upper bound for the RAM used to stage an importAll() before it is written
+#ifndef NVS_CFG_IMPORT_MAX_SIZE
+#define NVS_CFG_IMPORT_MAX_SIZE 16384
+#endif
+
+// Highest shard count accepted by NVSConfigBus::setShards() (one hex digit
+// in the derived namespace names)
+#ifndef NVS_CFG_MAX_SHARDS
+#define NVS_CFG_MAX_SHARDS 16
+#endif
+
+// Modules that can have hot fields declared (see NVSConfigBus::setHotFields())
+#ifndef NVS_CFG_MAX_HOT_MODULES
+#define NVS_CFG_MAX_HOT_MODULES 8
+#endif
+
+// Modules that can be switched to journal mode (see NVSConfigBus::setJournal())
+#ifndef NVS_CFG_MAX_JOURNAL_MODULES
+#define NVS_CFG_MAX_JOURNAL_MODULES 8
+#endif
+
+// Modules that can be prefetched at the same time (see NVSConfigBus::prefetch())
+#ifndef NVS_CFG_MAX_PREFETCH
+#define NVS_CFG_MAX_PREFETCH 4
+#endif
+
+// Stack size and priority of the task that serves prefetch() reads
+#ifndef NVS_CFG_PREFETCH_STACK
+#define NVS_CFG_PREFETCH_STACK 4096
+#endif
+#ifndef NVS_CFG_PREFETCH_PRIORITY
+#define NVS_CFG_PREFETCH_PRIORITY 1
+#endif
+
+// Modules remembered in the learned boot profile (see NVSConfigBus::enableBootPrefetch())
+#ifndef NVS_CFG_BOOT_PREFETCH_MODULES
+#define NVS_CFG_BOOT_PREFETCH_MODULES 8
+#endif
+
+// Loads within this many milliseconds after boot are recorded for the boot profile
+#ifndef NVS_CFG_BOOT_WINDOW_MS
+#define NVS_CFG_BOOT_WINDOW_MS 5000
+#endif
+
+// Journal records per module at most (one hex digit in the `<id>:j<k>` key)
+#define NVS_CFG_JOURNAL_MAX_SLOTS 16
+
+// Modules that can be given an RTC persistence class (see NVSConfigBus::setPersistence())
+#ifndef NVS_CFG_MAX_VOLATILE_MODULES
+#define NVS_CFG_MAX_VOLATILE_MODULES 8
+#endif
+
+/**
+ * @brief Reason for the last failure reported by NVSConfigBus::lastError()
+ */
+enum class NVSConfigError : uint8_t {
+  None = 0,              ///< Last operation succeeded
+  InvalidArgument,       ///< Null/empty moduleId or buffer
+  NamespaceUnavailable,  ///< NVS namespace could not be opened
+  ParseError,            ///< Input is not valid JSON / MessagePack
+  InvalidModuleId,       ///< moduleId empty, too long or using reserved characters
+  ModuleTooLarge,        ///< A module exceeds NVS_CFG_MAX_MODULE_SIZE
+  ImportTooLarge,        ///< Import exceeds its staging limit
+  OutOfMemory,           ///< A transient buffer could not be allocated
+  BudgetExhausted,       ///< The RAM budget (NVSMemoryBudget) did not admit a buffer in time
+  NoSpace,               ///< Not enough free NVS entries
+  WriteFailed,           ///< NVS or output write failed
+  ConcurrentChange       ///< Modules were added or removed while exportAllStep() ran
+};
+
+/**
+ * @brief Outcome of one call of an incremental operation (NVSConfigBus::clearAllStep() etc.)
+ */
+enum class NVSStepResult : uint8_t {
+  Done,     ///< Operation complete; the cursor is reset
+  Pending,  ///< Budget used up: call again with the same cursor
+  Failed    ///< Operation ended with an error (see lastError()); the cursor is reset
+};
+
+/**
+ * @brief Continuation token of an incremental operation
+ * 
+ * Start with a zero-initialized cursor (`NVSCursor cursor = {};`) and pass it
+ * to every call until the operation returns Done or Failed. The members are
+ * internal state; a cursor belongs to the operation that started it, and
+ * zeroing it restarts that operation from the beginning.
+ */
+struct NVSCursor {
+  uint8_t op;        ///< Operation that owns the cursor (0: not started)
+  uint8_t phase;     ///< Stage within the operation
+  uint8_t error;     ///< First non-fatal error (NVSConfigError), reported at the end
+  uint32_t count;    ///< Modules still to be written (MessagePack export)
+  char lastId[13];   ///< Last module handled; the next call resumes after it
+};
+
+/**
+ * @brief Output encoding used by NVSConfigBus::exportAll()
+ */
+enum class NVSExportFormat : uint8_t {
+  Json,     ///< One JSON object: { "<moduleId>": { ...config... }, ... }
+  MsgPack   ///< The same structure encoded as one MessagePack map
+};
+
+/**
+ * @brief How a module's configuration is currently stored
+ */
+enum class NVSModuleFormat : uint8_t {
+  None = 0,    ///< No data stored (unknown module or cleared)
+  MsgPack,     ///< MessagePack blob under `<id>:mp` (current format)
+  JsonBytes,   ///< JSON text blob under `<id>` (fallback / pre-migration)
+  JsonString   ///< JSON NVS string under `<id>` (legacy, migrated on first load)
+};
+
+/**
+ * @brief Where saveModuleConfig() persists a module (see NVSConfigBus::setPersistence())
+ */
+enum class NVSPersistence : uint8_t {
+  Nvs = 0,     ///< Every save is written to NVS (default)
+  RtcOnly,     ///< Saves stay in the RTC snapshot: survive deep sleep, lost on power loss
+  RtcDeferred  ///< Saves stay in the RTC snapshot; NVS is updated at most once per flush interval
+};
+
+/**
+ * @brief Directory entry describing one stored module
+ */
+struct NVSModuleInfo {
+  char moduleId[13];        ///< Module identifier (NUL-terminated)
+  NVSModuleFormat format;   ///< Storage format read by loadModuleConfig()
+  uint16_t size;            ///< Stored size in bytes incl. the hot-field entry (0 if unknown, e.g. legacy strings)
+  uint32_t generation;      ///< Bus generation of the last save (0 if never saved by this version)
+  uint32_t crc;             ///< CRC-32 of the stored bytes (0 if unknown)
+};
+
+/**
+ * @brief Counters returned by NVSConfigBus::prefetchStats()
+ */
+struct NVSPrefetchStats {
+  uint32_t requested;  ///< prefetch() calls that scheduled a read
+  uint32_t hits;       ///< Loads served from a prefetched blob
+  uint32_t late;       ///< Loads that came before their prefetch read had finished
+  uint32_t wasted;     ///< Prefetched blobs dropped unused (evicted, stale after a save, dropPrefetched())
+  uint32_t failed;     ///< Prefetch reads that failed (module not stored as MessagePack, no RAM)
+
+  /** @brief Share of scheduled prefetches that served a load (0..1) */
+  float hitRate() const { return requested != 0 ? (float)hits / (float)requested : 0.0f; }
+};
+
 /**
  * @class NVSConfigBus
  * @brief Centralized configuration storage bus for multiple modules
@@ -41,9 +198,32 @@
  * - Each module stores its config as a JSON blob under its moduleId key
  * - Modules are isolated: clearing one module doesn't affect others
  * - Caller is responsible for applying default values when loading fails
+ * - Every save bumps a persistent generation counter used for delta sync
+ * - Keys starting with "__" and keys containing ':' are reserved for the bus
+ * - A RAM module directory (built from the `<id>:i` records on first use)
+ *   answers existence/size queries and skips NVS probes on load
+ * - Optionally, modules are spread over several derived namespaces by a hash
+ *   of their moduleId (see setShards())
+ * - Frequently changing top-level fields can be declared hot: they are kept in
+ *   a small `<id>:h` entry so saving them does not rewrite the module blob
+ * - Frequently saved modules can use journal mode: saves append the changed
+ *   members to a ring of `<id>:j<k>` records on top of the `<id>:mp` checkpoint
+ * - Persistent counters (boot count, runtime) are single NVS integers that are
+ *   incremented without touching any module document
+ * - Short event histories live next to the configuration in NVSRecordLog rings
+ * - An optional snapshot in RTC memory serves loads after a deep-sleep wake
+ *   without reading flash (see enableRtcSnapshot())
+ * - Session state that only has to survive deep sleep can be saved to that
+ *   snapshot alone, or flushed to NVS lazily (see setPersistence())
+ * - Modules about to be loaded can be read ahead by a background task, so the
+ *   load itself only deserializes (see prefetch()); the modules loaded during
+ *   boot can be learned and read ahead on the next boot (see enableBootPrefetch())
  * 
+ * @note Use a single NVSConfigBus instance per namespace: the module directory
+ *       only tracks writes made through the instance that owns it.
  * @note This class is intended for configuration storage, not high-frequency logging.
- *       Avoid calling saveModuleConfig() in tight loops to minimize flash wear.
+ *       Avoid calling saveModuleConfig() in tight loops to minimize flash wear;
+ *       use incrementCounter() or an NVSRecordLog for values that change often.
  * 
  * @example
  * ```cpp
@@ -73,11 +253,30 @@ public:
    * @param nvsNamespace The NVS namespace to use (default: "appcfg")
    *                     Must be a valid NVS namespace string (max 15 characters).
    *                     The namespace is stored but NVS is not mounted until first use.
+   * @param allocator Placement policy for buffers and the module directory
+   *                  (default: NVSDefaultAllocator, PSRAM for large buffers).
+   *                  Must outlive the bus.
+   * @param partition Label of the NVS partition to store in (default: the
+   *                  `nvs` partition). A dedicated partition keeps config
+   *                  writes away from the page GC caused by Wi-Fi/PHY data and
+   *                  other high-churn users of the default partition. It is
+   *                  initialized on first use; the label must outlive the bus.
    * 
    * @note The Arduino core must have initialized the NVS/Preferences system.
    *       This typically happens automatically on ESP32.
+   * 
+   * @example
+   * ```cpp
+   * // partitions.csv: cfg, data, nvs, , 0x6000,
+   * NVSConfigBus configBus("appcfg", nullptr, "cfg");
+   * ```
    */
-  explicit NVSConfigBus(const char* nvsNamespace = "appcfg");
+  explicit NVSConfigBus(const char* nvsNamespace = "appcfg", NVSAllocator* allocator = nullptr,
+                        const char* partition = nullptr);
+  ~NVSConfigBus();
+
+  NVSConfigBus(const NVSConfigBus&) = delete;
+  NVSConfigBus& operator=(const NVSConfigBus&) = delete;
 
   /**
    * @brief Load configuration for a specific module
@@ -91,7 +290,8 @@ public:
    *                 This string is used directly as the NVS key.
    * @param doc The JSON document to populate with loaded data.
    *            Must be pre-allocated with sufficient capacity.
-   *            Will be cleared if loading fails.
+   *            Will be cleared if loading fails. Any JsonDocument works,
+   *            including the arena-backed NVSScopedDocument (NVSJsonArena.h).
    * 
    * @return true if configuration was successfully loaded and parsed
    * @return false if configuration is missing, corrupted, or invalid
@@ -113,7 +313,38 @@ public:
    * }
    * ```
    */
-  bool loadModuleConfig(const char* moduleId, DynamicJsonDocument& doc);
+  bool loadModuleConfig(const char* moduleId, JsonDocument& doc);
+
+  /**
+   * @brief Load a module's configuration, or compiled-in defaults if it is not stored
+   * 
+   * @p defaults is a MessagePack image of the default document, typically a
+   * `constexpr` array generated at build time from a JSON file by
+   * `tools/json2msgpack.py` (hooks for PlatformIO and CMake are in `tools/`).
+   * Such arrays live in flash, so no code builds the defaults member by member
+   * and nothing is written to NVS until the caller saves.
+   * 
+   * Defaults are only used when the module is not stored; a stored module that
+   * fails to load is reported as a failure, so it is not replaced by defaults
+   * on the next save by accident.
+   * 
+   * @param moduleId The unique identifier for the module
+   * @param doc The JSON document to populate (cleared on failure)
+   * @param defaults MessagePack bytes of the default document
+   * @param defaultsSize Size of @p defaults
+   * @param fromDefaults Optional: set to true if @p doc holds the defaults
+   * @return false if a stored module could not be loaded or @p defaults are invalid
+   * 
+   * @example
+   * ```cpp
+   * #include "config_defaults.h"  // Generated from defaults/sensor.json
+   * 
+   * JsonDocument doc;
+   * configBus.loadModuleConfigOrDefault("sensor", doc, sensor_defaults, sizeof(sensor_defaults));
+   * ```
+   */
+  bool loadModuleConfigOrDefault(const char* moduleId, JsonDocument& doc, const uint8_t* defaults,
+                                 size_t defaultsSize, bool* fromDefaults = nullptr);
 
   /**
    * @brief Save configuration for a specific module
@@ -144,7 +375,7 @@ public:
    * configBus.saveModuleConfig("pulsfan", doc);
    * ```
    */
-  bool saveModuleConfig(const char* moduleId, const DynamicJsonDocument& doc);
+  bool saveModuleConfig(const char* moduleId, const JsonDocument& doc);
 
   /**
    * @brief Save configuration using MessagePack format (recommended)
@@ -213,10 +444,378 @@ public:
    * ```
    */
   bool loadModuleConfigMsgPack(const char* moduleId,
-                               DynamicJsonDocument& doc,
+                               JsonDocument& doc,
                                uint8_t* buf,
                                size_t bufSize);
 
+  /**
+   * @brief Declare top-level fields of a module that change often
+   * 
+   * On save, these members are split off into a small `<id>:h` entry. The
+   * main blob is only rewritten when one of the other fields changed, so
+   * saving a document where only hot fields differ writes tens of bytes
+   * (hot entry plus the `<id>:i` record) instead of the whole module.
+   * Loads, views and exports merge both parts transparently.
+   * 
+   * Declarations live in RAM: make them in setup() before the first save.
+   * 
+   * @param moduleId The unique identifier for the module
+   * @param fields Names of the hot members (the array and strings must
+   *               outlive the bus), or nullptr to remove the declaration
+   * @param count Number of entries in @p fields
+   * @return false if NVS_CFG_MAX_HOT_MODULES modules already have declarations
+   * 
+   * @example
+   * ```cpp
+   * static const char* const lampHot[] = {"mode", "brightness"};
+   * configBus.setHotFields("lamp", lampHot, 2);
+   * 
+   * doc["brightness"] = 40;
+   * configBus.saveModuleConfig("lamp", doc);  // Only the hot entry is rewritten
+   * ```
+   */
+  bool setHotFields(const char* moduleId, const char* const* fields, size_t count);
+
+  /**
+   * @brief Store a frequently saved module as checkpoint plus change journal
+   * 
+   * In journal mode a save only appends the top-level members that differ
+   * from the stored state as one `<id>:j<k>` record in a ring of @p slots
+   * records; `<id>:mp` stays untouched as the checkpoint. Loads replay the
+   * records on top of the checkpoint. When the ring is full the replayed state
+   * becomes the new checkpoint and the ring starts over; compactJournals()
+   * does this ahead of time from a less critical context.
+   * 
+   * A save falls back to a full rewrite (which also clears the ring) when a
+   * member was removed or the changes are larger than half the module.
+   * Journal mode and hot fields (setHotFields()) are exclusive per module.
+   * Declarations live in RAM; loads replay stored records either way.
+   * 
+   * @param moduleId The unique identifier for the module
+   * @param slots Ring size (1..NVS_CFG_JOURNAL_MAX_SLOTS), 0 to switch back
+   *              to full saves
+   * @return false if the slot count is invalid, the module has hot fields or
+   *         NVS_CFG_MAX_JOURNAL_MODULES modules are already journaled
+   * 
+   * @example
+   * ```cpp
+   * configBus.setJournal("stats", 8);
+   * 
+   * doc["boots"] = boots + 1;
+   * configBus.saveModuleConfig("stats", doc);  // Appends a ~20 byte record
+   * ```
+   */
+  bool setJournal(const char* moduleId, uint8_t slots);
+
+  /**
+   * @brief Fold journal records into new checkpoints
+   * 
+   * Meant to be called from loop() or an idle task so saves rarely have to
+   * checkpoint a full ring themselves.
+   * 
+   * @param force Compact every journaled module with records, not only those
+   *              whose ring is at least half full
+   * @return false if a checkpoint could not be written
+   */
+  bool compactJournals(bool force = false);
+
+  /**
+   * @brief Add to a persistent counter
+   * 
+   * Counters are stored as one 64-bit NVS integer each (`<name>:n`, in the
+   * shard of @p name), so an increment writes a single 32-byte NVS entry
+   * instead of a module document. NVS appends every write to the active page
+   * and rotates through all pages of the partition before erasing one again:
+   * incrementing every minute fills about 340 pages a month, i.e. roughly 70
+   * erases per sector of the default 20 KB `nvs` partition (flash sectors are
+   * rated for 100 000).
+   * Counters are not part of exports and are removed by clearAll(); a full
+   * importAll() restore keeps them.
+   * 
+   * @param name Counter name (module ID rules: 1..12 characters, no ':')
+   * @param delta Amount to add (0 only reads the counter)
+   * @param value Optional: receives the new value
+   * @return false if the name is invalid or NVS cannot be written
+   * 
+   * @example
+   * ```cpp
+   * uint64_t boots;
+   * configBus.incrementCounter("boots", 1, &boots);
+   * 
+   * // Every minute from loop()
+   * configBus.incrementCounter("fanMinutes");
+   * ```
+   */
+  bool incrementCounter(const char* name, uint32_t delta = 1, uint64_t* value = nullptr);
+
+  /**
+   * @brief Current value of a persistent counter (0 if it was never written)
+   */
+  uint64_t counter(const char* name);
+
+  /**
+   * @brief Set a persistent counter, e.g. to reset it after service
+   */
+  bool setCounter(const char* name, uint64_t value);
+
+  /**
+   * @brief Remove a persistent counter
+   * @return true if it existed
+   */
+  bool removeCounter(const char* name);
+
+  /**
+   * @brief Keep loaded modules in a memory region that survives deep sleep
+   * 
+   * Every module read from or saved to NVS as MessagePack is also copied into
+   * @p region together with the bus generation; the region is sealed with a
+   * CRC-32. After a deep-sleep wake, loadModuleConfig() and
+   * readModuleMsgPack() deserialize straight from the region, so a wake costs
+   * a single NVS read (the bus generation, checked on first use) instead of a
+   * directory scan plus one blob read per module. If the generation no longer
+   * matches (another writer, cleared or replaced flash) or the CRC fails, the
+   * region is discarded and refilled by the following loads.
+   * 
+   * On the ESP32 the region is an `RTC_DATA_ATTR` array of the sketch (RTC
+   * slow memory holds 8 KB); any buffer that outlives the bus works, e.g. a
+   * static array standing in for RTC memory in host tests. Modules with hot
+   * fields are refilled from NVS after each save.
+   * 
+   * @param region Snapshot memory (nullptr disables the snapshot)
+   * @param size Size of @p region (larger than 20 bytes of header)
+   * @return false if @p size is too small
+   * 
+   * @example
+   * ```cpp
+   * RTC_DATA_ATTR uint8_t cfgSnapshot[2048];
+   * 
+   * void setup() {
+   *   configBus.enableRtcSnapshot(cfgSnapshot, sizeof(cfgSnapshot));
+   *   configBus.loadModuleConfig("sensor", doc);  // No flash read after a wake
+   *   esp_deep_sleep(30 * 1000000ULL);
+   * }
+   * ```
+   */
+  bool enableRtcSnapshot(uint8_t* region, size_t size);
+
+  /**
+   * @brief Choose where saves of a module are persisted
+   * 
+   * The same loadModuleConfig()/saveModuleConfig() calls are routed by the
+   * module's class:
+   * - NVSPersistence::Nvs: every save is written to flash (default)
+   * - NVSPersistence::RtcOnly: saves only update the RTC snapshot; the state
+   *   survives deep sleep and resets but not power loss, and costs no flash
+   * - NVSPersistence::RtcDeferred: saves update the RTC snapshot; the first
+   *   save after @p flushInterval seconds of unflushed changes (or
+   *   flushVolatile()) writes the module to NVS. Power loss loses at most the
+   *   changes of one interval
+   * 
+   * Saves fall back to NVS for RtcDeferred modules when no snapshot is enabled
+   * or the region is full, and fail for RtcOnly modules. The snapshot keeps
+   * unflushed modules across generation changes; they are dropped by
+   * clearAll() and full imports. Volatile state is not visible to exists(),
+   * listModules() or exportAll() until it is written to NVS. Switching a
+   * module back to NVSPersistence::Nvs writes its unflushed state to NVS.
+   * 
+   * @param moduleId The unique identifier for the module
+   * @param mode Persistence class
+   * @param flushInterval RtcDeferred only: seconds between NVS writes
+   *                      (measured with the RTC timer, so sleep time counts)
+   * @return false if NVS_CFG_MAX_VOLATILE_MODULES modules are already
+   *         configured, or writing back unflushed state failed
+   * 
+   * @example
+   * ```cpp
+   * configBus.enableRtcSnapshot(cfgSnapshot, sizeof(cfgSnapshot));
+   * configBus.setPersistence("session", NVSPersistence::RtcOnly);
+   * configBus.setPersistence("meter", NVSPersistence::RtcDeferred, 10 * 60);
+   * configBus.saveModuleConfig("session", doc);  // No flash write
+   * ```
+   */
+  bool setPersistence(const char* moduleId, NVSPersistence mode, uint32_t flushInterval = 600);
+
+  /**
+   * @brief Write unflushed RtcDeferred modules to NVS
+   * 
+   * Call from loop() to flush modules whose interval has passed even if they
+   * are not saved again, and with @p force before removing power.
+   * 
+   * @param force Flush every unflushed module regardless of its interval
+   * @return false if a module could not be written (it stays unflushed)
+   */
+  bool flushVolatile(bool force = false);
+
+  /**
+   * @brief Do deferred housekeeping in small steps until a time budget is spent
+   * 
+   * Picks up work that otherwise lands on a foreground call or never happens:
+   * - RtcDeferred modules whose flush interval has passed are written to NVS
+   *   (as flushVolatile() would)
+   * - journals whose ring is at least half full get a new checkpoint (as
+   *   compactJournals() would)
+   * - modules still stored as legacy JSON are migrated to MessagePack (instead
+   *   of on their first loadModuleConfig())
+   * - legacy JSON `<id>` copies left next to migrated modules are removed
+   * 
+   * Each step looks at one module and the position is kept between calls, so
+   * every call resumes where the previous one stopped. At least one step runs
+   * per call; a step that writes can overrun the budget by one NVS write.
+   * 
+   * Call it from loop() or a low-priority task. For idle-time maintenance let
+   * the FreeRTOS idle hook wake such a task: the idle task itself must not
+   * block on flash writes or the bus lock.
+   * 
+   * @param budgetMicros Time budget in microseconds (0: a single step)
+   * @return true if work may be left (call again), false once a full pass
+   *         over all modules found nothing to do
+   * 
+   * @example
+   * ```cpp
+   * void loop() {
+   *   handleInput();
+   *   configBus.runMaintenance(2000);  // At most ~2 ms plus one write per loop
+   * }
+   * ```
+   */
+  bool runMaintenance(uint32_t budgetMicros);
+
+  /**
+   * @brief Read a module into RAM in the background ahead of its next load
+   * 
+   * Queues the module for a low-priority task (started on first use) that
+   * reads the stored MessagePack blob into one of NVS_CFG_MAX_PREFETCH cache
+   * slots. The next loadModuleConfig() of the module takes the blob from the
+   * slot and only deserializes it; the slot is free again afterwards.
+   * 
+   * The cached blob is checked against the module directory on load, so a save
+   * in between makes the load read NVS as usual (counted as wasted). When all
+   * slots are taken, the oldest blob nobody loaded yet is evicted. Cache
+   * memory is reserved against the bus RAM budget (NVSMemoryClass::Cache).
+   * 
+   * @param moduleId The unique identifier for the module
+   * @return true if the read was queued or the module is already cached or
+   *         queued, false for an invalid moduleId, when every slot is still
+   *         being read, or if the task could not be started
+   * 
+   * @example
+   * ```cpp
+   * void openSettingsMenu() {
+   *   configBus.prefetch("pulsfan");  // The fan page is the usual next screen
+   *   drawMenu();
+   * }
+   * ```
+   */
+  bool prefetch(const char* moduleId);
+
+  /**
+   * @brief Free every prefetched blob and cancel queued reads
+   * 
+   * Blobs dropped without being loaded count as wasted.
+   */
+  void dropPrefetched();
+
+  /**
+   * @brief Prefetch effectiveness since construction or resetPrefetchStats()
+   * 
+   * A low hitRate() with many wasted prefetches means the hints are wrong or
+   * come too early (the cache is evicted first); many late loads mean they
+   * come too late to hide the read.
+   */
+  NVSPrefetchStats prefetchStats();
+
+  /**
+   * @brief Zero the prefetchStats() counters
+   */
+  void resetPrefetchStats();
+
+  /**
+   * @brief Learn which modules are loaded at boot and prefetch them next time
+   * 
+   * Call once at the very start of setup(), before peripherals are brought
+   * up. The prefetch task reads the boot profile (the `__boot` record) and
+   * prefetches the modules it lists, in the order they were loaded on earlier
+   * boots, while the application initializes hardware. As cache slots are
+   * taken by loads, the next modules of the profile follow.
+   * 
+   * Meanwhile the first loadModuleConfig() of every module within @p windowMs
+   * after boot is recorded in RAM. When the window ends the task merges this
+   * boot into the profile: modules are ordered by this boot's first loads,
+   * each carries a frequency score that rises on boots that load it and decays
+   * on boots that do not, and modules rarely loaded at boot are not
+   * prefetched. The record is written at most once per boot and only when it
+   * changed, so a device with a stable boot sequence stops writing it.
+   * 
+   * @param windowMs Recording window in milliseconds since boot
+   * @return false if the prefetch task could not be started
+   * 
+   * @example
+   * ```cpp
+   * void setup() {
+   *   configBus.enableBootPrefetch();  // Before the slow peripheral init
+   *   initDisplay();
+   *   initSensors();
+   *   configBus.loadModuleConfig("display", doc);  // Usually served from RAM
+   * }
+   * ```
+   */
+  bool enableBootPrefetch(uint32_t windowMs = NVS_CFG_BOOT_WINDOW_MS);
+
+  /**
+   * @brief Read a module's stored MessagePack blob without deserializing it
+   * 
+   * For modules with hot fields (setHotFields()) the result is one map holding
+   * the hot-field entry's members followed by the rest of the module; journal
+   * records (setJournal()) are already applied.
+   * 
+   * @param moduleId The unique identifier for the module
+   * @param buf Destination buffer (sizeOf() tells the size needed)
+   * @param bufSize Size of the buffer in bytes
+   * @return Number of bytes read, or 0 if the module has no MessagePack blob,
+   *         the buffer is too small or the read failed
+   */
+  size_t readModuleMsgPack(const char* moduleId, uint8_t* buf, size_t bufSize);
+
+  /**
+   * @brief Store an already encoded MessagePack blob as a module
+   * 
+   * Counterpart of readModuleMsgPack() for code that encodes modules itself
+   * (e.g. structs generated by `tools/schema2cpp.py`, see NVSCodec.h). The
+   * blob is saved like the output of saveModuleConfigMsgPack(), including hot
+   * fields, journal mode and the persistence class.
+   * 
+   * @param moduleId The unique identifier for the module
+   * @param buf Blob in the first @p len bytes; the rest of the buffer is
+   *            scratch space for hot fields and journal records (a buffer of
+   *            twice the blob size always suffices)
+   * @param len Size of the blob
+   * @param bufSize Size of @p buf (at least @p len)
+   * @return false if the blob is not valid MessagePack or the write failed
+   */
+  bool saveModuleMsgPack(const char* moduleId, uint8_t* buf, size_t len, size_t bufSize);
+
+  /**
+   * @brief Memory an ArduinoJson document needs to hold a module
+   * 
+   * Reads the stored MessagePack blob and walks its structure (values,
+   * members, strings) to compute an upper bound of what ArduinoJson allocates
+   * for it. Legacy JSON modules get a coarse bound from their text size until
+   * they have been migrated by a load.
+   * 
+   * To load into a document sized this way in one step, use
+   * NVSScopedDocument (NVSJsonArena.h), which sizes its arena on load().
+   * 
+   * @param moduleId The unique identifier for the module
+   * @return Bytes needed, or 0 if the module does not exist or is unreadable
+   * 
+   * @example
+   * ```cpp
+   * Serial.printf("pulsfan needs %u bytes of JSON memory\n",
+   *               (unsigned)configBus.requiredCapacity("pulsfan"));
+   * ```
+   */
+  size_t requiredCapacity(const char* moduleId);
+
   /**
    * @brief Clear configuration for a specific module
    * 
@@ -260,17 +859,970 @@ public:
    */
   bool clearAll();
 
-private:
-  const char* _namespace;  ///< The NVS namespace for this bus instance
-  
   /**
-   * @brief Build the MessagePack key name from moduleId (uses :mp suffix)
+   * @brief Incremental clearAll(): erase the namespace a few keys per call
    * 
-   * @param moduleId The module identifier
-   * @param keyBuf Output buffer for the key (must be at least strlen(moduleId) + 4)
-   * @param keyBufSize Size of the key buffer
-   * @return true if key was built successfully
+   * clearAll() erases whole namespaces in one go, which blocks for tens of
+   * milliseconds on a full partition. This version erases key by key and
+   * returns once @p budgetMicros have passed, so callers can feed the task
+   * watchdog and serve real-time work in between. The result is the same as
+   * clearAll(): the generation counter is kept monotonic and the reset is
+   * recorded for exportChangedSince() once the last key is gone.
+   * 
+   * Until the operation is Done the namespace is partially cleared: modules
+   * not erased yet can still be loaded, and a module saved meanwhile may or
+   * may not survive. After a reboot, start again with a fresh cursor.
+   * 
+   * @param cursor Continuation token (zero-initialized for the first call)
+   * @param budgetMicros Time budget in microseconds; at least one key is
+   *                     erased per call (0: a single key)
+   * @return Pending until every key is erased, then Done (or Failed)
+   * 
+   * @example
+   * ```cpp
+   * NVSCursor cursor = {};
+   * while (configBus.clearAllStep(cursor, 2000) == NVSStepResult::Pending) {
+   *   vTaskDelay(1);  // Let other tasks and the watchdog run
+   * }
+   * ```
    */
-  bool buildMsgPackKey(const char* moduleId, char* keyBuf, size_t keyBufSize) const;
+  NVSStepResult clearAllStep(NVSCursor& cursor, uint32_t budgetMicros);
+
+  /**
+   * @brief Stream every module stored in the namespace to @p out
+   * 
+   * Iterates the NVS namespace and writes one object keyed by moduleId whose
+   * values are the module configurations. MessagePack blobs are transcoded to
+   * JSON on the fly (or copied verbatim for MsgPack output) without building a
+   * JsonDocument, so peak RAM is a single read buffer the size of the largest
+   * stored blob, independent of the number of modules.
+   * 
+   * Modules still stored only in the legacy JSON format are included as well;
+   * if both formats exist for a module, the MessagePack copy wins (same as
+   * loadModuleConfig()).
+   * 
+   * @param out Destination (Serial, a File, a WiFiClient, ...)
+   * @param format Output encoding (default: JSON)
+   * 
+   * @return true if every module was exported
+   * @return false if the namespace could not be read, a write to @p out failed,
+   *         or a module was unreadable (its value is written as null so the
+   *         output stays well-formed)
+   * 
+   * @note The namespace is read-only during the export; no NVS writes happen.
+   * 
+   * @example
+   * ```cpp
+   * // Dump all module configs for a support ticket
+   * configBus.exportAll(Serial);
+   * 
+   * // Binary backup to a file
+   * File f = SPIFFS.open("/cfg.mp", "w");
+   * configBus.exportAll(f, NVSExportFormat::MsgPack);
+   * f.close();
+   * ```
+   */
+  bool exportAll(Print& out, NVSExportFormat format = NVSExportFormat::Json);
+
+  /**
+   * @brief Incremental exportAll(): write a few modules to @p out per call
+   * 
+   * Produces exactly the output of exportAll(), spread over as many calls as
+   * the budget requires. Modules are written in moduleId order and the cursor
+   * remembers the last one, so modules saved between calls are exported with
+   * their latest value. If modules are added or removed while a MessagePack
+   * export runs, the map count written up front no longer matches and the
+   * export fails with NVSConfigError::ConcurrentChange (JSON output simply
+   * includes the modules after the resume point).
+   * 
+   * @param out Destination; must stay valid until the operation ends
+   * @param format Output encoding; the same for every call
+   * @param cursor Continuation token (zero-initialized for the first call)
+   * @param budgetMicros Time budget in microseconds; at least one module is
+   *                     written per call (0: a single module)
+   * @return Pending while modules are left, Done once the map is closed,
+   *         Failed if @p out failed, the directory was unavailable or a module
+   *         was unreadable (written as null, as exportAll() does)
+   */
+  NVSStepResult exportAllStep(Print& out, NVSExportFormat format, NVSCursor& cursor, uint32_t budgetMicros);
+
+  /**
+   * @brief Migrate every legacy JSON module to MessagePack, a few per call
+   * 
+   * Does in one bounded pass what runMaintenance() does over time: legacy
+   * JSON modules are converted to MessagePack and JSON copies left next to
+   * migrated modules are removed. Failing modules are skipped and reported
+   * when the pass ends.
+   * 
+   * @param cursor Continuation token (zero-initialized for the first call)
+   * @param budgetMicros Time budget in microseconds; at least one module is
+   *                     examined per call
+   * @return Pending while modules are left, Done after the last one, Failed
+   *         if a module could not be migrated (see lastError())
+   */
+  NVSStepResult migrateAllStep(NVSCursor& cursor, uint32_t budgetMicros);
+
+  /**
+   * @brief Restore or provision many modules from one JSON or MessagePack stream
+   * 
+   * Accepts exactly the format produced by exportAll(): a single object/map keyed
+   * by moduleId (the encoding is detected from the first byte). The stream is
+   * parsed incrementally and every module value is converted straight to its
+   * stored MessagePack representation - no JsonDocument is built and nothing is
+   * parsed twice.
+   * 
+   * All modules are parsed, validated and staged in RAM first, and the free
+   * NVS space is checked before the first write. Only then are the modules
+   * written through a single NVS handle with one commit at the end. An error
+   * found while parsing, validating or checking space leaves the namespace
+   * untouched; NVS writes and erases take effect immediately, so a write or
+   * erase failure after that point can leave a partial import.
+   * 
+   * Modules whose value is null (as written by exportAll() for unreadable
+   * modules) are skipped. A legacy JSON copy of an imported module is removed.
+   * 
+   * @param in Source stream (Serial, a File, a WiFiClient, ...). Stream timeouts apply.
+   * @param replaceAll If true, all modules not present in the stream are removed
+   *                   (full restore; counters and NVSRecordLog records are kept);
+   *                   otherwise the import is merged into the namespace
+   * @param maxImportSize Upper bound for the staged MessagePack data in bytes
+   * 
+   * @return true if every module was imported
+   * @return false on any error; see lastError() for the reason
+   * 
+   * @note Peak RAM is the staged data (at most @p maxImportSize) plus one
+   *       NVS_CFG_MAX_MODULE_SIZE conversion buffer.
+   * @warning A power loss or write failure during the final write phase can
+   *          leave a partial import; re-running the same import completes it.
+   * 
+   * @example
+   * ```cpp
+   * // Factory provisioning over the serial port
+   * Serial.setTimeout(5000);
+   * if (!configBus.importAll(Serial)) {
+   *   Serial.printf("Import failed: %d\n", (int)configBus.lastError());
+   * }
+   * ```
+   */
+  bool importAll(Stream& in, bool replaceAll = false, size_t maxImportSize = NVS_CFG_IMPORT_MAX_SIZE);
+
+  /**
+   * @brief Stream only the modules changed since generation @p since
+   * 
+   * Every successful save (and every clearModuleConfig()) assigns the module the
+   * next value of a persistent, monotonically increasing bus generation. A sync
+   * client stores the generation returned by the previous export and asks only
+   * for newer changes, so transfer time scales with the changes instead of the
+   * total configuration size.
+   * 
+   * Output (JSON shown; MessagePack uses the same structure):
+   * ```
+   * {"generation":42,"full":false,"modules":{"pulsfan":{...}},"removed":["blecfg"]}
+   * ```
+   * - generation: pass this value as @p since next time
+   * - full: true if the client must replace its whole view (first sync with
+   *   since = 0, or the namespace was reset by clearAll() since @p since);
+   *   modules then contains every module and removed is empty
+   * - modules: changed module configs, same encoding as exportAll()
+   * - removed: modules cleared since @p since
+   * 
+   * @param since Generation returned by the previous sync (0 for a full sync)
+   * @param out Destination (e.g. a BLE characteristic stream)
+   * @param format Output encoding (default: JSON)
+   * 
+   * @return true if every selected module was exported
+   * @return false on read or write errors; see lastError()
+   * 
+   * @example
+   * ```cpp
+   * uint32_t lastSync = 0;  // persisted by the companion app
+   * configBus.exportChangedSince(lastSync, bleStream);
+   * ```
+   */
+  bool exportChangedSince(uint32_t since, Print& out, NVSExportFormat format = NVSExportFormat::Json);
+
+  /**
+   * @brief Current bus generation (the generation of the most recent change)
+   * 
+   * @return 0 if nothing has been saved since the namespace was created
+   */
+  uint32_t generation();
+
+  /**
+   * @brief Generation at which @p moduleId was last saved or cleared
+   * 
+   * @return 0 if the module has no recorded generation (e.g. written by an older
+   *         library version and not saved since)
+   */
+  uint32_t moduleGeneration(const char* moduleId);
+
+  /**
+   * @brief Check whether a module has stored configuration
+   * 
+   * Answered from the in-RAM module directory, which is built once from NVS on
+   * first use and kept up to date by every save/clear of this instance.
+   * 
+   * @param moduleId The unique identifier for the module
+   * @return true if loadModuleConfig() would find data for the module
+   */
+  bool exists(const char* moduleId);
+
+  /**
+   * @brief Stored size of a module's configuration in bytes
+   * 
+   * Useful to size buffers for loadModuleConfigMsgPack(). Answered from the
+   * module directory without touching NVS.
+   * 
+   * @param moduleId The unique identifier for the module
+   * @return Stored size, or 0 if the module does not exist (or is a legacy
+   *         JSON string entry whose size is unknown until its first load)
+   */
+  size_t sizeOf(const char* moduleId);
+
+  /**
+   * @brief Get the directory entry of a module
+   * 
+   * @param moduleId The unique identifier for the module
+   * @param info Filled with format, size, generation and CRC
+   * @return true if the module exists
+   */
+  bool moduleInfo(const char* moduleId, NVSModuleInfo& info);
+
+  /**
+   * @brief Enumerate all stored modules (sorted by moduleId)
+   * 
+   * @param out Array receiving up to @p maxCount entries (may be nullptr to only count)
+   * @param maxCount Capacity of @p out
+   * @return Total number of stored modules (may exceed @p maxCount)
+   * 
+   * @example
+   * ```cpp
+   * NVSModuleInfo modules[16];
+   * size_t n = configBus.listModules(modules, 16);
+   * for (size_t i = 0; i < n && i < 16; i++) {
+   *   Serial.printf("%s: %u bytes\n", modules[i].moduleId, modules[i].size);
+   * }
+   * ```
+   */
+  size_t listModules(NVSModuleInfo* out, size_t maxCount);
+
+  /**
+   * @brief Reason why the last loadModuleConfig() / saveModuleConfig() /
+   *        exportAll() / exportChangedSince() / importAll() / rebalance() call
+   *        or incremental operation (clearAllStep() etc.) failed
+   * 
+   * @return NVSConfigError::None if it succeeded
+   */
+  NVSConfigError lastError() const { return _lastError; }
+
+  /**
+   * @brief Spread modules over @p count namespaces
+   * 
+   * Shard 0 is the bus namespace itself (which also keeps the bus-wide
+   * bookkeeping); shard k > 0 is `<namespace>.<k in hex>`. Each module lives
+   * in the shard picked by a hash of its moduleId, so every NVS lookup only
+   * competes with the keys of its own shard. Callers keep using moduleIds as
+   * before.
+   * 
+   * Call before the first load/save. After changing the count of a bus that
+   * already holds data, call rebalance() once to move modules to their new
+   * shards.
+   * 
+   * @param count Number of shards (1 = single namespace, the default)
+   * @return false if @p count is 0, above NVS_CFG_MAX_SHARDS, or the namespace
+   *         is too long to derive shard names (max 13 characters)
+   * 
+   * @example
+   * ```cpp
+   * NVSConfigBus configBus("appcfg");
+   * void setup() {
+   *   configBus.setShards(4);
+   *   configBus.rebalance();  // No-op unless the stored layout differs
+   * }
+   * ```
+   */
+  bool setShards(uint8_t count);
+
+  /**
+   * @brief Number of shards modules are spread over
+   */
+  uint8_t shards() const { return _shards; }
+
+  /**
+   * @brief Move every module key to the shard it belongs to under the
+   *        current shard count
+   * 
+   * Scans all possible shard namespaces, so it also completes a rebalance that
+   * was interrupted (keys are copied and committed before the source is erased).
+   * The layout is recorded in the bus namespace; when it already matches,
+   * the call only reads that record.
+   * 
+   * @return false if a key could not be moved (see lastError())
+   */
+  bool rebalance();
+
+  /**
+   * @brief Reserve this bus's transient buffers against @p budget
+   * 
+   * By default all buses share NVSMemoryBudget::shared(). The budget must
+   * outlive the bus.
+   */
+  void setMemoryBudget(NVSMemoryBudget& budget);
+
+  /**
+   * @brief Budget the transient buffers of this bus are reserved against
+   */
+  NVSMemoryBudget& memoryBudget() const { return *_budget; }
+
+  /**
+   * @brief Allocator placing this bus's buffers (see NVSMemoryClass)
+   */
+  NVSAllocator& allocator() const { return *_allocator; }
+
+  /**
+   * @brief Label of the NVS partition this bus stores in
+   */
+  const char* partition() const { return _partition; }
+
+private:
+  friend class NVSRecordLog;  // Stores its records in the namespace of its name
+
+  const char* _namespace;  ///< The NVS namespace for this bus instance
+  const char* _partition;  ///< NVS partition label (NVS_DEFAULT_PART_NAME unless configured)
+  bool _partitionReady;    ///< Partition initialized (always true for the default one)
+  NVSConfigError _lastError;  ///< Result of the last operation reporting errors
+  NVSMemoryBudget* _budget;   ///< Admission control for transient buffers
+  NVSAllocator* _allocator;   ///< Placement policy for all bus allocations
+  uint8_t _shards;            ///< Namespaces modules are spread over (see setShards())
+
+  /**
+   * @brief Per-module bookkeeping stored under the `<id>:i` key
+   * 
+   * The `<id>:i` records together form the on-flash module directory; the
+   * RAM mirror (_dir) is rebuilt from them with one namespace scan.
+   */
+  struct ModuleInfo {
+    uint32_t generation;     ///< Bus generation of the last save or clear
+    bool deleted;            ///< Tombstone left by clearModuleConfig() for delta sync
+    bool legacyCopy;         ///< A legacy JSON `<id>` key exists next to `<id>:mp`
+    NVSModuleFormat format;  ///< Representation loadModuleConfig() reads
+    uint16_t size;           ///< Stored size of that representation
+    uint32_t crc;            ///< CRC-32 of the stored bytes (0 = unknown)
+    uint16_t hotSize;        ///< Size of the `<id>:h` hot-field entry (0 = none; RAM only)
+    uint16_t journalSize;    ///< Bytes in `<id>:j<k>` journal records (0 = none; RAM only)
+  };
+
+  /**
+   * @brief Hot-field declaration of one module (see setHotFields())
+   */
+  struct HotFields {
+    char moduleId[13];
+    const char* const* fields;
+    size_t count;
+  };
+
+  /**
+   * @brief Persistence class of one module (see setPersistence())
+   */
+  struct PersistenceConfig {
+    char moduleId[13];
+    NVSPersistence mode;
+    uint32_t flushInterval;  ///< Seconds (RtcDeferred)
+  };
+
+  /**
+   * @brief Outcome of a save of a volatile module
+   */
+  enum class VolatileSave : uint8_t {
+    Saved,        ///< Kept in the RTC snapshot
+    Failed,       ///< RtcOnly module without room in the snapshot
+    WriteThrough  ///< Write to NVS (flush due, or no snapshot for an RtcDeferred module)
+  };
+
+  /**
+   * @brief Journal-mode declaration of one module (see setJournal())
+   */
+  struct JournalConfig {
+    char moduleId[13];
+    uint8_t slots;
+  };
+
+  /**
+   * @brief Journal records found while reading a module
+   */
+  struct JournalStatus {
+    uint8_t records;     ///< Records applied on top of the checkpoint
+    uint8_t newestSlot;  ///< Slot of the newest applied record (0xff: none)
+    uint16_t bytes;      ///< Bytes of all record keys present (applied or stale)
+    uint32_t baseCrc;    ///< CRC-32 of the checkpoint the records apply to
+  };
+
+  /**
+   * @brief Outcome of a journal-mode save
+   */
+  enum class JournalSave : uint8_t {
+    Saved,     ///< Record appended (checkpointed first if the ring was full)
+    Failed,    ///< NVS write failed
+    FullSave   ///< Not expressible as a record: do a regular save
+  };
+
+  /**
+   * @brief Outcome of one maintenance step (see runMaintenance())
+   */
+  enum class MaintenanceStep : uint8_t {
+    Idle,    ///< Nothing to do for this module
+    Worked,  ///< Work done
+    Failed   ///< Work due but it failed (retried on the next pass)
+  };
+
+  /**
+   * @brief Position of runMaintenance() between calls
+   */
+  struct MaintenanceCursor {
+    uint8_t phase;  ///< 0: volatile modules, 1: journals, 2: directory entries
+    size_t index;   ///< Slot or directory index within the phase
+    bool pending;   ///< A step of the current pass did or attempted work
+  };
+
+  /**
+   * @brief State of a prefetch slot
+   */
+  enum class PrefetchState : uint8_t {
+    Free,     ///< Unused
+    Queued,   ///< Waiting for the prefetch task
+    Reading,  ///< Being read by the prefetch task
+    Ready     ///< Blob in RAM, waiting for its load
+  };
+
+  /**
+   * @brief One prefetched (or queued) module
+   */
+  struct PrefetchSlot {
+    char moduleId[13];
+    PrefetchState state;
+    bool cancelled;   ///< Load came while Reading: discard the blob when the read ends
+    bool boot;        ///< Queued from the boot profile: dropped when the boot window ends
+    uint32_t order;   ///< Request sequence number (reads and evictions go oldest first)
+    uint8_t* data;    ///< Blob (Ready), Cache memory reserved against _budget
+    size_t len;       ///< Blob length
+    size_t reserved;  ///< Bytes allocated and reserved for data
+    ModuleInfo info;  ///< Directory entry the blob was read for
+  };
+
+  /**
+   * @brief Module in the learned boot profile (`__boot` record)
+   */
+  struct BootEntry {
+    char moduleId[13];
+    uint8_t score;  ///< Boot load frequency: +128 (up to 255) on boots that load it, halved on others
+  };
+
+  /**
+   * @brief Boot prefetch state (see enableBootPrefetch())
+   */
+  struct BootProfile {
+    uint32_t windowMs;  ///< Recording window after boot
+    uint8_t phase;      ///< 0: off, 1: profile not read yet, 2: prefetching and recording, 3: done
+    uint8_t count;      ///< Entries in profile
+    uint8_t next;       ///< Next profile entry to prefetch
+    uint8_t seenCount;  ///< Entries in seen
+    BootEntry profile[NVS_CFG_BOOT_PREFETCH_MODULES];  ///< Stored profile in prefetch order
+    char seen[NVS_CFG_BOOT_PREFETCH_MODULES][13];       ///< Modules loaded in this boot's window, first load first
+  };
+
+  /**
+   * @brief RAM directory entry (sorted by moduleId in _dir)
+   */
+  struct DirectoryEntry {
+    char moduleId[13];
+    uint8_t scanFlags;  ///< Only used while the directory is being built
+    ModuleInfo info;
+  };
+
+  /**
+   * @brief Result of a directory lookup
+   */
+  enum class Lookup : uint8_t {
+    Found,       ///< Entry present (may still be a tombstone / format None)
+    Missing,     ///< Module definitely not stored
+    Unavailable  ///< Directory could not be built; fall back to probing NVS
+  };
+
+  SemaphoreHandle_t _lock;  ///< Guards the RAM directory
+  DirectoryEntry* _dir;     ///< RAM mirror of the module directory
+  size_t _dirCount;         ///< Number of entries in _dir
+  size_t _dirCapacity;      ///< Allocated entries in _dir
+  bool _dirLoaded;          ///< True once _dir reflects NVS
+  uint8_t* _rtc;            ///< Snapshot region (see enableRtcSnapshot()), nullptr if disabled
+  size_t _rtcSize;          ///< Size of _rtc
+  bool _rtcChecked;         ///< True once _rtc was validated against NVS
+  HotFields _hot[NVS_CFG_MAX_HOT_MODULES];  ///< Hot-field declarations (moduleId[0] == 0: free)
+  JournalConfig _journal[NVS_CFG_MAX_JOURNAL_MODULES];  ///< Journal-mode declarations
+  PersistenceConfig _persistence[NVS_CFG_MAX_VOLATILE_MODULES];  ///< Persistence classes other than Nvs
+  MaintenanceCursor _maintenance;  ///< Resume point of runMaintenance()
+  PrefetchSlot _prefetch[NVS_CFG_MAX_PREFETCH];  ///< Prefetch cache (moduleId[0] == 0: free)
+  TaskHandle_t volatile _prefetchTask;  ///< Task serving prefetch(), nullptr until first use
+  volatile bool _prefetchStop;          ///< Asks the prefetch task to exit (destructor)
+  uint32_t _prefetchOrder;              ///< Sequence number of the last prefetch() request
+  NVSPrefetchStats _prefetchStats;      ///< Counters for prefetchStats()
+  BootProfile _boot;                    ///< Boot profile learning and replay
+
+  static const size_t kModuleInfoSize = 12;  ///< Encoded size of a ModuleInfo record
+  static const size_t kModuleInfoSizeV1 = 5; ///< Size of records without format/size/crc
+  static const char* const kGenerationKey;  ///< "__gen": last assigned bus generation
+  static const char* const kResetKey;       ///< "__rst": generation of the last clearAll()
+  static const char* const kShardsKey;      ///< "__shd": shard count the stored layout uses
+  static const char* const kBootKey;        ///< "__boot": learned boot load profile
+  static const size_t kNamespaceBufSize = 16;  ///< NVS namespace name incl. NUL
+  
+  /**
+   * @brief Build the MessagePack key name from moduleId (uses :mp suffix)
+   * 
+   * @param moduleId The module identifier
+   * @param keyBuf Output buffer for the key (must be at least strlen(moduleId) + 4)
+   * @param keyBufSize Size of the key buffer
+   * @return true if key was built successfully
+   */
+  bool buildMsgPackKey(const char* moduleId, char* keyBuf, size_t keyBufSize) const;
+
+  /**
+   * @brief Build `<moduleId><suffix>`, enforcing the 15-character NVS key limit
+   */
+  static bool buildKey(const char* moduleId, const char* suffix, char* keyBuf, size_t keyBufSize);
+
+  /**
+   * @brief Shard a module lives in (0 if sharding is off)
+   */
+  uint8_t shardOf(const char* moduleId) const;
+
+  /**
+   * @brief Namespace name of @p shard
+   * @param buf Scratch space of kNamespaceBufSize bytes for derived names
+   * @return @p buf, or _namespace for shard 0
+   */
+  const char* shardNamespace(uint8_t shard, char* buf) const;
+
+  /**
+   * @brief Initialize a dedicated partition on first use
+   * @return false if it is missing or cannot be mounted
+   */
+  bool ensurePartition();
+
+  /**
+   * @brief Open the namespace of @p shard (read-only opens fail if it does not exist)
+   */
+  bool openShard(Preferences& prefs, uint8_t shard, bool readOnly);
+
+  /**
+   * @brief Open the namespace of @p shard as a raw NVS handle (for batched commits)
+   */
+  bool openShardHandle(uint8_t shard, nvs_open_mode_t mode, nvs_handle_t& handle);
+
+  /**
+   * @brief Open the namespace holding @p moduleId
+   */
+  bool openModule(Preferences& prefs, const char* moduleId, bool readOnly) {
+    return openShard(prefs, shardOf(moduleId), readOnly);
+  }
+
+  /**
+   * @brief Hot-field declaration of a module, nullptr if it has none
+   */
+  const HotFields* hotFieldsOf(const char* moduleId) const;
+
+  /**
+   * @brief Split serialized module @p data in place into cold and hot parts
+   * 
+   * Members named in @p hot are appended after @p len as a map16-headed hot
+   * entry (so merging never needs more room than both parts take); the rest
+   * stays in front as the cold map.
+   * 
+   * @param cold Set to the cold map (inside @p data)
+   * @param coldLen Set to its length
+   * @param hotEntry Set to the hot entry (inside @p data, after the cold map's old extent)
+   * @param hotLen Set to its length (0 if no hot member is present)
+   * @return false if @p data is not a map or the hot entry does not fit in @p capacity
+   */
+  static bool splitHotFields(const HotFields& hot, uint8_t* data, size_t len, size_t capacity,
+                             uint8_t*& cold, size_t& coldLen, uint8_t*& hotEntry, size_t& hotLen);
+
+  /**
+   * @brief Merge a hot entry read to @p buf with the cold map read right after it
+   * @return Length of the merged map at @p buf
+   */
+  static size_t mergeHotFields(uint8_t* buf, size_t hotLen, size_t coldLen);
+
+  /**
+   * @brief Buffer size readModuleMsgPack() needs for a module
+   * 
+   * Includes the hot entry, every journal record and the two bytes a
+   * replayed checkpoint header may grow by.
+   */
+  static size_t storedBytes(const ModuleInfo& info) {
+    return info.size + info.hotSize + (info.journalSize > 0 ? info.journalSize + 2u : 0u);
+  }
+
+  /**
+   * @brief readModuleMsgPack() that also reports the journal state
+   */
+  size_t readModuleState(const char* moduleId, uint8_t* buf, size_t bufSize, JournalStatus& status);
+
+  /**
+   * @brief Ring size of a journaled module, 0 if it is saved in full
+   */
+  uint8_t journalSlotsOf(const char* moduleId) const;
+
+  /**
+   * @brief Save serialized module @p data (in @p buf) as a journal record
+   * 
+   * The record is built in the buffer tail behind @p len.
+   */
+  JournalSave saveJournalRecord(const char* moduleId, uint8_t slots, uint8_t* buf, size_t len,
+                                size_t bufSize);
+
+  /**
+   * @brief Apply the module's journal records to the checkpoint at @p buf
+   * 
+   * Records are read into the tail of @p buf and applied oldest first.
+   * 
+   * @param len Length of the checkpoint map at @p buf
+   * @return New length, 0 if @p buf is too small
+   */
+  size_t replayJournal(Preferences& prefs, const char* moduleId, uint8_t* buf, size_t len,
+                       size_t bufSize, JournalStatus& status);
+
+  /**
+   * @brief Write replayed state as the new checkpoint and clear the ring
+   * 
+   * @param info Record to store; size and crc are set from @p state
+   */
+  bool writeJournalCheckpoint(Preferences& prefs, const char* moduleId, ModuleInfo& info,
+                              const uint8_t* state, size_t len);
+
+  /**
+   * @brief Remove every `<id>:j<k>` record of a module
+   */
+  void eraseJournal(Preferences& prefs, const char* moduleId);
+
+  /**
+   * @brief Save a serialized module according to its persistence class
+   */
+  bool storeModuleBlob(const char* moduleId, uint8_t* buf, size_t msgPackSize, size_t bufSize);
+
+  /**
+   * @brief Write a serialized module to NVS (journal, hot fields, snapshot)
+   * @param buf Blob in [0, msgPackSize), scratch space up to @p bufSize
+   */
+  bool writeModuleBlob(const char* moduleId, uint8_t* buf, size_t msgPackSize, size_t bufSize);
+
+  /**
+   * @brief Persistence class of a module (nullptr: NVSPersistence::Nvs)
+   */
+  const PersistenceConfig* persistenceOf(const char* moduleId) const;
+
+  /**
+   * @brief Keep a save of a volatile module in the snapshot
+   */
+  VolatileSave saveVolatile(const char* moduleId, const PersistenceConfig& config, const uint8_t* buf, size_t len);
+
+  /**
+   * @brief Write a module's unflushed snapshot entry to NVS (true if there is none)
+   */
+  bool flushVolatileModule(const char* moduleId);
+
+  /**
+   * @brief Flush an RtcDeferred module if it is unflushed and its interval has passed
+   */
+  MaintenanceStep flushVolatileDue(const PersistenceConfig& config, bool force);
+
+  /**
+   * @brief Run the maintenance step at the cursor and advance it
+   * @param passDone Set when the cursor wrapped around to the first phase
+   */
+  MaintenanceStep maintenanceStep(bool& passDone);
+
+  /**
+   * @brief Checkpoint one journaled module (see compactJournals())
+   */
+  MaintenanceStep compactJournal(const JournalConfig& journal, bool force);
+
+  /**
+   * @brief Migrate a legacy JSON module or drop its leftover JSON copy
+   */
+  MaintenanceStep tidyModule(const DirectoryEntry& entry);
+
+  /**
+   * @brief Body of the prefetch task: serve queued slots until asked to stop
+   */
+  static void prefetchTaskMain(void* arg);
+
+  /**
+   * @brief Start the prefetch task if it is not running; caller holds _lock
+   */
+  bool startPrefetchTask();
+
+  /**
+   * @brief Queue a prefetch read; caller holds _lock
+   * @param fromBoot Boot profile request: uses free slots only (prefetch()
+   *                 evicts the oldest unused blob) and is dropped when the
+   *                 boot window ends
+   * @return true if queued (or already cached or queued)
+   */
+  bool queuePrefetch(const char* moduleId, bool fromBoot);
+
+  /**
+   * @brief Remember the first load of @p moduleId within the boot window
+   */
+  void recordBootLoad(const char* moduleId);
+
+  /**
+   * @brief Prefetch task side of boot prefetch: read the profile, queue its
+   *        next modules into free slots, save the profile once the window ends
+   */
+  void bootPrefetchStep();
+
+  /**
+   * @brief How long the prefetch task may sleep before bootPrefetchStep() is due
+   */
+  TickType_t bootWaitTicks() const;
+
+  /**
+   * @brief Merge this boot's loads into the profile and store it if it changed
+   */
+  void saveBootProfile();
+
+  /**
+   * @brief Read the oldest queued prefetch slot
+   * @return false if no slot was queued
+   */
+  bool prefetchNext();
+
+  /**
+   * @brief Serve a load from the prefetch cache
+   *
+   * Frees the module's slot in any case: a queued read is no longer useful and
+   * a read in progress is discarded when it ends.
+   *
+   * @param info Current directory entry; a blob read for another one is stale
+   * @return true if @p doc was loaded from the cached blob
+   */
+  bool takePrefetched(const char* moduleId, const ModuleInfo& info, JsonDocument& doc);
+
+  /**
+   * @brief Slot of @p moduleId in the prefetch cache; caller holds _lock
+   */
+  PrefetchSlot* prefetchSlotOf(const char* moduleId);
+
+  /**
+   * @brief Free a prefetch slot and its blob; caller holds _lock
+   */
+  void releasePrefetchSlot(PrefetchSlot& slot);
+
+  /**
+   * @brief True if two directory entries describe the same stored bytes
+   *        (a cached blob is only valid for the entry it was read for)
+   */
+  static bool sameStoredBlob(const ModuleInfo& a, const ModuleInfo& b);
+
+  /**
+   * @brief Validate the snapshot region on first use (drops stale entries)
+   * @return true if a snapshot region is active
+   */
+  bool rtcReady();
+
+  /**
+   * @brief Module blob held in the snapshot region
+   * @param dirty Optional: receives whether the entry is newer than NVS
+   * @param dirtySince Optional: receives when the entry first got ahead of NVS
+   */
+  bool rtcFind(const char* moduleId, const uint8_t*& data, size_t& len, bool* dirty = nullptr,
+               uint32_t* dirtySince = nullptr);
+
+  /**
+   * @brief Store a module blob in the snapshot
+   * @return false if it does not fit
+   */
+  bool rtcPut(const char* moduleId, const uint8_t* data, size_t len, bool dirty = false, uint32_t dirtySince = 0);
+
+  /**
+   * @brief Drop a module from the snapshot
+   * @return true if it was held
+   */
+  bool rtcRemove(const char* moduleId);
+
+  /**
+   * @brief Empty the snapshot and bind it to @p generation
+   * @param keepDirty Keep entries that are newer than NVS
+   */
+  void rtcReset(uint32_t generation, bool keepDirty = false);
+
+  /**
+   * @brief Record a new bus generation in the snapshot header
+   */
+  void rtcSetGeneration(uint32_t generation);
+
+  /**
+   * @brief Build `<id>:j<slot>`
+   */
+  static bool buildJournalKey(const char* moduleId, uint8_t slot, char* keyBuf, size_t keyBufSize);
+
+  /**
+   * @brief Build a journal record of the members of @p doc that differ from @p state
+   * 
+   * @return Record length, 0 if a member of @p state is missing from @p doc
+   *         or the record does not fit in @p outSize
+   */
+  static size_t buildJournalRecord(const uint8_t* doc, size_t docLen, const uint8_t* state,
+                                   size_t stateLen, uint8_t* out, size_t outSize);
+
+  /**
+   * @brief Encode a ModuleInfo into its kModuleInfoSize-byte stored form
+   */
+  static void encodeModuleInfo(const ModuleInfo& info, uint8_t* raw);
+
+  /**
+   * @brief Decode a stored record; format/size/crc are only valid if the
+   *        returned length is kModuleInfoSize
+   * @return Number of bytes decoded (0 if @p len is too short)
+   */
+  static size_t decodeModuleInfo(const uint8_t* raw, size_t len, ModuleInfo& info);
+
+  /**
+   * @brief Write the `<id>:i` record of a module
+   */
+  static bool writeModuleInfo(Preferences& prefs, const char* moduleId, const ModuleInfo& info);
+
+  /**
+   * @brief Reserve and persist the next bus generation
+   * 
+   * Called before the data write so that a power loss can only cause a
+   * spurious resend during delta sync, never a missed change.
+   * 
+   * @param prefs Preferences opened read-write on the module's shard
+   * @param moduleId Module being written (the counter lives in shard 0)
+   * @return The new generation
+   */
+  uint32_t nextGeneration(Preferences& prefs, const char* moduleId);
+
+  /**
+   * @brief CRC-32 (IEEE, as used by zlib) of stored bytes
+   */
+  static uint32_t crc32(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Build the RAM directory from NVS if not done yet
+   * @return false if it could not be built (out of memory)
+   */
+  bool ensureDirectory();
+
+  /**
+   * @brief Look up a module in the RAM directory (building it if needed)
+   */
+  Lookup lookupModule(const char* moduleId, ModuleInfo& info);
+
+  /**
+   * @brief Insert or replace the RAM entry of a module (no-op until built)
+   */
+  void updateDirectory(const char* moduleId, const ModuleInfo& info);
+
+  /**
+   * @brief Copy the entry at @p index (sorted order) out of the directory
+   * @return false if @p index is past the end
+   */
+  bool directoryEntryAt(size_t index, DirectoryEntry& entry);
+
+  /**
+   * @brief Copy the first entry whose moduleId sorts after @p moduleId
+   * @param moduleId Resume point ("" for the first entry)
+   * @return false if there is none
+   */
+  bool directoryEntryAfter(const char* moduleId, DirectoryEntry& entry);
+
+  /**
+   * @brief Mark the RAM directory as empty (after clearAll / full restore)
+   */
+  void resetDirectory();
+
+  /**
+   * @brief Drop the RAM directory so it is rebuilt from NVS on next use
+   */
+  void invalidateDirectory();
+
+  /**
+   * @brief Find or insert a RAM entry; caller holds _lock
+   * @return nullptr if the directory could not grow
+   */
+  DirectoryEntry* directorySlot(const char* moduleId, bool insert);
+
+  /**
+   * @brief Write one `moduleId: value` pair of an export map
+   * 
+   * @param first True for the first pair (JSON: no leading comma)
+   * @param prefs Per-shard namespaces, opened on first use
+   * @param opened Per-shard open state (0 = not tried, 1 = open, -1 = unavailable)
+   * @param buf Read buffer shared by the pairs of one export
+   * @param readError Set if the value had to be written as null
+   * @return false if writing to @p out failed
+   */
+  bool writeModuleEntry(Print& out, NVSExportFormat format, const DirectoryEntry& entry, bool first,
+                        Preferences* prefs, int8_t* opened, NVSScratchBuffer& buf, NVSConfigError& readError);
+
+  /**
+   * @brief Write the modules map shared by exportAll() and exportChangedSince()
+   * 
+   * @param out Destination
+   * @param format Output encoding
+   * @param since Only modules with a generation above this value (0 = all)
+   * @param readError Set if a module had to be exported as null (ParseError,
+   *                  or the allocation error if its buffer was refused)
+   * @return false if writing to @p out failed
+   */
+  bool writeModuleMap(Print& out, NVSExportFormat format, uint32_t since, NVSConfigError& readError);
+
+  /**
+   * @brief Map an NVS key back to the moduleId it stores
+   * 
+   * `<id>:mp` keys are MessagePack modules; keys without a ':' are legacy JSON
+   * modules. Any other key (reserved "__" prefix or another suffix) is not a module.
+   * 
+   * @param key NVS key as returned by the entry iterator
+   * @param idBuf Output buffer for the moduleId (at least 16 bytes)
+   * @param idBufSize Size of the output buffer
+   * @param isMsgPack Set to true if @p key is the MessagePack copy
+   * @return true if @p key holds a module configuration
+   */
+  static bool moduleIdFromKey(const char* key, char* idBuf, size_t idBufSize, bool& isMsgPack);
+
+  /**
+   * @brief Check whether an NVS key belongs to a module: its data (`<id>`,
+   *        `<id>:mp`), record (`<id>:i`), hot fields (`<id>:h`) or journal (`<id>:j<k>`)
+   *
+   * Counters, record logs and "__" bookkeeping keys are not module keys.
+   */
+  static bool isModuleKey(const char* key);
+
+  /**
+   * @brief Erase every module key of one shard namespace, keeping all other keys
+   *
+   * @param shard Shard whose namespace is cleared
+   * @param handle Read-write handle of that namespace (not committed here)
+   * @return true if every module key was erased
+   */
+  bool eraseModuleKeys(uint8_t shard, nvs_handle_t handle);
+
+  /**
+   * @brief Check that a moduleId can be stored (length limit, no reserved characters)
+   */
+  static bool isValidModuleId(const char* moduleId);
+
+  /**
+   * @brief Write all modules staged by importAll() with one handle and one commit per shard
+   * 
+   * @param staged Staged records (see NVSConfigBusTransfer.cpp for the layout)
+   * @param stagedSize Size of the staged data in bytes
+   * @param replaceAll Erase all stored modules before writing
+   * @return true if all modules were written and committed
+   */
+  bool commitImport(const uint8_t* staged, size_t stagedSize, bool replaceAll);
 };
 
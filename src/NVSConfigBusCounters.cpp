@@ -0,0 +1,73 @@
+#include "NVSConfigBus.h"
+#include "NVSLock.h"
+#include <string.h>
+
+bool NVSConfigBus::incrementCounter(const char* name, uint32_t delta, uint64_t* value) {
+  char key[16];
+  if (!isValidModuleId(name) || !buildKey(name, ":n", key, sizeof(key))) {
+    NVS_CFG_LOG("incrementCounter: invalid counter name");
+    return false;
+  }
+
+  // Read-modify-write must not interleave with another task's increment
+  NVSLockGuard guard(_lock);
+  Preferences prefs;
+  if (!openModule(prefs, name, delta == 0)) {
+    if (delta == 0 && value != nullptr) {
+      *value = 0;  // Namespace not created yet: nothing stored
+      return true;
+    }
+    NVS_CFG_LOG("incrementCounter: failed to open Preferences namespace");
+    return false;
+  }
+  uint64_t current = prefs.getULong64(key, 0) + delta;
+  bool ok = delta == 0 || prefs.putULong64(key, current) == sizeof(current);
+  prefs.end();
+
+  if (!ok) {
+    NVS_CFG_LOG("incrementCounter: write failed");
+    return false;
+  }
+  if (value != nullptr) {
+    *value = current;
+  }
+  return true;
+}
+
+uint64_t NVSConfigBus::counter(const char* name) {
+  uint64_t value = 0;
+  incrementCounter(name, 0, &value);
+  return value;
+}
+
+bool NVSConfigBus::setCounter(const char* name, uint64_t value) {
+  char key[16];
+  if (!isValidModuleId(name) || !buildKey(name, ":n", key, sizeof(key))) {
+    NVS_CFG_LOG("setCounter: invalid counter name");
+    return false;
+  }
+  NVSLockGuard guard(_lock);
+  Preferences prefs;
+  if (!openModule(prefs, name, false)) {
+    NVS_CFG_LOG("setCounter: failed to open Preferences namespace");
+    return false;
+  }
+  bool ok = prefs.putULong64(key, value) == sizeof(value);
+  prefs.end();
+  return ok;
+}
+
+bool NVSConfigBus::removeCounter(const char* name) {
+  char key[16];
+  if (!isValidModuleId(name) || !buildKey(name, ":n", key, sizeof(key))) {
+    return false;
+  }
+  NVSLockGuard guard(_lock);
+  Preferences prefs;
+  if (!openModule(prefs, name, false)) {
+    return false;
+  }
+  bool existed = prefs.isKey(key) && prefs.remove(key);
+  prefs.end();
+  return existed;
+}
@@ -0,0 +1,360 @@
+#include "NVSConfigBus.h"
+#include "NVSKeyIterator.h"
+#include "NVSLock.h"
+#include <esp_rom_crc.h>
+#include <string.h>
+
+namespace {
+
+// Scan flags collected while building the directory from the namespace keys
+const uint8_t kScanMsgPack = 0x01;     // `<id>:mp` blob present
+const uint8_t kScanJsonBytes = 0x02;   // `<id>` JSON blob present
+const uint8_t kScanJsonString = 0x04;  // `<id>` JSON string present
+const uint8_t kScanRecordV2 = 0x08;    // `<id>:i` carries format/size/crc
+
+// `<id>:i` flag bits
+const uint8_t kInfoDeleted = 0x01;
+const uint8_t kInfoLegacyCopy = 0x02;
+
+uint32_t readLE32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void writeLE32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+}  // namespace
+
+// `<id>:i` layout (little endian):
+//   [generation:4][flags:1][format:1][size:2][crc:4]
+// Records written by earlier versions only contain generation and flags.
+void NVSConfigBus::encodeModuleInfo(const ModuleInfo& info, uint8_t* raw) {
+  writeLE32(raw, info.generation);
+  raw[4] = (uint8_t)((info.deleted ? kInfoDeleted : 0) | (info.legacyCopy ? kInfoLegacyCopy : 0));
+  raw[5] = (uint8_t)info.format;
+  raw[6] = (uint8_t)info.size;
+  raw[7] = (uint8_t)(info.size >> 8);
+  writeLE32(raw + 8, info.crc);
+}
+
+size_t NVSConfigBus::decodeModuleInfo(const uint8_t* raw, size_t len, ModuleInfo& info) {
+  info = ModuleInfo{0, false, false, NVSModuleFormat::None, 0, 0, 0, 0};
+  if (len < kModuleInfoSizeV1) {
+    return 0;
+  }
+  info.generation = readLE32(raw);
+  info.deleted = (raw[4] & kInfoDeleted) != 0;
+  info.legacyCopy = (raw[4] & kInfoLegacyCopy) != 0;
+  if (len < kModuleInfoSize) {
+    return kModuleInfoSizeV1;
+  }
+  info.format = (NVSModuleFormat)raw[5];
+  info.size = (uint16_t)(raw[6] | (raw[7] << 8));
+  info.crc = readLE32(raw + 8);
+  return kModuleInfoSize;
+}
+
+bool NVSConfigBus::writeModuleInfo(Preferences& prefs, const char* moduleId, const ModuleInfo& info) {
+  char infoKey[16];
+  uint8_t raw[kModuleInfoSize];
+  encodeModuleInfo(info, raw);
+  return buildKey(moduleId, ":i", infoKey, sizeof(infoKey)) &&
+         prefs.putBytes(infoKey, raw, sizeof(raw)) == sizeof(raw);
+}
+
+uint32_t NVSConfigBus::crc32(const uint8_t* data, size_t len) {
+  return esp_rom_crc32_le(0, data, len);
+}
+
+NVSConfigBus::DirectoryEntry* NVSConfigBus::directorySlot(const char* moduleId, bool insert) {
+  // Binary search in the sorted array
+  size_t lo = 0;
+  size_t hi = _dirCount;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    int cmp = strcmp(_dir[mid].moduleId, moduleId);
+    if (cmp == 0) {
+      return &_dir[mid];
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (!insert || strlen(moduleId) >= sizeof(_dir[0].moduleId)) {
+    return nullptr;
+  }
+  if (_dirCount == _dirCapacity) {
+    size_t newCapacity = _dirCapacity == 0 ? 8 : _dirCapacity * 2;
+    DirectoryEntry* grown = (DirectoryEntry*)_allocator->reallocate(
+        _dir, newCapacity * sizeof(DirectoryEntry), NVSMemoryClass::Metadata);
+    if (grown == nullptr) {
+      return nullptr;
+    }
+    _dir = grown;
+    _dirCapacity = newCapacity;
+  }
+  memmove(&_dir[lo + 1], &_dir[lo], (_dirCount - lo) * sizeof(DirectoryEntry));
+  _dirCount++;
+
+  DirectoryEntry& entry = _dir[lo];
+  memset(&entry, 0, sizeof(entry));
+  strcpy(entry.moduleId, moduleId);
+  return &entry;
+}
+
+bool NVSConfigBus::ensureDirectory() {
+  NVSLockGuard guard(_lock);
+  if (_dirLoaded) {
+    return true;
+  }
+
+  _dirCount = 0;
+
+  // One pass over each shard's keys collects data keys and `<id>:i` records
+  char moduleId[16];
+  char ns[kNamespaceBufSize];
+  bool isMsgPack = false;
+  bool ok = true;
+  for (uint8_t shard = 0; ok && shard < _shards; shard++) {
+    Preferences prefs;
+    if (!openShard(prefs, shard, true)) {
+      continue;  // Namespace does not exist yet: nothing stored there
+    }
+    NVSKeyIterator it(_partition, shardNamespace(shard, ns));
+    while (ok && it.next()) {
+      const char* key = it.key();
+      size_t keyLen = strlen(key);
+      DirectoryEntry* entry = nullptr;
+      bool isRecord = keyLen > 2 && strcmp(key + keyLen - 2, ":i") == 0 && keyLen - 2 < sizeof(moduleId);
+      bool isHot = keyLen > 2 && strcmp(key + keyLen - 2, ":h") == 0 && keyLen - 2 < sizeof(moduleId);
+      bool isJournal = keyLen > 3 && key[keyLen - 3] == ':' && key[keyLen - 2] == 'j' &&
+                       keyLen - 3 < sizeof(moduleId);
+
+      if (isRecord || isHot) {
+        memcpy(moduleId, key, keyLen - 2);
+        moduleId[keyLen - 2] = '\0';
+      } else if (isJournal) {
+        memcpy(moduleId, key, keyLen - 3);
+        moduleId[keyLen - 3] = '\0';
+      } else if (!moduleIdFromKey(key, moduleId, sizeof(moduleId), isMsgPack)) {
+        continue;  // Bookkeeping or other non-module key
+      }
+      if (shardOf(moduleId) != shard) {
+        continue;  // Left behind by another shard count; loads cannot see it until rebalance()
+      }
+
+      entry = directorySlot(moduleId, true);
+      if (entry != nullptr && isRecord) {
+        uint8_t raw[kModuleInfoSize];
+        size_t rawLen = prefs.getBytes(key, raw, sizeof(raw));
+        ModuleInfo info;
+        if (decodeModuleInfo(raw, rawLen, info) == kModuleInfoSize) {
+          entry->scanFlags |= kScanRecordV2;
+        }
+        info.hotSize = entry->info.hotSize;  // `<id>:h` and `<id>:j<k>` keys may come first
+        info.journalSize = entry->info.journalSize;
+        entry->info = info;
+      } else if (entry != nullptr && isHot) {
+        entry->info.hotSize = (uint16_t)prefs.getBytesLength(key);
+      } else if (entry != nullptr && isJournal) {
+        entry->info.journalSize = (uint16_t)(entry->info.journalSize + prefs.getBytesLength(key));
+      } else if (entry != nullptr) {
+        entry->scanFlags |= isMsgPack ? kScanMsgPack
+                            : it.type() == NVS_TYPE_STR ? kScanJsonString : kScanJsonBytes;
+      }
+      ok = entry != nullptr;
+    }
+    prefs.end();
+  }
+
+  // Reconcile records with the keys actually present. Records from older
+  // versions (or ones that disagree with the keys) are completed by probing
+  // the data key once.
+  size_t kept = 0;
+  for (size_t i = 0; ok && i < _dirCount; i++) {
+    DirectoryEntry& entry = _dir[i];
+    uint8_t flags = entry.scanFlags;
+    NVSModuleFormat actual = (flags & kScanMsgPack) ? NVSModuleFormat::MsgPack
+                             : (flags & kScanJsonBytes) ? NVSModuleFormat::JsonBytes
+                             : (flags & kScanJsonString) ? NVSModuleFormat::JsonString
+                             : NVSModuleFormat::None;
+    bool hasLegacy = (flags & (kScanJsonBytes | kScanJsonString)) != 0;
+
+    if (!(flags & kScanRecordV2) || entry.info.format != actual) {
+      entry.info.format = actual;
+      entry.info.crc = 0;
+      entry.info.size = 0;
+      Preferences prefs;
+      if (actual == NVSModuleFormat::MsgPack && openModule(prefs, entry.moduleId, true)) {
+        char msgPackKey[16];
+        buildKey(entry.moduleId, ":mp", msgPackKey, sizeof(msgPackKey));
+        entry.info.size = (uint16_t)prefs.getBytesLength(msgPackKey);
+        prefs.end();
+      } else if (actual == NVSModuleFormat::JsonBytes && openModule(prefs, entry.moduleId, true)) {
+        entry.info.size = (uint16_t)prefs.getBytesLength(entry.moduleId);
+        prefs.end();
+      }
+    }
+    entry.info.legacyCopy = actual == NVSModuleFormat::MsgPack && hasLegacy;
+    if (actual != NVSModuleFormat::MsgPack) {
+      entry.info.hotSize = 0;  // Only merged into MessagePack blobs
+      entry.info.journalSize = 0;
+    }
+    entry.info.deleted = actual == NVSModuleFormat::None && entry.info.deleted;
+    entry.scanFlags = 0;
+
+    // Drop records without data that are not tombstones (e.g. interrupted writes)
+    if (actual != NVSModuleFormat::None || entry.info.deleted) {
+      _dir[kept++] = entry;
+    }
+  }
+
+  if (!ok) {
+    NVS_CFG_LOG("ensureDirectory: out of memory, falling back to NVS probes");
+    _dirCount = 0;
+    return false;
+  }
+  _dirCount = kept;
+  _dirLoaded = true;
+  return true;
+}
+
+NVSConfigBus::Lookup NVSConfigBus::lookupModule(const char* moduleId, ModuleInfo& info) {
+  if (!ensureDirectory()) {
+    return Lookup::Unavailable;
+  }
+  NVSLockGuard guard(_lock);
+  DirectoryEntry* entry = directorySlot(moduleId, false);
+  if (entry == nullptr) {
+    return Lookup::Missing;
+  }
+  info = entry->info;
+  return Lookup::Found;
+}
+
+void NVSConfigBus::updateDirectory(const char* moduleId, const ModuleInfo& info) {
+  NVSLockGuard guard(_lock);
+  if (!_dirLoaded) {
+    return;  // Will be read from the `<id>:i` records when first needed
+  }
+  DirectoryEntry* entry = directorySlot(moduleId, true);
+  if (entry == nullptr) {
+    // Could not grow: force a rebuild rather than serving stale answers
+    _dirCount = 0;
+    _dirLoaded = false;
+    return;
+  }
+  entry->info = info;
+}
+
+bool NVSConfigBus::directoryEntryAt(size_t index, DirectoryEntry& entry) {
+  NVSLockGuard guard(_lock);
+  if (!_dirLoaded || index >= _dirCount) {
+    return false;
+  }
+  entry = _dir[index];
+  return true;
+}
+
+bool NVSConfigBus::directoryEntryAfter(const char* moduleId, DirectoryEntry& entry) {
+  NVSLockGuard guard(_lock);
+  if (!_dirLoaded) {
+    return false;
+  }
+  // Binary search for the first entry sorting after moduleId
+  size_t lo = 0;
+  size_t hi = _dirCount;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (strcmp(_dir[mid].moduleId, moduleId) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo >= _dirCount) {
+    return false;
+  }
+  entry = _dir[lo];
+  return true;
+}
+
+void NVSConfigBus::resetDirectory() {
+  NVSLockGuard guard(_lock);
+  _dirCount = 0;
+  _dirLoaded = true;
+}
+
+void NVSConfigBus::invalidateDirectory() {
+  NVSLockGuard guard(_lock);
+  _dirCount = 0;
+  _dirLoaded = false;
+}
+
+bool NVSConfigBus::exists(const char* moduleId) {
+  ModuleInfo info;
+  return moduleId != nullptr && lookupModule(moduleId, info) == Lookup::Found &&
+         info.format != NVSModuleFormat::None;
+}
+
+size_t NVSConfigBus::sizeOf(const char* moduleId) {
+  ModuleInfo info;
+  if (moduleId == nullptr || lookupModule(moduleId, info) != Lookup::Found) {
+    return 0;
+  }
+  return info.format == NVSModuleFormat::None ? 0 : storedBytes(info);
+}
+
+bool NVSConfigBus::moduleInfo(const char* moduleId, NVSModuleInfo& out) {
+  ModuleInfo info;
+  if (moduleId == nullptr || lookupModule(moduleId, info) != Lookup::Found ||
+      info.format == NVSModuleFormat::None) {
+    return false;
+  }
+  strncpy(out.moduleId, moduleId, sizeof(out.moduleId) - 1);
+  out.moduleId[sizeof(out.moduleId) - 1] = '\0';
+  out.format = info.format;
+  out.size = (uint16_t)storedBytes(info);
+  out.generation = info.generation;
+  out.crc = info.crc;
+  return true;
+}
+
+size_t NVSConfigBus::listModules(NVSModuleInfo* out, size_t maxCount) {
+  if (!ensureDirectory()) {
+    return 0;
+  }
+  NVSLockGuard guard(_lock);
+  size_t count = 0;
+  for (size_t i = 0; i < _dirCount; i++) {
+    const DirectoryEntry& entry = _dir[i];
+    if (entry.info.format == NVSModuleFormat::None) {
+      continue;  // Tombstone
+    }
+    if (out != nullptr && count < maxCount) {
+      NVSModuleInfo& info = out[count];
+      memcpy(info.moduleId, entry.moduleId, sizeof(info.moduleId));
+      info.format = entry.info.format;
+      info.size = (uint16_t)storedBytes(entry.info);
+      info.generation = entry.info.generation;
+      info.crc = entry.info.crc;
+    }
+    count++;
+  }
+  return count;
+}
+
+uint32_t NVSConfigBus::moduleGeneration(const char* moduleId) {
+  ModuleInfo info;
+  if (moduleId == nullptr || lookupModule(moduleId, info) != Lookup::Found) {
+    return 0;
+  }
+  return info.generation;
+}
@@ -0,0 +1,168 @@
+#include "NVSConfigBus.h"
+#include "NVSLock.h"
+#include "NVSMsgPack.h"
+#include <string.h>
+
+namespace {
+
+// The hot entry always uses a map16 header, so the merged count fits in place
+const size_t kHotHeaderSize = 3;
+
+bool isHotKey(const NVSMsgPack::Token& key, const char* const* fields, size_t count) {
+  if (key.type != NVSMsgPack::Type::Str) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (fields[i] != nullptr && strlen(fields[i]) == key.length &&
+        memcmp(fields[i], key.data, key.length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool NVSConfigBus::setHotFields(const char* moduleId, const char* const* fields, size_t count) {
+  if (!isValidModuleId(moduleId)) {
+    NVS_CFG_LOG("setHotFields: invalid moduleId");
+    return false;
+  }
+  if (fields == nullptr) {
+    count = 0;
+  }
+  if (count > 0 && journalSlotsOf(moduleId) > 0) {
+    NVS_CFG_LOG("setHotFields: module is in journal mode");
+    return false;
+  }
+
+  NVSLockGuard guard(_lock);
+  HotFields* slot = nullptr;
+  for (size_t i = 0; i < NVS_CFG_MAX_HOT_MODULES; i++) {
+    if (strcmp(_hot[i].moduleId, moduleId) == 0) {
+      slot = &_hot[i];
+      break;
+    }
+    if (slot == nullptr && _hot[i].moduleId[0] == '\0') {
+      slot = &_hot[i];
+    }
+  }
+
+  if (count == 0) {
+    if (slot != nullptr && strcmp(slot->moduleId, moduleId) == 0) {
+      memset(slot, 0, sizeof(*slot));  // Next save folds the hot entry back in
+    }
+    return true;
+  }
+  if (slot == nullptr) {
+    NVS_CFG_LOG("setHotFields: too many modules (raise NVS_CFG_MAX_HOT_MODULES)");
+    return false;
+  }
+  strcpy(slot->moduleId, moduleId);
+  slot->fields = fields;
+  slot->count = count;
+  return true;
+}
+
+const NVSConfigBus::HotFields* NVSConfigBus::hotFieldsOf(const char* moduleId) const {
+  for (size_t i = 0; i < NVS_CFG_MAX_HOT_MODULES; i++) {
+    if (_hot[i].moduleId[0] != '\0' && strcmp(_hot[i].moduleId, moduleId) == 0) {
+      return &_hot[i];
+    }
+  }
+  return nullptr;
+}
+
+bool NVSConfigBus::splitHotFields(const HotFields& hot, uint8_t* data, size_t len, size_t capacity,
+                                  uint8_t*& cold, size_t& coldLen, uint8_t*& hotEntry, size_t& hotLen) {
+  const uint8_t* end = data + len;
+  const uint8_t* p = data;
+  NVSMsgPack::Token root;
+  if (!NVSMsgPack::readToken(p, end, root) || root.type != NVSMsgPack::Type::Map) {
+    return false;
+  }
+  const size_t headerLen = (size_t)(p - data);
+
+  // First pass only measures, so a split that does not fit leaves data intact
+  size_t hotCount = 0;
+  size_t hotBytes = 0;
+  for (uint32_t i = 0; i < root.length; i++) {
+    const uint8_t* pair = p;
+    const uint8_t* k = p;
+    NVSMsgPack::Token key;
+    if (!NVSMsgPack::readToken(k, end, key) || !NVSMsgPack::skipValue(p, end) ||
+        !NVSMsgPack::skipValue(p, end)) {
+      return false;
+    }
+    if (isHotKey(key, hot.fields, hot.count)) {
+      hotCount++;
+      hotBytes += (size_t)(p - pair);
+    }
+  }
+
+  cold = data;
+  coldLen = len;
+  hotEntry = data + len;
+  hotLen = 0;
+  if (hotCount == 0) {
+    return true;
+  }
+  if (len + kHotHeaderSize + hotBytes > capacity) {
+    return false;
+  }
+
+  // Second pass: hot pairs are appended behind the blob, cold pairs compacted
+  // forward (the write position never overtakes the read position)
+  uint8_t* tail = hotEntry;
+  tail[0] = 0xde;
+  tail[1] = (uint8_t)(hotCount >> 8);
+  tail[2] = (uint8_t)hotCount;
+  tail += kHotHeaderSize;
+  uint8_t* write = data + headerLen;
+  p = data + headerLen;
+  for (uint32_t i = 0; i < root.length; i++) {
+    const uint8_t* pair = p;
+    const uint8_t* k = p;
+    NVSMsgPack::Token key;
+    NVSMsgPack::readToken(k, end, key);
+    NVSMsgPack::skipValue(p, end);
+    NVSMsgPack::skipValue(p, end);
+    size_t pairLen = (size_t)(p - pair);
+    if (isHotKey(key, hot.fields, hot.count)) {
+      memcpy(tail, pair, pairLen);
+      tail += pairLen;
+    } else {
+      memmove(write, pair, pairLen);
+      write += pairLen;
+    }
+  }
+
+  // A smaller count never needs a longer header: place it right before the pairs
+  uint8_t header[5];
+  size_t coldHeaderLen = NVSMsgPack::encodeMapHeader(root.length - (uint32_t)hotCount, header);
+  cold = data + headerLen - coldHeaderLen;
+  memcpy(cold, header, coldHeaderLen);
+  coldLen = (size_t)(write - cold);
+  hotLen = kHotHeaderSize + hotBytes;
+  return true;
+}
+
+size_t NVSConfigBus::mergeHotFields(uint8_t* buf, size_t hotLen, size_t coldLen) {
+  uint8_t* cold = buf + hotLen;
+  const uint8_t* p = cold;
+  NVSMsgPack::Token coldRoot;
+  if (hotLen < kHotHeaderSize || buf[0] != 0xde ||
+      !NVSMsgPack::readToken(p, cold + coldLen, coldRoot) || coldRoot.type != NVSMsgPack::Type::Map) {
+    // Not mergeable: the module blob alone is still a complete value
+    memmove(buf, cold, coldLen);
+    return coldLen;
+  }
+
+  // Drop the cold header and count its pairs into the hot one
+  size_t coldHeaderLen = (size_t)(p - cold);
+  memmove(cold, p, coldLen - coldHeaderLen);
+  uint32_t count = (((uint32_t)buf[1] << 8) | buf[2]) + coldRoot.length;
+  buf[1] = (uint8_t)(count >> 8);
+  buf[2] = (uint8_t)count;
+  return hotLen + coldLen - coldHeaderLen;
+}
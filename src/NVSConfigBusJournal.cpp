@@ -0,0 +1,416 @@
+#include "NVSConfigBus.h"
+#include "NVSLock.h"
+#include "NVSMsgPack.h"
+#include <string.h>
+
+namespace {
+
+// `<id>:j<k>` record layout (little endian):
+//   [base crc:4][generation:4][map16 of the changed top-level members]
+// Records only apply to the checkpoint whose CRC-32 they carry, so records
+// left behind by an interrupted checkpoint are ignored.
+const size_t kRecordPrefix = 8;
+const size_t kMap16Header = 3;
+const uint8_t kNoSlot = 0xff;
+
+uint32_t readLE32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void writeLE32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+// One key/value pair of a map
+struct Member {
+  const uint8_t* pair;   // Key header
+  const uint8_t* value;  // Value header
+  size_t keyLen;         // Encoded key length
+  size_t length;         // Encoded pair length
+};
+
+bool readMember(const uint8_t*& p, const uint8_t* end, Member& m) {
+  m.pair = p;
+  if (!NVSMsgPack::skipValue(p, end)) {
+    return false;
+  }
+  m.value = p;
+  m.keyLen = (size_t)(m.value - m.pair);
+  if (!NVSMsgPack::skipValue(p, end)) {
+    return false;
+  }
+  m.length = (size_t)(p - m.pair);
+  return true;
+}
+
+// Member with the same encoded key among `count` pairs
+bool findMember(const uint8_t* pairs, const uint8_t* end, uint32_t count, const Member& key, Member& found) {
+  const uint8_t* p = pairs;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!readMember(p, end, found)) {
+      return false;
+    }
+    if (found.keyLen == key.keyLen && memcmp(found.pair, key.pair, key.keyLen) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool readMapHeader(const uint8_t* map, const uint8_t* end, uint32_t& count, const uint8_t*& pairs) {
+  NVSMsgPack::Token t;
+  pairs = map;
+  if (!NVSMsgPack::readToken(pairs, end, t) || t.type != NVSMsgPack::Type::Map) {
+    return false;
+  }
+  count = t.length;
+  return true;
+}
+
+}  // namespace
+
+bool NVSConfigBus::setJournal(const char* moduleId, uint8_t slots) {
+  if (!isValidModuleId(moduleId) || slots > NVS_CFG_JOURNAL_MAX_SLOTS) {
+    NVS_CFG_LOG("setJournal: invalid moduleId or slot count");
+    return false;
+  }
+  if (slots > 0 && hotFieldsOf(moduleId) != nullptr) {
+    NVS_CFG_LOG("setJournal: module has hot fields");
+    return false;
+  }
+
+  NVSLockGuard guard(_lock);
+  JournalConfig* entry = nullptr;
+  for (size_t i = 0; i < NVS_CFG_MAX_JOURNAL_MODULES; i++) {
+    if (strcmp(_journal[i].moduleId, moduleId) == 0) {
+      entry = &_journal[i];
+      break;
+    }
+    if (entry == nullptr && _journal[i].moduleId[0] == '\0') {
+      entry = &_journal[i];
+    }
+  }
+
+  if (slots == 0) {
+    if (entry != nullptr && strcmp(entry->moduleId, moduleId) == 0) {
+      memset(entry, 0, sizeof(*entry));  // Next save rewrites the module and clears the ring
+    }
+    return true;
+  }
+  if (entry == nullptr) {
+    NVS_CFG_LOG("setJournal: too many modules (raise NVS_CFG_MAX_JOURNAL_MODULES)");
+    return false;
+  }
+  strcpy(entry->moduleId, moduleId);
+  entry->slots = slots;
+  return true;
+}
+
+uint8_t NVSConfigBus::journalSlotsOf(const char* moduleId) const {
+  for (size_t i = 0; i < NVS_CFG_MAX_JOURNAL_MODULES; i++) {
+    if (_journal[i].moduleId[0] != '\0' && strcmp(_journal[i].moduleId, moduleId) == 0) {
+      return _journal[i].slots;
+    }
+  }
+  return 0;
+}
+
+bool NVSConfigBus::buildJournalKey(const char* moduleId, uint8_t slot, char* keyBuf, size_t keyBufSize) {
+  char suffix[4];
+  snprintf(suffix, sizeof(suffix), ":j%x", (unsigned)(slot & 0x0f));
+  return buildKey(moduleId, suffix, keyBuf, keyBufSize);
+}
+
+size_t NVSConfigBus::buildJournalRecord(const uint8_t* doc, size_t docLen, const uint8_t* state,
+                                        size_t stateLen, uint8_t* out, size_t outSize) {
+  const uint8_t* docEnd = doc + docLen;
+  const uint8_t* stateEnd = state + stateLen;
+  uint32_t docCount;
+  uint32_t stateCount;
+  const uint8_t* docPairs;
+  const uint8_t* statePairs;
+  if (!readMapHeader(doc, docEnd, docCount, docPairs) ||
+      !readMapHeader(state, stateEnd, stateCount, statePairs) || outSize < kRecordPrefix + kMap16Header) {
+    return 0;
+  }
+
+  uint8_t* w = out + kRecordPrefix + kMap16Header;
+  uint32_t changed = 0;
+  uint32_t matched = 0;
+  const uint8_t* p = docPairs;
+  for (uint32_t i = 0; i < docCount; i++) {
+    Member m;
+    Member old;
+    if (!readMember(p, docEnd, m)) {
+      return 0;
+    }
+    if (findMember(statePairs, stateEnd, stateCount, m, old)) {
+      matched++;
+      if (old.length == m.length && memcmp(old.value, m.value, m.length - m.keyLen) == 0) {
+        continue;  // Unchanged
+      }
+    }
+    if (w + m.length > out + outSize) {
+      return 0;
+    }
+    memcpy(w, m.pair, m.length);
+    w += m.length;
+    changed++;
+  }
+  if (matched < stateCount) {
+    return 0;  // A member was removed: records only add or replace members
+  }
+
+  uint8_t* header = out + kRecordPrefix;
+  header[0] = 0xde;
+  header[1] = (uint8_t)(changed >> 8);
+  header[2] = (uint8_t)changed;
+  return (size_t)(w - out);
+}
+
+size_t NVSConfigBus::replayJournal(Preferences& prefs, const char* moduleId, uint8_t* buf, size_t len,
+                                   size_t bufSize, JournalStatus& status) {
+  struct Record {
+    uint32_t generation;
+    uint8_t slot;
+    uint16_t length;
+  };
+  Record records[NVS_CFG_JOURNAL_MAX_SLOTS];
+  size_t count = 0;
+  char key[16];
+
+  // First pass: find the records of this checkpoint, ordered by generation
+  for (uint8_t slot = 0; slot < NVS_CFG_JOURNAL_MAX_SLOTS; slot++) {
+    if (!buildJournalKey(moduleId, slot, key, sizeof(key))) {
+      return 0;
+    }
+    size_t recLen = prefs.getBytesLength(key);
+    if (recLen == 0) {
+      continue;
+    }
+    status.bytes = (uint16_t)(status.bytes + recLen);
+    if (recLen > bufSize - len) {
+      NVS_CFG_LOG("replayJournal: buffer too small for journal record");
+      return 0;
+    }
+    uint8_t* rec = buf + bufSize - recLen;
+    if (recLen < kRecordPrefix + kMap16Header || prefs.getBytes(key, rec, recLen) != recLen ||
+        readLE32(rec) != status.baseCrc) {
+      continue;  // Stale (older checkpoint) or unreadable
+    }
+    size_t pos = count++;
+    uint32_t generation = readLE32(rec + 4);
+    while (pos > 0 && records[pos - 1].generation > generation) {
+      records[pos] = records[pos - 1];
+      pos--;
+    }
+    records[pos] = Record{generation, slot, (uint16_t)recLen};
+  }
+  if (count == 0) {
+    return len;
+  }
+
+  // Give the checkpoint a map16 header so the member count can grow in place
+  uint32_t total;
+  const uint8_t* pairs;
+  if (!readMapHeader(buf, buf + len, total, pairs)) {
+    NVS_CFG_LOG("replayJournal: checkpoint is not a map, records ignored");
+    return len;
+  }
+  size_t headerLen = (size_t)(pairs - buf);
+  if (headerLen != kMap16Header) {
+    if (len - headerLen + kMap16Header > bufSize) {
+      return 0;
+    }
+    memmove(buf + kMap16Header, pairs, len - headerLen);
+    len = len - headerLen + kMap16Header;
+    buf[0] = 0xde;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const Record& r = records[i];
+    uint8_t* rec = buf + bufSize - r.length;
+    const uint8_t* recEnd = buf + bufSize;
+    buildJournalKey(moduleId, r.slot, key, sizeof(key));
+    if (rec < buf + len || prefs.getBytes(key, rec, r.length) != r.length) {
+      NVS_CFG_LOG("replayJournal: buffer too small or record unreadable");
+      return 0;
+    }
+    uint32_t changed;
+    const uint8_t* p;
+    if (!NVSMsgPack::validate(rec + kRecordPrefix, r.length - kRecordPrefix) ||
+        !readMapHeader(rec + kRecordPrefix, recEnd, changed, p)) {
+      continue;
+    }
+
+    // Replaced members are removed and re-appended: the state only grows at its
+    // end, which stays in front of the record being read
+    for (uint32_t k = 0; k < changed; k++) {
+      Member m;
+      Member old;
+      readMember(p, recEnd, m);
+      if (findMember(buf + kMap16Header, buf + len, total, m, old)) {
+        uint8_t* oldPair = buf + (old.pair - buf);
+        memmove(oldPair, oldPair + old.length, (size_t)(buf + len - oldPair) - old.length);
+        len -= old.length;
+        total--;
+      }
+      memmove(buf + len, m.pair, m.length);
+      len += m.length;
+      total++;
+    }
+    status.records++;
+    status.newestSlot = r.slot;
+  }
+  buf[1] = (uint8_t)(total >> 8);
+  buf[2] = (uint8_t)total;
+  return len;
+}
+
+bool NVSConfigBus::writeJournalCheckpoint(Preferences& prefs, const char* moduleId, ModuleInfo& info,
+                                          const uint8_t* state, size_t len) {
+  char msgPackKey[16];
+  if (!buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey))) {
+    return false;
+  }
+  info.format = NVSModuleFormat::MsgPack;
+  info.size = (uint16_t)len;
+  info.crc = crc32(state, len);
+  info.journalSize = 0;
+
+  // Until the blob is written, loads still replay the old records onto the old
+  // checkpoint; afterwards they no longer match its CRC. The record follows the
+  // blob, so it never describes a checkpoint that was not written.
+  if (prefs.putBytes(msgPackKey, state, len) != len) {
+    return false;
+  }
+  if (!writeModuleInfo(prefs, moduleId, info)) {
+    // The old record no longer matches the blob: drop it, so the next
+    // directory scan measures the checkpoint instead of trusting the record
+    char infoKey[16];
+    if (buildKey(moduleId, ":i", infoKey, sizeof(infoKey))) {
+      prefs.remove(infoKey);
+    }
+    return false;
+  }
+  eraseJournal(prefs, moduleId);
+  return true;
+}
+
+void NVSConfigBus::eraseJournal(Preferences& prefs, const char* moduleId) {
+  char key[16];
+  for (uint8_t slot = 0; slot < NVS_CFG_JOURNAL_MAX_SLOTS; slot++) {
+    if (buildJournalKey(moduleId, slot, key, sizeof(key)) && prefs.isKey(key)) {
+      prefs.remove(key);
+    }
+  }
+}
+
+NVSConfigBus::JournalSave NVSConfigBus::saveJournalRecord(const char* moduleId, uint8_t slots, uint8_t* buf,
+                                                          size_t len, size_t bufSize) {
+  // The first save of a module (or one with hot fields) is a regular full save
+  ModuleInfo previous;
+  if (lookupModule(moduleId, previous) != Lookup::Found || previous.format != NVSModuleFormat::MsgPack ||
+      previous.hotSize > 0) {
+    return JournalSave::FullSave;
+  }
+
+  NVSScratchBuffer state(*_budget, *_allocator, storedBytes(previous));
+  if (!state) {
+    return JournalSave::FullSave;
+  }
+  JournalStatus status;
+  size_t stateLen = readModuleState(moduleId, state.data(), state.size(), status);
+  size_t recLen = stateLen > 0 ? buildJournalRecord(buf, len, state.data(), stateLen, buf + len, bufSize - len) : 0;
+  if (recLen == 0 || (recLen - kRecordPrefix - kMap16Header) * 2 > len) {
+    return JournalSave::FullSave;  // Cheaper (and simpler to load) as a full rewrite
+  }
+
+  Preferences prefs;
+  if (!openModule(prefs, moduleId, false)) {
+    NVS_CFG_LOG("saveModuleConfigMsgPack: failed to open Preferences namespace");
+    return JournalSave::Failed;
+  }
+
+  ModuleInfo info = previous;
+  info.generation = nextGeneration(prefs, moduleId);
+  bool ok;
+  uint8_t slot = status.newestSlot == kNoSlot ? 0 : (uint8_t)((status.newestSlot + 1) % slots);
+  if (status.records >= slots) {
+    // Ring full: the replayed state becomes the checkpoint the record applies to
+    ok = writeJournalCheckpoint(prefs, moduleId, info, state.data(), stateLen);
+    status.baseCrc = info.crc;
+    status.bytes = 0;
+    slot = 0;
+  } else {
+    ok = writeModuleInfo(prefs, moduleId, info);
+  }
+  state.release();
+
+  info.journalSize = status.bytes;
+  if (ok && recLen > kRecordPrefix + kMap16Header) {
+    char key[16];
+    uint8_t* rec = buf + len;
+    writeLE32(rec, status.baseCrc);
+    writeLE32(rec + 4, info.generation);
+    ok = buildJournalKey(moduleId, slot, key, sizeof(key));
+    size_t replaced = ok ? prefs.getBytesLength(key) : 0;  // Stale record in that slot
+    ok = ok && prefs.putBytes(key, rec, recLen) == recLen;
+    info.journalSize = (uint16_t)(status.bytes - replaced + recLen);
+  }
+  prefs.end();
+
+  if (!ok) {
+    NVS_CFG_LOG("saveModuleConfigMsgPack: journal write failed");
+    invalidateDirectory();  // Record and keys may disagree: rebuild on next use
+    return JournalSave::Failed;
+  }
+  updateDirectory(moduleId, info);
+  return JournalSave::Saved;
+}
+
+bool NVSConfigBus::compactJournals(bool force) {
+  _lastError = NVSConfigError::None;
+  bool ok = true;
+  for (size_t i = 0; i < NVS_CFG_MAX_JOURNAL_MODULES; i++) {
+    JournalConfig journal = _journal[i];
+    ok = compactJournal(journal, force) != MaintenanceStep::Failed && ok;
+  }
+  return ok;
+}
+
+NVSConfigBus::MaintenanceStep NVSConfigBus::compactJournal(const JournalConfig& journal, bool force) {
+  ModuleInfo info;
+  if (journal.moduleId[0] == '\0' || lookupModule(journal.moduleId, info) != Lookup::Found ||
+      info.format != NVSModuleFormat::MsgPack || info.journalSize == 0) {
+    return MaintenanceStep::Idle;
+  }
+
+  NVSScratchBuffer state(*_budget, *_allocator, storedBytes(info));
+  if (!state) {
+    _lastError = state.error();
+    return MaintenanceStep::Failed;
+  }
+  JournalStatus status;
+  size_t len = readModuleState(journal.moduleId, state.data(), state.size(), status);
+  if (len == 0 || (status.records * 2 < journal.slots && !(force && status.bytes > 0))) {
+    return MaintenanceStep::Idle;
+  }
+
+  // Same content, so the generation stays: delta sync has nothing new to report
+  Preferences prefs;
+  bool written = openModule(prefs, journal.moduleId, false) &&
+                 writeJournalCheckpoint(prefs, journal.moduleId, info, state.data(), len);
+  prefs.end();
+  if (!written) {
+    NVS_CFG_LOG("compactJournals: checkpoint write failed");
+    _lastError = NVSConfigError::WriteFailed;
+    invalidateDirectory();
+    return MaintenanceStep::Failed;
+  }
+  updateDirectory(journal.moduleId, info);
+  return MaintenanceStep::Worked;
+}
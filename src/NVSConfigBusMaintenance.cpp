@@ -0,0 +1,122 @@
+#include "NVSConfigBus.h"
+#include "NVSJsonArena.h"
+#include <esp_timer.h>
+#include <string.h>
+
+namespace {
+
+// Phases of a maintenance pass, in cursor order
+const uint8_t kPhaseVolatile = 0;   // _persistence[] slots
+const uint8_t kPhaseJournal = 1;    // _journal[] slots
+const uint8_t kPhaseDirectory = 2;  // Directory entries
+
+}  // namespace
+
+bool NVSConfigBus::runMaintenance(uint32_t budgetMicros) {
+  _lastError = NVSConfigError::None;
+  const int64_t start = esp_timer_get_time();
+  for (;;) {
+    bool passDone = false;
+    if (maintenanceStep(passDone) == MaintenanceStep::Worked) {
+      _maintenance.pending = true;
+    }
+    if (passDone) {
+      bool pending = _maintenance.pending;
+      _maintenance.pending = false;
+      if (!pending) {
+        return false;  // A whole pass without work: everything is tidy
+      }
+    }
+    if (esp_timer_get_time() - start >= (int64_t)budgetMicros) {
+      return true;
+    }
+  }
+}
+
+NVSConfigBus::MaintenanceStep NVSConfigBus::maintenanceStep(bool& passDone) {
+  MaintenanceCursor& cursor = _maintenance;
+  MaintenanceStep step = MaintenanceStep::Idle;
+  bool phaseDone = false;
+
+  switch (cursor.phase) {
+    case kPhaseVolatile: {
+      // Unused slots are skipped within the step
+      while (cursor.index < NVS_CFG_MAX_VOLATILE_MODULES && _persistence[cursor.index].moduleId[0] == '\0') {
+        cursor.index++;
+      }
+      if (cursor.index < NVS_CFG_MAX_VOLATILE_MODULES) {
+        PersistenceConfig config = _persistence[cursor.index];
+        step = flushVolatileDue(config, false);
+      }
+      phaseDone = cursor.index + 1 >= NVS_CFG_MAX_VOLATILE_MODULES;
+      break;
+    }
+    case kPhaseJournal: {
+      while (cursor.index < NVS_CFG_MAX_JOURNAL_MODULES && _journal[cursor.index].moduleId[0] == '\0') {
+        cursor.index++;
+      }
+      if (cursor.index < NVS_CFG_MAX_JOURNAL_MODULES) {
+        JournalConfig journal = _journal[cursor.index];
+        step = compactJournal(journal, false);
+      }
+      phaseDone = cursor.index + 1 >= NVS_CFG_MAX_JOURNAL_MODULES;
+      break;
+    }
+    default: {
+      // Entries may shift while we are away; a skipped one is seen next pass
+      DirectoryEntry entry;
+      if (ensureDirectory() && directoryEntryAt(cursor.index, entry)) {
+        step = tidyModule(entry);
+      }
+      DirectoryEntry next;
+      phaseDone = !directoryEntryAt(cursor.index + 1, next);
+      break;
+    }
+  }
+
+  cursor.index++;
+  if (phaseDone) {
+    cursor.index = 0;
+    cursor.phase = cursor.phase == kPhaseDirectory ? kPhaseVolatile : (uint8_t)(cursor.phase + 1);
+    passDone = cursor.phase == kPhaseVolatile;
+  }
+  return step;
+}
+
+NVSConfigBus::MaintenanceStep NVSConfigBus::tidyModule(const DirectoryEntry& entry) {
+  const ModuleInfo& info = entry.info;
+
+  if (info.format == NVSModuleFormat::JsonBytes || info.format == NVSModuleFormat::JsonString) {
+    // Loading migrates legacy JSON to MessagePack as a side effect
+    NVSScopedDocument doc(*this);
+    ModuleInfo migrated;
+    if (!doc.load(entry.moduleId) || lookupModule(entry.moduleId, migrated) != Lookup::Found ||
+        migrated.format != NVSModuleFormat::MsgPack) {
+      NVS_CFG_LOG("runMaintenance: legacy JSON module not migrated");
+      return MaintenanceStep::Failed;
+    }
+    return MaintenanceStep::Worked;
+  }
+
+  if (info.format != NVSModuleFormat::MsgPack || !info.legacyCopy) {
+    return MaintenanceStep::Idle;
+  }
+
+  // The JSON key goes first: a record still flagging a removed copy is harmless
+  Preferences prefs;
+  if (!openModule(prefs, entry.moduleId, false)) {
+    return MaintenanceStep::Failed;
+  }
+  ModuleInfo tidy = info;
+  tidy.legacyCopy = false;
+  bool ok = (!prefs.isKey(entry.moduleId) || prefs.remove(entry.moduleId)) &&
+            writeModuleInfo(prefs, entry.moduleId, tidy);
+  prefs.end();
+  if (!ok) {
+    NVS_CFG_LOG("runMaintenance: legacy JSON copy not removed");
+    _lastError = NVSConfigError::WriteFailed;
+    return MaintenanceStep::Failed;
+  }
+  updateDirectory(entry.moduleId, tidy);
+  return MaintenanceStep::Worked;
+}
@@ -0,0 +1,437 @@
+#include "NVSConfigBus.h"
+#include "NVSLock.h"
+#include <esp_timer.h>
+#include <string.h>
+
+namespace {
+
+// `__boot` record: [version][count] then per module [score][idLen][moduleId]
+const uint8_t kBootVersion = 1;
+const size_t kBootRecordSize = 2 + NVS_CFG_BOOT_PREFETCH_MODULES * 14;
+
+// Scores rise by kBootHitScore on boots that load a module and halve on boots
+// that do not. A module loaded on every boot reaches 255 on its second boot,
+// after which its entry no longer changes; one loaded on every other boot
+// alternates between 255 and 127. A module no longer loaded at boot is
+// prefetched twice more and leaves the profile after five boots.
+const uint8_t kBootHitScore = 128;   // Added for every boot that loaded the module
+const uint8_t kBootMinScore = 32;    // Prefetched from this score on
+const uint8_t kBootKeepScore = 8;    // Dropped from the profile below this score
+
+bool bootWindowOpen(uint32_t windowMs) {
+  return esp_timer_get_time() < (int64_t)windowMs * 1000;
+}
+
+}  // namespace
+
+bool NVSConfigBus::prefetch(const char* moduleId) {
+  if (!isValidModuleId(moduleId)) {
+    return false;
+  }
+
+  // The directory lookup is left to the task as well: on the first call it
+  // builds the directory, which is exactly the latency to hide
+  NVSLockGuard guard(_lock);
+  if (!startPrefetchTask()) {
+    return false;
+  }
+  if (!queuePrefetch(moduleId, false)) {
+    NVS_CFG_LOG("prefetch: every slot is being read");
+    return false;
+  }
+  return true;
+}
+
+bool NVSConfigBus::startPrefetchTask() {
+  if (_prefetchTask != nullptr) {
+    return true;
+  }
+  TaskHandle_t task = nullptr;
+  if (xTaskCreate(prefetchTaskMain, "nvsPrefetch", NVS_CFG_PREFETCH_STACK, this, NVS_CFG_PREFETCH_PRIORITY,
+                  &task) != pdPASS) {
+    NVS_CFG_LOG("prefetch: failed to start the prefetch task");
+    return false;
+  }
+  _prefetchTask = task;
+  return true;
+}
+
+bool NVSConfigBus::queuePrefetch(const char* moduleId, bool fromBoot) {
+  PrefetchSlot* queued = prefetchSlotOf(moduleId);
+  if (queued != nullptr) {
+    queued->boot = queued->boot && fromBoot;  // Kept past the boot window once asked for
+    return true;
+  }
+
+  PrefetchSlot* slot = nullptr;
+  PrefetchSlot* oldest = nullptr;
+  for (size_t i = 0; i < NVS_CFG_MAX_PREFETCH && slot == nullptr; i++) {
+    PrefetchSlot& s = _prefetch[i];
+    if (s.state == PrefetchState::Free) {
+      slot = &s;
+    } else if (s.state == PrefetchState::Ready && (oldest == nullptr || s.order < oldest->order)) {
+      oldest = &s;
+    }
+  }
+  if (slot == nullptr && !fromBoot && oldest != nullptr) {
+    _prefetchStats.wasted++;
+    releasePrefetchSlot(*oldest);
+    slot = oldest;
+  }
+  if (slot == nullptr) {
+    return false;
+  }
+
+  strncpy(slot->moduleId, moduleId, sizeof(slot->moduleId) - 1);
+  slot->state = PrefetchState::Queued;
+  slot->boot = fromBoot;
+  slot->order = ++_prefetchOrder;
+  _prefetchStats.requested++;
+  xTaskNotifyGive(_prefetchTask);
+  return true;
+}
+
+void NVSConfigBus::dropPrefetched() {
+  NVSLockGuard guard(_lock);
+  for (size_t i = 0; i < NVS_CFG_MAX_PREFETCH; i++) {
+    PrefetchSlot& slot = _prefetch[i];
+    if (slot.state == PrefetchState::Reading) {
+      slot.cancelled = true;  // The task frees it when the read ends
+    } else if (slot.state != PrefetchState::Free) {
+      _prefetchStats.wasted += slot.state == PrefetchState::Ready ? 1 : 0;
+      releasePrefetchSlot(slot);
+    }
+  }
+}
+
+NVSPrefetchStats NVSConfigBus::prefetchStats() {
+  NVSLockGuard guard(_lock);
+  return _prefetchStats;
+}
+
+void NVSConfigBus::resetPrefetchStats() {
+  NVSLockGuard guard(_lock);
+  memset(&_prefetchStats, 0, sizeof(_prefetchStats));
+}
+
+void NVSConfigBus::prefetchTaskMain(void* arg) {
+  NVSConfigBus* bus = static_cast<NVSConfigBus*>(arg);
+  while (!bus->_prefetchStop) {
+    do {
+      bus->bootPrefetchStep();
+    } while (!bus->_prefetchStop && bus->prefetchNext());
+    ulTaskNotifyTake(pdTRUE, bus->bootWaitTicks());
+  }
+  bus->_prefetchTask = nullptr;  // Tells the destructor we are gone
+  vTaskDelete(nullptr);
+}
+
+bool NVSConfigBus::prefetchNext() {
+  size_t index = NVS_CFG_MAX_PREFETCH;
+  char moduleId[13];
+  {
+    NVSLockGuard guard(_lock);
+    for (size_t i = 0; i < NVS_CFG_MAX_PREFETCH; i++) {
+      if (_prefetch[i].state == PrefetchState::Queued &&
+          (index == NVS_CFG_MAX_PREFETCH || _prefetch[i].order < _prefetch[index].order)) {
+        index = i;
+      }
+    }
+    if (index == NVS_CFG_MAX_PREFETCH) {
+      return false;
+    }
+    _prefetch[index].state = PrefetchState::Reading;
+    memcpy(moduleId, _prefetch[index].moduleId, sizeof(moduleId));
+  }
+
+  // Read without holding the lock, so loads of other modules are not blocked
+  ModuleInfo info;
+  uint8_t* data = nullptr;
+  size_t reserved = 0;
+  size_t len = 0;
+  if (lookupModule(moduleId, info) == Lookup::Found && info.format == NVSModuleFormat::MsgPack) {
+    reserved = storedBytes(info);
+    if (_budget->acquire(reserved)) {
+      data = static_cast<uint8_t*>(_allocator->allocate(reserved, NVSMemoryClass::Cache));
+      if (data == nullptr) {
+        _budget->release(reserved);
+      }
+    }
+    if (data != nullptr) {
+      len = readModuleMsgPack(moduleId, data, reserved);
+    }
+  }
+
+  NVSLockGuard guard(_lock);
+  PrefetchSlot& slot = _prefetch[index];
+  ModuleInfo now;
+  bool current = len > 0 && lookupModule(moduleId, now) == Lookup::Found && sameStoredBlob(now, info);
+  if (slot.cancelled || !current) {
+    // A cancelled read was already counted as late by its load
+    if (!slot.cancelled) {
+      _prefetchStats.failed++;
+    }
+    if (data != nullptr) {
+      _allocator->deallocate(data, NVSMemoryClass::Cache);
+      _budget->release(reserved);
+    }
+    memset(&slot, 0, sizeof(slot));
+    return true;
+  }
+  slot.data = data;
+  slot.len = len;
+  slot.reserved = reserved;
+  slot.info = info;
+  slot.state = PrefetchState::Ready;
+  return true;
+}
+
+bool NVSConfigBus::takePrefetched(const char* moduleId, const ModuleInfo& info, JsonDocument& doc) {
+  uint8_t* data;
+  size_t len;
+  size_t reserved;
+  {
+    NVSLockGuard guard(_lock);
+    PrefetchSlot* slot = prefetchSlotOf(moduleId);
+    if (slot == nullptr) {
+      return false;
+    }
+    if (slot->state != PrefetchState::Ready) {
+      // Too late to help this load
+      _prefetchStats.late++;
+      if (slot->state == PrefetchState::Reading) {
+        slot->cancelled = true;
+      } else {
+        releasePrefetchSlot(*slot);
+      }
+      return false;
+    }
+    if (!sameStoredBlob(slot->info, info)) {
+      _prefetchStats.wasted++;  // Saved again since the read
+      releasePrefetchSlot(*slot);
+      return false;
+    }
+    // Take the blob out of the slot; deserializing happens without the lock
+    data = slot->data;
+    len = slot->len;
+    reserved = slot->reserved;
+    slot->data = nullptr;
+    releasePrefetchSlot(*slot);
+  }
+
+  bool loaded = !deserializeMsgPack(doc, data, len);
+  _allocator->deallocate(data, NVSMemoryClass::Cache);
+  _budget->release(reserved);
+
+  NVSLockGuard guard(_lock);
+  if (loaded) {
+    _prefetchStats.hits++;
+  } else {
+    _prefetchStats.wasted++;  // The regular load reports the error
+  }
+  return loaded;
+}
+
+NVSConfigBus::PrefetchSlot* NVSConfigBus::prefetchSlotOf(const char* moduleId) {
+  for (size_t i = 0; i < NVS_CFG_MAX_PREFETCH; i++) {
+    PrefetchSlot& slot = _prefetch[i];
+    // A cancelled read belongs to nobody: a new prefetch() gets its own slot
+    if (slot.state != PrefetchState::Free && !slot.cancelled && strcmp(slot.moduleId, moduleId) == 0) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+bool NVSConfigBus::sameStoredBlob(const ModuleInfo& a, const ModuleInfo& b) {
+  return a.generation == b.generation && a.format == b.format && a.size == b.size && a.crc == b.crc &&
+         a.hotSize == b.hotSize && a.journalSize == b.journalSize;
+}
+
+void NVSConfigBus::releasePrefetchSlot(PrefetchSlot& slot) {
+  if (slot.data != nullptr) {
+    _allocator->deallocate(slot.data, NVSMemoryClass::Cache);
+    _budget->release(slot.reserved);
+  }
+  memset(&slot, 0, sizeof(slot));
+  if (_prefetchTask != nullptr && _boot.next < _boot.count) {
+    xTaskNotifyGive(_prefetchTask);  // Room for the next module of the boot profile
+  }
+}
+
+bool NVSConfigBus::enableBootPrefetch(uint32_t windowMs) {
+  NVSLockGuard guard(_lock);
+  if (_boot.phase == 0) {
+    _boot.windowMs = windowMs;
+    _boot.phase = 1;
+  }
+  if (!startPrefetchTask()) {
+    _boot.phase = 0;
+    return false;
+  }
+  xTaskNotifyGive(_prefetchTask);
+  return true;
+}
+
+void NVSConfigBus::recordBootLoad(const char* moduleId) {
+  if (_boot.phase == 0 || _boot.phase == 3 || !bootWindowOpen(_boot.windowMs) || !isValidModuleId(moduleId)) {
+    return;
+  }
+  NVSLockGuard guard(_lock);
+  for (size_t i = 0; i < _boot.seenCount; i++) {
+    if (strcmp(_boot.seen[i], moduleId) == 0) {
+      return;  // Only the first load counts
+    }
+  }
+  if (_boot.seenCount < NVS_CFG_BOOT_PREFETCH_MODULES) {
+    strncpy(_boot.seen[_boot.seenCount], moduleId, sizeof(_boot.seen[0]) - 1);
+    _boot.seenCount++;
+  }
+}
+
+void NVSConfigBus::bootPrefetchStep() {
+  if (_boot.phase == 1) {
+    // Read the profile here rather than in enableBootPrefetch(), off the boot path
+    uint8_t raw[kBootRecordSize];
+    size_t len = 0;
+    Preferences prefs;
+    if (openShard(prefs, 0, true)) {
+      len = prefs.getBytesLength(kBootKey);
+      len = len <= sizeof(raw) ? prefs.getBytes(kBootKey, raw, len) : 0;
+      prefs.end();
+    }
+
+    NVSLockGuard guard(_lock);
+    _boot.count = 0;
+    if (len >= 2 && raw[0] == kBootVersion) {
+      size_t pos = 2;
+      for (uint8_t i = 0; i < raw[1] && _boot.count < NVS_CFG_BOOT_PREFETCH_MODULES; i++) {
+        if (pos + 2 > len || raw[pos + 1] >= sizeof(_boot.profile[0].moduleId) || pos + 2 + raw[pos + 1] > len) {
+          NVS_CFG_LOG("enableBootPrefetch: boot profile damaged, learning anew");
+          _boot.count = 0;
+          break;
+        }
+        BootEntry& entry = _boot.profile[_boot.count];
+        entry.score = raw[pos];
+        memcpy(entry.moduleId, raw + pos + 2, raw[pos + 1]);
+        entry.moduleId[raw[pos + 1]] = '\0';
+        pos += 2 + raw[pos + 1];
+        _boot.count += isValidModuleId(entry.moduleId) ? 1 : 0;
+      }
+    }
+    _boot.next = 0;
+    _boot.phase = 2;
+  }
+
+  if (_boot.phase != 2) {
+    return;
+  }
+  if (!bootWindowOpen(_boot.windowMs)) {
+    saveBootProfile();
+    // Modules not loaded by now are not needed at boot: free their RAM
+    NVSLockGuard guard(_lock);
+    _boot.next = _boot.count;
+    _boot.phase = 3;
+    for (size_t i = 0; i < NVS_CFG_MAX_PREFETCH; i++) {
+      PrefetchSlot& slot = _prefetch[i];
+      if (slot.boot && !slot.cancelled && slot.state != PrefetchState::Free) {
+        _prefetchStats.wasted++;
+        if (slot.state == PrefetchState::Reading) {
+          slot.cancelled = true;
+        } else {
+          releasePrefetchSlot(slot);
+        }
+      }
+    }
+    return;
+  }
+
+  // Fill free slots only: blobs waiting for their load are never evicted for
+  // modules the application needs later
+  NVSLockGuard guard(_lock);
+  while (_boot.next < _boot.count) {
+    const BootEntry& entry = _boot.profile[_boot.next];
+    if (entry.score >= kBootMinScore && !queuePrefetch(entry.moduleId, true)) {
+      break;
+    }
+    _boot.next++;
+  }
+}
+
+TickType_t NVSConfigBus::bootWaitTicks() const {
+  if (_boot.phase != 2) {
+    return _boot.phase == 1 ? 0 : portMAX_DELAY;
+  }
+  int64_t left = (int64_t)_boot.windowMs * 1000 - esp_timer_get_time();
+  return left > 0 ? pdMS_TO_TICKS(left / 1000) + 1 : 0;
+}
+
+void NVSConfigBus::saveBootProfile() {
+  BootEntry merged[NVS_CFG_BOOT_PREFETCH_MODULES];
+  size_t count = 0;
+  uint8_t before[kBootRecordSize];
+  uint8_t after[kBootRecordSize];
+  size_t beforeLen = 0;
+  size_t afterLen = 0;
+
+  auto encode = [](const BootEntry* entries, size_t n, uint8_t* out) {
+    size_t pos = 2;
+    out[0] = kBootVersion;
+    out[1] = (uint8_t)n;
+    for (size_t i = 0; i < n; i++) {
+      size_t idLen = strlen(entries[i].moduleId);
+      out[pos] = entries[i].score;
+      out[pos + 1] = (uint8_t)idLen;
+      memcpy(out + pos + 2, entries[i].moduleId, idLen);
+      pos += 2 + idLen;
+    }
+    return pos;
+  };
+
+  {
+    NVSLockGuard guard(_lock);
+    // This boot's loads first, in load order
+    for (size_t i = 0; i < _boot.seenCount; i++) {
+      uint8_t score = 0;
+      for (size_t j = 0; j < _boot.count; j++) {
+        if (strcmp(_boot.profile[j].moduleId, _boot.seen[i]) == 0) {
+          score = _boot.profile[j].score;
+        }
+      }
+      memcpy(merged[count].moduleId, _boot.seen[i], sizeof(merged[count].moduleId));
+      int raised = score + kBootHitScore;
+      merged[count].score = (uint8_t)(raised > 255 ? 255 : raised);
+      count++;
+    }
+    // Then the modules this boot did not load, decayed
+    for (size_t j = 0; j < _boot.count && count < NVS_CFG_BOOT_PREFETCH_MODULES; j++) {
+      bool seen = false;
+      for (size_t i = 0; i < _boot.seenCount && !seen; i++) {
+        seen = strcmp(_boot.profile[j].moduleId, _boot.seen[i]) == 0;
+      }
+      uint8_t score = _boot.profile[j].score / 2;
+      if (!seen && score >= kBootKeepScore) {
+        merged[count] = _boot.profile[j];
+        merged[count].score = score;
+        count++;
+      }
+    }
+    beforeLen = _boot.count > 0 ? encode(_boot.profile, _boot.count, before) : 0;
+    afterLen = count > 0 ? encode(merged, count, after) : 0;
+  }
+
+  // A stable boot sequence converges to the same record: nothing to write
+  if (afterLen == beforeLen && memcmp(before, after, afterLen) == 0) {
+    return;
+  }
+  Preferences prefs;
+  bool ok = openShard(prefs, 0, false);
+  if (ok) {
+    ok = afterLen > 0 ? prefs.putBytes(kBootKey, after, afterLen) == afterLen
+                      : (!prefs.isKey(kBootKey) || prefs.remove(kBootKey));
+    prefs.end();
+  }
+  if (!ok) {
+    NVS_CFG_LOG("enableBootPrefetch: boot profile not saved");
+  }
+}
@@ -0,0 +1,349 @@
+#include "NVSConfigBus.h"
+#include "NVSLock.h"
+#include <string.h>
+#include <sys/time.h>
+
+namespace {
+
+const uint32_t kRtcMagic = 0x4e435331;  // "NCS1"
+
+// Header in front of the entries; read and written with memcpy because the
+// caller's region need not be aligned
+struct RtcHeader {
+  uint32_t magic;
+  uint32_t owner;       ///< Hash of partition and namespace
+  uint32_t generation;  ///< Bus generation the clean entries belong to
+  uint16_t used;        ///< Bytes of entries behind the header
+  uint16_t reserved;
+  uint32_t crc;         ///< CRC-32 of the entries
+};
+
+const size_t kRtcHeaderSize = sizeof(RtcHeader);
+
+// Entry: [id length 1][flags 1][dirty since 4][id][blob length 2][blob],
+// integers little endian
+const size_t kRtcEntryOverhead = 8;
+const uint8_t kRtcDirty = 0x01;  ///< Newer than NVS (volatile module): kept across generations
+
+uint32_t ownerHash(const char* partition, const char* ns) {
+  uint32_t hash = 2166136261u;
+  for (const char* c = partition; *c != '\0'; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  hash = (hash ^ (uint8_t)'/') * 16777619u;
+  for (const char* c = ns; *c != '\0'; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  return hash;
+}
+
+size_t blobLen(const uint8_t* entry) {
+  const uint8_t* p = entry + 6 + entry[0];
+  return (size_t)p[0] | ((size_t)p[1] << 8);
+}
+
+size_t entryLen(const uint8_t* entry) {
+  return kRtcEntryOverhead + entry[0] + blobLen(entry);
+}
+
+uint32_t entrySince(const uint8_t* entry) {
+  return (uint32_t)entry[2] | ((uint32_t)entry[3] << 8) | ((uint32_t)entry[4] << 16) | ((uint32_t)entry[5] << 24);
+}
+
+// Seconds from the RTC timer, which (unlike millis()) keeps counting in deep sleep
+uint32_t rtcClock() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (uint32_t)tv.tv_sec;
+}
+
+}  // namespace
+
+bool NVSConfigBus::enableRtcSnapshot(uint8_t* region, size_t size) {
+  NVSLockGuard guard(_lock);
+  if (region != nullptr && (size <= kRtcHeaderSize || size - kRtcHeaderSize > 0xffff)) {
+    NVS_CFG_LOG("enableRtcSnapshot: region must hold 21..65555 bytes");
+    return false;
+  }
+  _rtc = region;
+  _rtcSize = region != nullptr ? size : 0;
+  _rtcChecked = false;
+  return true;
+}
+
+bool NVSConfigBus::setPersistence(const char* moduleId, NVSPersistence mode, uint32_t flushInterval) {
+  if (!isValidModuleId(moduleId)) {
+    NVS_CFG_LOG("setPersistence: invalid moduleId");
+    return false;
+  }
+
+  {
+    NVSLockGuard guard(_lock);
+    PersistenceConfig* entry = nullptr;
+    for (size_t i = 0; i < NVS_CFG_MAX_VOLATILE_MODULES; i++) {
+      if (strcmp(_persistence[i].moduleId, moduleId) == 0) {
+        entry = &_persistence[i];
+        break;
+      }
+      if (entry == nullptr && _persistence[i].moduleId[0] == '\0') {
+        entry = &_persistence[i];
+      }
+    }
+
+    if (mode != NVSPersistence::Nvs) {
+      if (entry == nullptr) {
+        NVS_CFG_LOG("setPersistence: too many modules (raise NVS_CFG_MAX_VOLATILE_MODULES)");
+        return false;
+      }
+      strcpy(entry->moduleId, moduleId);
+      entry->mode = mode;
+      entry->flushInterval = flushInterval;
+      return true;
+    }
+    if (entry != nullptr && strcmp(entry->moduleId, moduleId) == 0) {
+      memset(entry, 0, sizeof(*entry));
+    }
+  }
+  // Unflushed state would otherwise only live in RTC memory
+  return flushVolatileModule(moduleId);
+}
+
+const NVSConfigBus::PersistenceConfig* NVSConfigBus::persistenceOf(const char* moduleId) const {
+  for (size_t i = 0; i < NVS_CFG_MAX_VOLATILE_MODULES; i++) {
+    if (_persistence[i].moduleId[0] != '\0' && strcmp(_persistence[i].moduleId, moduleId) == 0) {
+      return &_persistence[i];
+    }
+  }
+  return nullptr;
+}
+
+NVSConfigBus::VolatileSave NVSConfigBus::saveVolatile(const char* moduleId, const PersistenceConfig& config,
+                                                      const uint8_t* buf, size_t len) {
+  NVSLockGuard guard(_lock);
+  if (!rtcReady()) {
+    if (config.mode == NVSPersistence::RtcOnly) {
+      NVS_CFG_LOG("saveModuleConfigMsgPack: RTC-only module needs enableRtcSnapshot()");
+      return VolatileSave::Failed;
+    }
+    return VolatileSave::WriteThrough;
+  }
+
+  // The flush interval counts from the first change NVS has not seen yet
+  uint32_t now = rtcClock();
+  const uint8_t* data;
+  size_t dataLen;
+  bool dirty = false;
+  uint32_t since = now;
+  if (!rtcFind(moduleId, data, dataLen, &dirty, &since) || !dirty) {
+    since = now;
+  }
+  if (config.mode == NVSPersistence::RtcDeferred && now - since >= config.flushInterval) {
+    return VolatileSave::WriteThrough;  // Due: this save goes to NVS
+  }
+  if (!rtcPut(moduleId, buf, len, true, since)) {
+    if (config.mode == NVSPersistence::RtcOnly) {
+      NVS_CFG_LOG("saveModuleConfigMsgPack: RTC snapshot region full");
+      return VolatileSave::Failed;
+    }
+    return VolatileSave::WriteThrough;
+  }
+  return VolatileSave::Saved;
+}
+
+bool NVSConfigBus::flushVolatile(bool force) {
+  _lastError = NVSConfigError::None;
+  bool ok = true;
+  for (size_t i = 0; i < NVS_CFG_MAX_VOLATILE_MODULES; i++) {
+    PersistenceConfig config = _persistence[i];
+    ok = flushVolatileDue(config, force) != MaintenanceStep::Failed && ok;
+  }
+  return ok;
+}
+
+NVSConfigBus::MaintenanceStep NVSConfigBus::flushVolatileDue(const PersistenceConfig& config, bool force) {
+  const uint8_t* data;
+  size_t len;
+  bool dirty;
+  uint32_t since;
+  if (config.moduleId[0] == '\0' || config.mode != NVSPersistence::RtcDeferred ||
+      !rtcFind(config.moduleId, data, len, &dirty, &since) || !dirty ||
+      (!force && rtcClock() - since < config.flushInterval)) {
+    return MaintenanceStep::Idle;
+  }
+  return flushVolatileModule(config.moduleId) ? MaintenanceStep::Worked : MaintenanceStep::Failed;
+}
+
+bool NVSConfigBus::flushVolatileModule(const char* moduleId) {
+  const uint8_t* data;
+  size_t len;
+  bool dirty;
+  uint32_t since;
+  if (!rtcFind(moduleId, data, len, &dirty, &since) || !dirty) {
+    return true;
+  }
+
+  // Room for splitting hot fields or building a journal record behind the
+  // blob, plus a copy to put back if the write fails. Allocated outside the
+  // lock, so the entry is looked up again
+  const size_t workSize = 2 * len + 8;
+  NVSScratchBuffer scratch(*_budget, *_allocator, workSize + len);
+  if (!scratch) {
+    _lastError = scratch.error();
+    return false;
+  }
+  uint8_t* backup = scratch.data() + workSize;
+  {
+    NVSLockGuard guard(_lock);
+    size_t current;
+    if (!rtcFind(moduleId, data, current, &dirty, &since) || !dirty || current != len) {
+      return true;  // Saved or cleared meanwhile (a resized entry waits for the next flush)
+    }
+    memcpy(scratch.data(), data, len);
+    memcpy(backup, data, len);
+  }
+  if (!writeModuleBlob(moduleId, scratch.data(), len, workSize)) {
+    rtcPut(moduleId, backup, len, true, since);
+    _lastError = NVSConfigError::WriteFailed;
+    return false;
+  }
+  return true;
+}
+
+bool NVSConfigBus::rtcReady() {
+  NVSLockGuard guard(_lock);
+  if (_rtc == nullptr) {
+    return false;
+  }
+  if (_rtcChecked) {
+    return true;
+  }
+  _rtcChecked = true;
+
+  RtcHeader header;
+  memcpy(&header, _rtc, kRtcHeaderSize);
+  uint32_t current = generation();
+  if (header.magic != kRtcMagic || header.owner != ownerHash(_partition, _namespace) ||
+      header.used > _rtcSize - kRtcHeaderSize || header.crc != crc32(_rtc + kRtcHeaderSize, header.used)) {
+    rtcReset(current);  // Power-on (or another bus's region): nothing to keep
+  } else if (header.generation != current) {
+    rtcReset(current, true);  // NVS changed meanwhile; volatile modules are still newer
+  }
+  return true;
+}
+
+bool NVSConfigBus::rtcFind(const char* moduleId, const uint8_t*& data, size_t& len, bool* dirty,
+                           uint32_t* dirtySince) {
+  NVSLockGuard guard(_lock);
+  if (!rtcReady()) {
+    return false;
+  }
+  RtcHeader header;
+  memcpy(&header, _rtc, kRtcHeaderSize);
+  size_t idLen = strlen(moduleId);
+  const uint8_t* p = _rtc + kRtcHeaderSize;
+  const uint8_t* end = p + header.used;
+  while (p < end) {
+    if (p[0] == idLen && memcmp(p + 6, moduleId, idLen) == 0) {
+      data = p + kRtcEntryOverhead + idLen;
+      len = blobLen(p);
+      if (dirty != nullptr) {
+        *dirty = (p[1] & kRtcDirty) != 0;
+      }
+      if (dirtySince != nullptr) {
+        *dirtySince = entrySince(p);
+      }
+      return true;
+    }
+    p += entryLen(p);
+  }
+  return false;
+}
+
+bool NVSConfigBus::rtcRemove(const char* moduleId) {
+  NVSLockGuard guard(_lock);
+  const uint8_t* data;
+  size_t len;
+  if (!rtcFind(moduleId, data, len)) {
+    return false;
+  }
+  RtcHeader header;
+  memcpy(&header, _rtc, kRtcHeaderSize);
+  uint8_t* entry = const_cast<uint8_t*>(data) - kRtcEntryOverhead - strlen(moduleId);
+  size_t removed = entryLen(entry);
+  uint8_t* end = _rtc + kRtcHeaderSize + header.used;
+  memmove(entry, entry + removed, (size_t)(end - entry - removed));
+  header.used = (uint16_t)(header.used - removed);
+  header.crc = crc32(_rtc + kRtcHeaderSize, header.used);
+  memcpy(_rtc, &header, kRtcHeaderSize);
+  return true;
+}
+
+bool NVSConfigBus::rtcPut(const char* moduleId, const uint8_t* data, size_t len, bool dirty, uint32_t dirtySince) {
+  NVSLockGuard guard(_lock);
+  rtcRemove(moduleId);
+  if (!rtcReady()) {
+    return false;
+  }
+  RtcHeader header;
+  memcpy(&header, _rtc, kRtcHeaderSize);
+  size_t idLen = strlen(moduleId);
+  size_t needed = kRtcEntryOverhead + idLen + len;
+  if (len > 0xffff || header.used + needed > _rtcSize - kRtcHeaderSize) {
+    return false;  // Does not fit: the module keeps loading from NVS
+  }
+  uint8_t* entry = _rtc + kRtcHeaderSize + header.used;
+  entry[0] = (uint8_t)idLen;
+  entry[1] = dirty ? kRtcDirty : 0;
+  entry[2] = (uint8_t)dirtySince;
+  entry[3] = (uint8_t)(dirtySince >> 8);
+  entry[4] = (uint8_t)(dirtySince >> 16);
+  entry[5] = (uint8_t)(dirtySince >> 24);
+  memcpy(entry + 6, moduleId, idLen);
+  entry[6 + idLen] = (uint8_t)len;
+  entry[7 + idLen] = (uint8_t)(len >> 8);
+  memcpy(entry + kRtcEntryOverhead + idLen, data, len);
+  header.used = (uint16_t)(header.used + needed);
+  header.crc = crc32(_rtc + kRtcHeaderSize, header.used);
+  memcpy(_rtc, &header, kRtcHeaderSize);
+  return true;
+}
+
+void NVSConfigBus::rtcReset(uint32_t generation, bool keepDirty) {
+  NVSLockGuard guard(_lock);
+  if (_rtc == nullptr) {
+    return;
+  }
+  size_t used = 0;
+  if (keepDirty && rtcReady()) {
+    // Compact the dirty entries to the front of a validated region
+    RtcHeader header;
+    memcpy(&header, _rtc, kRtcHeaderSize);
+    uint8_t* p = _rtc + kRtcHeaderSize;
+    uint8_t* end = p + header.used;
+    uint8_t* write = p;
+    while (p < end) {
+      size_t len = entryLen(p);
+      if ((p[1] & kRtcDirty) != 0) {
+        memmove(write, p, len);
+        write += len;
+      }
+      p += len;
+    }
+    used = (size_t)(write - (_rtc + kRtcHeaderSize));
+  }
+  RtcHeader header = {kRtcMagic, ownerHash(_partition, _namespace), generation, (uint16_t)used, 0,
+                      crc32(_rtc + kRtcHeaderSize, used)};
+  memcpy(_rtc, &header, kRtcHeaderSize);
+  _rtcChecked = true;
+}
+
+void NVSConfigBus::rtcSetGeneration(uint32_t generation) {
+  NVSLockGuard guard(_lock);
+  if (!rtcReady()) {
+    return;
+  }
+  RtcHeader header;
+  memcpy(&header, _rtc, kRtcHeaderSize);
+  header.generation = generation;
+  memcpy(_rtc, &header, kRtcHeaderSize);
+}
@@ -0,0 +1,210 @@
+#include "NVSConfigBus.h"
+#include "NVSKeyIterator.h"
+#include "NVSLock.h"
+#include <nvs_flash.h>
+#include <string.h>
+
+namespace {
+
+// Misplaced keys collected per pass; the iterator is closed before they move
+const size_t kMoveBatch = 16;
+
+struct PendingKey {
+  char key[16];
+  nvs_type_t type;
+  uint8_t target;
+};
+
+// moduleId a key belongs to: the part before ':' (all module keys), nothing
+// for the reserved "__" bookkeeping keys
+bool moduleIdOfKey(const char* key, char* idBuf, size_t idBufSize) {
+  if (key[0] == '_' && key[1] == '_') {
+    return false;
+  }
+  const char* colon = strchr(key, ':');
+  size_t idLen = colon != nullptr ? (size_t)(colon - key) : strlen(key);
+  if (idLen == 0 || idLen + 1 > idBufSize) {
+    return false;
+  }
+  memcpy(idBuf, key, idLen);
+  idBuf[idLen] = '\0';
+  return true;
+}
+
+// Copy one entry of any NVS type between two open handles (no commit)
+bool copyEntry(nvs_handle_t from, nvs_handle_t to, const char* key, nvs_type_t type, NVSScratchBuffer& buf) {
+  switch (type) {
+    case NVS_TYPE_U8: { uint8_t v; return nvs_get_u8(from, key, &v) == ESP_OK && nvs_set_u8(to, key, v) == ESP_OK; }
+    case NVS_TYPE_I8: { int8_t v; return nvs_get_i8(from, key, &v) == ESP_OK && nvs_set_i8(to, key, v) == ESP_OK; }
+    case NVS_TYPE_U16: { uint16_t v; return nvs_get_u16(from, key, &v) == ESP_OK && nvs_set_u16(to, key, v) == ESP_OK; }
+    case NVS_TYPE_I16: { int16_t v; return nvs_get_i16(from, key, &v) == ESP_OK && nvs_set_i16(to, key, v) == ESP_OK; }
+    case NVS_TYPE_U32: { uint32_t v; return nvs_get_u32(from, key, &v) == ESP_OK && nvs_set_u32(to, key, v) == ESP_OK; }
+    case NVS_TYPE_I32: { int32_t v; return nvs_get_i32(from, key, &v) == ESP_OK && nvs_set_i32(to, key, v) == ESP_OK; }
+    case NVS_TYPE_U64: { uint64_t v; return nvs_get_u64(from, key, &v) == ESP_OK && nvs_set_u64(to, key, v) == ESP_OK; }
+    case NVS_TYPE_I64: { int64_t v; return nvs_get_i64(from, key, &v) == ESP_OK && nvs_set_i64(to, key, v) == ESP_OK; }
+    case NVS_TYPE_STR: {
+      size_t len = 0;  // Includes the terminator
+      return nvs_get_str(from, key, nullptr, &len) == ESP_OK && buf.grow(len) &&
+             nvs_get_str(from, key, (char*)buf.data(), &len) == ESP_OK &&
+             nvs_set_str(to, key, (const char*)buf.data()) == ESP_OK;
+    }
+    case NVS_TYPE_BLOB: {
+      size_t len = 0;
+      return nvs_get_blob(from, key, nullptr, &len) == ESP_OK && buf.grow(len > 0 ? len : 1) &&
+             nvs_get_blob(from, key, buf.data(), &len) == ESP_OK &&
+             nvs_set_blob(to, key, buf.data(), len) == ESP_OK;
+    }
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+uint8_t NVSConfigBus::shardOf(const char* moduleId) const {
+  if (_shards <= 1) {
+    return 0;
+  }
+  // FNV-1a: stable across builds and platforms, so the layout survives updates
+  uint32_t hash = 2166136261u;
+  for (const char* c = moduleId; *c != '\0'; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  return (uint8_t)(hash % _shards);
+}
+
+const char* NVSConfigBus::shardNamespace(uint8_t shard, char* buf) const {
+  if (shard == 0) {
+    return _namespace;
+  }
+  snprintf(buf, kNamespaceBufSize, "%s.%x", _namespace, (unsigned)shard);
+  return buf;
+}
+
+bool NVSConfigBus::ensurePartition() {
+  NVSLockGuard guard(_lock);
+  if (_partitionReady) {
+    return true;
+  }
+  // Never erase here: a partition that needs erasing still holds config
+  esp_err_t err = nvs_flash_init_partition(_partition);
+  if (err != ESP_OK) {
+    char msg[80];
+    snprintf(msg, sizeof(msg), "ensurePartition: cannot mount '%s' (error 0x%x)", _partition, (unsigned)err);
+    NVS_CFG_LOG(msg);
+    return false;
+  }
+  _partitionReady = true;
+  return true;
+}
+
+bool NVSConfigBus::openShard(Preferences& prefs, uint8_t shard, bool readOnly) {
+  char ns[kNamespaceBufSize];
+  return ensurePartition() && prefs.begin(shardNamespace(shard, ns), readOnly, _partition);
+}
+
+bool NVSConfigBus::openShardHandle(uint8_t shard, nvs_open_mode_t mode, nvs_handle_t& handle) {
+  char ns[kNamespaceBufSize];
+  return ensurePartition() &&
+         nvs_open_from_partition(_partition, shardNamespace(shard, ns), mode, &handle) == ESP_OK;
+}
+
+bool NVSConfigBus::setShards(uint8_t count) {
+  if (count == 0 || count > NVS_CFG_MAX_SHARDS) {
+    NVS_CFG_LOG("setShards: invalid shard count");
+    return false;
+  }
+  if (count > 1 && strlen(_namespace) + 2 >= kNamespaceBufSize) {
+    NVS_CFG_LOG("setShards: namespace too long for derived shard names (max 13 chars)");
+    return false;
+  }
+  _shards = count;
+  invalidateDirectory();
+  return true;
+}
+
+bool NVSConfigBus::rebalance() {
+  _lastError = NVSConfigError::None;
+
+  // Nothing to do if the stored layout already uses this shard count
+  // (stores written before sharding existed use one namespace)
+  Preferences base;
+  uint8_t layout = 1;
+  if (openShard(base, 0, true)) {
+    layout = base.getUChar(kShardsKey, 1);
+    base.end();
+  }
+  if (layout == _shards) {
+    return true;
+  }
+
+  NVSScratchBuffer buf(*_budget, *_allocator);
+  PendingKey pending[kMoveBatch];
+  char ns[kNamespaceBufSize];
+  char moduleId[16];
+  size_t moved = 0;
+  bool ok = true;
+
+  // Every possible shard, so leftovers of an interrupted rebalance are found too
+  for (uint8_t shard = 0; ok && shard < NVS_CFG_MAX_SHARDS; shard++) {
+    for (;;) {
+      size_t count = 0;
+      {
+        NVSKeyIterator it(_partition, shardNamespace(shard, ns));
+        while (count < kMoveBatch && it.next()) {
+          if (!moduleIdOfKey(it.key(), moduleId, sizeof(moduleId))) {
+            continue;
+          }
+          uint8_t target = shardOf(moduleId);
+          if (target != shard) {
+            strncpy(pending[count].key, it.key(), sizeof(pending[count].key) - 1);
+            pending[count].key[sizeof(pending[count].key) - 1] = '\0';
+            pending[count].type = it.type();
+            pending[count].target = target;
+            count++;
+          }
+        }
+      }
+      if (count == 0) {
+        break;
+      }
+
+      nvs_handle_t from;
+      if (!openShardHandle(shard, NVS_READWRITE, from)) {
+        ok = false;
+        break;
+      }
+      for (size_t i = 0; ok && i < count; i++) {
+        // Copy and commit before erasing, so a power loss leaves a duplicate
+        // (resolved by the next rebalance) rather than losing the key
+        nvs_handle_t to;
+        ok = openShardHandle(pending[i].target, NVS_READWRITE, to);
+        if (ok) {
+          ok = copyEntry(from, to, pending[i].key, pending[i].type, buf) && nvs_commit(to) == ESP_OK;
+          nvs_close(to);
+        }
+        ok = ok && nvs_erase_key(from, pending[i].key) == ESP_OK && nvs_commit(from) == ESP_OK;
+        moved += ok ? 1 : 0;
+      }
+      nvs_close(from);
+    }
+  }
+  buf.release();
+  invalidateDirectory();  // Rebuilt from the new layout on next use
+
+  if (ok && openShard(base, 0, false)) {
+    ok = base.putUChar(kShardsKey, _shards) == 1;
+    base.end();
+  } else {
+    ok = false;
+  }
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "rebalance: moved %u keys to %u shards", (unsigned)moved, (unsigned)_shards);
+  NVS_CFG_LOG(msg);
+  if (!ok) {
+    NVS_CFG_LOG("rebalance: failed, call again to resume");
+    _lastError = buf.error() != NVSConfigError::None ? buf.error() : NVSConfigError::WriteFailed;
+  }
+  return ok;
+}
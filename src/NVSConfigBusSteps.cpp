@@ -0,0 +1,254 @@
+#include "NVSConfigBus.h"
+#include "NVSKeyIterator.h"
+#include "NVSMsgPack.h"
+#include <esp_timer.h>
+#include <string.h>
+
+namespace {
+
+// Operations a cursor can belong to (NVSCursor::op)
+const uint8_t kOpClear = 1;
+const uint8_t kOpExport = 2;
+const uint8_t kOpMigrate = 3;
+
+// Keys collected per iterator pass; the iterator is closed before they are erased
+const size_t kEraseBatch = 16;
+
+bool budgetUsed(int64_t start, uint32_t budgetMicros) {
+  return esp_timer_get_time() - start >= (int64_t)budgetMicros;
+}
+
+// Take a fresh cursor for `op`; false if it belongs to another operation
+bool claimCursor(NVSCursor& cursor, uint8_t op) {
+  if (cursor.op == 0) {
+    memset(&cursor, 0, sizeof(cursor));
+    cursor.op = op;
+  }
+  return cursor.op == op;
+}
+
+NVSStepResult finish(NVSCursor& cursor, NVSStepResult result) {
+  memset(&cursor, 0, sizeof(cursor));
+  return result;
+}
+
+void rememberId(NVSCursor& cursor, const char* moduleId) {
+  strncpy(cursor.lastId, moduleId, sizeof(cursor.lastId) - 1);
+  cursor.lastId[sizeof(cursor.lastId) - 1] = '\0';
+}
+
+}  // namespace
+
+NVSStepResult NVSConfigBus::clearAllStep(NVSCursor& cursor, uint32_t budgetMicros) {
+  _lastError = NVSConfigError::None;
+  if (!claimCursor(cursor, kOpClear)) {
+    _lastError = NVSConfigError::InvalidArgument;
+    return NVSStepResult::Failed;
+  }
+  const int64_t start = esp_timer_get_time();
+
+  // Lookups probe NVS while the namespace is partially cleared
+  invalidateDirectory();
+  if (!ensurePartition()) {
+    NVS_CFG_LOG("clearAllStep: partition unavailable");
+    _lastError = NVSConfigError::NamespaceUnavailable;
+    return finish(cursor, NVSStepResult::Failed);
+  }
+
+  // Phase p clears shard (p + 1) % NVS_CFG_MAX_SHARDS: every derived shard
+  // namespace first (leftovers of another shard count too), the bus namespace last
+  char ns[kNamespaceBufSize];
+  char keys[kEraseBatch][16];
+  while (cursor.phase < NVS_CFG_MAX_SHARDS) {
+    uint8_t shard = (uint8_t)((cursor.phase + 1) % NVS_CFG_MAX_SHARDS);
+    size_t count = 0;
+    {
+      NVSKeyIterator it(_partition, shardNamespace(shard, ns));
+      while (count < kEraseBatch && it.next()) {
+        // Bookkeeping keys stay until the clear completes, so the generation
+        // counter is never lost halfway
+        if (shard == 0 && (strcmp(it.key(), kGenerationKey) == 0 || strcmp(it.key(), kResetKey) == 0 ||
+                           strcmp(it.key(), kShardsKey) == 0)) {
+          continue;
+        }
+        strncpy(keys[count], it.key(), sizeof(keys[count]) - 1);
+        keys[count][sizeof(keys[count]) - 1] = '\0';
+        count++;
+      }
+    }
+    if (count == 0) {
+      cursor.phase++;
+      continue;
+    }
+
+    nvs_handle_t handle;
+    if (!openShardHandle(shard, NVS_READWRITE, handle)) {
+      NVS_CFG_LOG("clearAllStep: failed to open namespace");
+      _lastError = NVSConfigError::NamespaceUnavailable;
+      return finish(cursor, NVSStepResult::Failed);
+    }
+    bool ok = true;
+    bool outOfTime = false;
+    for (size_t i = 0; ok && !outOfTime && i < count; i++) {
+      esp_err_t err = nvs_erase_key(handle, keys[i]);
+      ok = err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND;
+      outOfTime = budgetUsed(start, budgetMicros);
+    }
+    ok = nvs_commit(handle) == ESP_OK && ok;
+    nvs_close(handle);
+    if (!ok) {
+      NVS_CFG_LOG("clearAllStep: erase failed");
+      _lastError = NVSConfigError::WriteFailed;
+      return finish(cursor, NVSStepResult::Failed);
+    }
+    if (outOfTime) {
+      return NVSStepResult::Pending;
+    }
+  }
+
+  // Every key is gone: same bookkeeping as clearAll(). The generation is read
+  // only now, so saves made while the clear ran cannot make it go backwards.
+  Preferences prefs;
+  if (!openShard(prefs, 0, false)) {
+    NVS_CFG_LOG("clearAllStep: failed to open Preferences namespace");
+    _lastError = NVSConfigError::NamespaceUnavailable;
+    return finish(cursor, NVSStepResult::Failed);
+  }
+  uint32_t generation = prefs.getUInt(kGenerationKey, 0) + 1;
+  bool ok = prefs.putUInt(kGenerationKey, generation) == sizeof(uint32_t) &&
+            prefs.putUInt(kResetKey, generation) == sizeof(uint32_t);
+  prefs.end();
+  if (!ok) {
+    NVS_CFG_LOG("clearAllStep: generation not stored");
+    _lastError = NVSConfigError::WriteFailed;
+    rtcReset(0);
+    return finish(cursor, NVSStepResult::Failed);
+  }
+  rtcReset(generation);
+  resetDirectory();
+  return finish(cursor, NVSStepResult::Done);
+}
+
+NVSStepResult NVSConfigBus::exportAllStep(Print& out, NVSExportFormat format, NVSCursor& cursor,
+                                          uint32_t budgetMicros) {
+  _lastError = NVSConfigError::None;
+  if (!claimCursor(cursor, kOpExport)) {
+    _lastError = NVSConfigError::InvalidArgument;
+    return NVSStepResult::Failed;
+  }
+  const int64_t start = esp_timer_get_time();
+  if (!ensureDirectory()) {
+    _lastError = NVSConfigError::OutOfMemory;
+    return finish(cursor, NVSStepResult::Failed);
+  }
+
+  DirectoryEntry entry;
+  bool ok = true;
+  if (cursor.phase == 0) {
+    // Map header; MessagePack needs the element count up front
+    if (format == NVSExportFormat::MsgPack) {
+      for (size_t i = 0; directoryEntryAt(i, entry); i++) {
+        cursor.count += entry.info.format != NVSModuleFormat::None ? 1 : 0;
+      }
+      uint8_t header[5];
+      size_t len = NVSMsgPack::encodeMapHeader(cursor.count, header);
+      ok = out.write(header, len) == len;
+    } else {
+      ok = out.write((const uint8_t*)"{", 1) == 1;
+    }
+    cursor.phase = 1;
+  }
+
+  // Per-call state: namespaces and the read buffer are released between calls
+  Preferences prefs[NVS_CFG_MAX_SHARDS];
+  int8_t opened[NVS_CFG_MAX_SHARDS] = {};
+  NVSScratchBuffer buf(*_budget, *_allocator);
+  NVSConfigError readError = NVSConfigError::None;
+  bool more = false;
+  bool changed = false;
+
+  while (ok) {
+    // Resume after the last module written; tombstones are not exported
+    bool found = directoryEntryAfter(cursor.lastId, entry);
+    while (found && entry.info.format == NVSModuleFormat::None) {
+      found = directoryEntryAfter(entry.moduleId, entry);
+    }
+    if (found && format == NVSExportFormat::MsgPack && cursor.count == 0) {
+      changed = true;  // More modules than the header announced
+      break;
+    }
+    if (!found) {
+      changed = format == NVSExportFormat::MsgPack && cursor.count != 0;
+      break;
+    }
+    ok = writeModuleEntry(out, format, entry, cursor.lastId[0] == '\0', prefs, opened, buf, readError);
+    rememberId(cursor, entry.moduleId);
+    cursor.count -= cursor.count > 0 ? 1 : 0;
+    if (readError != NVSConfigError::None && cursor.error == 0) {
+      cursor.error = (uint8_t)readError;
+    }
+    if (ok && budgetUsed(start, budgetMicros)) {
+      more = true;
+      break;
+    }
+  }
+  buf.release();
+  for (uint8_t shard = 0; shard < NVS_CFG_MAX_SHARDS; shard++) {
+    if (opened[shard] == 1) {
+      prefs[shard].end();
+    }
+  }
+
+  if (ok && more) {
+    return NVSStepResult::Pending;
+  }
+  if (ok && changed) {
+    NVS_CFG_LOG("exportAllStep: modules added or removed during the export");
+    _lastError = NVSConfigError::ConcurrentChange;
+    return finish(cursor, NVSStepResult::Failed);
+  }
+  if (ok && format == NVSExportFormat::Json) {
+    ok = out.write((const uint8_t*)"}", 1) == 1;
+  }
+  if (!ok) {
+    NVS_CFG_LOG("exportAllStep: write to output failed");
+    _lastError = NVSConfigError::WriteFailed;
+    return finish(cursor, NVSStepResult::Failed);
+  }
+  _lastError = (NVSConfigError)cursor.error;
+  return finish(cursor, cursor.error == 0 ? NVSStepResult::Done : NVSStepResult::Failed);
+}
+
+NVSStepResult NVSConfigBus::migrateAllStep(NVSCursor& cursor, uint32_t budgetMicros) {
+  _lastError = NVSConfigError::None;
+  if (!claimCursor(cursor, kOpMigrate)) {
+    _lastError = NVSConfigError::InvalidArgument;
+    return NVSStepResult::Failed;
+  }
+  const int64_t start = esp_timer_get_time();
+  if (!ensureDirectory()) {
+    _lastError = NVSConfigError::OutOfMemory;
+    return finish(cursor, NVSStepResult::Failed);
+  }
+
+  DirectoryEntry entry;
+  while (directoryEntryAfter(cursor.lastId, entry)) {
+    _lastError = NVSConfigError::None;
+    MaintenanceStep step = tidyModule(entry);
+    if (step == MaintenanceStep::Worked && lookupModule(entry.moduleId, entry.info) == Lookup::Found &&
+        entry.info.legacyCopy) {
+      step = tidyModule(entry);  // Migrated just now: drop the JSON copy too
+    }
+    if (step == MaintenanceStep::Failed && cursor.error == 0) {
+      cursor.error = (uint8_t)(_lastError != NVSConfigError::None ? _lastError : NVSConfigError::ParseError);
+    }
+    rememberId(cursor, entry.moduleId);
+    if (budgetUsed(start, budgetMicros)) {
+      _lastError = NVSConfigError::None;
+      return NVSStepResult::Pending;
+    }
+  }
+
+  _lastError = (NVSConfigError)cursor.error;
+  return finish(cursor, cursor.error == 0 ? NVSStepResult::Done : NVSStepResult::Failed);
+}
@@ -0,0 +1,699 @@
+#include "NVSConfigBus.h"
+#include "NVSKeyIterator.h"
+#include "NVSMsgPack.h"
+#include <ctype.h>
+#include <nvs.h>
+#include <string.h>
+
+namespace {
+
+// Outcome of exporting a single module
+enum class ExportResult {
+  Written,      // Module value written
+  Unreadable,   // Module skipped, null written in its place
+  WriteFailed   // Output broke, abort the export
+};
+
+bool writeAll(Print& out, const uint8_t* data, size_t len) {
+  return out.write(data, len) == len;
+}
+
+bool writeAll(Print& out, const char* s) {
+  return writeAll(out, (const uint8_t*)s, strlen(s));
+}
+
+// Write one module's value from its stored bytes (len 0: unreadable, written as null)
+ExportResult writeModuleValue(const uint8_t* data, size_t len, bool isMsgPack, Print& out,
+                              NVSExportFormat format) {
+  const uint8_t nil = 0xc0;
+  bool valid = len > 0;
+  if (valid && isMsgPack) {
+    // Validate first so a corrupt blob cannot leave half a value in the output
+    valid = NVSMsgPack::validate(data, len);
+  }
+
+  if (!valid) {
+    bool ok = format == NVSExportFormat::Json ? writeAll(out, "null") : writeAll(out, &nil, 1);
+    return ok ? ExportResult::Unreadable : ExportResult::WriteFailed;
+  }
+
+  bool ok;
+  if (format == NVSExportFormat::Json) {
+    ok = isMsgPack ? NVSMsgPack::toJson(data, len, out) : writeAll(out, data, len);
+  } else if (isMsgPack) {
+    ok = writeAll(out, data, len);
+  } else {
+    // Legacy JSON into MessagePack output: the only path that needs a document
+    DynamicJsonDocument doc(NVS_CFG_MAX_MODULE_SIZE);
+    if (deserializeJson(doc, data, len)) {
+      return writeAll(out, &nil, 1) ? ExportResult::Unreadable : ExportResult::WriteFailed;
+    }
+    ok = serializeMsgPack(doc, out) > 0;
+  }
+  return ok ? ExportResult::Written : ExportResult::WriteFailed;
+}
+
+// Read one module's stored bytes and write its value to `out`
+ExportResult exportModuleValue(Preferences& prefs, const char* key, bool isMsgPack, bool isString,
+                               NVSScratchBuffer& buf, Print& out, NVSExportFormat format) {
+  size_t len = 0;
+
+  if (isString) {
+    // Legacy JSON stored as NVS string: read into the buffer, no String allocation.
+    // Strings have no length query in Preferences, so use the same bound as loadModuleConfig()
+    if (!buf.grow(NVS_CFG_MAX_MODULE_SIZE)) {
+      return ExportResult::Unreadable;
+    }
+    len = prefs.getString(key, (char*)buf.data(), buf.size());
+    if (len > 0) {
+      len--;  // Returned length includes the terminator
+    }
+  } else {
+    size_t storedLen = prefs.getBytesLength(key);
+    if (storedLen > 0 && buf.grow(storedLen)) {
+      len = prefs.getBytes(key, buf.data(), storedLen);
+      if (len != storedLen) {
+        len = 0;
+      }
+    }
+  }
+
+  return writeModuleValue(buf.data(), len, isMsgPack, out, format);
+}
+
+// Byte reader over an Arduino Stream for the NVSMsgPack parsers.
+// Honors the stream timeout and supports pushing back one byte for format detection.
+class StreamReader {
+public:
+  explicit StreamReader(Stream& in) : _in(in), _pushedBack(-1) {}
+
+  int read() {
+    if (_pushedBack >= 0) {
+      int c = _pushedBack;
+      _pushedBack = -1;
+      return c;
+    }
+    uint8_t c;
+    return _in.readBytes(&c, 1) == 1 ? c : -1;
+  }
+
+  void unread(int c) { _pushedBack = c; }
+
+private:
+  Stream& _in;
+  int _pushedBack;
+};
+
+// Staged import record: [idLen:1][moduleId][valueLen:2, little endian][MessagePack value]
+// Returns None, or why the record could not be staged
+NVSConfigError stageModule(NVSScratchBuffer& staged, size_t& stagedSize, size_t maxSize,
+                 const char* moduleId, const NVSMsgPack::BufferWriter& value) {
+  size_t idLen = strlen(moduleId);
+  size_t recordLen = 1 + idLen + 2 + value.size();
+  if (stagedSize + recordLen > maxSize) {
+    return NVSConfigError::ImportTooLarge;
+  }
+  if (stagedSize + recordLen > staged.size()) {
+    size_t newCap = staged.size() == 0 ? 1024 : staged.size() * 2;
+    while (newCap < stagedSize + recordLen) {
+      newCap *= 2;
+    }
+    if (newCap > maxSize) {
+      newCap = maxSize;
+    }
+    if (!staged.grow(newCap)) {
+      return staged.error();
+    }
+  }
+  uint8_t* p = staged.data() + stagedSize;
+  *p++ = (uint8_t)idLen;
+  memcpy(p, moduleId, idLen);
+  p += idLen;
+  *p++ = (uint8_t)(value.size() & 0xff);
+  *p++ = (uint8_t)(value.size() >> 8);
+  memcpy(p, value.data(), value.size());
+  stagedSize += recordLen;
+  return NVSConfigError::None;
+}
+
+// Keys collected per iterator pass when a full import erases the stored modules
+const size_t kEraseBatch = 16;
+
+// A lone nil is how exportAll() marks an unreadable module
+bool isNilValue(const NVSMsgPack::BufferWriter& value) {
+  return value.size() == 1 && value.data()[0] == 0xc0;
+}
+
+}  // namespace
+
+bool NVSConfigBus::moduleIdFromKey(const char* key, char* idBuf, size_t idBufSize, bool& isMsgPack) {
+  if (key == nullptr || key[0] == '\0' || idBuf == nullptr) {
+    return false;
+  }
+  if (key[0] == '_' && key[1] == '_') {
+    return false;  // Reserved for bus bookkeeping
+  }
+
+  size_t keyLen = strlen(key);
+  const char* colon = strchr(key, ':');
+  size_t idLen = keyLen;
+  isMsgPack = false;
+
+  if (colon != nullptr) {
+    if (strcmp(colon, ":mp") != 0) {
+      return false;  // Some other suffix, not a module blob
+    }
+    isMsgPack = true;
+    idLen = (size_t)(colon - key);
+  }
+
+  if (idLen == 0 || idLen + 1 > idBufSize) {
+    return false;
+  }
+  memcpy(idBuf, key, idLen);
+  idBuf[idLen] = '\0';
+  return true;
+}
+
+bool NVSConfigBus::isModuleKey(const char* key) {
+  char moduleId[16];
+  bool isMsgPack;
+  if (moduleIdFromKey(key, moduleId, sizeof(moduleId), isMsgPack)) {
+    return true;
+  }
+  const char* colon = key != nullptr ? strchr(key, ':') : nullptr;
+  if (colon == nullptr || colon == key || (key[0] == '_' && key[1] == '_')) {
+    return false;
+  }
+  // NVSRecordLog slots (`<name>:<hex>`) never match: 'h', 'i' and 'j' are not hex digits
+  return strcmp(colon, ":i") == 0 || strcmp(colon, ":h") == 0 ||
+         (colon[1] == 'j' && isxdigit((unsigned char)colon[2]) && colon[3] == '\0');
+}
+
+bool NVSConfigBus::eraseModuleKeys(uint8_t shard, nvs_handle_t handle) {
+  char ns[kNamespaceBufSize];
+  char keys[kEraseBatch][16];
+  while (true) {
+    // Collect a batch first; the iterator is closed before its keys are erased
+    size_t count = 0;
+    {
+      NVSKeyIterator it(_partition, shardNamespace(shard, ns));
+      while (count < kEraseBatch && it.next()) {
+        if (isModuleKey(it.key())) {
+          strncpy(keys[count], it.key(), sizeof(keys[count]) - 1);
+          keys[count][sizeof(keys[count]) - 1] = '\0';
+          count++;
+        }
+      }
+    }
+    size_t erased = 0;
+    for (size_t i = 0; i < count; i++) {
+      esp_err_t err = nvs_erase_key(handle, keys[i]);
+      if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return false;
+      }
+      erased += err == ESP_OK ? 1 : 0;
+    }
+    if (erased == 0) {
+      return true;  // No module keys left
+    }
+  }
+}
+
+bool NVSConfigBus::isValidModuleId(const char* moduleId) {
+  if (moduleId == nullptr || moduleId[0] == '\0') {
+    return false;
+  }
+  size_t len = strlen(moduleId);
+  // 12 characters leave room for the ':mp' suffix within the 15-character NVS key limit
+  if (len > 12 || strchr(moduleId, ':') != nullptr) {
+    return false;
+  }
+  return !(moduleId[0] == '_' && moduleId[1] == '_');
+}
+
+bool NVSConfigBus::writeModuleEntry(Print& out, NVSExportFormat format, const DirectoryEntry& entry, bool first,
+                                    Preferences* prefs, int8_t* opened, NVSScratchBuffer& buf,
+                                    NVSConfigError& readError) {
+  // Key
+  size_t idLen = strlen(entry.moduleId);
+  bool ok;
+  if (format == NVSExportFormat::Json) {
+    NVSMsgPack::BufferedWriter<Print> w(out);
+    if (!first) {
+      w.write(',');
+    }
+    NVSMsgPack::writeJsonString(w, (const uint8_t*)entry.moduleId, idLen);
+    w.write(':');
+    ok = w.flush();
+  } else {
+    uint8_t header[5];
+    ok = writeAll(out, header, NVSMsgPack::encodeStrHeader(idLen, header)) &&
+         writeAll(out, (const uint8_t*)entry.moduleId, idLen);
+  }
+  if (!ok) {
+    return false;
+  }
+
+  // Value: read the representation loadModuleConfig() would use
+  char dataKey[16];
+  bool isMsgPack = entry.info.format == NVSModuleFormat::MsgPack;
+  buildKey(entry.moduleId, isMsgPack ? ":mp" : "", dataKey, sizeof(dataKey));
+  uint8_t shard = shardOf(entry.moduleId);
+  if (opened[shard] == 0) {
+    opened[shard] = openShard(prefs[shard], shard, true) ? 1 : -1;
+  }
+  ExportResult result;
+  if (entry.info.hotSize > 0 || entry.info.journalSize > 0) {
+    // Hot fields or journal records live in further entries: export the merged map
+    size_t len = buf.grow(storedBytes(entry.info))
+                     ? readModuleMsgPack(entry.moduleId, buf.data(), buf.size())
+                     : 0;
+    result = writeModuleValue(buf.data(), len, true, out, format);
+  } else {
+    result = exportModuleValue(prefs[shard], dataKey, isMsgPack,
+                               entry.info.format == NVSModuleFormat::JsonString, buf, out, format);
+  }
+  if (result == ExportResult::Unreadable) {
+    NVS_CFG_LOG("exportAll: module unreadable, exported as null");
+    readError = buf.error() != NVSConfigError::None ? buf.error() : NVSConfigError::ParseError;
+  }
+  return result != ExportResult::WriteFailed;
+}
+
+bool NVSConfigBus::writeModuleMap(Print& out, NVSExportFormat format, uint32_t since,
+                                  NVSConfigError& readError) {
+  DirectoryEntry entry;
+
+  // Shard namespaces are opened on first use and kept open for the export
+  Preferences prefs[NVS_CFG_MAX_SHARDS];
+  int8_t opened[NVS_CFG_MAX_SHARDS] = {};  // 0 = not tried, 1 = open, -1 = unavailable
+
+  // Decide whether a directory entry is part of the export: stored modules
+  // only (no tombstones), changed after `since` for delta exports
+  auto selected = [&](const DirectoryEntry& e) {
+    return e.info.format != NVSModuleFormat::None && (since == 0 || e.info.generation > since);
+  };
+
+  bool ok = true;
+  if (format == NVSExportFormat::MsgPack) {
+    // MessagePack needs the element count up front
+    uint32_t count = 0;
+    for (size_t i = 0; directoryEntryAt(i, entry); i++) {
+      if (selected(entry)) {
+        count++;
+      }
+    }
+    uint8_t header[5];
+    ok = writeAll(out, header, NVSMsgPack::encodeMapHeader(count, header));
+  } else {
+    ok = writeAll(out, "{");
+  }
+
+  NVSScratchBuffer buf(*_budget, *_allocator);
+  bool first = true;
+
+  for (size_t i = 0; ok && directoryEntryAt(i, entry); i++) {
+    if (selected(entry)) {
+      ok = writeModuleEntry(out, format, entry, first, prefs, opened, buf, readError);
+      first = false;
+    }
+  }
+  buf.release();
+  for (uint8_t shard = 0; shard < NVS_CFG_MAX_SHARDS; shard++) {
+    if (opened[shard] == 1) {
+      prefs[shard].end();
+    }
+  }
+
+  if (ok && format == NVSExportFormat::Json) {
+    ok = writeAll(out, "}");
+  }
+  return ok;
+}
+
+bool NVSConfigBus::exportAll(Print& out, NVSExportFormat format) {
+  _lastError = NVSConfigError::None;
+  if (!ensureDirectory()) {
+    _lastError = NVSConfigError::OutOfMemory;
+    return false;
+  }
+  NVSConfigError readError = NVSConfigError::None;
+  bool ok = writeModuleMap(out, format, 0, readError);
+
+  if (!ok) {
+    NVS_CFG_LOG("exportAll: write to output failed");
+    _lastError = NVSConfigError::WriteFailed;
+  } else if (readError != NVSConfigError::None) {
+    _lastError = readError;
+  }
+  return ok && readError == NVSConfigError::None;
+}
+
+bool NVSConfigBus::exportChangedSince(uint32_t since, Print& out, NVSExportFormat format) {
+  _lastError = NVSConfigError::None;
+  if (!ensureDirectory()) {
+    _lastError = NVSConfigError::OutOfMemory;
+    return false;
+  }
+  Preferences prefs;
+  bool opened = openShard(prefs, 0, true);  // Read-only mode; fails if the namespace is empty
+
+  uint32_t current = opened ? prefs.getUInt(kGenerationKey, 0) : 0;
+  uint32_t reset = opened ? prefs.getUInt(kResetKey, 0) : 0;
+  if (opened) {
+    prefs.end();
+  }
+  // The client's view is unusable if it predates a reset or comes from another epoch
+  bool full = since == 0 || since > current || since < reset;
+
+  // Removed modules: tombstones newer than `since`
+  DirectoryEntry entry;
+  const char* moduleId = entry.moduleId;
+  auto removed = [&]() {
+    return !full && entry.info.deleted && entry.info.generation > since;
+  };
+
+  bool ok;
+  char num[16];
+  snprintf(num, sizeof(num), "%lu", (unsigned long)current);
+  if (format == NVSExportFormat::Json) {
+    ok = writeAll(out, "{\"generation\":") && writeAll(out, num) &&
+         writeAll(out, full ? ",\"full\":true,\"modules\":" : ",\"full\":false,\"modules\":");
+  } else {
+    uint8_t header[32];
+    NVSMsgPack::BufferWriter w(header, sizeof(header));
+    w.writeMapHeader(4);
+    w.writeStr("generation", 10);
+    w.writeUInt(current);
+    w.writeStr("full", 4);
+    w.writeBool(full);
+    ok = writeAll(out, w.data(), w.size());
+    w.reset();
+    w.writeStr("modules", 7);
+    ok = ok && writeAll(out, w.data(), w.size());
+  }
+
+  NVSConfigError readError = NVSConfigError::None;
+  ok = ok && writeModuleMap(out, format, full ? 0 : since, readError);
+
+  if (ok && format == NVSExportFormat::Json) {
+    ok = writeAll(out, ",\"removed\":[");
+    bool first = true;
+    for (size_t i = 0; ok && directoryEntryAt(i, entry); i++) {
+      if (removed()) {
+        NVSMsgPack::BufferedWriter<Print> w(out);
+        if (!first) {
+          w.write(',');
+        }
+        NVSMsgPack::writeJsonString(w, (const uint8_t*)moduleId, strlen(moduleId));
+        ok = w.flush();
+        first = false;
+      }
+    }
+    ok = ok && writeAll(out, "]}");
+  } else if (ok) {
+    uint32_t count = 0;
+    for (size_t i = 0; directoryEntryAt(i, entry); i++) {
+      if (removed()) {
+        count++;
+      }
+    }
+    uint8_t header[16];
+    NVSMsgPack::BufferWriter w(header, sizeof(header));
+    w.writeStr("removed", 7);
+    w.writeArrayHeader(count);
+    ok = writeAll(out, w.data(), w.size());
+    for (size_t i = 0; ok && count > 0 && directoryEntryAt(i, entry); i++) {
+      if (removed()) {
+        uint8_t strHeader[5];
+        size_t idLen = strlen(moduleId);
+        ok = writeAll(out, strHeader, NVSMsgPack::encodeStrHeader(idLen, strHeader)) &&
+             writeAll(out, (const uint8_t*)moduleId, idLen);
+        count--;
+      }
+    }
+  }
+
+  if (!ok) {
+    NVS_CFG_LOG("exportChangedSince: write to output failed");
+    _lastError = NVSConfigError::WriteFailed;
+  } else if (readError != NVSConfigError::None) {
+    _lastError = readError;
+  }
+  return ok && readError == NVSConfigError::None;
+}
+
+bool NVSConfigBus::importAll(Stream& in, bool replaceAll, size_t maxImportSize) {
+  _lastError = NVSConfigError::None;
+
+  NVSScratchBuffer moduleBuf(*_budget, *_allocator, NVS_CFG_MAX_MODULE_SIZE);
+  if (!moduleBuf) {
+    NVS_CFG_LOG("importAll: failed to allocate module buffer");
+    _lastError = moduleBuf.error();
+    return false;
+  }
+  NVSMsgPack::BufferWriter value(moduleBuf.data(), NVS_CFG_MAX_MODULE_SIZE);
+
+  NVSScratchBuffer staged(*_budget, *_allocator);
+  size_t stagedSize = 0;
+  size_t moduleCount = 0;
+  char moduleId[64];
+  NVSConfigError error = NVSConfigError::None;
+
+  // Stage one parsed module (or skip it if it was exported as null)
+  auto stage = [&]() {
+    if (!isValidModuleId(moduleId)) {
+      error = NVSConfigError::InvalidModuleId;
+    } else if (!isNilValue(value)) {
+      error = stageModule(staged, stagedSize, maxImportSize, moduleId, value);
+    }
+    if (error != NVSConfigError::None) {
+      return false;
+    }
+    moduleCount++;
+    return true;
+  };
+
+  // Detect the encoding from the first non-whitespace byte
+  StreamReader reader(in);
+  int first;
+  do {
+    first = reader.read();
+  } while (first == ' ' || first == '\t' || first == '\r' || first == '\n');
+  reader.unread(first);
+
+  if (first == '{') {
+    NVSMsgPack::JsonToMsgPack<StreamReader> json(reader);
+    json.expect('{');
+    bool more = !json.expect('}');
+    while (more) {
+      value.reset();
+      if (!json.readString(moduleId, sizeof(moduleId)) || !json.expect(':')) {
+        error = NVSConfigError::ParseError;
+        break;
+      }
+      if (!json.convert(value)) {
+        error = value.overflowed() ? NVSConfigError::ModuleTooLarge : NVSConfigError::ParseError;
+        break;
+      }
+      if (!stage()) {
+        break;
+      }
+      if (json.expect('}')) {
+        more = false;
+      } else if (!json.expect(',')) {
+        error = NVSConfigError::ParseError;
+        break;
+      }
+    }
+  } else if (first >= 0) {
+    // MessagePack: top-level map header, then str key / value pairs
+    const NVSMsgPack::HeaderLayout h = NVSMsgPack::describeHeader((uint8_t)reader.read());
+    uint32_t count = h.length;
+    uint8_t lenBytes[4];
+    for (size_t k = 0; k < h.lenBytes; k++) {
+      int b = reader.read();
+      lenBytes[k] = (uint8_t)b;
+      if (b < 0) {
+        error = NVSConfigError::ParseError;
+      }
+    }
+    if (h.type != NVSMsgPack::Type::Map) {
+      error = NVSConfigError::ParseError;
+    } else if (h.lenBytes > 0) {
+      count = (uint32_t)NVSMsgPack::readBigEndian(lenBytes, h.lenBytes);
+    }
+
+    for (uint32_t k = 0; k < count && error == NVSConfigError::None; k++) {
+      // Key: copy the str value, then decode it into moduleId
+      value.reset();
+      NVSMsgPack::Token key;
+      const uint8_t* p = moduleBuf.data();
+      if (!NVSMsgPack::copyValue(reader, value) ||
+          !NVSMsgPack::readToken(p, moduleBuf.data() + value.size(), key) ||
+          key.type != NVSMsgPack::Type::Str || key.length >= sizeof(moduleId)) {
+        error = NVSConfigError::ParseError;
+        break;
+      }
+      memcpy(moduleId, key.data, key.length);
+      moduleId[key.length] = '\0';
+
+      value.reset();
+      if (!NVSMsgPack::copyValue(reader, value)) {
+        error = value.overflowed() ? NVSConfigError::ModuleTooLarge : NVSConfigError::ParseError;
+        break;
+      }
+      if (!NVSMsgPack::validate(value.data(), value.size())) {
+        error = NVSConfigError::ParseError;
+        break;
+      }
+      stage();
+    }
+  } else {
+    error = NVSConfigError::ParseError;  // Empty stream or timeout
+  }
+
+  moduleBuf.release();
+
+  if (error == NVSConfigError::None && !commitImport(staged.data(), stagedSize, replaceAll)) {
+    error = _lastError;
+  }
+  staged.release();
+
+  if (error != NVSConfigError::None) {
+    char errorMsg[96];
+    snprintf(errorMsg, sizeof(errorMsg), "importAll: aborted after %u staged modules (error %d)",
+             (unsigned)moduleCount, (int)error);
+    NVS_CFG_LOG(errorMsg);
+    _lastError = error;
+    return false;
+  }
+  return true;
+}
+
+bool NVSConfigBus::commitImport(const uint8_t* staged, size_t stagedSize, bool replaceAll) {
+  // Estimate the NVS entries needed: blob index + data header + 32-byte data entries.
+  // Erased entries count as available because page GC reclaims them.
+  size_t neededEntries = 0;
+  for (size_t pos = 0; pos < stagedSize;) {
+    size_t idLen = staged[pos];
+    size_t len = staged[pos + 1 + idLen] | ((size_t)staged[pos + 2 + idLen] << 8);
+    neededEntries += 2 + (len + 31) / 32 + 2;  // + the `<id>:i` record
+    pos += 1 + idLen + 2 + len;
+  }
+
+  nvs_stats_t stats;
+  const size_t entriesPerPage = 126;
+  if (nvs_get_stats(_partition, &stats) == ESP_OK) {
+    // One page stays reserved for GC
+    size_t available = stats.total_entries > stats.used_entries + entriesPerPage
+                           ? stats.total_entries - stats.used_entries - entriesPerPage
+                           : 0;
+    if (neededEntries > available) {
+      NVS_CFG_LOG("importAll: not enough free NVS entries");
+      _lastError = NVSConfigError::NoSpace;
+      return false;
+    }
+  }
+
+  // One handle per shard, opened on first use; shard 0 holds the counters
+  nvs_handle_t handles[NVS_CFG_MAX_SHARDS];
+  bool opened[NVS_CFG_MAX_SHARDS] = {};
+  if (!openShardHandle(0, NVS_READWRITE, handles[0])) {
+    NVS_CFG_LOG("importAll: failed to open NVS namespace");
+    _lastError = NVSConfigError::NamespaceUnavailable;
+    return false;
+  }
+  opened[0] = true;
+  auto shardHandle = [&](uint8_t shard) -> bool {
+    if (!opened[shard]) {
+      opened[shard] = openShardHandle(shard, NVS_READWRITE, handles[shard]);
+    }
+    return opened[shard];
+  };
+
+  // One generation for the whole import; a full restore also counts as a reset for delta sync
+  uint32_t generation = 0;
+  nvs_get_u32(handles[0], kGenerationKey, &generation);
+  generation++;
+
+  bool ok = true;
+  if (replaceAll) {
+    // Only module keys go: counters, record logs and bookkeeping stay
+    ok = eraseModuleKeys(0, handles[0]) && nvs_set_u32(handles[0], kResetKey, generation) == ESP_OK;
+    // Every derived namespace that exists, including leftovers of another shard count
+    for (uint8_t shard = 1; ok && shard < NVS_CFG_MAX_SHARDS; shard++) {
+      nvs_handle_t probe;
+      if (!openShardHandle(shard, NVS_READONLY, probe)) {
+        continue;
+      }
+      nvs_close(probe);
+      ok = shardHandle(shard) && eraseModuleKeys(shard, handles[shard]);
+    }
+    resetDirectory();
+  }
+  ok = ok && nvs_set_u32(handles[0], kGenerationKey, generation) == ESP_OK;
+
+  char moduleId[16];
+  char msgPackKey[64];
+  char infoKey[16];
+  uint8_t raw[kModuleInfoSize];
+
+  for (size_t pos = 0; ok && pos < stagedSize;) {
+    size_t idLen = staged[pos];
+    memcpy(moduleId, staged + pos + 1, idLen);
+    moduleId[idLen] = '\0';
+    size_t len = staged[pos + 1 + idLen] | ((size_t)staged[pos + 2 + idLen] << 8);
+    const uint8_t* data = staged + pos + 3 + idLen;
+    pos += 3 + idLen + len;
+    rtcRemove(moduleId);
+
+    uint8_t shard = shardOf(moduleId);
+    ModuleInfo info = {generation, false, false, NVSModuleFormat::MsgPack, (uint16_t)len, crc32(data, len), 0, 0};
+    encodeModuleInfo(info, raw);
+    ok = shardHandle(shard) &&
+         buildMsgPackKey(moduleId, msgPackKey, sizeof(msgPackKey)) &&
+         buildKey(moduleId, ":i", infoKey, sizeof(infoKey)) &&
+         nvs_set_blob(handles[shard], infoKey, raw, sizeof(raw)) == ESP_OK &&
+         nvs_set_blob(handles[shard], msgPackKey, data, len) == ESP_OK;
+    if (ok) {
+      // The imported MessagePack copy supersedes any legacy JSON key, hot-field
+      // entry and journal records
+      esp_err_t err = nvs_erase_key(handles[shard], moduleId);
+      ok = err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND;
+      if (ok && buildKey(moduleId, ":h", infoKey, sizeof(infoKey))) {
+        err = nvs_erase_key(handles[shard], infoKey);
+        ok = err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND;
+      }
+      ModuleInfo previous;
+      Lookup lookup = lookupModule(moduleId, previous);
+      if (lookup == Lookup::Unavailable || (lookup == Lookup::Found && previous.journalSize > 0)) {
+        for (uint8_t slot = 0; ok && slot < NVS_CFG_JOURNAL_MAX_SLOTS; slot++) {
+          buildJournalKey(moduleId, slot, infoKey, sizeof(infoKey));
+          err = nvs_erase_key(handles[shard], infoKey);
+          ok = err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND;
+        }
+      }
+      updateDirectory(moduleId, info);
+    }
+  }
+
+  // Single commit per shard; the counters in shard 0 are committed last
+  for (uint8_t shard = NVS_CFG_MAX_SHARDS; shard-- > 0;) {
+    if (opened[shard]) {
+      ok = ok && nvs_commit(handles[shard]) == ESP_OK;
+      nvs_close(handles[shard]);
+    }
+  }
+  // Imported modules refill the snapshot on load; a merge keeps unflushed
+  // volatile modules it did not import
+  rtcReset(ok ? generation : 0, !replaceAll);
+
+  if (!ok) {
+    NVS_CFG_LOG("importAll: NVS write failed");
+    _lastError = NVSConfigError::WriteFailed;
+    invalidateDirectory();  // Partially applied: rebuild from NVS on next use
+  }
+  return ok;
+}
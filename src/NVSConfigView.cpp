@@ -0,0 +1,219 @@
+#include "NVSConfigView.h"
+#include "NVSJsonArena.h"
+#include <string.h>
+
+using NVSMsgPack::Token;
+using NVSMsgPack::Type;
+
+bool NVSStringRef::equals(const char* str) const {
+  return str != nullptr && strlen(str) == length && (length == 0 || memcmp(data, str, length) == 0);
+}
+
+bool NVSStringRef::copyTo(char* buf, size_t bufSize) const {
+  if (buf == nullptr || bufSize == 0) {
+    return false;
+  }
+  size_t n = length < bufSize ? length : bufSize - 1;
+  if (n > 0) {
+    memcpy(buf, data, n);
+  }
+  buf[n] = '\0';
+  return n == length;
+}
+
+bool NVSConfigValue::token(Token& t) const {
+  const uint8_t* p = _p;
+  return _p != nullptr && NVSMsgPack::readToken(p, _end, t);
+}
+
+Type NVSConfigValue::type() const {
+  Token t;
+  return token(t) ? t.type : Type::Invalid;
+}
+
+size_t NVSConfigValue::size() const {
+  Token t;
+  if (!token(t) || (t.type != Type::Map && t.type != Type::Array)) {
+    return 0;
+  }
+  return t.length;
+}
+
+NVSConfigValue NVSConfigValue::operator[](const char* key) const {
+  if (key == nullptr) {
+    return NVSConfigValue();
+  }
+  NVSConfigIterator it = children();
+  while (it._isMap && it.next()) {
+    if (it.key().equals(key)) {
+      return it.value();
+    }
+  }
+  return NVSConfigValue();
+}
+
+NVSConfigValue NVSConfigValue::operator[](size_t index) const {
+  NVSConfigIterator it = children();
+  if (it._isMap || index >= it._remaining) {
+    return NVSConfigValue();
+  }
+  for (size_t i = 0; i <= index; i++) {
+    if (!it.next()) {
+      return NVSConfigValue();
+    }
+  }
+  return it.value();
+}
+
+int64_t NVSConfigValue::asInt(int64_t fallback) const {
+  Token t;
+  if (!token(t)) {
+    return fallback;
+  }
+  switch (t.type) {
+    case Type::Int: return t.i;
+    case Type::UInt: return t.u > (uint64_t)INT64_MAX ? fallback : (int64_t)t.u;
+    case Type::Float: return (int64_t)t.f;
+    case Type::Double: return (int64_t)t.d;
+    case Type::Bool: return t.b ? 1 : 0;
+    default: return fallback;
+  }
+}
+
+double NVSConfigValue::asDouble(double fallback) const {
+  Token t;
+  if (!token(t)) {
+    return fallback;
+  }
+  switch (t.type) {
+    case Type::Int: return (double)t.i;
+    case Type::UInt: return (double)t.u;
+    case Type::Float: return t.f;
+    case Type::Double: return t.d;
+    default: return fallback;
+  }
+}
+
+bool NVSConfigValue::asBool(bool fallback) const {
+  Token t;
+  if (!token(t)) {
+    return fallback;
+  }
+  switch (t.type) {
+    case Type::Bool: return t.b;
+    case Type::Int: return t.i != 0;
+    case Type::UInt: return t.u != 0;
+    case Type::Float: return t.f != 0;
+    case Type::Double: return t.d != 0;
+    default: return fallback;
+  }
+}
+
+NVSStringRef NVSConfigValue::asString() const {
+  NVSStringRef str;
+  Token t;
+  if (token(t) && t.type == Type::Str) {
+    str.data = (const char*)t.data;
+    str.length = t.length;
+  }
+  return str;
+}
+
+NVSConfigIterator NVSConfigValue::children() const {
+  NVSConfigIterator it;
+  const uint8_t* p = _p;
+  Token t;
+  if (_p != nullptr && NVSMsgPack::readToken(p, _end, t) &&
+      (t.type == Type::Map || t.type == Type::Array)) {
+    it._p = p;
+    it._end = _end;
+    it._remaining = t.length;
+    it._isMap = t.type == Type::Map;
+  }
+  return it;
+}
+
+bool NVSConfigIterator::next() {
+  if (_remaining == 0) {
+    return false;
+  }
+  _remaining--;
+  _key = NVSStringRef();
+  if (_isMap) {
+    NVSConfigValue key(_p, _end);
+    _key = key.asString();
+    if (!NVSMsgPack::skipValue(_p, _end)) {
+      _remaining = 0;
+      return false;
+    }
+  }
+  _value = NVSConfigValue(_p, _end);
+  if (!NVSMsgPack::skipValue(_p, _end)) {
+    _remaining = 0;
+    return false;
+  }
+  return true;
+}
+
+NVSConfigView::NVSConfigView(NVSConfigBus& bus)
+    : _bus(bus), _blob(bus.memoryBudget(), bus.allocator()), _length(0), _error(NVSConfigError::None) {}
+
+void NVSConfigView::clear() {
+  _blob.release();
+  _length = 0;
+}
+
+NVSConfigValue NVSConfigView::root() const {
+  return _length > 0 ? NVSConfigValue(_blob.data(), _blob.data() + _length) : NVSConfigValue();
+}
+
+bool NVSConfigView::load(const char* moduleId) {
+  clear();
+  _error = NVSConfigError::None;
+  if (moduleId == nullptr || strlen(moduleId) == 0) {
+    _error = NVSConfigError::InvalidArgument;
+    return false;
+  }
+
+  NVSModuleInfo info;
+  bool known = _bus.moduleInfo(moduleId, info);
+  if (known && info.format != NVSModuleFormat::MsgPack) {
+    // Legacy JSON: one regular load stores the MessagePack copy
+    {
+      NVSScopedDocument migrate(_bus);
+      if (!migrate.load(moduleId)) {
+        _error = _bus.lastError();
+        return false;
+      }
+    }
+    known = _bus.moduleInfo(moduleId, info);
+    if (known && info.format != NVSModuleFormat::MsgPack) {
+      // Migration is skipped (and retried by the next load) when its buffer
+      // or the write fails
+      NVS_CFG_LOG("NVSConfigView: module could not be migrated to MessagePack");
+      _error = NVSConfigError::WriteFailed;
+      return false;
+    }
+  }
+
+  // Exact size from the directory, otherwise the largest module size
+  size_t size = known && info.size > 0 ? info.size : NVS_CFG_MAX_MODULE_SIZE;
+  if (!_blob.grow(size)) {
+    NVS_CFG_LOG("NVSConfigView: failed to allocate blob buffer");
+    _error = _blob.error();
+    return false;
+  }
+  size_t length = _bus.readModuleMsgPack(moduleId, _blob.data(), size);
+  if (length == 0) {
+    _blob.release();
+    return false;  // Not stored (or unreadable, logged by the bus)
+  }
+  if (!NVSMsgPack::validate(_blob.data(), length)) {
+    NVS_CFG_LOG("NVSConfigView: stored MessagePack is malformed");
+    _error = NVSConfigError::ParseError;
+    _blob.release();
+    return false;
+  }
+  _length = length;
+  return true;
+}
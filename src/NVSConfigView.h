@@ -0,0 +1,199 @@
+/**
+ * @file NVSConfigView.h
+ * @brief Read-only access to a stored module without building a JSON document
+ *
+ * A consumer that only reads a few settings does not need a DOM: the stored
+ * MessagePack blob already contains every value. NVSConfigView keeps that blob
+ * in one buffer and answers lookups by walking it, so strings are returned as
+ * references into the blob instead of being copied into ArduinoJson's string
+ * pool.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include "NVSConfigBus.h"
+#include "NVSMsgPack.h"
+
+/**
+ * @brief String inside a view's blob (not NUL-terminated)
+ */
+struct NVSStringRef {
+  const char* data = nullptr;
+  size_t length = 0;
+
+  /** @brief true if the string equals the C string @p str */
+  bool equals(const char* str) const;
+
+  /**
+   * @brief Copy into @p buf as a NUL-terminated C string
+   * @return false if @p buf is too small (the copy is truncated)
+   */
+  bool copyTo(char* buf, size_t bufSize) const;
+};
+
+class NVSConfigIterator;
+
+/**
+ * @class NVSConfigValue
+ * @brief One value inside an NVSConfigView (a position in the blob)
+ *
+ * Looking up a missing key or index yields an empty value, so lookups can be
+ * chained like with ArduinoJson: `view["wifi"]["channels"][2].asInt(1)`.
+ * Lookups walk the blob and cost O(size of the container); values are only
+ * valid while their view is loaded.
+ */
+class NVSConfigValue {
+public:
+  NVSConfigValue() : _p(nullptr), _end(nullptr) {}
+  NVSConfigValue(const uint8_t* p, const uint8_t* end) : _p(p), _end(end) {}
+
+  /** @brief false if the key or index did not exist */
+  explicit operator bool() const { return _p != nullptr; }
+
+  /** @brief MessagePack type (Type::Invalid if the value does not exist) */
+  NVSMsgPack::Type type() const;
+
+  bool isNull() const { return type() == NVSMsgPack::Type::Nil || _p == nullptr; }
+  bool isMap() const { return type() == NVSMsgPack::Type::Map; }
+  bool isArray() const { return type() == NVSMsgPack::Type::Array; }
+  bool isString() const { return type() == NVSMsgPack::Type::Str; }
+
+  /** @brief Member count of a map, element count of an array, 0 otherwise */
+  size_t size() const;
+
+  /** @brief Member @p key of a map */
+  NVSConfigValue operator[](const char* key) const;
+
+  /** @brief Element @p index of an array */
+  NVSConfigValue operator[](size_t index) const;
+  NVSConfigValue operator[](int index) const { return index < 0 ? NVSConfigValue() : (*this)[(size_t)index]; }
+
+  /** @brief Integer value (floats truncated, bools as 0/1), @p fallback otherwise */
+  int64_t asInt(int64_t fallback = 0) const;
+
+  /** @brief Numeric value as double, @p fallback otherwise */
+  double asDouble(double fallback = 0.0) const;
+
+  /** @brief Boolean value (numbers: non-zero), @p fallback otherwise */
+  bool asBool(bool fallback = false) const;
+
+  /** @brief String value, empty reference if the value is not a string */
+  NVSStringRef asString() const;
+
+  /** @brief Iterate over the children (none unless this is a map or array) */
+  NVSConfigIterator children() const;
+
+private:
+  bool token(NVSMsgPack::Token& t) const;
+
+  const uint8_t* _p;    ///< Header of the value (nullptr if it does not exist)
+  const uint8_t* _end;  ///< End of the blob
+};
+
+/**
+ * @class NVSConfigIterator
+ * @brief Walks the members of a map or the elements of an array
+ *
+ * @example
+ * ```cpp
+ * NVSConfigIterator it = view["tokens"].children();
+ * while (it.next()) {
+ *   NVSStringRef token = it.value().asString();
+ * }
+ * ```
+ */
+class NVSConfigIterator {
+public:
+  /**
+   * @brief Advance to the next child (the first call yields the first one)
+   * @return true if a child is available via key() / value()
+   */
+  bool next();
+
+  /** @brief Key of the current map member (empty for arrays and non-string keys) */
+  NVSStringRef key() const { return _key; }
+
+  /** @brief Current member value or array element */
+  NVSConfigValue value() const { return _value; }
+
+private:
+  friend class NVSConfigValue;
+  NVSConfigIterator() : _p(nullptr), _end(nullptr), _remaining(0), _isMap(false) {}
+
+  const uint8_t* _p;    ///< Next child (key for maps)
+  const uint8_t* _end;
+  uint32_t _remaining;  ///< Children not yet visited
+  bool _isMap;
+  NVSStringRef _key;
+  NVSConfigValue _value;
+};
+
+/**
+ * @class NVSConfigView
+ * @brief Read-only, zero-copy view of a stored module
+ *
+ * load() reads the module's MessagePack blob into one buffer (budgeted like
+ * every other bus buffer) and validates it once; afterwards lookups read
+ * straight from it. Compared with loading into a JsonDocument the module's
+ * strings are not duplicated and no slot pool is allocated, which matters most
+ * for string-heavy configs such as token or host lists. The blob and every
+ * NVSConfigValue taken from it are released together when the view is
+ * destroyed or reloaded.
+ *
+ * Legacy JSON modules are migrated to MessagePack by one regular load first.
+ *
+ * @example
+ * ```cpp
+ * NVSConfigView cfg(configBus);
+ * if (cfg.load("wifi")) {
+ *   char ssid[33];
+ *   cfg["ssid"].asString().copyTo(ssid, sizeof(ssid));
+ *   uint8_t channel = (uint8_t)cfg["channel"].asInt(6);
+ * }
+ * ```
+ */
+class NVSConfigView {
+public:
+  explicit NVSConfigView(NVSConfigBus& bus);
+
+  NVSConfigView(const NVSConfigView&) = delete;
+  NVSConfigView& operator=(const NVSConfigView&) = delete;
+
+  /**
+   * @brief Read a module (the previous one is released first)
+   * @return false if the module is missing, unreadable or not valid MessagePack
+   *         (see error())
+   */
+  bool load(const char* moduleId);
+
+  /**
+   * @brief Release the blob (all values taken from the view become invalid)
+   */
+  void clear();
+
+  /** @brief Root value of the loaded module (empty if nothing is loaded) */
+  NVSConfigValue root() const;
+
+  NVSConfigValue operator[](const char* key) const { return root()[key]; }
+
+  /** @brief true while a module is loaded */
+  explicit operator bool() const { return _length > 0; }
+
+  /** @brief Bytes held by the view (the stored blob) */
+  size_t memoryUsage() const { return _length; }
+
+  /**
+   * @brief Why the last load() failed (None if the module does not exist,
+   *        BudgetExhausted, OutOfMemory, ParseError, ...)
+   */
+  NVSConfigError error() const { return _error; }
+
+private:
+  NVSConfigBus& _bus;
+  NVSScratchBuffer _blob;
+  size_t _length;  ///< Valid bytes in _blob (0 if nothing is loaded)
+  NVSConfigError _error;
+};
@@ -0,0 +1,245 @@
+#include "NVSJsonArena.h"
+#include <string.h>
+
+namespace {
+
+// ArduinoJson 7 memory model (upper bounds; see ResourceManager / StringNode)
+#ifdef ARDUINOJSON_POOL_CAPACITY
+const size_t kPoolCapacity = ARDUINOJSON_POOL_CAPACITY;
+#else
+const size_t kPoolCapacity = sizeof(void*) <= 4 ? 128 : 256;
+#endif
+#ifdef ARDUINOJSON_INITIAL_POOL_COUNT
+const size_t kInitialPools = ARDUINOJSON_INITIAL_POOL_COUNT;
+#else
+const size_t kInitialPools = 4;
+#endif
+
+#if ARDUINOJSON_VERSION_MAJOR == 7 && ARDUINOJSON_VERSION_MINOR < 3
+// One slot per value holding content, key pointer and next index
+const size_t kSlotSize = 8 + 2 * sizeof(void*);
+const bool kSeparateKeySlots = false;
+#else
+// 7.3+: compact slots; keys and 64-bit values take an extra slot each
+const size_t kSlotSize = 2 * sizeof(void*);
+const bool kSeparateKeySlots = true;
+#endif
+
+const size_t kStringHeader = sizeof(void*) + 2 * sizeof(uint32_t);  // next, references, length
+const size_t kStringBuilderCapacity = 31;  // First allocation of every string being parsed
+const size_t kPoolListEntry = 2 * sizeof(void*);
+const size_t kArenaOverhead = 8 + 7;  // NVSArenaAllocator block header + alignment
+
+size_t slotCount(const NVSMsgPack::Shape& shape) {
+  size_t slots = shape.values;
+  if (kSeparateKeySlots) {
+    slots += shape.members + shape.wideValues;
+  }
+  return slots;
+}
+
+}  // namespace
+
+NVSArenaAllocator::NVSArenaAllocator(uint8_t* buf, size_t size) : _peak(0), _failures(0) {
+  assign(buf, size);
+}
+
+void NVSArenaAllocator::assign(uint8_t* buf, size_t size) {
+  _buf = buf;
+  _size = buf != nullptr ? size : 0;
+  // Block headers (and thus payloads) must be 8-byte aligned; trim the front
+  // so the end of the arena stays where the caller put it
+  size_t skew = (uintptr_t)_buf & 7;
+  if (skew != 0) {
+    size_t pad = 8 - skew;
+    _buf += pad;
+    _size = _size > pad ? _size - pad : 0;
+  }
+  _top = 0;
+  _limit = _size;
+  _last = kNoBlock;
+}
+
+void* NVSArenaAllocator::allocate(size_t size) {
+  size_t needed = sizeof(BlockHeader) + align(size);
+  if (needed > _limit - _top) {
+    _failures++;
+    return nullptr;
+  }
+  BlockHeader* header = (BlockHeader*)(_buf + _top);
+  header->size = (uint32_t)size;
+  header->prev = _last;
+  _last = (uint32_t)_top;
+  _top += needed;
+  if (_top > _peak) {
+    _peak = _top;
+  }
+  return header + 1;
+}
+
+void NVSArenaAllocator::deallocate(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  BlockHeader* header = headerOf(ptr);
+  if ((uint8_t*)header == _buf + _last) {
+    // Top block: pop it; earlier blocks are reclaimed by reset()
+    _top = _last;
+    _last = header->prev;
+  }
+}
+
+void* NVSArenaAllocator::reallocate(void* ptr, size_t newSize) {
+  if (ptr == nullptr) {
+    return allocate(newSize);
+  }
+  BlockHeader* header = headerOf(ptr);
+  size_t offset = (uint8_t*)header - _buf;
+
+  if (offset == _last) {
+    // Top block: grow or shrink in place
+    size_t needed = sizeof(BlockHeader) + align(newSize);
+    if (needed > _limit - offset) {
+      _failures++;
+      return nullptr;
+    }
+    header->size = (uint32_t)newSize;
+    _top = offset + needed;
+    if (_top > _peak) {
+      _peak = _top;
+    }
+    return ptr;
+  }
+
+  if (newSize <= header->size) {
+    header->size = (uint32_t)newSize;  // Shrinking a buried block: keep it where it is
+    return ptr;
+  }
+  void* moved = allocate(newSize);
+  if (moved != nullptr) {
+    memcpy(moved, ptr, header->size);
+  }
+  return moved;
+}
+
+void NVSArenaAllocator::reset() {
+  _top = 0;
+  _last = kNoBlock;
+}
+
+uint8_t* NVSArenaAllocator::reserveTail(size_t size) {
+  if (_limit != _size || size > _size - _top) {
+    return nullptr;
+  }
+  _limit = _size - size;
+  return _buf + _limit;
+}
+
+void NVSArenaAllocator::releaseTail() {
+  _limit = _size;
+}
+
+size_t NVSScopedDocument::documentBytes(const NVSMsgPack::Shape& shape) {
+  size_t slots = slotCount(shape);
+  size_t pools = (slots + kPoolCapacity - 1) / kPoolCapacity;
+  size_t bytes = slots * kSlotSize + (size_t)shape.strings * (kStringHeader + 1) + shape.stringBytes;
+  if (pools > kInitialPools) {
+    bytes += pools * kPoolListEntry;  // Pool list moves to the heap
+  }
+  return bytes;
+}
+
+size_t NVSScopedDocument::arenaBytes(const NVSMsgPack::Shape& shape) {
+  size_t slots = slotCount(shape);
+  size_t pools = (slots + kPoolCapacity - 1) / kPoolCapacity;
+  // Pools are allocated at full capacity; shrinking a buried one frees nothing
+  size_t bytes = pools * (kPoolCapacity * kSlotSize + kArenaOverhead);
+  bytes += (size_t)shape.strings * (kStringHeader + 1 + kArenaOverhead) + shape.stringBytes;
+  // The string being parsed may briefly hold up to twice its length
+  bytes += kStringHeader + kStringBuilderCapacity + 1 + shape.stringBytes + kArenaOverhead;
+  if (pools > kInitialPools) {
+    bytes += 4 * pools * kPoolListEntry + 2 * kArenaOverhead;  // Doubling growth leaves copies behind
+  }
+  return bytes;
+}
+
+NVSScopedDocument::NVSScopedDocument(NVSConfigBus& bus, size_t arenaSize)
+    : _bus(bus), _autoSize(arenaSize == 0), _scratch(bus.memoryBudget(), bus.allocator(), arenaSize),
+      _arena(_scratch.data(), _scratch.size()), _doc(&_arena) {}
+
+NVSScopedDocument::NVSScopedDocument(NVSConfigBus& bus, uint8_t* buf, size_t size)
+    : _bus(bus), _autoSize(false), _scratch(bus.memoryBudget(), bus.allocator()), _arena(buf, size),
+      _doc(&_arena) {}
+
+bool NVSScopedDocument::ensureArena(size_t size) {
+  if (!_autoSize || _scratch.size() >= size) {
+    return true;
+  }
+  // Only called with an empty document: the arena holds no live blocks
+  if (!_scratch.grow(size)) {
+    NVS_CFG_LOG("NVSScopedDocument: failed to grow arena");
+    return false;
+  }
+  _arena.assign(_scratch.data(), _scratch.size());
+  return true;
+}
+
+void NVSScopedDocument::clear() {
+  _doc.clear();  // Returns every pool and string to the arena
+  _arena.reset();
+}
+
+bool NVSScopedDocument::load(const char* moduleId) {
+  clear();
+
+  NVSModuleInfo info;
+  if (!_bus.moduleInfo(moduleId, info) || info.format != NVSModuleFormat::MsgPack || info.size == 0) {
+    // Legacy JSON (or directory unavailable): the regular path handles migration
+    return ensureArena(NVS_CFG_DOC_ARENA_SIZE) && _bus.loadModuleConfig(moduleId, _doc);
+  }
+  // Upper bound only: hot fields and journal records are merged while reading,
+  // so the document can be shorter than the stored bytes
+  size_t bound = info.size;
+  size_t length = 0;
+
+  if (_autoSize) {
+    // Read the blob into the end of the arena, measure it, then grow the
+    // arena to the exact bound and move the blob to the new end
+    if (!ensureArena(bound + 8)) {
+      return false;
+    }
+    size_t oldEnd = _scratch.size();
+    NVSMsgPack::Shape shape;
+    length = _bus.readModuleMsgPack(moduleId, _scratch.data() + oldEnd - bound, bound);
+    if (length == 0 || !NVSMsgPack::measureShape(_scratch.data() + oldEnd - bound, length, shape)) {
+      NVS_CFG_LOG("NVSScopedDocument: module unreadable");
+      return false;
+    }
+    memmove(_scratch.data() + oldEnd - length, _scratch.data() + oldEnd - bound, length);
+    if (!ensureArena(arenaBytes(shape) + length + 8)) {
+      return false;
+    }
+    if (_scratch.size() != oldEnd) {
+      memmove(_scratch.data() + _scratch.size() - length, _scratch.data() + oldEnd - length, length);
+    }
+  }
+
+  // Stage the blob at the tail; the document grows from the front
+  uint8_t* blob = _arena.reserveTail(_autoSize ? length : bound);
+  if (blob == nullptr) {
+    NVS_CFG_LOG("NVSScopedDocument: arena too small for module");
+    return false;
+  }
+  if (!_autoSize) {
+    length = _bus.readModuleMsgPack(moduleId, blob, bound);
+  }
+  bool ok = length > 0 && !deserializeMsgPack(_doc, blob, length);
+  _arena.releaseTail();
+
+  if (!ok) {
+    NVS_CFG_LOG(_arena.failures() > 0 ? "NVSScopedDocument: arena exhausted while parsing"
+                                      : "NVSScopedDocument: module unreadable");
+    _doc.clear();
+  }
+  return ok;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file NVSJsonArena.h
+ * @brief Arena-backed ArduinoJson documents for short-lived config loads
+ *
+ * A typical settings load is read, apply, discard. With a regular JsonDocument
+ * that is a heap round-trip for every pool and string. NVSScopedDocument
+ * backs the document with a bump allocator over one block (taken from the
+ * bus's scratch memory or supplied by the caller) and releases it in one go.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "NVSConfigBus.h"
+#include "NVSMsgPack.h"
+
+// Arena size of an auto-sized NVSScopedDocument when the module is legacy JSON
+// (no MessagePack structure to measure)
+#ifndef NVS_CFG_DOC_ARENA_SIZE
+#define NVS_CFG_DOC_ARENA_SIZE 4096
+#endif
+
+/**
+ * @class NVSArenaAllocator
+ * @brief Bump allocator implementing the ArduinoJson 7 Allocator interface
+ *
+ * Blocks are carved from the front of a fixed buffer. Freeing or resizing the
+ * most recent block is done in place; other frees are deferred until reset().
+ * The tail of the buffer can be lent out temporarily (reserveTail()), which
+ * NVSScopedDocument uses to stage the stored MessagePack blob.
+ */
+class NVSArenaAllocator : public ArduinoJson::Allocator {
+public:
+  /**
+   * @param buf Backing memory (must outlive the allocator)
+   * @param size Size of @p buf in bytes
+   */
+  NVSArenaAllocator(uint8_t* buf, size_t size);
+
+  /**
+   * @brief Switch to another backing buffer (the arena must be unused)
+   *
+   * The end of the usable area always coincides with `buf + size`, so data
+   * placed there before is found by reserveTail() afterwards.
+   */
+  void assign(uint8_t* buf, size_t size);
+
+  void* allocate(size_t size) override;
+  void deallocate(void* ptr) override;
+  void* reallocate(void* ptr, size_t newSize) override;
+
+  /**
+   * @brief Release every block at once (documents using the arena must be empty)
+   */
+  void reset();
+
+  /**
+   * @brief Lend the last @p size bytes of the arena out of band
+   * @return nullptr if they are in use or the arena is too small
+   */
+  uint8_t* reserveTail(size_t size);
+
+  /**
+   * @brief Return the bytes lent by reserveTail()
+   */
+  void releaseTail();
+
+  size_t capacity() const { return _size; }  ///< Arena size in bytes
+  size_t used() const { return _top; }       ///< Bytes currently carved (incl. headers)
+  size_t peak() const { return _peak; }      ///< Highest used() so far
+  uint32_t failures() const { return _failures; }  ///< Allocations refused for lack of space
+
+private:
+  // Precedes every block; `prev` links back so freeing the top block can pop it
+  struct alignas(8) BlockHeader {
+    uint32_t size;  ///< Payload size
+    uint32_t prev;  ///< Offset of the previous block header (kNoBlock if none)
+  };
+  static const uint32_t kNoBlock = 0xffffffff;
+
+  static size_t align(size_t size) { return (size + 7) & ~(size_t)7; }
+  BlockHeader* headerOf(void* ptr) const { return (BlockHeader*)ptr - 1; }
+
+  uint8_t* _buf;
+  size_t _size;
+  size_t _top;     ///< First free byte
+  size_t _limit;   ///< End of the usable area (lowered by reserveTail())
+  uint32_t _last;  ///< Offset of the most recent block header
+  size_t _peak;
+  uint32_t _failures;
+};
+
+/**
+ * @class NVSScopedDocument
+ * @brief JsonDocument whose memory lives in one arena, released in one go
+ *
+ * load() stages the stored MessagePack blob at the tail of the arena while the
+ * document fills it from the front, so a MessagePack load does no heap work
+ * besides the arena itself. With a caller-supplied buffer it does none at all.
+ * Legacy JSON modules are loaded (and migrated) through loadModuleConfig().
+ *
+ * Without an explicit size the arena is sized by load(): the blob is read
+ * once, its structure measured (NVSMsgPack::measureShape()) and the arena
+ * grown to the upper bound from arenaBytes(), so the document neither
+ * overflows nor has to be retried.
+ *
+ * @example
+ * ```cpp
+ * {
+ *   NVSScopedDocument cfg(configBus);       // arena sized to the module by load()
+ *   if (cfg.load("pulsfan")) {
+ *     applyFanSettings(cfg.doc());
+ *   }
+ * }  // arena released here
+ *
+ * static uint8_t arena[2048];              // or: no heap at all
+ * NVSScopedDocument wifi(configBus, arena, sizeof(arena));
+ * ```
+ */
+class NVSScopedDocument {
+public:
+  /**
+   * @brief Arena from the bus's budget and allocator
+   *
+   * @param arenaSize Fixed arena size, or 0 to let load() size it per module
+   */
+  explicit NVSScopedDocument(NVSConfigBus& bus, size_t arenaSize = 0);
+
+  /**
+   * @brief Arena over caller memory (static buffer, stack, ...)
+   */
+  NVSScopedDocument(NVSConfigBus& bus, uint8_t* buf, size_t size);
+
+  NVSScopedDocument(const NVSScopedDocument&) = delete;
+  NVSScopedDocument& operator=(const NVSScopedDocument&) = delete;
+
+  /**
+   * @brief Load a module into doc() (cleared first)
+   * @return false if the module is missing, unreadable or the arena is too small
+   *         (arena().failures() > 0 points at the latter)
+   */
+  bool load(const char* moduleId);
+
+  /**
+   * @brief Empty the document and rewind the arena
+   */
+  void clear();
+
+  JsonDocument& doc() { return _doc; }
+  JsonVariant operator[](const char* key) { return _doc[key]; }
+
+  /**
+   * @brief false if a fixed-size arena could not be allocated
+   */
+  explicit operator bool() const { return _autoSize || _arena.capacity() > 0; }
+
+  const NVSArenaAllocator& arena() const { return _arena; }
+
+  /**
+   * @brief Upper bound of the bytes ArduinoJson allocates for a document of
+   *        @p shape once deserialization has finished
+   */
+  static size_t documentBytes(const NVSMsgPack::Shape& shape);
+
+  /**
+   * @brief Arena size that is guaranteed to deserialize a value of @p shape
+   *
+   * Larger than documentBytes(): slot pools are carved at full capacity and
+   * the arena adds a block header per allocation.
+   */
+  static size_t arenaBytes(const NVSMsgPack::Shape& shape);
+
+private:
+  bool ensureArena(size_t size);
+
+  NVSConfigBus& _bus;
+  bool _autoSize;             ///< Arena is (re)sized by load()
+  NVSScratchBuffer _scratch;  ///< Backing memory when not caller-supplied
+  NVSArenaAllocator _arena;
+  JsonDocument _doc;          ///< Destroyed first: returns its blocks to _arena
+};
@@ -0,0 +1,46 @@
+#include "NVSKeyIterator.h"
+#include <esp_idf_version.h>
+#include <string.h>
+
+NVSKeyIterator::NVSKeyIterator(const char* partition, const char* nvsNamespace, nvs_type_t type)
+    : _it(nullptr), _started(false) {
+  memset(&_info, 0, sizeof(_info));
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+  if (nvs_entry_find(partition, nvsNamespace, type, &_it) != ESP_OK) {
+    _it = nullptr;  // ESP_ERR_NVS_NOT_FOUND: namespace empty or missing
+  }
+#else
+  _it = nvs_entry_find(partition, nvsNamespace, type);
+#endif
+}
+
+NVSKeyIterator::~NVSKeyIterator() {
+  if (_it != nullptr) {
+    nvs_release_iterator(_it);
+  }
+}
+
+bool NVSKeyIterator::next() {
+  if (_it == nullptr) {
+    return false;
+  }
+
+  if (_started) {
+    // Both IDF variants release the iterator when the end is reached
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+    if (nvs_entry_next(&_it) != ESP_OK) {
+      _it = nullptr;
+      return false;
+    }
+#else
+    _it = nvs_entry_next(_it);
+    if (_it == nullptr) {
+      return false;
+    }
+#endif
+  }
+  _started = true;
+
+  nvs_entry_info(_it, &_info);
+  return true;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file NVSKeyIterator.h
+ * @brief Thin wrapper around the ESP-IDF NVS entry iterator
+ *
+ * Preferences has no way to enumerate keys, so NVSConfigBus uses the IDF
+ * iterator directly for whole-namespace operations such as exportAll().
+ * The wrapper hides the API differences between IDF 4.x and 5.x.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <nvs.h>
+
+/**
+ * @class NVSKeyIterator
+ * @brief Iterates over all keys stored in one NVS namespace
+ *
+ * @example
+ * ```cpp
+ * NVSKeyIterator it(NVS_DEFAULT_PART_NAME, "appcfg");
+ * while (it.next()) {
+ *   Serial.println(it.key());
+ * }
+ * ```
+ */
+class NVSKeyIterator {
+public:
+  /**
+   * @brief Start iterating over @p nvsNamespace in partition @p partition
+   *
+   * @param partition NVS partition label (usually NVS_DEFAULT_PART_NAME)
+   * @param nvsNamespace Namespace to iterate
+   * @param type Entry type filter (default: all types)
+   */
+  NVSKeyIterator(const char* partition, const char* nvsNamespace, nvs_type_t type = NVS_TYPE_ANY);
+  ~NVSKeyIterator();
+
+  NVSKeyIterator(const NVSKeyIterator&) = delete;
+  NVSKeyIterator& operator=(const NVSKeyIterator&) = delete;
+
+  /**
+   * @brief Advance to the next entry (the first call yields the first entry)
+   * @return true if an entry is available via key() / type()
+   */
+  bool next();
+
+  /** @brief Key of the current entry (valid after next() returned true) */
+  const char* key() const { return _info.key; }
+
+  /** @brief NVS type of the current entry (valid after next() returned true) */
+  nvs_type_t type() const { return _info.type; }
+
+private:
+  nvs_iterator_t _it;      ///< IDF iterator (nullptr once exhausted)
+  bool _started;           ///< True after the first call to next()
+  nvs_entry_info_t _info;  ///< Info of the current entry
+};
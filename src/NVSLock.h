@@ -0,0 +1,40 @@
+/**
+ * @file NVSLock.h
+ * @brief Scoped FreeRTOS mutex guard used by NVSConfigBus
+ *
+ * NVSConfigBus keeps some state in RAM (e.g. the module directory) that can be
+ * touched from several tasks. The guard tolerates a null handle so a bus whose
+ * mutex could not be created still works single-threaded.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * @class NVSLockGuard
+ * @brief Takes a recursive mutex for the lifetime of the guard
+ */
+class NVSLockGuard {
+public:
+  explicit NVSLockGuard(SemaphoreHandle_t lock) : _lock(lock) {
+    if (_lock != nullptr) {
+      xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    }
+  }
+
+  ~NVSLockGuard() {
+    if (_lock != nullptr) {
+      xSemaphoreGiveRecursive(_lock);
+    }
+  }
+
+  NVSLockGuard(const NVSLockGuard&) = delete;
+  NVSLockGuard& operator=(const NVSLockGuard&) = delete;
+
+private:
+  SemaphoreHandle_t _lock;
+};
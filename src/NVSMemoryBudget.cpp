@@ -0,0 +1,131 @@
+#include "NVSMemoryBudget.h"
+#include "NVSConfigBus.h"
+#include "NVSLock.h"
+
+NVSMemoryBudget::NVSMemoryBudget(size_t limitBytes, uint32_t waitMs)
+    : _mutex(xSemaphoreCreateRecursiveMutex()),
+      _released(xSemaphoreCreateCounting(0xffff, 0)),
+      _limit(limitBytes), _waitMs(waitMs), _used(0), _peak(0), _rejected(0), _waiters(0) {}
+
+NVSMemoryBudget::~NVSMemoryBudget() {
+  if (_released != nullptr) {
+    vSemaphoreDelete(_released);
+  }
+  if (_mutex != nullptr) {
+    vSemaphoreDelete(_mutex);
+  }
+}
+
+NVSMemoryBudget& NVSMemoryBudget::shared() {
+  static NVSMemoryBudget budget;
+  return budget;
+}
+
+void NVSMemoryBudget::configure(size_t limitBytes, uint32_t waitMs) {
+  {
+    NVSLockGuard guard(_mutex);
+    _limit = limitBytes;
+    _waitMs = waitMs;
+  }
+  release(0);  // A larger limit may admit waiting tasks
+}
+
+bool NVSMemoryBudget::admit(size_t bytes) {
+  // Caller holds _mutex
+  if (_limit != 0 && _used + bytes > _limit) {
+    return false;
+  }
+  _used += bytes;
+  if (_used > _peak) {
+    _peak = _used;
+  }
+  return true;
+}
+
+bool NVSMemoryBudget::acquire(size_t bytes) {
+  TickType_t start = xTaskGetTickCount();
+  TickType_t remaining = 0;
+  bool waiting = false;
+  while (true) {
+    {
+      NVSLockGuard guard(_mutex);
+      if (waiting) {
+        _waiters--;
+        waiting = false;
+      }
+      if (admit(bytes)) {
+        return true;
+      }
+
+      // Requests that can never fit, or that may not wait, fail right away
+      TickType_t elapsed = xTaskGetTickCount() - start;
+      TickType_t timeout = pdMS_TO_TICKS(_waitMs);
+      if (bytes > _limit || _released == nullptr || elapsed >= timeout) {
+        _rejected++;
+        return false;
+      }
+      remaining = timeout - elapsed;
+      _waiters++;
+      waiting = true;
+    }
+    // Woken by release(); re-check under the mutex (another task may win)
+    xSemaphoreTake(_released, remaining);
+  }
+}
+
+bool NVSMemoryBudget::grow(size_t oldBytes, size_t newBytes) {
+  if (newBytes <= oldBytes) {
+    return true;
+  }
+  return acquire(newBytes - oldBytes);
+}
+
+void NVSMemoryBudget::release(size_t bytes) {
+  NVSLockGuard guard(_mutex);
+  _used = bytes < _used ? _used - bytes : 0;
+  // Wake every waiter; each one re-checks whether its request fits now
+  for (uint16_t i = 0; i < _waiters && _released != nullptr; i++) {
+    xSemaphoreGive(_released);
+  }
+}
+
+NVSScratchBuffer::NVSScratchBuffer(NVSMemoryBudget& budget, NVSAllocator& allocator, size_t size,
+                                   NVSMemoryClass memoryClass)
+    : _budget(budget), _allocator(allocator), _memoryClass(memoryClass), _data(nullptr), _size(0),
+      _error(NVSConfigError::None) {
+  if (size > 0) {
+    grow(size);
+  }
+}
+
+NVSScratchBuffer::~NVSScratchBuffer() {
+  release();
+}
+
+bool NVSScratchBuffer::grow(size_t size) {
+  if (size <= _size) {
+    return true;
+  }
+  if (!_budget.grow(_size, size)) {
+    _error = NVSConfigError::BudgetExhausted;
+    return false;
+  }
+  uint8_t* grown = (uint8_t*)_allocator.reallocate(_data, size, _memoryClass);
+  if (grown == nullptr) {
+    _budget.release(size - _size);
+    _error = NVSConfigError::OutOfMemory;
+    return false;
+  }
+  _data = grown;
+  _size = size;
+  return true;
+}
+
+void NVSScratchBuffer::release() {
+  if (_data != nullptr) {
+    _allocator.deallocate(_data, _memoryClass);
+    _budget.release(_size);
+    _data = nullptr;
+    _size = 0;
+  }
+}
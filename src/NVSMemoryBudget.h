@@ -0,0 +1,159 @@
+/**
+ * @file NVSMemoryBudget.h
+ * @brief Bounded pool for the transient buffers of NVSConfigBus
+ *
+ * Every scratch buffer NVSConfigBus needs for a load, save, export or import
+ * is reserved against a byte budget before it is allocated. Requests that
+ * would exceed the budget wait (up to a timeout) for other tasks to release
+ * their buffers, or fail with NVSConfigError::BudgetExhausted, so config I/O
+ * from several tasks cannot run the heap dry.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "NVSAllocator.h"
+
+// Default byte budget of NVSMemoryBudget::shared() (0 = unlimited, only tracked)
+#ifndef NVS_CFG_RAM_BUDGET
+#define NVS_CFG_RAM_BUDGET 0
+#endif
+
+// Default time a request waits for budget before failing (0 = fail fast)
+#ifndef NVS_CFG_RAM_WAIT_MS
+#define NVS_CFG_RAM_WAIT_MS 100
+#endif
+
+enum class NVSConfigError : uint8_t;  // Defined in NVSConfigBus.h
+
+/**
+ * @class NVSMemoryBudget
+ * @brief Thread-safe byte counter with admission control
+ *
+ * All NVSConfigBus instances share NVSMemoryBudget::shared() unless a bus is
+ * given its own pool with NVSConfigBus::setMemoryBudget().
+ *
+ * @example
+ * ```cpp
+ * // ESP32-C3: at most 6 KB of config buffers in flight, wait up to 50 ms
+ * NVSMemoryBudget::shared().configure(6144, 50);
+ * ```
+ */
+class NVSMemoryBudget {
+public:
+  /**
+   * @brief Create a budget
+   *
+   * @param limitBytes Maximum bytes reserved at the same time (0 = unlimited)
+   * @param waitMs How long acquire() waits for released budget (0 = fail fast)
+   */
+  explicit NVSMemoryBudget(size_t limitBytes = NVS_CFG_RAM_BUDGET, uint32_t waitMs = NVS_CFG_RAM_WAIT_MS);
+  ~NVSMemoryBudget();
+
+  NVSMemoryBudget(const NVSMemoryBudget&) = delete;
+  NVSMemoryBudget& operator=(const NVSMemoryBudget&) = delete;
+
+  /**
+   * @brief Pool used by every NVSConfigBus that has not been given another one
+   */
+  static NVSMemoryBudget& shared();
+
+  /**
+   * @brief Change limit and wait time (buffers already reserved stay valid)
+   */
+  void configure(size_t limitBytes, uint32_t waitMs);
+
+  /**
+   * @brief Reserve @p bytes, waiting up to the configured time if needed
+   * @return false if the request exceeds the limit or timed out
+   */
+  bool acquire(size_t bytes);
+
+  /**
+   * @brief Grow an existing reservation from @p oldBytes to @p newBytes
+   * @return false (reservation unchanged) if the growth could not be admitted
+   */
+  bool grow(size_t oldBytes, size_t newBytes);
+
+  /**
+   * @brief Return @p bytes to the pool and wake waiting tasks
+   */
+  void release(size_t bytes);
+
+  size_t limit() const { return _limit; }      ///< Configured limit (0 = unlimited)
+  size_t used() const { return _used; }        ///< Bytes currently reserved
+  size_t peak() const { return _peak; }        ///< Highest value of used() so far
+  uint32_t rejected() const { return _rejected; }  ///< Requests that failed admission
+
+private:
+  bool admit(size_t bytes);
+
+  SemaphoreHandle_t _mutex;     ///< Guards the counters
+  SemaphoreHandle_t _released;  ///< Signalled once per waiter on release()
+  size_t _limit;
+  uint32_t _waitMs;
+  size_t _used;
+  size_t _peak;
+  uint32_t _rejected;
+  uint16_t _waiters;            ///< Tasks blocked in acquire()
+};
+
+/**
+ * @class NVSScratchBuffer
+ * @brief Heap buffer whose size is reserved against an NVSMemoryBudget
+ *
+ * Memory comes from an NVSAllocator under the given memory class. Released
+ * (memory and budget) when it goes out of scope.
+ *
+ * @example
+ * ```cpp
+ * NVSScratchBuffer buf(NVSMemoryBudget::shared(), NVSAllocator::defaultAllocator(), 2048);
+ * if (!buf) {
+ *   return false;  // buf.error() tells budget from heap exhaustion
+ * }
+ * ```
+ */
+class NVSScratchBuffer {
+public:
+  /**
+   * @brief Reserve and allocate @p size bytes (0 = empty, grow() later)
+   */
+  NVSScratchBuffer(NVSMemoryBudget& budget, NVSAllocator& allocator, size_t size = 0,
+                   NVSMemoryClass memoryClass = NVSMemoryClass::Scratch);
+  ~NVSScratchBuffer();
+
+  NVSScratchBuffer(const NVSScratchBuffer&) = delete;
+  NVSScratchBuffer& operator=(const NVSScratchBuffer&) = delete;
+
+  /**
+   * @brief Enlarge the buffer to at least @p size bytes, keeping its contents
+   * @return false if budget or heap refused; the old buffer stays valid
+   */
+  bool grow(size_t size);
+
+  /**
+   * @brief Free the buffer and return its budget early
+   */
+  void release();
+
+  uint8_t* data() const { return _data; }
+  size_t size() const { return _size; }
+  explicit operator bool() const { return _data != nullptr; }
+
+  /**
+   * @brief Why the last allocation failed (BudgetExhausted or OutOfMemory)
+   */
+  NVSConfigError error() const { return _error; }
+
+private:
+  NVSMemoryBudget& _budget;
+  NVSAllocator& _allocator;
+  NVSMemoryClass _memoryClass;
+  uint8_t* _data;
+  size_t _size;
+  NVSConfigError _error;
+};
@@ -0,0 +1,1095 @@
+/**
+ * @file NVSMsgPack.h
+ * @brief Minimal streaming MessagePack helpers used by NVSConfigBus
+ *
+ * These helpers operate directly on the MessagePack bytes stored in NVS without
+ * building an ArduinoJson document. They are used for bulk export, where every
+ * module blob is transcoded to JSON on the fly with a small, constant amount of RAM,
+ * and for bulk import, where a JSON or MessagePack stream is converted to the
+ * stored MessagePack representation as it is read.
+ *
+ * The header only depends on the C standard library so it can also be compiled
+ * for host tools. Output is written through any type that provides
+ * `size_t write(const uint8_t* data, size_t len)` (e.g. Arduino's Print); input
+ * is read from any type that provides `int read()` returning -1 at the end.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <errno.h>
+
+// Maximum container nesting handled by the streaming transcoders
+// (matches ArduinoJson's default nesting limit)
+#ifndef NVS_CFG_MAX_NESTING
+#define NVS_CFG_MAX_NESTING 10
+#endif
+
+namespace NVSMsgPack {
+
+/**
+ * @brief Kind of a decoded MessagePack token
+ */
+enum class Type : uint8_t {
+  Invalid,
+  Nil,
+  Bool,
+  Int,     ///< Negative integer (value in Token::i)
+  UInt,    ///< Non-negative integer (value in Token::u)
+  Float,
+  Double,
+  Str,     ///< Payload in Token::data / Token::length
+  Bin,     ///< Payload in Token::data / Token::length
+  Ext,     ///< Payload in Token::data / Token::length
+  Array,   ///< Token::length elements follow
+  Map      ///< Token::length key/value pairs follow
+};
+
+/**
+ * @brief One decoded MessagePack header (plus payload pointer for str/bin/ext)
+ */
+struct Token {
+  Type type = Type::Invalid;
+  uint32_t length = 0;           ///< Element count (array/map) or payload size (str/bin/ext)
+  const uint8_t* data = nullptr; ///< Payload for str/bin/ext (points into the input)
+  union {
+    bool b;
+    int64_t i;
+    uint64_t u;
+    float f;
+    double d;
+  };
+  Token() : u(0) {}
+};
+
+inline uint64_t readBigEndian(const uint8_t* p, size_t n) {
+  uint64_t v = 0;
+  for (size_t k = 0; k < n; k++) {
+    v = (v << 8) | p[k];
+  }
+  return v;
+}
+
+/**
+ * @brief Static layout of a MessagePack header, derived from its first byte
+ */
+struct HeaderLayout {
+  Type type = Type::Invalid;
+  uint8_t lenBytes = 0;    ///< Width of the big-endian length field (str/bin/ext/array/map)
+  uint8_t fixedBytes = 0;  ///< Fixed-size payload (scalar value bytes, ext type byte)
+  uint32_t length = 0;     ///< Length encoded in the first byte (fix* types)
+  bool hasPayload = false; ///< True if `length` payload bytes follow (str/bin/ext)
+};
+
+/**
+ * @brief Describe the header that starts with byte @p c
+ */
+inline HeaderLayout describeHeader(uint8_t c) {
+  HeaderLayout h;
+  if (c <= 0x7f || c >= 0xe0) { h.type = c <= 0x7f ? Type::UInt : Type::Int; return h; }
+  if ((c & 0xf0) == 0x80) { h.type = Type::Map; h.length = c & 0x0f; return h; }
+  if ((c & 0xf0) == 0x90) { h.type = Type::Array; h.length = c & 0x0f; return h; }
+  if ((c & 0xe0) == 0xa0) { h.type = Type::Str; h.length = c & 0x1f; h.hasPayload = true; return h; }
+
+  switch (c) {
+    case 0xc0: h.type = Type::Nil; break;
+    case 0xc2: case 0xc3: h.type = Type::Bool; break;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+      h.type = Type::UInt; h.fixedBytes = (uint8_t)(1 << (c - 0xcc)); break;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+      h.type = Type::Int; h.fixedBytes = (uint8_t)(1 << (c - 0xd0)); break;
+    case 0xca: h.type = Type::Float; h.fixedBytes = 4; break;
+    case 0xcb: h.type = Type::Double; h.fixedBytes = 8; break;
+    case 0xd9: case 0xda: case 0xdb:
+      h.type = Type::Str; h.lenBytes = (uint8_t)(1 << (c - 0xd9)); h.hasPayload = true; break;
+    case 0xc4: case 0xc5: case 0xc6:
+      h.type = Type::Bin; h.lenBytes = (uint8_t)(1 << (c - 0xc4)); h.hasPayload = true; break;
+    case 0xc7: case 0xc8: case 0xc9:
+      h.type = Type::Ext; h.lenBytes = (uint8_t)(1 << (c - 0xc7)); h.fixedBytes = 1; h.hasPayload = true; break;
+    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+      h.type = Type::Ext; h.length = (uint32_t)1 << (c - 0xd4); h.fixedBytes = 1; h.hasPayload = true; break;
+    case 0xdc: case 0xdd: h.type = Type::Array; h.lenBytes = (uint8_t)(2 << (c - 0xdc)); break;
+    case 0xde: case 0xdf: h.type = Type::Map; h.lenBytes = (uint8_t)(2 << (c - 0xde)); break;
+    default: break;  // 0xc1 is never used
+  }
+  return h;
+}
+
+/**
+ * @brief Decode the token at @p p and advance past it
+ *
+ * For str/bin/ext the payload is skipped as well; for arrays and maps only
+ * the header is consumed (the elements follow).
+ *
+ * @return false if the input is truncated or uses a reserved type byte
+ */
+inline bool readToken(const uint8_t*& p, const uint8_t* end, Token& t) {
+  if (p >= end) {
+    return false;
+  }
+  const uint8_t c = *p++;
+  const HeaderLayout h = describeHeader(c);
+  size_t avail = (size_t)(end - p);
+
+  t.type = h.type;
+  t.length = h.length;
+  t.data = nullptr;
+  if (h.type == Type::Invalid || avail < (size_t)h.lenBytes + h.fixedBytes) {
+    return false;
+  }
+  if (h.lenBytes > 0) {
+    t.length = (uint32_t)readBigEndian(p, h.lenBytes);
+    p += h.lenBytes;
+    avail -= h.lenBytes;
+  }
+
+  switch (h.type) {
+    case Type::UInt:
+      t.u = h.fixedBytes == 0 ? c : readBigEndian(p, h.fixedBytes);
+      break;
+    case Type::Int: {
+      if (h.fixedBytes == 0) {
+        t.i = (int8_t)c;
+        break;
+      }
+      uint64_t raw = readBigEndian(p, h.fixedBytes);
+      size_t bits = (size_t)h.fixedBytes * 8;
+      // Sign-extend from the encoded width
+      if (bits < 64 && (raw & ((uint64_t)1 << (bits - 1)))) {
+        raw |= ~(uint64_t)0 << bits;
+      }
+      t.i = (int64_t)raw;
+      if (t.i >= 0) {
+        t.type = Type::UInt;
+      }
+      break;
+    }
+    case Type::Bool:
+      t.b = c == 0xc3;
+      break;
+    case Type::Float: {
+      uint32_t raw = (uint32_t)readBigEndian(p, 4);
+      memcpy(&t.f, &raw, sizeof(raw));
+      break;
+    }
+    case Type::Double: {
+      uint64_t raw = readBigEndian(p, 8);
+      memcpy(&t.d, &raw, sizeof(raw));
+      break;
+    }
+    case Type::Array:
+    case Type::Map: {
+      // Every element takes at least one byte: reject absurd counts early
+      uint64_t minBytes = h.type == Type::Map ? (uint64_t)t.length * 2 : t.length;
+      return minBytes <= avail;
+    }
+    default:
+      break;
+  }
+  p += h.fixedBytes;
+  avail -= h.fixedBytes;
+
+  if (h.hasPayload) {
+    // str/bin/ext: skip the payload (ext's type byte was consumed as fixedBytes)
+    if (avail < t.length) {
+      return false;
+    }
+    t.data = p;
+    p += t.length;
+  }
+  return true;
+}
+
+/**
+ * @brief Skip exactly one complete value (including nested containers)
+ *
+ * Uses a single pending-element counter instead of recursion, so the stack
+ * usage is constant regardless of nesting depth.
+ */
+inline bool skipValue(const uint8_t*& p, const uint8_t* end) {
+  uint64_t pending = 1;
+  Token t;
+  while (pending > 0) {
+    if (!readToken(p, end, t)) {
+      return false;
+    }
+    pending--;
+    if (t.type == Type::Array) {
+      pending += t.length;
+    } else if (t.type == Type::Map) {
+      pending += (uint64_t)t.length * 2;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Check that @p data holds exactly one well-formed MessagePack value
+ */
+inline bool validate(const uint8_t* data, size_t len) {
+  if (data == nullptr || len == 0) {
+    return false;
+  }
+  const uint8_t* p = data;
+  const uint8_t* end = data + len;
+  return skipValue(p, end) && p == end;
+}
+
+/**
+ * @brief Structural statistics of one MessagePack value (see measureShape())
+ */
+struct Shape {
+  uint32_t values = 0;       ///< Values, including containers and the root (map keys excluded)
+  uint32_t members = 0;      ///< Map key/value pairs
+  uint32_t strings = 0;      ///< str/bin payloads, keys included
+  uint32_t stringBytes = 0;  ///< Total size of those payloads
+  uint32_t wideValues = 0;   ///< Doubles and integers that do not fit in 32 bits
+  uint8_t depth = 0;         ///< Deepest container nesting (0 = scalar root)
+};
+
+/**
+ * @brief Count what a DOM built from @p data would have to hold
+ *
+ * Like validate(), but also collects a Shape; used to size JSON documents
+ * before deserializing.
+ *
+ * @return false if @p data is not exactly one well-formed value
+ */
+inline bool measureShape(const uint8_t* data, size_t len, Shape& shape) {
+  shape = Shape();
+  if (data == nullptr || len == 0) {
+    return false;
+  }
+  const uint8_t* p = data;
+  const uint8_t* end = data + len;
+
+  // Remaining elements per open container; depth saturates at
+  // NVS_CFG_MAX_NESTING + 1, the counts stay exact at any depth
+  uint64_t remaining[NVS_CFG_MAX_NESTING + 1];
+  size_t level = 0;
+  uint64_t pending = 1;
+  uint32_t tokens = 0;
+  Token t;
+  while (pending > 0) {
+    if (!readToken(p, end, t)) {
+      return false;
+    }
+    pending--;
+    tokens++;
+    while (level > 0 && remaining[level - 1] == 0) {
+      level--;
+    }
+    if (level > 0) {
+      remaining[level - 1]--;
+    }
+
+    switch (t.type) {
+      case Type::Str:
+      case Type::Bin:
+        shape.strings++;
+        shape.stringBytes += t.length;
+        break;
+      case Type::Double:
+        shape.wideValues++;
+        break;
+      case Type::Int:
+        shape.wideValues += t.i < INT32_MIN ? 1 : 0;
+        break;
+      case Type::UInt:
+        shape.wideValues += t.u > UINT32_MAX ? 1 : 0;
+        break;
+      case Type::Array:
+      case Type::Map: {
+        uint64_t elements = t.type == Type::Map ? (uint64_t)t.length * 2 : t.length;
+        if (t.type == Type::Map) {
+          shape.members += t.length;
+        }
+        pending += elements;
+        if (level + 1 > shape.depth) {
+          shape.depth = (uint8_t)(level + 1);
+        }
+        if (elements > 0 && level < NVS_CFG_MAX_NESTING) {
+          remaining[level++] = elements;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  shape.values = tokens - shape.members;
+  return p == end;
+}
+
+/**
+ * @brief Write the smallest MessagePack map header for @p count pairs
+ * @return Number of bytes written to @p out (at most 5)
+ */
+inline size_t encodeMapHeader(uint32_t count, uint8_t* out) {
+  if (count < 16) {
+    out[0] = (uint8_t)(0x80 | count);
+    return 1;
+  }
+  if (count <= 0xffff) {
+    out[0] = 0xde;
+    out[1] = (uint8_t)(count >> 8);
+    out[2] = (uint8_t)count;
+    return 3;
+  }
+  out[0] = 0xdf;
+  out[1] = (uint8_t)(count >> 24);
+  out[2] = (uint8_t)(count >> 16);
+  out[3] = (uint8_t)(count >> 8);
+  out[4] = (uint8_t)count;
+  return 5;
+}
+
+/**
+ * @brief Write the smallest MessagePack array header for @p count elements
+ * @return Number of bytes written to @p out (at most 5)
+ */
+inline size_t encodeArrayHeader(uint32_t count, uint8_t* out) {
+  if (count < 16) {
+    out[0] = (uint8_t)(0x90 | count);
+    return 1;
+  }
+  if (count <= 0xffff) {
+    out[0] = 0xdc;
+    out[1] = (uint8_t)(count >> 8);
+    out[2] = (uint8_t)count;
+    return 3;
+  }
+  out[0] = 0xdd;
+  out[1] = (uint8_t)(count >> 24);
+  out[2] = (uint8_t)(count >> 16);
+  out[3] = (uint8_t)(count >> 8);
+  out[4] = (uint8_t)count;
+  return 5;
+}
+
+/**
+ * @brief Write the smallest MessagePack str header for a @p len byte string
+ * @return Number of bytes written to @p out (at most 5)
+ */
+inline size_t encodeStrHeader(uint32_t len, uint8_t* out) {
+  if (len < 32) {
+    out[0] = (uint8_t)(0xa0 | len);
+    return 1;
+  }
+  if (len <= 0xff) {
+    out[0] = 0xd9;
+    out[1] = (uint8_t)len;
+    return 2;
+  }
+  if (len <= 0xffff) {
+    out[0] = 0xda;
+    out[1] = (uint8_t)(len >> 8);
+    out[2] = (uint8_t)len;
+    return 3;
+  }
+  out[0] = 0xdb;
+  out[1] = (uint8_t)(len >> 24);
+  out[2] = (uint8_t)(len >> 16);
+  out[3] = (uint8_t)(len >> 8);
+  out[4] = (uint8_t)len;
+  return 5;
+}
+
+/**
+ * @brief Small write-combining buffer in front of a byte sink
+ *
+ * The transcoder emits many tiny fragments (quotes, commas, digits); batching
+ * them avoids one virtual Print::write() call per character.
+ */
+template <typename TWriter, size_t N = 32>
+class BufferedWriter {
+public:
+  explicit BufferedWriter(TWriter& out) : _out(out), _len(0), _ok(true) {}
+
+  void write(const uint8_t* data, size_t len) {
+    if (len >= N) {
+      flush();
+      sink(data, len);
+      return;
+    }
+    if (_len + len > N) {
+      flush();
+    }
+    memcpy(_buf + _len, data, len);
+    _len += len;
+  }
+
+  void write(char c) {
+    if (_len == N) {
+      flush();
+    }
+    _buf[_len++] = (uint8_t)c;
+  }
+
+  void write(const char* s) { write((const uint8_t*)s, strlen(s)); }
+
+  bool flush() {
+    if (_len > 0) {
+      sink(_buf, _len);
+      _len = 0;
+    }
+    return _ok;
+  }
+
+  bool ok() const { return _ok; }
+
+private:
+  void sink(const uint8_t* data, size_t len) {
+    if (_ok && _out.write(data, len) != len) {
+      _ok = false;
+    }
+  }
+
+  TWriter& _out;
+  uint8_t _buf[N];
+  size_t _len;
+  bool _ok;
+};
+
+/**
+ * @brief Write @p len bytes as a quoted, escaped JSON string
+ */
+template <typename TBuffered>
+void writeJsonString(TBuffered& w, const uint8_t* s, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  w.write('"');
+  size_t runStart = 0;
+  for (size_t k = 0; k < len; k++) {
+    const uint8_t c = s[k];
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;  // Plain byte (UTF-8 sequences are passed through unchanged)
+    }
+    w.write(s + runStart, k - runStart);
+    runStart = k + 1;
+    w.write('\\');
+    switch (c) {
+      case '"': w.write('"'); break;
+      case '\\': w.write('\\'); break;
+      case '\b': w.write('b'); break;
+      case '\f': w.write('f'); break;
+      case '\n': w.write('n'); break;
+      case '\r': w.write('r'); break;
+      case '\t': w.write('t'); break;
+      default:
+        w.write("u00");
+        w.write(hex[c >> 4]);
+        w.write(hex[c & 0x0f]);
+        break;
+    }
+  }
+  w.write(s + runStart, len - runStart);
+  w.write('"');
+}
+
+/**
+ * @brief Write a scalar token as JSON text (containers are handled by toJson())
+ */
+template <typename TBuffered>
+void writeJsonScalar(TBuffered& w, const Token& t) {
+  char num[32];
+  switch (t.type) {
+    case Type::Bool:
+      w.write(t.b ? "true" : "false");
+      break;
+    case Type::UInt:
+      snprintf(num, sizeof(num), "%llu", (unsigned long long)t.u);
+      w.write(num);
+      break;
+    case Type::Int:
+      snprintf(num, sizeof(num), "%lld", (long long)t.i);
+      w.write(num);
+      break;
+    case Type::Float:
+      if (isnan(t.f) || isinf(t.f)) {
+        w.write("null");  // JSON has no representation for NaN/Infinity
+      } else {
+        // Shortest of the two precisions that round-trips
+        snprintf(num, sizeof(num), "%.7g", (double)t.f);
+        if (strtof(num, nullptr) != t.f) {
+          snprintf(num, sizeof(num), "%.9g", (double)t.f);
+        }
+        w.write(num);
+      }
+      break;
+    case Type::Double:
+      if (isnan(t.d) || isinf(t.d)) {
+        w.write("null");
+      } else {
+        snprintf(num, sizeof(num), "%.15g", t.d);
+        if (strtod(num, nullptr) != t.d) {
+          snprintf(num, sizeof(num), "%.17g", t.d);
+        }
+        w.write(num);
+      }
+      break;
+    case Type::Str:
+      writeJsonString(w, t.data, t.length);
+      break;
+    default:
+      w.write("null");  // nil, and bin/ext which have no JSON equivalent
+      break;
+  }
+}
+
+/**
+ * @brief Transcode one MessagePack value to JSON text without building a DOM
+ *
+ * Nesting is tracked in a fixed array of NVS_CFG_MAX_NESTING frames, so RAM use
+ * is constant. Non-string map keys are written as quoted strings to keep the
+ * output valid JSON.
+ *
+ * @param data MessagePack input
+ * @param len Size of the input in bytes
+ * @param out Destination with `size_t write(const uint8_t*, size_t)`
+ * @return true if the whole value was transcoded and written
+ * @return false on malformed input, excessive nesting or a short write
+ *
+ * @note Output is streamed while parsing. Call validate() first if a failure
+ *       must not leave partial output behind.
+ */
+template <typename TWriter>
+bool toJson(const uint8_t* data, size_t len, TWriter& out) {
+  struct Frame {
+    uint32_t remaining;  // Items left (map: keys + values)
+    bool isMap;
+    bool first;
+  };
+  Frame stack[NVS_CFG_MAX_NESTING];
+  size_t depth = 0;
+
+  BufferedWriter<TWriter> w(out);
+  const uint8_t* p = data;
+  const uint8_t* end = data + len;
+  Token t;
+
+  do {
+    // Separator / key handling for the enclosing container
+    bool isKey = false;
+    if (depth > 0) {
+      Frame& f = stack[depth - 1];
+      isKey = f.isMap && (f.remaining % 2 == 0);
+      if (isKey || !f.isMap) {
+        if (!f.first) {
+          w.write(',');
+        }
+        f.first = false;
+      }
+      f.remaining--;
+    }
+
+    if (!readToken(p, end, t)) {
+      return false;
+    }
+
+    if (isKey) {
+      if (t.type == Type::Str) {
+        writeJsonString(w, t.data, t.length);
+      } else if (t.type == Type::Array || t.type == Type::Map) {
+        return false;  // Container keys cannot be expressed in JSON
+      } else {
+        // Stringify scalar keys, e.g. 1 -> "1"
+        w.write('"');
+        writeJsonScalar(w, t);
+        w.write('"');
+      }
+      w.write(':');
+    } else if (t.type == Type::Array || t.type == Type::Map) {
+      if (depth >= NVS_CFG_MAX_NESTING) {
+        return false;
+      }
+      bool isMap = t.type == Type::Map;
+      w.write(isMap ? '{' : '[');
+      stack[depth].remaining = isMap ? t.length * 2 : t.length;
+      stack[depth].isMap = isMap;
+      stack[depth].first = true;
+      depth++;
+    } else {
+      writeJsonScalar(w, t);
+    }
+
+    // Close every container that is now complete
+    while (depth > 0 && stack[depth - 1].remaining == 0) {
+      w.write(stack[depth - 1].isMap ? '}' : ']');
+      depth--;
+    }
+  } while (depth > 0);
+
+  return w.flush();
+}
+
+/**
+ * @brief Append-only MessagePack encoder over a caller-provided buffer
+ *
+ * Writes past the capacity are dropped and latch overflowed(), so callers can
+ * encode a whole value and check once at the end.
+ */
+class BufferWriter {
+public:
+  BufferWriter(uint8_t* data, size_t capacity) : _data(data), _cap(capacity), _len(0), _overflow(false) {}
+
+  uint8_t* data() const { return _data; }
+  size_t size() const { return _len; }
+  bool overflowed() const { return _overflow; }
+  void reset() { _len = 0; _overflow = false; }
+
+  void put(uint8_t c) {
+    if (_len < _cap) {
+      _data[_len++] = c;
+    } else {
+      _overflow = true;
+    }
+  }
+
+  void put(const uint8_t* d, size_t n) {
+    if (n <= _cap - _len) {
+      memcpy(_data + _len, d, n);
+      _len += n;
+    } else {
+      _overflow = true;
+    }
+  }
+
+  void putBigEndian(uint64_t v, size_t n) {
+    for (size_t k = n; k > 0; k--) {
+      put((uint8_t)(v >> ((k - 1) * 8)));
+    }
+  }
+
+  void writeNil() { put(0xc0); }
+  void writeBool(bool b) { put(b ? 0xc3 : 0xc2); }
+
+  void writeUInt(uint64_t v) {
+    if (v <= 0x7f) { put((uint8_t)v); }
+    else if (v <= 0xff) { put(0xcc); putBigEndian(v, 1); }
+    else if (v <= 0xffff) { put(0xcd); putBigEndian(v, 2); }
+    else if (v <= 0xffffffffULL) { put(0xce); putBigEndian(v, 4); }
+    else { put(0xcf); putBigEndian(v, 8); }
+  }
+
+  void writeInt(int64_t v) {
+    if (v >= 0) { writeUInt((uint64_t)v); }
+    else if (v >= -32) { put((uint8_t)(int8_t)v); }
+    else if (v >= -128) { put(0xd0); putBigEndian((uint64_t)v, 1); }
+    else if (v >= -32768) { put(0xd1); putBigEndian((uint64_t)v, 2); }
+    else if (v >= -2147483647LL - 1) { put(0xd2); putBigEndian((uint64_t)v, 4); }
+    else { put(0xd3); putBigEndian((uint64_t)v, 8); }
+  }
+
+  /** @brief Encode as float32 when that is lossless (same rule as ArduinoJson) */
+  void writeDouble(double v) {
+    float f = (float)v;
+    if ((double)f == v || v != v) {
+      uint32_t raw;
+      memcpy(&raw, &f, sizeof(raw));
+      put(0xca);
+      putBigEndian(raw, 4);
+    } else {
+      uint64_t raw;
+      memcpy(&raw, &v, sizeof(raw));
+      put(0xcb);
+      putBigEndian(raw, 8);
+    }
+  }
+
+  void writeStr(const char* s, size_t len) {
+    uint8_t header[5];
+    put(header, encodeStrHeader((uint32_t)len, header));
+    put((const uint8_t*)s, len);
+  }
+
+  void writeMapHeader(uint32_t count) {
+    uint8_t header[5];
+    put(header, encodeMapHeader(count, header));
+  }
+
+  void writeArrayHeader(uint32_t count) {
+    uint8_t header[5];
+    put(header, encodeArrayHeader(count, header));
+  }
+
+  /**
+   * @brief Reserve room for a header whose size is only known at the end
+   * @return Position to pass to finishStr() / finishContainer()
+   */
+  size_t reserveHeader() {
+    size_t pos = _len;
+    for (int k = 0; k < 5; k++) {
+      put(0);
+    }
+    return pos;
+  }
+
+  /** @brief Finalize a string started with reserveHeader() */
+  void finishStr(size_t pos) {
+    uint8_t header[5];
+    finish(pos, encodeStrHeader((uint32_t)(_len - pos - 5), header), header);
+  }
+
+  /** @brief Finalize an array or map started with reserveHeader() */
+  void finishContainer(size_t pos, uint32_t count, bool isMap) {
+    uint8_t header[5];
+    finish(pos, isMap ? encodeMapHeader(count, header) : encodeArrayHeader(count, header), header);
+  }
+
+private:
+  // Replace the 5 reserved bytes at pos by the compact header and close the gap
+  void finish(size_t pos, size_t headerLen, const uint8_t* header) {
+    if (_overflow) {
+      return;
+    }
+    memcpy(_data + pos, header, headerLen);
+    size_t bodyStart = pos + 5;
+    memmove(_data + pos + headerLen, _data + bodyStart, _len - bodyStart);
+    _len -= 5 - headerLen;
+  }
+
+  uint8_t* _data;
+  size_t _cap;
+  size_t _len;
+  bool _overflow;
+};
+
+/**
+ * @brief Incremental JSON parser that emits MessagePack
+ *
+ * Reads one character at a time from any type with `int read()` (returning -1
+ * at end of input), so a multi-module JSON stream never has to be held in RAM.
+ * Strings and containers are encoded with provisional headers that are
+ * compacted once their size is known, producing the same bytes as
+ * ArduinoJson's serializeMsgPack().
+ */
+template <typename TReader>
+class JsonToMsgPack {
+public:
+  explicit JsonToMsgPack(TReader& in) : _in(in), _peeked(-2) {}
+
+  /** @brief Next non-whitespace character without consuming it (-1 at end) */
+  int peekNonSpace() {
+    for (;;) {
+      int c = peek();
+      if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        return c;
+      }
+      next();
+    }
+  }
+
+  /** @brief Consume @p expected (after optional whitespace) */
+  bool expect(char expected) {
+    if (peekNonSpace() != expected) {
+      return false;
+    }
+    next();
+    return true;
+  }
+
+  /**
+   * @brief Parse one JSON value and append its MessagePack encoding to @p out
+   * @return false on syntax errors, end of input, nesting above NVS_CFG_MAX_NESTING
+   *         or when @p out overflows
+   */
+  bool convert(BufferWriter& out) {
+    return parseValue(out, 0) && !out.overflowed();
+  }
+
+  /**
+   * @brief Parse a JSON string into @p buf as a NUL-terminated C string
+   * @return false on syntax errors or if the string does not fit
+   */
+  bool readString(char* buf, size_t bufSize) {
+    uint8_t tmp[64];
+    BufferWriter w(tmp, sizeof(tmp));
+    if (!expect('"') || !parseString(w) || w.overflowed()) {
+      return false;
+    }
+    const uint8_t* p = tmp;
+    Token t;
+    if (!readToken(p, tmp + w.size(), t) || t.length + 1 > bufSize) {
+      return false;
+    }
+    memcpy(buf, t.data, t.length);
+    buf[t.length] = '\0';
+    return true;
+  }
+
+private:
+  int peek() {
+    if (_peeked == -2) {
+      _peeked = _in.read();
+    }
+    return _peeked;
+  }
+
+  int next() {
+    int c = peek();
+    _peeked = -2;
+    return c;
+  }
+
+  bool parseValue(BufferWriter& out, uint8_t depth) {
+    int c = peekNonSpace();
+    switch (c) {
+      case '{':
+      case '[':
+        return parseContainer(out, depth, c == '{');
+      case '"':
+        next();
+        return parseString(out);
+      case 't':
+        out.writeBool(true);
+        return parseLiteral("true");
+      case 'f':
+        out.writeBool(false);
+        return parseLiteral("false");
+      case 'n':
+        out.writeNil();
+        return parseLiteral("null");
+      default:
+        return (c == '-' || (c >= '0' && c <= '9')) && parseNumber(out);
+    }
+  }
+
+  bool parseContainer(BufferWriter& out, uint8_t depth, bool isMap) {
+    if (depth >= NVS_CFG_MAX_NESTING) {
+      return false;
+    }
+    const char close = isMap ? '}' : ']';
+    next();  // '{' or '['
+    size_t pos = out.reserveHeader();
+    uint32_t count = 0;
+
+    if (peekNonSpace() == close) {
+      next();
+    } else {
+      for (;;) {
+        if (isMap) {
+          if (!expect('"') || !parseString(out) || !expect(':')) {
+            return false;
+          }
+        }
+        if (!parseValue(out, depth + 1)) {
+          return false;
+        }
+        count++;
+        int c = peekNonSpace();
+        next();
+        if (c == close) {
+          break;
+        }
+        if (c != ',' || out.overflowed()) {
+          return false;
+        }
+      }
+    }
+    out.finishContainer(pos, count, isMap);
+    return true;
+  }
+
+  bool parseString(BufferWriter& out) {
+    size_t pos = out.reserveHeader();
+    for (;;) {
+      int c = next();
+      if (c < 0 || c < 0x20) {
+        return false;  // End of input or unescaped control character
+      }
+      if (c == '"') {
+        break;
+      }
+      if (c != '\\') {
+        out.put((uint8_t)c);
+        continue;
+      }
+      c = next();
+      switch (c) {
+        case '"': case '\\': case '/': out.put((uint8_t)c); break;
+        case 'b': out.put('\b'); break;
+        case 'f': out.put('\f'); break;
+        case 'n': out.put('\n'); break;
+        case 'r': out.put('\r'); break;
+        case 't': out.put('\t'); break;
+        case 'u': {
+          uint32_t cp;
+          if (!parseHex4(cp)) {
+            return false;
+          }
+          if (cp >= 0xd800 && cp <= 0xdbff) {
+            // High surrogate: must be followed by \uDC00-\uDFFF
+            uint32_t low;
+            if (next() != '\\' || next() != 'u' || !parseHex4(low) || low < 0xdc00 || low > 0xdfff) {
+              return false;
+            }
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+          }
+          putUtf8(out, cp);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    out.finishStr(pos);
+    return true;
+  }
+
+  bool parseHex4(uint32_t& cp) {
+    cp = 0;
+    for (int k = 0; k < 4; k++) {
+      int c = next();
+      uint32_t digit;
+      if (c >= '0' && c <= '9') digit = (uint32_t)(c - '0');
+      else if (c >= 'a' && c <= 'f') digit = (uint32_t)(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F') digit = (uint32_t)(c - 'A' + 10);
+      else return false;
+      cp = (cp << 4) | digit;
+    }
+    return true;
+  }
+
+  static void putUtf8(BufferWriter& out, uint32_t cp) {
+    if (cp < 0x80) {
+      out.put((uint8_t)cp);
+    } else if (cp < 0x800) {
+      out.put((uint8_t)(0xc0 | (cp >> 6)));
+      out.put((uint8_t)(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+      out.put((uint8_t)(0xe0 | (cp >> 12)));
+      out.put((uint8_t)(0x80 | ((cp >> 6) & 0x3f)));
+      out.put((uint8_t)(0x80 | (cp & 0x3f)));
+    } else {
+      out.put((uint8_t)(0xf0 | (cp >> 18)));
+      out.put((uint8_t)(0x80 | ((cp >> 12) & 0x3f)));
+      out.put((uint8_t)(0x80 | ((cp >> 6) & 0x3f)));
+      out.put((uint8_t)(0x80 | (cp & 0x3f)));
+    }
+  }
+
+  bool parseLiteral(const char* literal) {
+    for (const char* s = literal; *s; s++) {
+      if (next() != *s) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool parseNumber(BufferWriter& out) {
+    char num[32];
+    size_t len = 0;
+    bool isFloat = false;
+    for (;;) {
+      int c = peek();
+      bool digit = c >= '0' && c <= '9';
+      if (!digit && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E') {
+        break;
+      }
+      if (len + 1 >= sizeof(num)) {
+        return false;
+      }
+      isFloat = isFloat || (!digit && c != '-' && c != '+');
+      num[len++] = (char)next();
+    }
+    num[len] = '\0';
+
+    char* endPtr = nullptr;
+    if (!isFloat) {
+      errno = 0;
+      if (num[0] == '-') {
+        long long v = strtoll(num, &endPtr, 10);
+        if (errno == 0 && endPtr == num + len) {
+          out.writeInt(v);
+          return true;
+        }
+      } else {
+        unsigned long long v = strtoull(num, &endPtr, 10);
+        if (errno == 0 && endPtr == num + len) {
+          out.writeUInt(v);
+          return true;
+        }
+      }
+      // Out of 64-bit range: fall through and store as a double
+    }
+    double d = strtod(num, &endPtr);
+    if (endPtr != num + len) {
+      return false;
+    }
+    out.writeDouble(d);
+    return true;
+  }
+
+  TReader& _in;
+  int _peeked;  ///< One character of lookahead (-2 = empty)
+};
+
+/**
+ * @brief Copy exactly one MessagePack value from a byte reader into @p out
+ *
+ * Headers are decoded as they arrive so the copy stops at the end of the value
+ * without needing a length prefix. Reading stops early once @p out overflows.
+ *
+ * @param in Reader with `int read()` (returning -1 at end of input)
+ * @param out Destination buffer
+ * @return false on truncated input, reserved type bytes or overflow
+ */
+template <typename TReader>
+bool copyValue(TReader& in, BufferWriter& out) {
+  uint64_t pending = 1;
+  uint8_t header[8];
+  while (pending > 0) {
+    int c = in.read();
+    if (c < 0) {
+      return false;
+    }
+    const HeaderLayout h = describeHeader((uint8_t)c);
+    if (h.type == Type::Invalid) {
+      return false;
+    }
+    out.put((uint8_t)c);
+
+    uint32_t length = h.length;
+    for (size_t k = 0; k < h.lenBytes; k++) {
+      int b = in.read();
+      if (b < 0) {
+        return false;
+      }
+      header[k] = (uint8_t)b;
+    }
+    if (h.lenBytes > 0) {
+      out.put(header, h.lenBytes);
+      length = (uint32_t)readBigEndian(header, h.lenBytes);
+    }
+
+    uint64_t payload = h.fixedBytes + (h.hasPayload ? (uint64_t)length : 0);
+    for (uint64_t k = 0; k < payload && !out.overflowed(); k++) {
+      int b = in.read();
+      if (b < 0) {
+        return false;
+      }
+      out.put((uint8_t)b);
+    }
+    if (out.overflowed()) {
+      return false;
+    }
+
+    pending--;
+    if (h.type == Type::Array) {
+      pending += length;
+    } else if (h.type == Type::Map) {
+      pending += (uint64_t)length * 2;
+    }
+  }
+  return true;
+}
+
+}  // namespace NVSMsgPack
@@ -0,0 +1,165 @@
+#include "NVSRecordLog.h"
+#include <string.h>
+
+namespace {
+
+const size_t kSeqSize = 4;
+
+uint32_t readLE32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void writeLE32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+}  // namespace
+
+NVSRecordLog::NVSRecordLog(NVSConfigBus& bus, const char* name, size_t recordSize, size_t capacity)
+    : _bus(bus), _name(name), _recordSize(recordSize), _capacity(capacity), _count(0), _nextSlot(0),
+      _nextSeq(1), _started(false) {}
+
+bool NVSRecordLog::buildSlotKey(size_t slot, char* keyBuf, size_t keyBufSize) const {
+  int len = snprintf(keyBuf, keyBufSize, "%s:%x", _name, (unsigned)slot);
+  return len > 0 && (size_t)len < keyBufSize && len <= 15;
+}
+
+bool NVSRecordLog::slotSequence(Preferences& prefs, size_t slot, uint32_t& seq) {
+  char key[20];
+  uint8_t raw[kSeqSize + NVS_CFG_MAX_RECORD_SIZE];
+  size_t len = kSeqSize + _recordSize;
+  if (!buildSlotKey(slot, key, sizeof(key)) || prefs.getBytesLength(key) != len ||
+      prefs.getBytes(key, raw, len) != len) {
+    return false;
+  }
+  seq = readLE32(raw);
+  return true;
+}
+
+bool NVSRecordLog::begin() {
+  _started = false;
+  _count = 0;
+  _nextSlot = 0;
+  _nextSeq = 1;
+  size_t nameLen = _name != nullptr ? strlen(_name) : 0;
+  if (nameLen == 0 || nameLen > 11 || strchr(_name, ':') != nullptr || (_name[0] == '_' && _name[1] == '_') ||
+      _recordSize == 0 || _recordSize > NVS_CFG_MAX_RECORD_SIZE || _capacity == 0 ||
+      _capacity > NVS_CFG_MAX_RECORD_SLOTS) {
+    NVS_CFG_LOG("NVSRecordLog: invalid name, record size or capacity");
+    return false;
+  }
+  _started = true;
+
+  Preferences prefs;
+  if (!_bus.openModule(prefs, _name, true)) {
+    return true;  // Namespace does not exist yet: empty log
+  }
+  uint32_t first;
+  if (!slotSequence(prefs, 0, first)) {
+    prefs.end();
+    return true;  // Slot 0 is written first: empty log
+  }
+
+  // Slots [0, k) hold the newest run (sequence numbers counting up from slot
+  // 0); slot k is empty or holds an older record from the previous lap
+  size_t lo = 1;
+  size_t hi = _capacity;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    uint32_t seq;
+    if (slotSequence(prefs, mid, seq) && (int32_t)(seq - first) > 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  uint32_t newest = first;
+  uint32_t older;
+  slotSequence(prefs, lo - 1, newest);
+  bool wrapped = lo < _capacity && slotSequence(prefs, lo, older);
+  prefs.end();
+
+  _count = wrapped ? _capacity : lo;
+  _nextSlot = lo % _capacity;
+  _nextSeq = newest + 1;
+  return true;
+}
+
+bool NVSRecordLog::append(const void* record) {
+  if (!_started || record == nullptr) {
+    return false;
+  }
+  char key[20];
+  uint8_t raw[kSeqSize + NVS_CFG_MAX_RECORD_SIZE];
+  writeLE32(raw, _nextSeq);
+  memcpy(raw + kSeqSize, record, _recordSize);
+
+  Preferences prefs;
+  if (!buildSlotKey(_nextSlot, key, sizeof(key)) || !_bus.openModule(prefs, _name, false)) {
+    NVS_CFG_LOG("NVSRecordLog: failed to open Preferences namespace");
+    return false;
+  }
+  bool ok = prefs.putBytes(key, raw, kSeqSize + _recordSize) == kSeqSize + _recordSize;
+  prefs.end();
+  if (!ok) {
+    NVS_CFG_LOG("NVSRecordLog: record write failed");
+    return false;
+  }
+
+  _nextSlot = (_nextSlot + 1) % _capacity;
+  _nextSeq++;
+  if (_count < _capacity) {
+    _count++;
+  }
+  return true;
+}
+
+bool NVSRecordLog::read(size_t index, void* record, uint32_t* sequence) {
+  if (!_started || record == nullptr || index >= _count) {
+    return false;
+  }
+  size_t oldest = _count < _capacity ? 0 : _nextSlot;
+  char key[20];
+  uint8_t raw[kSeqSize + NVS_CFG_MAX_RECORD_SIZE];
+  size_t len = kSeqSize + _recordSize;
+
+  Preferences prefs;
+  if (!buildSlotKey((oldest + index) % _capacity, key, sizeof(key)) || !_bus.openModule(prefs, _name, true)) {
+    return false;
+  }
+  bool ok = prefs.getBytes(key, raw, len) == len;
+  prefs.end();
+  if (!ok) {
+    return false;
+  }
+  memcpy(record, raw + kSeqSize, _recordSize);
+  if (sequence != nullptr) {
+    *sequence = readLE32(raw);
+  }
+  return true;
+}
+
+bool NVSRecordLog::clear() {
+  if (!_started) {
+    return false;
+  }
+  Preferences prefs;
+  if (!_bus.openModule(prefs, _name, false)) {
+    return false;
+  }
+  char key[20];
+  bool ok = true;
+  for (size_t slot = 0; slot < _capacity; slot++) {
+    if (buildSlotKey(slot, key, sizeof(key)) && prefs.isKey(key)) {
+      ok = prefs.remove(key) && ok;
+    }
+  }
+  prefs.end();
+  _count = 0;
+  _nextSlot = 0;
+  _nextSeq = 1;
+  return ok;
+}
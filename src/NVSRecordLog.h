@@ -0,0 +1,122 @@
+/**
+ * @file NVSRecordLog.h
+ * @brief Small persistent ring of fixed-size records next to the configuration
+ *
+ * Module documents are meant for settings that change rarely. A short event
+ * history (the last faults, resets or alarms) changes on every event, so it
+ * gets its own storage: each record is one NVS entry in a fixed ring of
+ * slots, an append writes only that record, and the oldest record is
+ * overwritten once the ring is full.
+ *
+ * @author Martin Lihs
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include "NVSConfigBus.h"
+
+// Largest record payload (one NVS blob of payload + 4 byte sequence number)
+#ifndef NVS_CFG_MAX_RECORD_SIZE
+#define NVS_CFG_MAX_RECORD_SIZE 120
+#endif
+
+// Largest ring (slot numbers are up to three hex digits in the key)
+#define NVS_CFG_MAX_RECORD_SLOTS 4096
+
+/**
+ * @class NVSRecordLog
+ * @brief Ring buffer of fixed-size records stored in a bus's namespace
+ *
+ * Record `k` of log `name` is stored as `<name>:<k in hex>` with a 32-bit
+ * sequence number in front of the payload, in the shard of @p name. Records
+ * are written to the slots in order, so begin() finds the newest one with a
+ * binary search over the slots' sequence numbers (about log2(capacity) reads)
+ * instead of reading the whole ring.
+ *
+ * Keep name, record size and capacity the same across firmware versions (or
+ * clear() the log when changing them). Logs are not part of exports and are
+ * removed by NVSConfigBus::clearAll(); a full NVSConfigBus::importAll()
+ * restore keeps them. An instance is not thread-safe; use one instance per log.
+ *
+ * @example
+ * ```cpp
+ * struct Fault { uint32_t uptime; uint16_t code; uint16_t detail; };
+ * NVSRecordLog faults(configBus, "faults", sizeof(Fault), 200);
+ *
+ * faults.begin();
+ * Fault f = {millis() / 1000, 0x21, 3};
+ * faults.append(&f);
+ *
+ * for (size_t i = 0; i < faults.count(); i++) {
+ *   faults.read(i, &f);  // Oldest first
+ * }
+ * ```
+ */
+class NVSRecordLog {
+public:
+  /**
+   * @param bus Bus whose partition and namespace hold the records
+   * @param name Log name (1..11 characters, no ':')
+   * @param recordSize Payload size of every record (1..NVS_CFG_MAX_RECORD_SIZE)
+   * @param capacity Number of records kept (1..NVS_CFG_MAX_RECORD_SLOTS)
+   */
+  NVSRecordLog(NVSConfigBus& bus, const char* name, size_t recordSize, size_t capacity);
+
+  NVSRecordLog(const NVSRecordLog&) = delete;
+  NVSRecordLog& operator=(const NVSRecordLog&) = delete;
+
+  /**
+   * @brief Locate the newest stored record (call once before the other methods)
+   * @return false if the parameters are invalid
+   */
+  bool begin();
+
+  /**
+   * @brief Append a record, overwriting the oldest one if the ring is full
+   * @param record recordSize() bytes
+   * @return false if the log is not started or NVS cannot be written
+   */
+  bool append(const void* record);
+
+  /**
+   * @brief Read a stored record
+   * @param index 0 = oldest, count() - 1 = newest
+   * @param record Receives recordSize() bytes
+   * @param sequence Optional: receives the record's sequence number
+   * @return false if @p index is out of range or the record is unreadable
+   */
+  bool read(size_t index, void* record, uint32_t* sequence = nullptr);
+
+  /**
+   * @brief Remove every record (O(capacity) NVS operations)
+   */
+  bool clear();
+
+  /** @brief Stored records (at most capacity()) */
+  size_t count() const { return _count; }
+
+  size_t capacity() const { return _capacity; }
+  size_t recordSize() const { return _recordSize; }
+
+  /** @brief Sequence number the next append() gets */
+  uint32_t nextSequence() const { return _nextSeq; }
+
+private:
+  /**
+   * @brief Sequence number stored in @p slot
+   * @return false if the slot is empty or unreadable
+   */
+  bool slotSequence(Preferences& prefs, size_t slot, uint32_t& seq);
+
+  bool buildSlotKey(size_t slot, char* keyBuf, size_t keyBufSize) const;
+
+  NVSConfigBus& _bus;
+  const char* _name;
+  size_t _recordSize;
+  size_t _capacity;
+  size_t _count;     ///< Stored records
+  size_t _nextSlot;  ///< Slot the next append() writes
+  uint32_t _nextSeq;
+  bool _started;
+};
@@ -0,0 +1,459 @@
+// In-memory NVS, Preferences and FreeRTOS stand-ins for host tests. Single
+// threaded: mutexes never block, and a semaphore wait advances the tick count
+// by its timeout instead of sleeping.
+#include "fake_platform.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <nvs_flash.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Entry {
+  nvs_type_t type;
+  std::vector<uint8_t> data;  // Blobs and strings (including the NUL)
+  uint64_t number;
+};
+
+typedef std::map<std::string, Entry> Namespace;
+
+struct Handle {
+  std::string partition;
+  std::string ns;
+  bool readOnly;
+};
+
+std::map<std::string, std::map<std::string, Namespace>> partitions;
+std::map<nvs_handle_t, Handle> handles;
+nvs_handle_t nextHandle = 1;
+TickType_t ticks = 0;
+
+Namespace* find(nvs_handle_t handle) {
+  auto h = handles.find(handle);
+  return h == handles.end() ? nullptr : &partitions[h->second.partition][h->second.ns];
+}
+
+bool writable(nvs_handle_t handle) {
+  auto h = handles.find(handle);
+  return h != handles.end() && !h->second.readOnly;
+}
+
+esp_err_t setEntry(nvs_handle_t handle, const char* key, const Entry& entry) {
+  if (!writable(handle) || key == nullptr || strlen(key) > 15) {
+    return ESP_FAIL;
+  }
+  (*find(handle))[key] = entry;
+  fake::nvsWrites++;
+  return ESP_OK;
+}
+
+const Entry* getEntry(nvs_handle_t handle, const char* key, nvs_type_t type) {
+  Namespace* ns = find(handle);
+  if (ns == nullptr) {
+    return nullptr;
+  }
+  auto e = ns->find(key);
+  return e == ns->end() || e->second.type != type ? nullptr : &e->second;
+}
+
+esp_err_t setNumber(nvs_handle_t handle, const char* key, nvs_type_t type, uint64_t value) {
+  return setEntry(handle, key, Entry{type, {}, value});
+}
+
+template <typename T>
+esp_err_t getNumber(nvs_handle_t handle, const char* key, nvs_type_t type, T* value) {
+  const Entry* e = getEntry(handle, key, type);
+  if (e == nullptr) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  *value = (T)e->number;
+  return ESP_OK;
+}
+
+esp_err_t getBytes(nvs_handle_t handle, const char* key, nvs_type_t type, void* out, size_t* len) {
+  const Entry* e = getEntry(handle, key, type);
+  if (e == nullptr) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  if (out != nullptr) {
+    if (*len < e->data.size()) {
+      return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, e->data.data(), e->data.size());
+  }
+  *len = e->data.size();
+  return ESP_OK;
+}
+
+}  // namespace
+
+namespace fake {
+
+unsigned long nvsOpens = 0;
+unsigned long nvsWrites = 0;
+
+void reset() {
+  partitions.clear();
+  handles.clear();
+  nvsOpens = 0;
+  nvsWrites = 0;
+}
+
+size_t keyCount(const char* ns) {
+  auto p = partitions.find(NVS_DEFAULT_PART_NAME);
+  if (p == partitions.end() || p->second.count(ns) == 0) {
+    return 0;
+  }
+  return p->second[ns].size();
+}
+
+}  // namespace fake
+
+// --- NVS -------------------------------------------------------------------
+
+esp_err_t nvs_flash_init_partition(const char* part) {
+  partitions[part];
+  return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase_partition(const char* part) {
+  partitions[part].clear();
+  return ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition(const char* part, const char* ns, nvs_open_mode_t mode, nvs_handle_t* handle) {
+  fake::nvsOpens++;
+  if (strlen(ns) > 15) {
+    return ESP_FAIL;
+  }
+  auto& p = partitions[part];
+  if (p.count(ns) == 0) {
+    if (mode == NVS_READONLY) {
+      return ESP_ERR_NVS_NOT_FOUND;
+    }
+    p[ns];
+  }
+  *handle = nextHandle++;
+  handles[*handle] = Handle{part, ns, mode == NVS_READONLY};
+  return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* ns, nvs_open_mode_t mode, nvs_handle_t* handle) {
+  return nvs_open_from_partition(NVS_DEFAULT_PART_NAME, ns, mode, handle);
+}
+
+void nvs_close(nvs_handle_t handle) { handles.erase(handle); }
+
+esp_err_t nvs_commit(nvs_handle_t handle) { return handles.count(handle) ? ESP_OK : ESP_FAIL; }
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+  if (!writable(handle)) {
+    return ESP_FAIL;
+  }
+  return find(handle)->erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+  if (!writable(handle)) {
+    return ESP_FAIL;
+  }
+  find(handle)->clear();
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_stats(const char*, nvs_stats_t* stats) {
+  stats->total_entries = 10000;
+  stats->used_entries = 0;
+  stats->free_entries = 10000;
+  stats->namespace_count = 0;
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_used_entry_count(nvs_handle_t handle, size_t* count) {
+  Namespace* ns = find(handle);
+  *count = ns != nullptr ? ns->size() : 0;
+  return ns != nullptr ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t len) {
+  const uint8_t* p = (const uint8_t*)value;
+  return setEntry(handle, key, Entry{NVS_TYPE_BLOB, std::vector<uint8_t>(p, p + len), 0});
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* value, size_t* len) {
+  return getBytes(handle, key, NVS_TYPE_BLOB, value, len);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+  const uint8_t* p = (const uint8_t*)value;
+  return setEntry(handle, key, Entry{NVS_TYPE_STR, std::vector<uint8_t>(p, p + strlen(value) + 1), 0});
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* value, size_t* len) {
+  return getBytes(handle, key, NVS_TYPE_STR, value, len);
+}
+
+#define FAKE_NVS_NUMBER(T, type, name)                                      \
+  esp_err_t nvs_set_##name(nvs_handle_t handle, const char* key, T value) { \
+    return setNumber(handle, key, type, (uint64_t)value);                   \
+  }                                                                         \
+  esp_err_t nvs_get_##name(nvs_handle_t handle, const char* key, T* value) { \
+    return getNumber(handle, key, type, value);                             \
+  }
+
+FAKE_NVS_NUMBER(uint8_t, NVS_TYPE_U8, u8)
+FAKE_NVS_NUMBER(int8_t, NVS_TYPE_I8, i8)
+FAKE_NVS_NUMBER(uint16_t, NVS_TYPE_U16, u16)
+FAKE_NVS_NUMBER(int16_t, NVS_TYPE_I16, i16)
+FAKE_NVS_NUMBER(uint32_t, NVS_TYPE_U32, u32)
+FAKE_NVS_NUMBER(int32_t, NVS_TYPE_I32, i32)
+FAKE_NVS_NUMBER(uint64_t, NVS_TYPE_U64, u64)
+FAKE_NVS_NUMBER(int64_t, NVS_TYPE_I64, i64)
+
+// Iterators work on a snapshot of the matching keys
+struct nvs_opaque_iterator_t {
+  std::vector<nvs_entry_info_t> entries;
+  size_t pos;
+};
+
+esp_err_t nvs_entry_find(const char* part, const char* ns, nvs_type_t type, nvs_iterator_t* it) {
+  nvs_iterator_t result = new nvs_opaque_iterator_t{{}, 0};
+  for (auto& n : partitions[part]) {
+    if (ns != nullptr && n.first != ns) {
+      continue;
+    }
+    for (auto& e : n.second) {
+      if (type != NVS_TYPE_ANY && e.second.type != type) {
+        continue;
+      }
+      nvs_entry_info_t info = {};
+      strncpy(info.namespace_name, n.first.c_str(), sizeof(info.namespace_name) - 1);
+      strncpy(info.key, e.first.c_str(), sizeof(info.key) - 1);
+      info.type = e.second.type;
+      result->entries.push_back(info);
+    }
+  }
+  if (result->entries.empty()) {
+    delete result;
+    *it = nullptr;
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  *it = result;
+  return ESP_OK;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t* it) {
+  if (++(*it)->pos < (*it)->entries.size()) {
+    return ESP_OK;
+  }
+  delete *it;
+  *it = nullptr;
+  return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t it, nvs_entry_info_t* info) {
+  *info = it->entries[it->pos];
+  return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t it) { delete it; }
+
+// --- Preferences -----------------------------------------------------------
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partitionLabel) {
+  end();
+  _readOnly = readOnly;
+  return nvs_open_from_partition(partitionLabel != nullptr ? partitionLabel : NVS_DEFAULT_PART_NAME, name,
+                                 readOnly ? NVS_READONLY : NVS_READWRITE, &_handle) == ESP_OK;
+}
+
+void Preferences::end() {
+  if (_handle != 0) {
+    nvs_close(_handle);
+    _handle = 0;
+  }
+}
+
+bool Preferences::clear() { return nvs_erase_all(_handle) == ESP_OK; }
+
+bool Preferences::remove(const char* key) { return nvs_erase_key(_handle, key) == ESP_OK; }
+
+bool Preferences::isKey(const char* key) {
+  Namespace* ns = find(_handle);
+  return ns != nullptr && ns->count(key) > 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  return nvs_set_blob(_handle, key, value, len) == ESP_OK ? len : 0;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  size_t len = 0;
+  return nvs_get_blob(_handle, key, nullptr, &len) == ESP_OK ? len : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  size_t len = maxLen;
+  return nvs_get_blob(_handle, key, buf, &len) == ESP_OK ? len : 0;
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+  size_t len = maxLen;
+  return nvs_get_str(_handle, key, value, &len) == ESP_OK ? len : 0;
+}
+
+String Preferences::getString(const char*, String defaultValue) { return defaultValue; }
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+  return nvs_set_u32(_handle, key, value) == ESP_OK ? sizeof(value) : 0;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+  uint32_t value = defaultValue;
+  return nvs_get_u32(_handle, key, &value) == ESP_OK ? value : defaultValue;
+}
+
+size_t Preferences::putULong64(const char* key, uint64_t value) {
+  return nvs_set_u64(_handle, key, value) == ESP_OK ? sizeof(value) : 0;
+}
+
+uint64_t Preferences::getULong64(const char* key, uint64_t defaultValue) {
+  uint64_t value = defaultValue;
+  return nvs_get_u64(_handle, key, &value) == ESP_OK ? value : defaultValue;
+}
+
+size_t Preferences::putUChar(const char* key, uint8_t value) {
+  return nvs_set_u8(_handle, key, value) == ESP_OK ? sizeof(value) : 0;
+}
+
+uint8_t Preferences::getUChar(const char* key, uint8_t defaultValue) {
+  uint8_t value = defaultValue;
+  return nvs_get_u8(_handle, key, &value) == ESP_OK ? value : defaultValue;
+}
+
+size_t Preferences::freeEntries() { return 10000; }
+
+// --- FreeRTOS --------------------------------------------------------------
+
+struct QueueDef {
+  UBaseType_t count;
+};
+
+TickType_t xTaskGetTickCount() { return ticks; }
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new QueueDef{1}; }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new QueueDef{1}; }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return new QueueDef{0}; }
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t, UBaseType_t initialCount) {
+  return new QueueDef{initialCount};
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout) {
+  if (sem->count > 0) {
+    sem->count--;
+    return pdTRUE;
+  }
+  ticks += timeout;  // Nobody else can give it
+  return pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  sem->count++;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t) { return pdTRUE; }
+void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
+
+// No background tasks: prefetching stays synchronous on the host
+BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* handle) {
+  *handle = nullptr;
+  return pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t) {}
+void vTaskDelay(TickType_t delay) { ticks += delay; }
+BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+
+// --- ESP-IDF and Arduino core ----------------------------------------------
+
+void* heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t) { return realloc(ptr, size); }
+void heap_caps_free(void* ptr) { free(ptr); }
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+int64_t esp_timer_get_time() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned long millis() { return (unsigned long)(esp_timer_get_time() / 1000); }
+unsigned long micros() { return (unsigned long)esp_timer_get_time(); }
+void delay(unsigned long) {}
+void yield() {}
+
+uint32_t EspClass::getFreeHeap() { return 200000; }
+uint32_t EspClass::getMaxAllocHeap() { return 100000; }
+uint32_t EspClass::getPsramSize() { return 0; }
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// --- ArduinoJson -----------------------------------------------------------
+// Linked but never reached by MessagePack-only tests: every call fails.
+
+namespace ArduinoJson {
+
+JsonDocument::JsonDocument(Allocator*) {}
+JsonDocument::operator JsonVariantConst() const { return JsonVariantConst(); }
+void JsonDocument::clear() {}
+DynamicJsonDocument::DynamicJsonDocument(size_t) {}
+
+size_t serializeMsgPack(JsonVariantConst, void*, size_t) { return 0; }
+size_t serializeMsgPack(JsonVariantConst, Print&) { return 0; }
+size_t serializeJson(JsonVariantConst, void*, size_t) { return 0; }
+size_t serializeJson(JsonVariantConst, Print&) { return 0; }
+size_t measureMsgPack(JsonVariantConst) { return 0; }
+size_t measureJson(JsonVariantConst) { return 0; }
+
+DeserializationError deserializeMsgPack(JsonDocument&, const void*, size_t) {
+  return DeserializationError::InvalidInput;
+}
+DeserializationError deserializeMsgPack(JsonDocument&, const uint8_t*, size_t, DeserializationOption::NestingLimit) {
+  return DeserializationError::InvalidInput;
+}
+DeserializationError deserializeMsgPack(JsonDocument&, const char*, size_t) {
+  return DeserializationError::InvalidInput;
+}
+DeserializationError deserializeJson(JsonDocument&, const void*, size_t) {
+  return DeserializationError::InvalidInput;
+}
+DeserializationError deserializeJson(JsonDocument&, const char*, size_t) {
+  return DeserializationError::InvalidInput;
+}
+DeserializationError deserializeJson(JsonDocument&, const char*) { return DeserializationError::InvalidInput; }
+DeserializationError deserializeJson(JsonDocument&, const String&) { return DeserializationError::InvalidInput; }
+
+}  // namespace ArduinoJson
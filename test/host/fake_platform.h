@@ -0,0 +1,16 @@
+// In-memory NVS, Preferences and FreeRTOS stand-ins for host tests
+#pragma once
+#include <stddef.h>
+
+namespace fake {
+
+extern unsigned long nvsOpens;   ///< Namespace opens (Preferences::begin() included)
+extern unsigned long nvsWrites;  ///< Blob, string and integer writes
+
+/** @brief Erase every partition and zero the counters */
+void reset();
+
+/** @brief Number of keys stored in one namespace of the default partition */
+size_t keyCount(const char* ns);
+
+}  // namespace fake
@@ -0,0 +1,82 @@
+// Host stand-in for the parts of the Arduino core the library uses
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t len) {
+    size_t n = 0;
+    while (n < len && write(buf[n])) {
+      n++;
+    }
+    return n;
+  }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(int v) { return printf("%d", v); }
+  size_t print(unsigned v) { return printf("%u", v); }
+  size_t print(long v) { return printf("%ld", v); }
+  size_t print(unsigned long v) { return printf("%lu", v); }
+  size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+  size_t println(const char* s = "") { return print(s) + write("\n"); }
+  size_t println(int v) { return print(v) + write("\n"); }
+  size_t println(unsigned v) { return print(v) + write("\n"); }
+  size_t println(long v) { return print(v) + write("\n"); }
+  size_t println(unsigned long v) { return print(v) + write("\n"); }
+  size_t println(double v, int digits = 2) { return print(v, digits) + write("\n"); }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(uint8_t* buf, size_t len) {
+    size_t n = 0;
+    for (int c; n < len && (c = read()) >= 0; n++) {
+      buf[n] = (uint8_t)c;
+    }
+    return n;
+  }
+  void setTimeout(unsigned long) {}
+};
+
+class String {
+public:
+  String(const char* s = "") : _s(s) {}
+  const char* c_str() const { return _s; }
+  unsigned length() const { return (unsigned)strlen(_s); }
+
+private:
+  const char* _s;
+};
+
+struct HardwareSerial : Stream {
+  size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void begin(long) {}
+};
+extern HardwareSerial Serial;
+
+struct EspClass {
+  uint32_t getFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getPsramSize();
+};
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+#define PROGMEM
@@ -0,0 +1,161 @@
+// Declarations of the ArduinoJson 7 API the library compiles against. The host
+// tests only exercise MessagePack paths, so nothing here is implemented; calls
+// that survive -Wl,--gc-sections are stubbed in fake_platform.cpp.
+#pragma once
+#include <Arduino.h>
+
+#define ARDUINOJSON_VERSION_MAJOR 7
+#define ARDUINOJSON_DEFAULT_NESTING_LIMIT 10
+
+namespace ArduinoJson {
+
+struct Allocator {
+  virtual void* allocate(size_t size) = 0;
+  virtual void deallocate(void* ptr) = 0;
+  virtual void* reallocate(void* ptr, size_t size) = 0;
+
+protected:
+  ~Allocator() {}
+};
+
+class JsonVariant;
+class JsonObject;
+class JsonArray;
+
+class JsonVariantConst {
+public:
+  template <class T> T as() const;
+  template <class T> bool is() const;
+  JsonVariantConst operator[](const char* key) const;
+  bool isNull() const;
+};
+
+class JsonVariant {
+public:
+  template <class T> T as() const;
+  template <class T> bool is() const;
+  template <class T> T to();
+  template <class T> bool set(const T& value);
+  template <class T> JsonVariant& operator=(const T& value);
+  JsonVariant operator[](const char* key) const;
+  JsonVariant operator[](size_t index) const;
+  operator JsonVariantConst() const;
+  bool isNull() const;
+  size_t size() const;
+};
+
+class JsonString {
+public:
+  const char* c_str() const;
+  size_t size() const;
+};
+
+class JsonPair {
+public:
+  JsonString key() const;
+  JsonVariant value() const;
+};
+
+struct JsonObjectIterator {
+  JsonPair operator*() const;
+  JsonObjectIterator& operator++();
+  bool operator!=(const JsonObjectIterator& other) const;
+};
+
+class JsonObject {
+public:
+  JsonObjectIterator begin() const;
+  JsonObjectIterator end() const;
+  JsonVariant operator[](const char* key) const;
+  void remove(const char* key);
+  size_t size() const;
+  bool isNull() const;
+  operator JsonVariant() const;
+};
+
+class JsonArray {
+public:
+  JsonVariant operator[](size_t index) const;
+  template <class T> bool add(const T& value);
+  size_t size() const;
+  void clear();
+  JsonVariant* begin() const;
+  JsonVariant* end() const;
+};
+
+class JsonDocument {
+public:
+  JsonDocument(Allocator* allocator = nullptr);
+  JsonDocument(const JsonDocument& other);
+  JsonDocument(JsonDocument&& other);
+  JsonDocument& operator=(const JsonDocument& other);
+  JsonDocument& operator=(JsonDocument&& other);
+
+  void clear();
+  void shrinkToFit();
+  bool overflowed() const;
+  size_t size() const;
+  size_t memoryUsage() const;
+  size_t capacity() const;
+  template <class T> T as() const;
+  template <class T> T as();
+  template <class T> bool is() const;
+  template <class T> T to();
+  template <class T> bool set(const T& value);
+  JsonVariant operator[](const char* key);
+  JsonVariantConst operator[](const char* key) const;
+  JsonVariant operator[](const String& key);
+  bool containsKey(const char* key) const;
+  void remove(const char* key);
+  bool isNull() const;
+  JsonArray createNestedArray(const char* key);
+  JsonObject createNestedObject(const char* key);
+  operator JsonVariant();
+  operator JsonVariantConst() const;
+};
+
+class DynamicJsonDocument : public JsonDocument {
+public:
+  explicit DynamicJsonDocument(size_t capacity = 0);
+};
+
+class DeserializationError {
+public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+  DeserializationError(Code code = Ok) : _code(code) {}
+  explicit operator bool() const { return _code != Ok; }
+  const char* c_str() const { return "stub"; }
+  Code code() const { return _code; }
+  bool operator==(Code code) const { return _code == code; }
+  bool operator!=(Code code) const { return _code != code; }
+
+private:
+  Code _code;
+};
+
+namespace DeserializationOption {
+struct NestingLimit {
+  NestingLimit(uint8_t limit = ARDUINOJSON_DEFAULT_NESTING_LIMIT) { (void)limit; }
+};
+}  // namespace DeserializationOption
+
+size_t serializeMsgPack(JsonVariantConst source, void* buf, size_t size);
+size_t serializeMsgPack(JsonVariantConst source, Print& out);
+size_t serializeJson(JsonVariantConst source, void* buf, size_t size);
+size_t serializeJson(JsonVariantConst source, Print& out);
+size_t measureMsgPack(JsonVariantConst source);
+size_t measureJson(JsonVariantConst source);
+DeserializationError deserializeMsgPack(JsonDocument& doc, const void* input, size_t size);
+DeserializationError deserializeMsgPack(JsonDocument& doc, const uint8_t* input, size_t size,
+                                        DeserializationOption::NestingLimit limit);
+DeserializationError deserializeMsgPack(JsonDocument& doc, const char* input, size_t size);
+DeserializationError deserializeMsgPack(JsonDocument& doc, Stream& input);
+DeserializationError deserializeJson(JsonDocument& doc, const void* input, size_t size);
+DeserializationError deserializeJson(JsonDocument& doc, const char* input, size_t size);
+DeserializationError deserializeJson(JsonDocument& doc, const char* input);
+DeserializationError deserializeJson(JsonDocument& doc, const String& input);
+DeserializationError deserializeJson(JsonDocument& doc, Stream& input);
+
+}  // namespace ArduinoJson
+
+using namespace ArduinoJson;
@@ -0,0 +1,28 @@
+// Host stand-in for the ESP32 Arduino Preferences class (see fake_platform.cpp)
+#pragma once
+#include <Arduino.h>
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false, const char* partitionLabel = nullptr);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+  size_t putBytes(const char* key, const void* value, size_t len);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+  size_t getBytesLength(const char* key);
+  size_t getString(const char* key, char* value, size_t maxLen);
+  String getString(const char* key, String defaultValue = String());
+  size_t putUInt(const char* key, uint32_t value);
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+  size_t putULong64(const char* key, uint64_t value);
+  uint64_t getULong64(const char* key, uint64_t defaultValue = 0);
+  size_t putUChar(const char* key, uint8_t value);
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+  size_t freeEntries();
+
+private:
+  uint32_t _handle = 0;
+  bool _readOnly = true;
+};
@@ -0,0 +1,127 @@
+/**
+ * @file test_allocator.cpp
+ * @brief Host test of the PSRAM placement policy
+ *
+ * The host has no PSRAM: NVSTaggedAllocator records the region
+ * NVSDefaultAllocator would have picked for each block, so the policy can be
+ * checked here for direct allocations and for a bus's own buffers.
+ *
+ * Build and run from the repository root:
+ * ```
+ * g++ -std=gnu++17 -Itest/host/stubs -Isrc -ffunction-sections -Wl,--gc-sections \
+ *     test/host/test_allocator.cpp test/host/fake_platform.cpp src/NVS*.cpp -o allocator_test
+ * ./allocator_test
+ * ```
+ */
+
+#include "fake_platform.h"
+#include <NVSConfigBus.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+const size_t kLarge = NVS_CFG_PSRAM_THRESHOLD * 2;
+const size_t kSmall = 64;
+
+// Stream over a constant buffer
+struct MemoryStream : Stream {
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+  MemoryStream(const uint8_t* d, size_t n) : data(d), size(n), pos(0) {}
+  size_t write(uint8_t) override { return 0; }
+  int available() override { return (int)(size - pos); }
+  int read() override { return pos < size ? data[pos++] : -1; }
+  int peek() override { return pos < size ? data[pos] : -1; }
+};
+
+void testPolicy() {
+  CHECK(NVSDefaultAllocator::preferredRegion(kLarge, NVSMemoryClass::Scratch) == NVSMemoryRegion::Psram);
+  CHECK(NVSDefaultAllocator::preferredRegion(kLarge, NVSMemoryClass::Cache) == NVSMemoryRegion::Psram);
+  CHECK(NVSDefaultAllocator::preferredRegion(kLarge, NVSMemoryClass::Metadata) == NVSMemoryRegion::Internal);
+  CHECK(NVSDefaultAllocator::preferredRegion(kSmall, NVSMemoryClass::Scratch) == NVSMemoryRegion::Internal);
+  CHECK(NVSDefaultAllocator::preferredRegion(kSmall, NVSMemoryClass::Cache) == NVSMemoryRegion::Internal);
+}
+
+void testTaggedPlacement() {
+  NVSTaggedAllocator tagged;
+  void* scratch = tagged.allocate(kLarge, NVSMemoryClass::Scratch);
+  void* cache = tagged.allocate(kLarge, NVSMemoryClass::Cache);
+  void* metadata = tagged.allocate(kLarge, NVSMemoryClass::Metadata);
+  void* small = tagged.allocate(kSmall, NVSMemoryClass::Scratch);
+  CHECK(tagged.regionOf(scratch) == NVSMemoryRegion::Psram);
+  CHECK(tagged.regionOf(cache) == NVSMemoryRegion::Psram);
+  CHECK(tagged.regionOf(metadata) == NVSMemoryRegion::Internal);
+  CHECK(tagged.regionOf(small) == NVSMemoryRegion::Internal);
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Psram) == 2 * kLarge);
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Internal) == kLarge + kSmall);
+
+  // Growing past the threshold moves the block
+  small = tagged.reallocate(small, kLarge, NVSMemoryClass::Scratch);
+  CHECK(small != nullptr);
+  CHECK(tagged.regionOf(small) == NVSMemoryRegion::Psram);
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Psram) == 3 * kLarge);
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Internal) == kLarge);
+
+  tagged.deallocate(scratch, NVSMemoryClass::Scratch);
+  tagged.deallocate(cache, NVSMemoryClass::Cache);
+  tagged.deallocate(metadata, NVSMemoryClass::Metadata);
+  tagged.deallocate(small, NVSMemoryClass::Scratch);
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Psram) == 0);
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Internal) == 0);
+  CHECK(tagged.peakBytes(NVSMemoryRegion::Psram) == 3 * kLarge);
+  CHECK(tagged.mismatches() == 0);
+}
+
+void testBusPlacement() {
+  fake::reset();
+  NVSTaggedAllocator tagged;
+  NVSConfigBus bus("alloctest", &tagged);
+
+  // Enough modules for a directory above the threshold
+  for (int i = 0; i < 40; i++) {
+    char moduleId[8];
+    snprintf(moduleId, sizeof(moduleId), "m%d", i);
+    uint8_t buf[16] = {0x81, 0xa1, 'v', (uint8_t)i};
+    CHECK(bus.saveModuleMsgPack(moduleId, buf, 4, sizeof(buf)));
+  }
+  CHECK(bus.exists("m39"));
+  CHECK(tagged.liveBytes(NVSMemoryClass::Metadata) >= NVS_CFG_PSRAM_THRESHOLD);
+  CHECK(tagged.peakBytes(NVSMemoryRegion::Internal) >= tagged.liveBytes(NVSMemoryClass::Metadata));
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Internal) == tagged.liveBytes(NVSMemoryClass::Metadata));
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Psram) == 0);
+
+  // The import's conversion buffer goes to PSRAM and is released afterwards
+  const uint8_t stream[] = {0x81, 0xa3, 'i', 'm', 'p', 0x81, 0xa1, 'v', 0x01};  // {"imp": {"v": 1}}
+  MemoryStream in(stream, sizeof(stream));
+  CHECK(bus.importAll(in));
+  CHECK(bus.exists("imp"));
+  CHECK(tagged.peakBytes(NVSMemoryRegion::Psram) >= NVS_CFG_PSRAM_THRESHOLD);
+  CHECK(tagged.liveBytes(NVSMemoryRegion::Psram) == 0);
+  CHECK(tagged.mismatches() == 0);
+}
+
+}  // namespace
+
+int main() {
+  testPolicy();
+  testTaggedPlacement();
+  testBusPlacement();
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All allocator checks passed\n");
+  return 0;
+}
@@ -0,0 +1,271 @@
+/**
+ * @file test_journal.cpp
+ * @brief Host test of journal mode (setJournal())
+ *
+ * Saves, replays, checkpoints and compaction run against the in-memory NVS
+ * from fake_platform.cpp; the test inspects and plants `<id>:j<k>` records
+ * through Preferences. A new bus over the same fake NVS stands in for a
+ * reboot.
+ *
+ * Build and run from the repository root:
+ * ```
+ * g++ -std=gnu++17 -Itest/host/stubs -Isrc -ffunction-sections -Wl,--gc-sections \
+ *     test/host/test_journal.cpp test/host/fake_platform.cpp src/NVS*.cpp -o journal_test
+ * ./journal_test
+ * ```
+ */
+
+#include "fake_platform.h"
+#include <NVSConfigBus.h>
+#include <NVSMsgPack.h>
+#include <Preferences.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+const char* const kNamespace = "jrntest";
+const char* const kModule = "stats";
+
+// {"pad": "<40 x>", "a": a, "b": b, "c": c}; a negative value leaves the member out
+size_t encode(uint8_t* out, int a, int b, int c) {
+  const int values[] = {a, b, c};
+  uint8_t* w = out + 1;
+  *w++ = 0xa3;
+  memcpy(w, "pad", 3);
+  w += 3;
+  *w++ = 0xd9;
+  *w++ = 40;
+  memset(w, 'x', 40);
+  w += 40;
+  uint8_t count = 1;
+  for (int i = 0; i < 3; i++) {
+    if (values[i] >= 0) {
+      *w++ = 0xa1;
+      *w++ = (uint8_t)('a' + i);
+      *w++ = (uint8_t)values[i];
+      count++;
+    }
+  }
+  out[0] = (uint8_t)(0x80 | count);
+  return (size_t)(w - out);
+}
+
+bool save(NVSConfigBus& bus, int a, int b = 1, int c = -1) {
+  uint8_t buf[256];
+  return bus.saveModuleMsgPack(kModule, buf, encode(buf, a, b, c), sizeof(buf));
+}
+
+// Integer member @p key of the map in @p buf, -1 if absent; @p count gets the member count
+int member(const uint8_t* buf, size_t len, char key, uint32_t* count = nullptr) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  NVSMsgPack::Token t;
+  if (len == 0 || !NVSMsgPack::readToken(p, end, t) || t.type != NVSMsgPack::Type::Map) {
+    return -1;
+  }
+  if (count != nullptr) {
+    *count = t.length;
+  }
+  for (uint32_t i = 0; i < t.length; i++) {
+    NVSMsgPack::Token k;
+    NVSMsgPack::Token v;
+    if (!NVSMsgPack::readToken(p, end, k) || k.type != NVSMsgPack::Type::Str) {
+      return -1;
+    }
+    if (k.length == 1 && k.data[0] == (uint8_t)key) {
+      return NVSMsgPack::readToken(p, end, v) && v.type == NVSMsgPack::Type::UInt ? (int)v.u : -1;
+    }
+    if (!NVSMsgPack::skipValue(p, end)) {
+      return -1;
+    }
+  }
+  return -1;
+}
+
+// Member @p key of the module as loaded (journal applied)
+int load(NVSConfigBus& bus, char key, uint32_t* count = nullptr) {
+  uint8_t buf[256];
+  return member(buf, bus.readModuleMsgPack(kModule, buf, sizeof(buf)), key, count);
+}
+
+size_t readKey(const char* key, uint8_t* buf, size_t size) {
+  Preferences prefs;
+  prefs.begin(kNamespace, true);
+  size_t len = prefs.getBytes(key, buf, size);
+  prefs.end();
+  return len;
+}
+
+void writeKey(const char* key, const uint8_t* buf, size_t len) {
+  Preferences prefs;
+  prefs.begin(kNamespace, false);
+  prefs.putBytes(key, buf, len);
+  prefs.end();
+}
+
+bool hasKey(const char* key) {
+  uint8_t buf[256];
+  return readKey(key, buf, sizeof(buf)) > 0;
+}
+
+// Member @p key of the stored checkpoint (journal not applied)
+int checkpoint(char key) {
+  uint8_t buf[256];
+  return member(buf, readKey("stats:mp", buf, sizeof(buf)), key);
+}
+
+void testSavesAppendRecords() {
+  fake::reset();
+  NVSConfigBus bus(kNamespace);
+  CHECK(bus.setJournal(kModule, 4));
+  CHECK(save(bus, 1));  // The first save is a full save
+  CHECK(hasKey("stats:mp"));
+  CHECK(!hasKey("stats:j0"));
+
+  uint8_t before[256];
+  size_t beforeLen = readKey("stats:mp", before, sizeof(before));
+  CHECK(save(bus, 2));
+  CHECK(save(bus, 3));
+  CHECK(save(bus, 3, 1, 7));  // Adds a member
+  CHECK(hasKey("stats:j0") && hasKey("stats:j1") && hasKey("stats:j2"));
+  CHECK(!hasKey("stats:j3"));
+
+  uint8_t after[256];
+  CHECK(readKey("stats:mp", after, sizeof(after)) == beforeLen);
+  CHECK(memcmp(before, after, beforeLen) == 0);  // The checkpoint is untouched
+
+  uint32_t count = 0;
+  CHECK(load(bus, 'a', &count) == 3);
+  CHECK(load(bus, 'c') == 7);
+  CHECK(count == 4);
+
+  // Loads replay the records without a journal declaration as well
+  NVSConfigBus rebooted(kNamespace);
+  CHECK(load(rebooted, 'a') == 3);
+  CHECK(load(rebooted, 'b') == 1);
+  CHECK(load(rebooted, 'c') == 7);
+}
+
+void testReplayFollowsGeneration() {
+  fake::reset();
+  {
+    NVSConfigBus bus(kNamespace);
+    bus.setJournal(kModule, 4);
+    CHECK(save(bus, 1));
+    CHECK(save(bus, 2));  // j0
+    CHECK(save(bus, 3));  // j1
+  }
+
+  // Swap the records: slot order now disagrees with generation order
+  uint8_t j0[64];
+  uint8_t j1[64];
+  size_t j0Len = readKey("stats:j0", j0, sizeof(j0));
+  size_t j1Len = readKey("stats:j1", j1, sizeof(j1));
+  CHECK(j0Len > 0 && j1Len > 0);
+  writeKey("stats:j0", j1, j1Len);
+  writeKey("stats:j1", j0, j0Len);
+
+  NVSConfigBus bus(kNamespace);
+  CHECK(load(bus, 'a') == 3);
+}
+
+void testFullRingCheckpoints() {
+  fake::reset();
+  NVSConfigBus bus(kNamespace);
+  bus.setJournal(kModule, 2);
+  CHECK(save(bus, 1));
+  CHECK(save(bus, 2));  // j0
+  CHECK(save(bus, 3));  // j1: the ring is full
+  CHECK(checkpoint('a') == 1);
+
+  // The replayed state becomes the checkpoint, the record starts a new ring
+  CHECK(save(bus, 4));
+  CHECK(checkpoint('a') == 3);
+  CHECK(hasKey("stats:j0"));
+  CHECK(!hasKey("stats:j1"));
+  CHECK(load(bus, 'a') == 4);
+
+  NVSConfigBus rebooted(kNamespace);
+  CHECK(load(rebooted, 'a') == 4);
+}
+
+void testRemovalFallsBackToFullSave() {
+  fake::reset();
+  uint8_t stale[64];
+  size_t staleLen;
+  {
+    NVSConfigBus bus(kNamespace);
+    bus.setJournal(kModule, 4);
+    CHECK(save(bus, 1));
+    CHECK(save(bus, 2));  // j0
+    staleLen = readKey("stats:j0", stale, sizeof(stale));
+    CHECK(staleLen > 0);
+
+    // Records cannot remove a member: "b" goes, so the module is rewritten
+    CHECK(save(bus, 5, -1));
+    CHECK(!hasKey("stats:j0"));
+    CHECK(checkpoint('a') == 5);
+    CHECK(checkpoint('b') == -1);
+    CHECK(load(bus, 'a') == 5);
+  }
+
+  // A record of the previous checkpoint (as left by an interrupted rewrite)
+  // carries the old CRC and is ignored
+  writeKey("stats:j0", stale, staleLen);
+  NVSConfigBus bus(kNamespace);
+  CHECK(load(bus, 'a') == 5);
+  CHECK(load(bus, 'b') == -1);
+}
+
+void testCompactJournals() {
+  fake::reset();
+  NVSConfigBus bus(kNamespace);
+  bus.setJournal(kModule, 4);
+  CHECK(save(bus, 1));
+  CHECK(save(bus, 2));  // j0
+  NVSModuleInfo before;
+  CHECK(bus.moduleInfo(kModule, before));
+
+  CHECK(bus.compactJournals());  // One record in four slots: not due yet
+  CHECK(hasKey("stats:j0"));
+  CHECK(checkpoint('a') == 1);
+
+  CHECK(bus.compactJournals(true));
+  CHECK(!hasKey("stats:j0"));
+  CHECK(checkpoint('a') == 2);
+  CHECK(load(bus, 'a') == 2);
+
+  NVSModuleInfo after;
+  CHECK(bus.moduleInfo(kModule, after));
+  CHECK(after.generation == before.generation);  // Same content
+
+  NVSConfigBus rebooted(kNamespace);
+  CHECK(load(rebooted, 'a') == 2);
+}
+
+}  // namespace
+
+int main() {
+  testSavesAppendRecords();
+  testReplayFollowsGeneration();
+  testFullRingCheckpoints();
+  testRemovalFallsBackToFullSave();
+  testCompactJournals();
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All journal checks passed\n");
+  return 0;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file test_rtc_snapshot.cpp
+ * @brief Host test of the RTC snapshot and the volatile persistence classes
+ *
+ * A static array stands in for RTC memory; a deep-sleep wake is simulated by
+ * constructing a new bus over the same array. NVS is the in-memory fake from
+ * fake_platform.cpp, which counts namespace opens and writes.
+ *
+ * Build and run from the repository root:
+ * ```
+ * g++ -std=gnu++17 -Itest/host/stubs -Isrc -ffunction-sections -Wl,--gc-sections \
+ *     test/host/test_rtc_snapshot.cpp test/host/fake_platform.cpp src/NVS*.cpp -o rtc_snapshot_test
+ * ./rtc_snapshot_test
+ * ```
+ */
+
+#include "fake_platform.h"
+#include <NVSConfigBus.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+const char* const kNamespace = "rtctest";
+
+uint8_t rtcRegion[512];  // Stands in for an RTC_DATA_ATTR array
+
+// Store {"v": value} as module @p moduleId
+bool save(NVSConfigBus& bus, const char* moduleId, uint8_t value) {
+  uint8_t buf[64] = {0x81, 0xa1, 'v', value};
+  return bus.saveModuleMsgPack(moduleId, buf, 4, sizeof(buf));
+}
+
+// Stored value of {"v": value}, or -1 if the module is not readable
+int load(NVSConfigBus& bus, const char* moduleId) {
+  uint8_t buf[64];
+  size_t len = bus.readModuleMsgPack(moduleId, buf, sizeof(buf));
+  return len == 4 && buf[0] == 0x81 && buf[2] == 'v' ? buf[3] : -1;
+}
+
+void powerOn() {
+  fake::reset();
+  memset(rtcRegion, 0, sizeof(rtcRegion));
+}
+
+void testWakeLoadsFromSnapshot() {
+  powerOn();
+  {
+    NVSConfigBus bus(kNamespace);
+    CHECK(bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion)));
+    CHECK(save(bus, "sensor", 1));
+    CHECK(save(bus, "net", 2));
+  }
+
+  // Wake: one NVS access (the bus generation), then none per module
+  NVSConfigBus bus(kNamespace);
+  CHECK(bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion)));
+  unsigned long opens = fake::nvsOpens;
+  CHECK(load(bus, "sensor") == 1);
+  CHECK(fake::nvsOpens - opens <= 1);
+  opens = fake::nvsOpens;
+  CHECK(load(bus, "net") == 2);
+  CHECK(fake::nvsOpens == opens);
+
+  // Saves keep the snapshot current
+  CHECK(save(bus, "net", 3));
+  opens = fake::nvsOpens;
+  CHECK(load(bus, "net") == 3);
+  CHECK(fake::nvsOpens == opens);
+}
+
+void testStaleSnapshotIsDiscarded() {
+  powerOn();
+  {
+    NVSConfigBus bus(kNamespace);
+    bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+    CHECK(save(bus, "sensor", 1));
+  }
+  {
+    // Another writer without the snapshot bumps the bus generation
+    NVSConfigBus other(kNamespace);
+    CHECK(save(other, "sensor", 7));
+  }
+
+  {
+    NVSConfigBus bus(kNamespace);
+    bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+    CHECK(load(bus, "sensor") == 7);  // From NVS, not the stale snapshot
+  }
+
+  // The load refilled the snapshot for the next wake
+  {
+    NVSConfigBus bus(kNamespace);
+    bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+    unsigned long opens = fake::nvsOpens;
+    CHECK(load(bus, "sensor") == 7);
+    CHECK(fake::nvsOpens - opens <= 1);
+  }
+
+  // A corrupted region fails its CRC and is discarded as well (byte 24 lies
+  // in the first module entry, behind the 20-byte header)
+  rtcRegion[24] ^= 0x01;
+  NVSConfigBus bus(kNamespace);
+  bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+  CHECK(load(bus, "sensor") == 7);
+}
+
+void testRtcOnly() {
+  powerOn();
+  {
+    NVSConfigBus bus(kNamespace);
+    CHECK(bus.setPersistence("session", NVSPersistence::RtcOnly));
+    CHECK(!save(bus, "session", 1));  // No snapshot region to keep it in
+
+    bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+    unsigned long writes = fake::nvsWrites;
+    CHECK(save(bus, "session", 1));
+    CHECK(fake::nvsWrites == writes);
+    CHECK(!bus.exists("session"));
+  }
+
+  {
+    NVSConfigBus bus(kNamespace);
+    bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+    bus.setPersistence("session", NVSPersistence::RtcOnly);
+    unsigned long opens = fake::nvsOpens;
+    CHECK(load(bus, "session") == 1);
+    CHECK(fake::nvsOpens - opens <= 1);
+  }
+
+  {
+    NVSConfigBus other(kNamespace);
+    CHECK(save(other, "base", 9));
+  }
+
+  // Volatile state survives a generation change, but not clearAll()
+  NVSConfigBus bus(kNamespace);
+  bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+  bus.setPersistence("session", NVSPersistence::RtcOnly);
+  CHECK(load(bus, "session") == 1);
+  CHECK(bus.clearAll());
+  CHECK(load(bus, "session") == -1);
+}
+
+void testRtcDeferred() {
+  powerOn();
+  {
+    NVSConfigBus bus(kNamespace);
+    bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+    CHECK(bus.setPersistence("meter", NVSPersistence::RtcDeferred, 600));
+    unsigned long writes = fake::nvsWrites;
+    CHECK(save(bus, "meter", 1));
+    CHECK(save(bus, "meter", 2));
+    CHECK(fake::nvsWrites == writes);  // Interval not over yet
+    CHECK(!bus.exists("meter"));
+  }
+
+  {
+    NVSConfigBus bus(kNamespace);
+    bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+    bus.setPersistence("meter", NVSPersistence::RtcDeferred, 600);
+    CHECK(load(bus, "meter") == 2);
+
+    unsigned long writes = fake::nvsWrites;
+    CHECK(bus.flushVolatile());
+    CHECK(fake::nvsWrites == writes);
+    CHECK(bus.flushVolatile(true));
+    CHECK(fake::nvsWrites > writes);
+    CHECK(bus.exists("meter"));
+
+    writes = fake::nvsWrites;
+    CHECK(bus.flushVolatile(true));  // Nothing unflushed is left
+    CHECK(fake::nvsWrites == writes);
+
+    // Interval 0: every save goes straight to NVS
+    bus.setPersistence("meter", NVSPersistence::RtcDeferred, 0);
+    CHECK(save(bus, "meter", 3));
+    CHECK(fake::nvsWrites > writes);
+  }
+
+  // Power loss clears RTC memory; the flushed state is still in NVS
+  memset(rtcRegion, 0, sizeof(rtcRegion));
+  NVSConfigBus bus(kNamespace);
+  bus.enableRtcSnapshot(rtcRegion, sizeof(rtcRegion));
+  bus.setPersistence("meter", NVSPersistence::RtcDeferred, 600);
+  CHECK(load(bus, "meter") == 3);
+}
+
+}  // namespace
+
+int main() {
+  testWakeLoadsFromSnapshot();
+  testStaleSnapshotIsDiscarded();
+  testRtcOnly();
+  testRtcDeferred();
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All RTC snapshot checks passed\n");
+  return 0;
+}
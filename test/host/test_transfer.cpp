@@ -0,0 +1,196 @@
+/**
+ * @file test_transfer.cpp
+ * @brief Host test of exportAll() / importAll()
+ *
+ * Exports go to a RAM buffer and are imported into an emptied fake NVS (see
+ * fake_platform.cpp), in both stream formats. A full restore must keep
+ * counters and NVSRecordLog records, and a malformed stream must not touch
+ * the namespace.
+ *
+ * Build and run from the repository root:
+ * ```
+ * g++ -std=gnu++17 -Itest/host/stubs -Isrc -ffunction-sections -Wl,--gc-sections \
+ *     test/host/test_transfer.cpp test/host/fake_platform.cpp src/NVS*.cpp -o transfer_test
+ * ./transfer_test
+ * ```
+ */
+
+#include "fake_platform.h"
+#include <NVSConfigBus.h>
+#include <NVSRecordLog.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+const char* const kNamespace = "xfertest";
+
+// {"ssid": "home", "port": 80}
+const uint8_t kNet[] = {0x82, 0xa4, 's', 's', 'i', 'd', 0xa4, 'h', 'o', 'm', 'e',
+                        0xa4, 'p', 'o', 'r', 't', 0x50};
+// {"dark": true, "pages": [1, 2]}
+const uint8_t kUi[] = {0x82, 0xa4, 'd', 'a', 'r', 'k', 0xc3, 0xa5, 'p', 'a', 'g', 'e', 's', 0x92, 0x01, 0x02};
+// {"v": 1}
+const uint8_t kOld[] = {0x81, 0xa1, 'v', 0x01};
+
+// Export target, read back as an import source
+struct MemoryStream : Stream {
+  uint8_t data[1024];
+  size_t size = 0;
+  size_t pos = 0;
+  MemoryStream() {}
+  MemoryStream(const void* text, size_t len) : size(len) { memcpy(data, text, len); }
+  size_t write(uint8_t c) override {
+    if (size == sizeof(data)) {
+      return 0;
+    }
+    data[size++] = c;
+    return 1;
+  }
+  int available() override { return (int)(size - pos); }
+  int read() override { return pos < size ? data[pos++] : -1; }
+  int peek() override { return pos < size ? data[pos] : -1; }
+};
+
+bool save(NVSConfigBus& bus, const char* moduleId, const uint8_t* blob, size_t len) {
+  uint8_t buf[64];
+  memcpy(buf, blob, len);
+  return bus.saveModuleMsgPack(moduleId, buf, len, sizeof(buf));
+}
+
+// True if the module is stored with exactly these MessagePack bytes
+bool stored(NVSConfigBus& bus, const char* moduleId, const uint8_t* blob, size_t len) {
+  uint8_t buf[64];
+  return bus.readModuleMsgPack(moduleId, buf, sizeof(buf)) == len && memcmp(buf, blob, len) == 0;
+}
+
+void roundTrip(NVSExportFormat format) {
+  fake::reset();
+  MemoryStream stream;
+  {
+    NVSConfigBus bus(kNamespace);
+    CHECK(save(bus, "net", kNet, sizeof(kNet)));
+    CHECK(save(bus, "ui", kUi, sizeof(kUi)));
+    CHECK(bus.exportAll(stream, format));
+  }
+  CHECK(stream.size > 0);
+  CHECK((format == NVSExportFormat::Json) == (stream.data[0] == '{'));
+
+  fake::reset();
+  NVSConfigBus bus(kNamespace);
+  CHECK(bus.importAll(stream));
+  CHECK(stored(bus, "net", kNet, sizeof(kNet)));
+  CHECK(stored(bus, "ui", kUi, sizeof(kUi)));
+
+  NVSConfigBus rebooted(kNamespace);
+  CHECK(stored(rebooted, "net", kNet, sizeof(kNet)));
+  CHECK(stored(rebooted, "ui", kUi, sizeof(kUi)));
+}
+
+void testJsonRoundTrip() { roundTrip(NVSExportFormat::Json); }
+
+void testMsgPackRoundTrip() { roundTrip(NVSExportFormat::MsgPack); }
+
+void testJsonImport() {
+  fake::reset();
+  const char text[] = " { \"net\" : {\"ssid\": \"home\", \"port\": 80},\n \"ui\": {\"dark\": true, \"pages\": [1, 2]} } ";
+  MemoryStream stream(text, strlen(text));
+  NVSConfigBus bus(kNamespace);
+  CHECK(bus.importAll(stream));
+  CHECK(stored(bus, "net", kNet, sizeof(kNet)));
+  CHECK(stored(bus, "ui", kUi, sizeof(kUi)));
+}
+
+void testReplaceAllKeepsCountersAndLogs() {
+  fake::reset();
+  const uint8_t records[2][4] = {{1, 2, 3, 4}, {5, 6, 7, 8}};
+  {
+    NVSConfigBus bus(kNamespace);
+    CHECK(save(bus, "old", kOld, sizeof(kOld)));
+    CHECK(save(bus, "net", kOld, sizeof(kOld)));
+    CHECK(bus.setCounter("boots", 7));
+    NVSRecordLog log(bus, "faults", sizeof(records[0]), 8);
+    CHECK(log.begin());
+    CHECK(log.append(records[0]));
+    CHECK(log.append(records[1]));
+  }
+
+  // Full restore from a stream with "net" and "ui"
+  const char text[] = "{\"net\":{\"ssid\":\"home\",\"port\":80},\"ui\":{\"dark\":true,\"pages\":[1,2]}}";
+  MemoryStream stream(text, strlen(text));
+  NVSConfigBus bus(kNamespace);
+  CHECK(bus.importAll(stream, true));
+  CHECK(!bus.exists("old"));
+  CHECK(stored(bus, "net", kNet, sizeof(kNet)));
+  CHECK(stored(bus, "ui", kUi, sizeof(kUi)));
+  CHECK(bus.counter("boots") == 7);
+
+  NVSRecordLog log(bus, "faults", sizeof(records[0]), 8);
+  CHECK(log.begin());
+  CHECK(log.count() == 2);
+  uint8_t record[4];
+  CHECK(log.read(0, record) && memcmp(record, records[0], sizeof(record)) == 0);
+  CHECK(log.read(1, record) && memcmp(record, records[1], sizeof(record)) == 0);
+}
+
+void testMalformedStreamChangesNothing() {
+  const char* const jsonStreams[] = {
+      "{\"net\":{\"ssid\":\"x\"},\"ui\":{\"dark\":tru}}",  // Bad literal in the second module
+      "{\"net\":{\"ssid\":\"x\"},\"ui\":[1,2}",          // Unbalanced array
+      "{\"net\":{\"ssid\":\"x\"}",                        // Truncated
+      "[{\"net\":1}]",                                    // Not an object
+  };
+  // {"net": {"ssid": "x"}, "ui": <0xc1, never used>}
+  const uint8_t msgPackStream[] = {0x82, 0xa3, 'n', 'e', 't', 0x81, 0xa4, 's', 's', 'i', 'd', 0xa1, 'x',
+                                   0xa2, 'u', 'i', 0xc1};
+
+  fake::reset();
+  {
+    NVSConfigBus bus(kNamespace);
+    CHECK(save(bus, "net", kNet, sizeof(kNet)));
+    CHECK(save(bus, "old", kOld, sizeof(kOld)));
+    CHECK(bus.setCounter("boots", 7));
+  }
+  size_t keys = fake::keyCount(kNamespace);
+  unsigned long writes = fake::nvsWrites;
+
+  for (size_t i = 0; i <= sizeof(jsonStreams) / sizeof(jsonStreams[0]); i++) {
+    MemoryStream stream = i < sizeof(jsonStreams) / sizeof(jsonStreams[0])
+                              ? MemoryStream(jsonStreams[i], strlen(jsonStreams[i]))
+                              : MemoryStream(msgPackStream, sizeof(msgPackStream));
+    NVSConfigBus bus(kNamespace);
+    CHECK(!bus.importAll(stream, true));
+    CHECK(bus.lastError() == NVSConfigError::ParseError);
+    CHECK(fake::nvsWrites == writes);
+    CHECK(fake::keyCount(kNamespace) == keys);
+    CHECK(stored(bus, "net", kNet, sizeof(kNet)));
+    CHECK(stored(bus, "old", kOld, sizeof(kOld)));
+    CHECK(bus.counter("boots") == 7);
+  }
+}
+
+}  // namespace
+
+int main() {
+  testJsonRoundTrip();
+  testMsgPackRoundTrip();
+  testJsonImport();
+  testReplaceAllKeepsCountersAndLogs();
+  testMalformedStreamChangesNothing();
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All transfer checks passed\n");
+  return 0;
+}
@@ -0,0 +1,35 @@
+# CMake hook (ESP-IDF component or plain CMake project) compiling default
+# config JSON files into a header of constexpr MessagePack arrays.
+#
+#   include(<path to NVSUtilityLibrary>/tools/NVSConfigDefaults.cmake)
+#   nvs_config_defaults(${COMPONENT_LIB} config_defaults.h
+#                       defaults/sensor.json defaults/wifi.json)
+#
+# The header is generated into the binary directory (added to the target's
+# include path) and regenerated whenever one of the JSON files changes.
+
+find_package(Python3 REQUIRED COMPONENTS Interpreter)
+
+# Captured at include time: inside the function CMAKE_CURRENT_LIST_DIR is the caller's
+set(NVS_JSON2MSGPACK "${CMAKE_CURRENT_LIST_DIR}/json2msgpack.py")
+
+function(nvs_config_defaults target header)
+  set(inputs)
+  foreach(json ${ARGN})
+    get_filename_component(json "${json}" ABSOLUTE)
+    list(APPEND inputs "${json}")
+  endforeach()
+  set(dir "${CMAKE_CURRENT_BINARY_DIR}/nvs_config_defaults")
+  set(output "${dir}/${header}")
+
+  add_custom_command(
+    OUTPUT "${output}"
+    COMMAND Python3::Interpreter "${NVS_JSON2MSGPACK}" -o "${output}" ${inputs}
+    DEPENDS ${inputs} "${NVS_JSON2MSGPACK}"
+    COMMENT "Generating ${header} from default config JSON"
+    VERBATIM)
+  string(MAKE_C_IDENTIFIER "${target}_${header}" stamp)
+  add_custom_target(${stamp} DEPENDS "${output}")
+  add_dependencies(${target} ${stamp})
+  target_include_directories(${target} PRIVATE "${dir}")
+endfunction()
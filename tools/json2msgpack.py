@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Convert default configuration JSON files into constexpr MessagePack arrays.
+
+Each input file becomes one array in the generated header, named after the
+file (``sensor.json`` -> ``sensor_defaults``), ready for
+``NVSConfigBus::loadModuleConfigOrDefault()``. The encoding follows
+ArduinoJson's serializeMsgPack(): smallest integer representation, float32
+where it is lossless, member order as in the file.
+
+Usage:
+    json2msgpack.py -o config_defaults.h defaults/sensor.json defaults/wifi.json
+
+Only the Python standard library is needed, so the script can run from a
+PlatformIO extra script or a CMake custom command (see pio_json_defaults.py
+and NVSConfigDefaults.cmake next to this file).
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import struct
+import sys
+
+
+def encode(value, out):
+    """Append the MessagePack encoding of a JSON value to the bytearray out."""
+    if value is None:
+        out.append(0xC0)
+    elif value is True:
+        out.append(0xC3)
+    elif value is False:
+        out.append(0xC2)
+    elif isinstance(value, int):
+        encode_int(value, out)
+    elif isinstance(value, float):
+        if struct.unpack(">f", struct.pack(">f", value))[0] == value or not math.isfinite(value):
+            out.append(0xCA)
+            out += struct.pack(">f", value)
+        else:
+            out.append(0xCB)
+            out += struct.pack(">d", value)
+    elif isinstance(value, str):
+        data = value.encode("utf-8")
+        n = len(data)
+        if n < 32:
+            out.append(0xA0 | n)
+        elif n < 0x100:
+            out += bytes((0xD9, n))
+        elif n < 0x10000:
+            out.append(0xDA)
+            out += struct.pack(">H", n)
+        else:
+            out.append(0xDB)
+            out += struct.pack(">I", n)
+        out += data
+    elif isinstance(value, list):
+        encode_header(len(value), 0x90, 0xDC, 0xDD, out)
+        for item in value:
+            encode(item, out)
+    elif isinstance(value, dict):
+        encode_header(len(value), 0x80, 0xDE, 0xDF, out)
+        for key, item in value.items():
+            encode(key, out)
+            encode(item, out)
+    else:
+        raise TypeError("unsupported JSON value: %r" % (value,))
+
+
+def encode_header(count, fix, code16, code32, out):
+    if count < 16:
+        out.append(fix | count)
+    elif count < 0x10000:
+        out.append(code16)
+        out += struct.pack(">H", count)
+    else:
+        out.append(code32)
+        out += struct.pack(">I", count)
+
+
+def encode_int(value, out):
+    if 0 <= value < 0x80:
+        out.append(value)
+    elif -32 <= value < 0:
+        out += struct.pack(">b", value)
+    elif value > 0:
+        for code, fmt, limit in ((0xCC, ">B", 0x100), (0xCD, ">H", 0x10000), (0xCE, ">I", 0x100000000),
+                                 (0xCF, ">Q", 0x10000000000000000)):
+            if value < limit:
+                out.append(code)
+                out += struct.pack(fmt, value)
+                return
+        raise ValueError("integer out of range: %d" % value)
+    else:
+        for code, fmt, limit in ((0xD0, ">b", 0x80), (0xD1, ">h", 0x8000), (0xD2, ">i", 0x80000000),
+                                 (0xD3, ">q", 0x8000000000000000)):
+            if -value <= limit:
+                out.append(code)
+                out += struct.pack(fmt, value)
+                return
+        raise ValueError("integer out of range: %d" % value)
+
+
+def array_name(path):
+    stem = os.path.splitext(os.path.basename(path))[0]
+    name = re.sub(r"[^0-9A-Za-z_]", "_", stem)
+    if name[:1].isdigit():
+        name = "_" + name
+    return name + "_defaults"
+
+
+def generate(inputs):
+    lines = [
+        "// Generated by json2msgpack.py from %s - do not edit" % ", ".join(os.path.basename(p) for p in inputs),
+        "#pragma once",
+        "",
+        "#include <stdint.h>",
+        "",
+    ]
+    for path in inputs:
+        with open(path, "r", encoding="utf-8") as f:
+            value = json.load(f)
+        data = bytearray()
+        encode(value, data)
+        lines.append("// %s (%d bytes)" % (os.path.basename(path), len(data)))
+        lines.append("constexpr uint8_t %s[] = {" % array_name(path))
+        for i in range(0, len(data), 12):
+            lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 12]) + ",")
+        lines.append("};")
+        lines.append("")
+    return "\n".join(lines)
+
+
+def write_if_changed(path, text):
+    """Keep the timestamp of an unchanged header so nothing is rebuilt."""
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            if f.read() == text:
+                return False
+    except OSError:
+        pass
+    directory = os.path.dirname(path)
+    if directory:
+        os.makedirs(directory, exist_ok=True)
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+    return True
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-o", "--output", required=True, help="header to generate")
+    parser.add_argument("inputs", nargs="+", help="JSON files (one array each)")
+    args = parser.parse_args(argv)
+
+    names = [array_name(p) for p in args.inputs]
+    if len(set(names)) != len(names):
+        parser.error("input file names map to duplicate array names")
+    try:
+        text = generate(args.inputs)
+    except (OSError, ValueError, TypeError) as e:
+        print("json2msgpack: %s" % e, file=sys.stderr)
+        return 1
+    write_if_changed(args.output, text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Extract NVSConfigBus modules from NVS partition dumps in bulk.
+
+Every dump becomes one JSON report:
+
+    {"file": "rma/0042.bin",
+     "namespaces": {"appcfg": {"generation": 7, "modules": {...}, "counters": {...}}},
+     "errors": []}
+
+Usage:
+    nvs_extract.py dumps/                     # JSON lines on stdout
+    nvs_extract.py -o reports/ dumps/         # reports/<dump>.json per dump
+    nvs_extract.py --label nvs flash.bin      # full flash dump, find the partition
+    nvs_extract.py --offset 0x9000 --size 0x5000 flash.bin
+
+Directories are searched recursively for --pattern (default *.bin). Dumps
+are spread over one worker process per core (-j); idle workers pull the next
+dumps from a shared queue, so a few large or damaged images never hold up the
+rest. Only the Python standard library is needed (see nvsimage.py).
+"""
+
+import argparse
+import fnmatch
+import json
+import multiprocessing
+import os
+import sys
+import time
+
+import nvsimage
+
+
+def find_dumps(inputs, pattern):
+    """Yield (path, path relative to its input) for every dump."""
+    for item in inputs:
+        if os.path.isdir(item):
+            for root, dirs, files in os.walk(item):
+                dirs.sort()
+                for name in sorted(files):
+                    if fnmatch.fnmatch(name, pattern):
+                        path = os.path.join(root, name)
+                        yield path, os.path.relpath(path, item)
+        else:
+            yield item, os.path.basename(item)
+
+
+def extract(path, offset=0, size=None, label=None, namespaces=None):
+    """Build the report of one dump (errors are reported, not raised)."""
+    report = {"file": path, "namespaces": {}, "errors": []}
+    try:
+        with open(path, "rb") as f:
+            data = f.read()
+        if label is not None:
+            found = nvsimage.find_partition(data, label)
+            if found is None:
+                raise ValueError("no partition labelled '%s'" % label)
+            offset, size = found
+        data = data[offset:offset + size if size is not None else len(data)]
+        image = nvsimage.parse(data)
+    except (OSError, ValueError) as e:
+        report["errors"].append(str(e))
+        report["failed"] = True
+        return report
+    report["namespaces"] = nvsimage.extract_modules(image, namespaces)
+    report["errors"] = image.errors
+    return report
+
+
+def _work(task):
+    path, rel, options = task
+    return rel, extract(path, **options)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("inputs", nargs="+", help="dump files or directories")
+    parser.add_argument("-o", "--out-dir", help="write one <dump>.json per dump instead of JSON lines")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1, help="worker processes")
+    parser.add_argument("--pattern", default="*.bin", help="file pattern inside directories (default *.bin)")
+    parser.add_argument("--offset", type=lambda s: int(s, 0), default=0, help="partition offset in each dump")
+    parser.add_argument("--size", type=lambda s: int(s, 0), help="partition size (default: rest of the dump)")
+    parser.add_argument("--label", help="find the partition by label in a full flash dump")
+    parser.add_argument("--namespace", action="append",
+                        help="only these namespaces (glob); also finds stores without bus keys")
+    args = parser.parse_args(argv)
+
+    options = {"offset": args.offset, "size": args.size, "label": args.label, "namespaces": args.namespace}
+    tasks = [(path, rel, options) for path, rel in find_dumps(args.inputs, args.pattern)]
+    started = time.time()
+    failed = 0
+    modules = 0
+    damaged = 0
+
+    def results():
+        if args.jobs <= 1 or len(tasks) <= 1:
+            for task in tasks:
+                yield _work(task)
+            return
+        with multiprocessing.Pool(min(args.jobs, len(tasks))) as pool:
+            # Small chunks keep every worker busy until the queue is empty
+            for result in pool.imap_unordered(_work, tasks, chunksize=4):
+                yield result
+
+    for rel, report in results():
+        failed += 1 if report.get("failed") else 0
+        damaged += 1 if report["errors"] else 0
+        modules += sum(len(ns["modules"]) for ns in report["namespaces"].values())
+        if args.out_dir:
+            out = os.path.join(args.out_dir, rel + ".json")
+            os.makedirs(os.path.dirname(out), exist_ok=True)
+            with open(out, "w", encoding="utf-8") as f:
+                json.dump(report, f, indent=2)
+                f.write("\n")
+        else:
+            sys.stdout.write(json.dumps(report) + "\n")
+
+    print("nvs_extract: %d dumps, %d modules, %d with errors, %d unreadable (%.1f s)" %
+          (len(tasks), modules, damaged, failed, time.time() - started), file=sys.stderr)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Generate ready-to-flash NVSConfigBus partition images from JSON configs.
+
+Each device file is a JSON object of modules, exactly what the firmware would
+pass to saveModuleConfig() one module at a time:
+
+    {"pulsfan": {"heartRateMin": 120, "heartRateMax": 180},
+     "wifi": {"ssid": "line-7", "channel": 6}}
+
+Usage:
+    nvs_provision.py -o images/ devices/                 # images/<device>.bin
+    nvs_provision.py -o images/ --common base.json --size 0x6000 devices/*.json
+    esptool.py write_flash 0x9000 images/SN0042.bin      # one flash write per device
+
+--common modules are stored on every device unless the device file has a
+module with the same id. --size, --namespace and --shards must match the
+partition table and the NVSConfigBus setup of the firmware. Directories are
+searched recursively for *.json; images are generated by one worker process
+per core (-j). --verify reads every image back with nvsimage.parse() and
+compares the modules. Only the Python standard library is needed.
+"""
+
+import argparse
+import json
+import multiprocessing
+import os
+import sys
+import time
+
+import nvsimage
+
+
+def find_devices(inputs):
+    """Yield (path, output name) for every device file."""
+    for item in inputs:
+        if os.path.isdir(item):
+            for root, dirs, files in os.walk(item):
+                dirs.sort()
+                for name in sorted(files):
+                    if name.endswith(".json"):
+                        path = os.path.join(root, name)
+                        yield path, os.path.splitext(os.path.relpath(path, item))[0]
+        else:
+            yield item, os.path.splitext(os.path.basename(item))[0]
+
+
+def provision(path, out, common, namespace, size, shards, max_module_size, verify):
+    """Write the image of one device; returns an error message or None."""
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            device = json.load(f)
+        if not isinstance(device, dict):
+            raise ValueError("top level must be an object of modules")
+        modules = dict(common)
+        modules.update(device)
+        image = nvsimage.bus_image(modules, namespace, size, shards, max_module_size)
+        if verify:
+            parsed = nvsimage.parse(image)
+            stored = nvsimage.extract_modules(parsed).get(namespace, {}).get("modules")
+            if parsed.errors or stored != json.loads(json.dumps(modules)):
+                raise ValueError("image does not read back the same modules")
+        os.makedirs(os.path.dirname(out) or ".", exist_ok=True)
+        with open(out, "wb") as f:
+            f.write(image)
+    except (OSError, ValueError) as e:
+        return "%s: %s" % (path, e)
+    return None
+
+
+def _work(task):
+    return provision(*task)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("inputs", nargs="+", help="device JSON files or directories")
+    parser.add_argument("-o", "--out-dir", required=True, help="directory for the <device>.bin images")
+    parser.add_argument("--common", help="JSON object of modules stored on every device")
+    parser.add_argument("--namespace", default="appcfg", help="bus namespace (default appcfg)")
+    parser.add_argument("--size", type=lambda s: int(s, 0), default=0x6000,
+                        help="partition size (default 0x6000, the default nvs partition)")
+    parser.add_argument("--shards", type=int, default=1, help="shard count passed to setShards()")
+    parser.add_argument("--max-module-size", type=int, default=2048, help="NVS_CFG_MAX_MODULE_SIZE")
+    parser.add_argument("--verify", action="store_true", help="parse every image back and compare")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1, help="worker processes")
+    args = parser.parse_args(argv)
+
+    common = {}
+    if args.common:
+        with open(args.common, "r", encoding="utf-8") as f:
+            common = json.load(f)
+        if not isinstance(common, dict):
+            parser.error("--common must be a JSON object of modules")
+
+    tasks = [(path, os.path.join(args.out_dir, name + ".bin"), common, args.namespace, args.size,
+              args.shards, args.max_module_size, args.verify)
+             for path, name in find_devices(args.inputs)]
+    started = time.time()
+    if args.jobs <= 1 or len(tasks) <= 1:
+        errors = [e for e in map(_work, tasks) if e]
+    else:
+        with multiprocessing.Pool(min(args.jobs, len(tasks))) as pool:
+            # Small chunks keep every worker busy until the queue is empty
+            errors = [e for e in pool.imap_unordered(_work, tasks, chunksize=8) if e]
+
+    for error in errors:
+        print("nvs_provision: %s" % error, file=sys.stderr)
+    print("nvs_provision: %d images, %d failed (%.1f s)" % (len(tasks), len(errors), time.time() - started),
+          file=sys.stderr)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
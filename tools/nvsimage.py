@@ -0,0 +1,529 @@
+"""Read and write ESP32 NVS partition images holding NVSConfigBus modules.
+
+Host-side counterpart of the library for raw partition images. It implements
+the ESP-IDF NVS layout itself - pages, entry state bitmaps, multi-entry
+strings and chunked blobs, with all CRCs - so no ESP-IDF checkout is needed.
+
+Reading dumps (e.g. from ``esptool.py read_flash``):
+
+    image = nvsimage.parse(open("dump.bin", "rb").read())
+    report = nvsimage.extract_modules(image)
+    # {"appcfg": {"generation": 7, "modules": {"pulsfan": {...}}, "counters": {...}}}
+
+Modules are rebuilt the way loadModuleConfig() reads them: ``<id>:mp``
+(MessagePack, merged with the ``<id>:h`` hot-field entry and the ``<id>:j<k>``
+journal records of its checkpoint) or the legacy JSON under ``<id>``, as
+selected by the ``<id>:i`` record. Shard namespaces (``<ns>.<k>``) are folded
+into their bus namespace. Damaged pages, entries and blobs are skipped and
+listed in ``image.errors``; nothing raises on bad input except a size that is
+not a whole number of pages.
+
+Writing ready-to-flash images:
+
+    data = nvsimage.bus_image({"pulsfan": {...}, "wifi": {...}}, "appcfg", 0x6000)
+
+bus_image() stores the keys saveModuleConfig() would leave behind on a
+freshly erased partition (``<id>:i``, ``<id>:mp``, ``__gen``).
+
+Only the Python standard library is needed. See nvs_extract.py and
+nvs_provision.py for the command line tools.
+"""
+
+import fnmatch
+import json
+import re
+import struct
+import zlib
+
+import json2msgpack
+
+PAGE_SIZE = 4096
+ENTRY_SIZE = 32
+ENTRIES_PER_PAGE = 126
+FIRST_ENTRY_OFFSET = 64
+
+# Page states (bits are cleared as a page advances)
+PAGE_EMPTY = 0xFFFFFFFF
+PAGE_ACTIVE = 0xFFFFFFFE
+PAGE_FULL = 0xFFFFFFFC
+PAGE_FREEING = 0xFFFFFFF8
+
+ENTRY_WRITTEN = 2
+
+TYPE_SZ = 0x21
+TYPE_BLOB = 0x41  # Single-page blob (version 1 pages)
+TYPE_BLOB_DATA = 0x42
+TYPE_BLOB_IDX = 0x48
+INTEGER_TYPES = {
+    0x01: "<B", 0x02: "<H", 0x04: "<I", 0x08: "<Q",
+    0x11: "<b", 0x12: "<h", 0x14: "<i", 0x18: "<q",
+}
+
+# NVSModuleFormat and `<id>:i` flags (NVSConfigBus.h, NVSConfigBusDirectory.cpp)
+FORMAT_MSGPACK = 1
+FORMAT_JSON_BYTES = 2
+FORMAT_JSON_STRING = 3
+INFO_DELETED = 0x01
+
+NVS_PAGE_VERSION = 0xFE  # Multi-page blobs (ESP-IDF 4.0 and later)
+CHUNK_ANY = 0xFF
+MAX_KEY_LENGTH = 15
+
+BUS_KEYS = ("__gen", "__rst", "__shd")
+SHARD_NAMESPACE = re.compile(r"^(.+)\.([0-9a-f]+)$")
+
+# MessagePack type byte -> value format / length format / fixext size
+MP_FIXED = {0xCA: ">f", 0xCB: ">d", 0xCC: ">B", 0xCD: ">H", 0xCE: ">I", 0xCF: ">Q",
+            0xD0: ">b", 0xD1: ">h", 0xD2: ">i", 0xD3: ">q"}
+MP_LENGTH = {0xD9: ">B", 0xDA: ">H", 0xDB: ">I", 0xC4: ">B", 0xC5: ">H", 0xC6: ">I",
+             0xDC: ">H", 0xDD: ">I", 0xDE: ">H", 0xDF: ">I", 0xC7: ">B", 0xC8: ">H", 0xC9: ">I"}
+MP_FIXEXT = {0xD4: 2, 0xD5: 3, 0xD6: 5, 0xD7: 9, 0xD8: 17}
+
+
+def crc32(data):
+    """CRC-32 as NVS computes it (esp_rom_crc32_le seeded with 0xFFFFFFFF)."""
+    return zlib.crc32(data, 0xFFFFFFFF) & 0xFFFFFFFF
+
+
+class NvsImage:
+    """Latest value of every key: ``namespaces[name][key]`` is int, str or bytes."""
+
+    def __init__(self):
+        self.namespaces = {}
+        self.errors = []
+
+
+class MsgPackError(ValueError):
+    pass
+
+
+def parse(data):
+    """Decode a raw NVS partition image into an NvsImage."""
+    if len(data) == 0 or len(data) % PAGE_SIZE != 0:
+        raise ValueError("image size %d is not a multiple of %d" % (len(data), PAGE_SIZE))
+    image = NvsImage()
+
+    pages = []
+    for offset in range(0, len(data), PAGE_SIZE):
+        page = memoryview(data)[offset:offset + PAGE_SIZE]
+        state, seq, version = struct.unpack_from("<IIB", page, 0)
+        if state not in (PAGE_ACTIVE, PAGE_FULL, PAGE_FREEING):
+            continue  # Empty, corrupt or invalid
+        if struct.unpack_from("<I", page, 28)[0] != crc32(page[4:28]):
+            image.errors.append("page 0x%x: header CRC mismatch" % offset)
+            continue
+        pages.append((seq, offset, page))
+
+    # Entries are appended in sequence order, so later entries replace earlier
+    # ones (a FREEING page still holds copies of items already moved on)
+    names = {0: None}
+    items = {}   # (ns index, key) -> value, or ("blob", size, chunk start, count)
+    chunks = {}  # (ns index, key, chunk index) -> bytes
+    for seq, offset, page in sorted(pages, key=lambda p: p[0]):
+        i = 0
+        while i < ENTRIES_PER_PAGE:
+            if entry_state(page, i) != ENTRY_WRITTEN:
+                i += 1
+                continue
+            entry = page[FIRST_ENTRY_OFFSET + i * ENTRY_SIZE:FIRST_ENTRY_OFFSET + (i + 1) * ENTRY_SIZE]
+            ns, dtype, span, chunk = struct.unpack_from("<BBBB", entry, 0)
+            where = "page 0x%x entry %d" % (offset, i)
+            if struct.unpack_from("<I", entry, 4)[0] != crc32(bytes(entry[0:4]) + bytes(entry[8:32])):
+                image.errors.append("%s: entry CRC mismatch" % where)
+                i += 1
+                continue
+            if span == 0 or i + span > ENTRIES_PER_PAGE:
+                image.errors.append("%s: invalid span %d" % (where, span))
+                i += 1
+                continue
+            key = bytes(entry[8:24]).split(b"\0", 1)[0].decode("utf-8", "replace")
+            payload = entry[24:32]
+
+            if dtype in INTEGER_TYPES:
+                value = struct.unpack_from(INTEGER_TYPES[dtype], payload, 0)[0]
+                if ns == 0:
+                    names[value] = key  # Namespace definition
+                else:
+                    items[(ns, key)] = value
+            elif dtype in (TYPE_SZ, TYPE_BLOB, TYPE_BLOB_DATA):
+                size, _, data_crc = struct.unpack_from("<HHI", payload, 0)
+                start = FIRST_ENTRY_OFFSET + (i + 1) * ENTRY_SIZE
+                value = bytes(page[start:start + size])
+                if size > (span - 1) * ENTRY_SIZE or crc32(value) != data_crc:
+                    image.errors.append("%s: data CRC mismatch for '%s'" % (where, key))
+                elif dtype == TYPE_SZ:
+                    items[(ns, key)] = value.split(b"\0", 1)[0].decode("utf-8", "replace")
+                elif dtype == TYPE_BLOB:
+                    items[(ns, key)] = value
+                else:
+                    chunks[(ns, key, chunk)] = value
+            elif dtype == TYPE_BLOB_IDX:
+                size, count, chunk_start = struct.unpack_from("<IBB", payload, 0)
+                items[(ns, key)] = ("blob", size, chunk_start, count)
+            i += span
+
+    for (ns, key), value in items.items():
+        name = names.get(ns)
+        if name is None:
+            image.errors.append("key '%s' in undefined namespace %d" % (key, ns))
+            continue
+        if isinstance(value, tuple):
+            _, size, chunk_start, count = value
+            parts = [chunks.get((ns, key, chunk_start + n)) for n in range(count)]
+            value = b"".join(p for p in parts if p is not None)
+            if None in parts or len(value) != size:
+                image.errors.append("%s/%s: incomplete blob (%d of %d bytes)" % (name, key, len(value), size))
+                continue
+        image.namespaces.setdefault(name, {})[key] = value
+    return image
+
+
+def entry_state(page, index):
+    bits = page[32 + index // 4]
+    return (bits >> ((index % 4) * 2)) & 3
+
+
+def find_partition(flash, label="nvs", table_offset=0x8000):
+    """Locate a data partition in a full flash dump via its partition table.
+
+    Returns (offset, size) or None.
+    """
+    for pos in range(table_offset, min(table_offset + 0xC00, len(flash) - 31), 32):
+        magic, ptype, subtype, offset, size = struct.unpack_from("<HBBII", flash, pos)
+        if magic != 0x50AA:
+            break
+        name = bytes(flash[pos + 12:pos + 28]).split(b"\0", 1)[0].decode("utf-8", "replace")
+        if ptype == 0x01 and name == label:
+            return offset, size
+    return None
+
+
+def msgpack_decode(data):
+    """Decode one MessagePack value into JSON-compatible Python values.
+
+    Binary and extension values become hex strings; map keys become strings.
+    """
+    value, pos = _decode(memoryview(data), 0)
+    if pos != len(data):
+        raise MsgPackError("%d trailing bytes" % (len(data) - pos))
+    return value
+
+
+def _take(data, pos, n):
+    if pos + n > len(data):
+        raise MsgPackError("truncated at byte %d" % pos)
+    return data[pos:pos + n], pos + n
+
+
+def _unpack(fmt, data, pos):
+    raw, pos = _take(data, pos, struct.calcsize(fmt))
+    return struct.unpack(fmt, raw)[0], pos
+
+
+def _decode(data, pos):
+    code, pos = _unpack(">B", data, pos)
+    if code <= 0x7F:
+        return code, pos
+    if code >= 0xE0:
+        return code - 0x100, pos
+    if 0x80 <= code <= 0x8F:
+        return _decode_map(data, pos, code & 0x0F)
+    if 0x90 <= code <= 0x9F:
+        return _decode_array(data, pos, code & 0x0F)
+    if 0xA0 <= code <= 0xBF:
+        return _decode_str(data, pos, code & 0x1F)
+    if code == 0xC0:
+        return None, pos
+    if code in (0xC2, 0xC3):
+        return code == 0xC3, pos
+    if code in MP_FIXED:
+        return _unpack(MP_FIXED[code], data, pos)
+    if code in MP_LENGTH:
+        n, pos = _unpack(MP_LENGTH[code], data, pos)
+        if code in (0xD9, 0xDA, 0xDB):
+            return _decode_str(data, pos, n)
+        if code in (0xDC, 0xDD):
+            return _decode_array(data, pos, n)
+        if code in (0xDE, 0xDF):
+            return _decode_map(data, pos, n)
+        if code in (0xC7, 0xC8, 0xC9):
+            n += 1  # Type byte
+        raw, pos = _take(data, pos, n)
+        return bytes(raw).hex(), pos
+    if code in MP_FIXEXT:
+        raw, pos = _take(data, pos, MP_FIXEXT[code])
+        return bytes(raw).hex(), pos
+    raise MsgPackError("invalid type byte 0x%02x" % code)
+
+
+def _decode_str(data, pos, n):
+    raw, pos = _take(data, pos, n)
+    return bytes(raw).decode("utf-8", "replace"), pos
+
+
+def _decode_array(data, pos, n):
+    out = []
+    for _ in range(n):
+        value, pos = _decode(data, pos)
+        out.append(value)
+    return out, pos
+
+
+def _decode_map(data, pos, n):
+    out = {}
+    for _ in range(n):
+        key, pos = _decode(data, pos)
+        value, pos = _decode(data, pos)
+        out[key if isinstance(key, str) else json.dumps(key)] = value
+    return out, pos
+
+
+def _merge_hot(hot, cold):
+    """Hot-field entry first, then the module blob (mergeHotFields())."""
+    try:
+        hot_map = msgpack_decode(hot)
+    except MsgPackError:
+        return cold
+    if not isinstance(hot_map, dict) or not isinstance(cold, dict) or hot[:1] != b"\xde":
+        return cold
+    merged = dict(hot_map)
+    merged.update(cold)
+    return merged
+
+
+def _replay_journal(keys, module_id, base_crc, value, errors):
+    """Apply the `<id>:j<k>` records of this checkpoint (replayJournal())."""
+    records = []
+    for slot in range(16):
+        rec = keys.get("%s:j%x" % (module_id, slot))
+        if isinstance(rec, bytes) and len(rec) >= 11 and struct.unpack_from("<I", rec, 0)[0] == base_crc:
+            records.append((struct.unpack_from("<I", rec, 4)[0], slot, rec))
+    if not records or not isinstance(value, dict):
+        return value
+    for generation, slot, rec in sorted(records):
+        try:
+            changed = msgpack_decode(rec[8:])
+        except MsgPackError as e:
+            errors.append("%s:j%x: %s" % (module_id, slot, e))
+            continue
+        if isinstance(changed, dict):
+            for key, member in changed.items():
+                value.pop(key, None)  # Replaced members move to the end
+                value[key] = member
+    return value
+
+
+def _module(keys, module_id, errors):
+    """Rebuild one module like loadModuleConfig(); None if it is not stored."""
+    info = keys.get(module_id + ":i")
+    fmt = None
+    if isinstance(info, bytes) and len(info) >= 5:
+        if info[4] & INFO_DELETED:
+            return None
+        if len(info) >= 12:
+            fmt = info[5]
+    mp = keys.get(module_id + ":mp")
+    legacy = keys.get(module_id)
+    try:
+        if isinstance(mp, bytes) and fmt in (None, FORMAT_MSGPACK):
+            value = msgpack_decode(mp)
+            hot = keys.get(module_id + ":h")
+            if isinstance(hot, bytes):
+                value = _merge_hot(hot, value)
+            return _replay_journal(keys, module_id, zlib.crc32(mp) & 0xFFFFFFFF, value, errors)
+        if isinstance(legacy, (bytes, str)) and fmt in (None, FORMAT_JSON_BYTES, FORMAT_JSON_STRING):
+            return json.loads(legacy.rstrip("\0" if isinstance(legacy, str) else b"\0"))
+    except (MsgPackError, ValueError) as e:
+        errors.append("%s: %s" % (module_id, e))
+    return None
+
+
+def is_bus_namespace(keys):
+    return any(k in keys for k in BUS_KEYS) or any(k.endswith((":mp", ":i")) for k in keys)
+
+
+def extract_modules(image, namespaces=None):
+    """Collect the modules of every bus namespace in an NvsImage.
+
+    @param namespaces Optional list of namespace names or glob patterns; these
+                      are searched for modules even without bus bookkeeping
+                      keys (e.g. stores written before the bus existed)
+    """
+    buses = {}
+    for name in sorted(image.namespaces):
+        keys = image.namespaces[name]
+        base = name
+        m = SHARD_NAMESPACE.match(name)
+        if m and m.group(1) in image.namespaces and is_bus_namespace(image.namespaces[m.group(1)]):
+            base = m.group(1)
+        if namespaces is not None:
+            if not any(fnmatch.fnmatchcase(base, pattern) for pattern in namespaces):
+                continue
+        elif not is_bus_namespace(keys) and base == name:
+            continue
+
+        bus = buses.setdefault(base, {"generation": None, "modules": {}, "counters": {}})
+        if "__gen" in keys:
+            bus["generation"] = keys["__gen"]
+        for key, value in sorted(keys.items()):
+            if key.startswith("__"):
+                continue
+            if key.endswith(":n") and isinstance(value, int):
+                bus["counters"][key[:-2]] = value
+                continue
+            module_id = key[:-3] if key.endswith(":mp") else key
+            if ":" in module_id or module_id in bus["modules"]:
+                continue
+            module = _module(keys, module_id, image.errors)
+            if module is not None:
+                bus["modules"][module_id] = module
+    for bus in buses.values():
+        bus["modules"] = dict(sorted(bus["modules"].items()))  # Shards interleaved
+    return buses
+
+
+class NvsWriter:
+    """Build an NVS partition image entry by entry, as the ESP-IDF NVS would.
+
+    Entries are appended in call order. Filled pages are marked FULL, the page
+    being written stays ACTIVE and the last page is kept empty, which the
+    NVS needs as spare page for garbage collection.
+    """
+
+    def __init__(self, size):
+        if size % PAGE_SIZE != 0 or size < 3 * PAGE_SIZE:
+            raise ValueError("partition size must be a multiple of 0x%x and at least 0x%x" %
+                             (PAGE_SIZE, 3 * PAGE_SIZE))
+        self._page_count = size // PAGE_SIZE
+        self._pages = []
+        self._entry = ENTRIES_PER_PAGE  # First write opens a page
+        self._namespaces = {}
+
+    def put_int(self, namespace, key, dtype, value):
+        """Store an integer; @p dtype is an NVS type code (0x01 u8 .. 0x18 i64)."""
+        data = struct.pack(INTEGER_TYPES[dtype], value).ljust(8, b"\xff")
+        self._write(self._namespace(namespace), dtype, CHUNK_ANY, key, data)
+
+    def put_u8(self, namespace, key, value):
+        self.put_int(namespace, key, 0x01, value)
+
+    def put_u32(self, namespace, key, value):
+        self.put_int(namespace, key, 0x04, value)
+
+    def put_str(self, namespace, key, text):
+        data = text.encode("utf-8") + b"\0"
+        if len(data) > (ENTRIES_PER_PAGE - 1) * ENTRY_SIZE:
+            raise ValueError("string '%s' does not fit into one page" % key)
+        self._write(self._namespace(namespace), TYPE_SZ, CHUNK_ANY, key, self._var_header(data), data)
+
+    def put_blob(self, namespace, key, data):
+        """Store a blob as data chunks (one per page it spans) plus its index."""
+        ns = self._namespace(namespace)
+        offset = 0
+        count = 0
+        while count == 0 or offset < len(data):
+            if ENTRIES_PER_PAGE - self._entry < 2:
+                self._new_page()
+            part = data[offset:offset + (ENTRIES_PER_PAGE - self._entry - 1) * ENTRY_SIZE]
+            self._write(ns, TYPE_BLOB_DATA, count, key, self._var_header(part), part)
+            offset += len(part)
+            count += 1
+        self._write(ns, TYPE_BLOB_IDX, CHUNK_ANY, key, struct.pack("<IBBH", len(data), count, 0, 0xFFFF))
+
+    def image(self):
+        empty = b"\xff" * PAGE_SIZE
+        return b"".join(bytes(p) for p in self._pages) + empty * (self._page_count - len(self._pages))
+
+    def _namespace(self, name):
+        if name not in self._namespaces:
+            if len(self._namespaces) >= 254:
+                raise ValueError("too many namespaces")
+            index = len(self._namespaces) + 1
+            self._write(0, 0x01, CHUNK_ANY, name, struct.pack("<B", index).ljust(8, b"\xff"))
+            self._namespaces[name] = index
+        return self._namespaces[name]
+
+    @staticmethod
+    def _var_header(data):
+        return struct.pack("<HHI", len(data), 0xFFFF, crc32(data))
+
+    def _new_page(self):
+        if self._pages:
+            struct.pack_into("<I", self._pages[-1], 0, PAGE_FULL)
+        if len(self._pages) + 1 >= self._page_count:
+            raise ValueError("partition full (the last page must stay empty)")
+        page = bytearray(b"\xff" * PAGE_SIZE)
+        struct.pack_into("<IIB", page, 0, PAGE_ACTIVE, len(self._pages), NVS_PAGE_VERSION)
+        struct.pack_into("<I", page, 28, crc32(page[4:28]))
+        self._pages.append(page)
+        self._entry = 0
+
+    def _write(self, ns, dtype, chunk, key, data, payload=b""):
+        raw_key = key.encode("utf-8")
+        if not raw_key or len(raw_key) > MAX_KEY_LENGTH:
+            raise ValueError("invalid NVS key '%s' (1..%d bytes)" % (key, MAX_KEY_LENGTH))
+        span = 1 + (len(payload) + ENTRY_SIZE - 1) // ENTRY_SIZE
+        if self._entry + span > ENTRIES_PER_PAGE:
+            self._new_page()
+        entry = bytearray(ENTRY_SIZE)
+        struct.pack_into("<BBBB", entry, 0, ns, dtype, span, chunk)
+        entry[8:8 + len(raw_key)] = raw_key
+        entry[24:32] = data
+        struct.pack_into("<I", entry, 4, crc32(bytes(entry[0:4]) + bytes(entry[8:32])))
+
+        page = self._pages[-1]
+        start = FIRST_ENTRY_OFFSET + self._entry * ENTRY_SIZE
+        page[start:start + ENTRY_SIZE] = entry
+        page[start + ENTRY_SIZE:start + ENTRY_SIZE + len(payload)] = payload
+        for i in range(self._entry, self._entry + span):
+            page[32 + i // 4] &= ~(1 << ((i % 4) * 2)) & 0xFF  # Empty (3) -> written (2)
+        self._entry += span
+
+
+def shard_of(module_id, shards):
+    """Shard of a module (NVSConfigBus::shardOf(), FNV-1a)."""
+    if shards <= 1:
+        return 0
+    h = 2166136261
+    for b in module_id.encode("utf-8"):
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h % shards
+
+
+def is_valid_module_id(module_id):
+    """Same rules as NVSConfigBus::isValidModuleId()."""
+    raw = module_id.encode("utf-8")
+    return 0 < len(raw) <= 12 and ":" not in module_id and not module_id.startswith("__")
+
+
+def bus_image(modules, namespace="appcfg", size=0x6000, shards=1, max_module_size=2048):
+    """Image holding the given modules as NVSConfigBus stores them.
+
+    @param modules Ordered mapping moduleId -> JSON object; modules receive
+                   generations 1..n in this order
+    @param shards  Shard count the firmware passes to setShards()
+    @param max_module_size NVS_CFG_MAX_MODULE_SIZE of the firmware
+    """
+    if not 0 < len(namespace) <= (MAX_KEY_LENGTH if shards <= 1 else MAX_KEY_LENGTH - 2):
+        raise ValueError("invalid namespace '%s'" % namespace)
+    if not 1 <= shards <= 16:
+        raise ValueError("shard count must be 1..16")
+    writer = NvsWriter(size)
+    writer.put_u32(namespace, "__gen", len(modules))
+    if shards > 1:
+        writer.put_u8(namespace, "__shd", shards)
+    for generation, (module_id, doc) in enumerate(modules.items(), 1):
+        if not is_valid_module_id(module_id):
+            raise ValueError("invalid moduleId '%s'" % module_id)
+        if not isinstance(doc, dict):
+            raise ValueError("module '%s' is not a JSON object" % module_id)
+        blob = bytearray()
+        json2msgpack.encode(doc, blob)
+        if len(blob) > max_module_size:
+            raise ValueError("module '%s' is %d bytes (limit %d)" % (module_id, len(blob), max_module_size))
+        shard = shard_of(module_id, shards)
+        ns = namespace if shard == 0 else "%s.%x" % (namespace, shard)
+        info = struct.pack("<IBBHI", generation, 0, FORMAT_MSGPACK, len(blob), zlib.crc32(blob) & 0xFFFFFFFF)
+        writer.put_blob(ns, module_id + ":i", info)
+        writer.put_blob(ns, module_id + ":mp", bytes(blob))
+    return writer.image()
@@ -0,0 +1,36 @@
+"""PlatformIO pre-build hook: compile default config JSON files into a header.
+
+platformio.ini:
+    extra_scripts = pre:<path to NVSUtilityLibrary>/tools/pio_json_defaults.py
+    custom_nvs_defaults_dir = defaults                  ; *.json files (default: defaults)
+    custom_nvs_defaults_header = include/config_defaults.h  ; (default)
+
+Every `<name>.json` in the directory becomes `constexpr uint8_t
+<name>_defaults[]` in the header (see json2msgpack.py). The header is only
+rewritten when its content changes, so unchanged defaults trigger no rebuild.
+"""
+
+import glob
+import inspect
+import os
+import sys
+
+Import("env")  # noqa: F821 (provided by SCons)
+
+# SCons executes this file without __file__
+_here = os.path.dirname(os.path.abspath(inspect.getframeinfo(inspect.currentframe()).filename))
+sys.path.insert(0, _here)
+import json2msgpack  # noqa: E402
+
+_project = env.subst("$PROJECT_DIR")  # noqa: F821
+_section = "env:" + env.subst("$PIOENV")  # noqa: F821
+_config = env.GetProjectConfig()  # noqa: F821
+_dir = os.path.join(_project, _config.get(_section, "custom_nvs_defaults_dir", "defaults"))
+_header = os.path.join(_project, _config.get(_section, "custom_nvs_defaults_header", "include/config_defaults.h"))
+
+_inputs = sorted(glob.glob(os.path.join(_dir, "*.json")))
+if _inputs:
+    if json2msgpack.main(["-o", _header] + _inputs) != 0:
+        env.Exit(1)  # noqa: F821
+else:
+    print("pio_json_defaults: no JSON files in %s" % _dir)
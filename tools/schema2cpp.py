@@ -0,0 +1,414 @@
+#!/usr/bin/env python3
+"""Generate a typed C++ struct and MessagePack codec from a module schema.
+
+The schema is a JSON file:
+
+    {
+      "module": "pulsfan",              // moduleId used in NVS
+      "struct": "PulsfanConfig",        // optional (default: <Module>Config)
+      "version": 2,                     // current schema version
+      "versionKey": "schema_version",   // optional (this is the default)
+      "fields": [
+        {"name": "heartRateMin", "type": "uint8", "default": 120, "aliases": ["hr_min"]},
+        {"name": "firmwareVersion", "type": "string", "size": 16, "default": "1.0.0"},
+        {"name": "gains", "type": "float", "count": 3, "default": [1.0, 1.0, 0.5], "since": 2,
+         "doc": "Channel gains"}
+      ]
+    }
+
+Types: bool, int8/16/32/64, uint8/16/32/64, float, double, and string (a
+char[size] member, so at most size - 1 bytes). "count" turns a field into a
+fixed-size array. "aliases" are older key names accepted when decoding
+(renames need no migration code). "since" documents the version that added
+a field; it shows up in the generated migration stub.
+
+Output (into --out-dir):
+  <module>_config.h   struct with defaults, encode()/decode(), load()/save()
+                      (regenerated on every run)
+  <module>_migrate.cpp  migrate() stub, only written if it does not exist yet
+
+The blob written by save() is an ordinary NVSConfigBus MessagePack module: it
+loads with loadModuleConfig(), exports and imports like any other module.
+Only the Python standard library is needed.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+# type -> (C++ type, worst-case encoded size of one value)
+SCALARS = {
+    "bool": ("bool", 1),
+    "int8": ("int8_t", 2),
+    "int16": ("int16_t", 3),
+    "int32": ("int32_t", 5),
+    "int64": ("int64_t", 9),
+    "uint8": ("uint8_t", 2),
+    "uint16": ("uint16_t", 3),
+    "uint32": ("uint32_t", 5),
+    "uint64": ("uint64_t", 9),
+    "float": ("float", 5),
+    "double": ("double", 9),
+}
+
+IDENT = re.compile(r"^[A-Za-z_][A-Za-z0-9_]*$")
+
+
+class SchemaError(Exception):
+    pass
+
+
+def str_header_size(n):
+    return 1 if n < 32 else 2 if n < 0x100 else 3 if n < 0x10000 else 5
+
+
+def container_header_size(n):
+    return 1 if n < 16 else 3 if n < 0x10000 else 5
+
+
+def c_string(s):
+    out = []
+    for b in s.encode("utf-8"):
+        c = chr(b)
+        if c in "\\\"":
+            out.append("\\" + c)
+        elif 0x20 <= b < 0x7F:
+            out.append(c)
+        else:
+            out.append("\\%03o" % b)
+    return '"' + "".join(out) + '"'
+
+
+def c_scalar(ftype, value, name):
+    if ftype == "bool":
+        if not isinstance(value, bool):
+            raise SchemaError("%s: default must be true or false" % name)
+        return "true" if value else "false"
+    if ftype in ("float", "double"):
+        if isinstance(value, bool) or not isinstance(value, (int, float)):
+            raise SchemaError("%s: default must be a number" % name)
+        text = repr(float(value))
+        return text + "f" if ftype == "float" else text
+    if isinstance(value, bool) or not isinstance(value, int):
+        raise SchemaError("%s: default must be an integer" % name)
+    bits = int(re.sub(r"\D", "", ftype))
+    signed = not ftype.startswith("u")
+    low, high = (-(1 << (bits - 1)), (1 << (bits - 1)) - 1) if signed else (0, (1 << bits) - 1)
+    if not low <= value <= high:
+        raise SchemaError("%s: default %d does not fit %s" % (name, value, ftype))
+    if bits == 64:
+        if signed and value == low:
+            return "(-%dLL - 1)" % high  # The literal itself would overflow
+        return "%d%s" % (value, "LL" if signed else "ULL")
+    return "%d%s" % (value, "" if signed else "u")
+
+
+class Field:
+    def __init__(self, spec):
+        self.name = spec.get("name", "")
+        if not IDENT.match(self.name):
+            raise SchemaError("field name %r is not a C++ identifier" % self.name)
+        self.type = spec.get("type")
+        if self.type != "string" and self.type not in SCALARS:
+            raise SchemaError("%s: unknown type %r" % (self.name, self.type))
+        self.count = spec.get("count")
+        if self.count is not None and (not isinstance(self.count, int) or self.count < 1):
+            raise SchemaError("%s: count must be a positive integer" % self.name)
+        if self.type == "string" and self.count is not None:
+            raise SchemaError("%s: string arrays are not supported" % self.name)
+        self.size = spec.get("size")
+        if self.type == "string" and (not isinstance(self.size, int) or self.size < 2):
+            raise SchemaError("%s: string fields need a size of at least 2" % self.name)
+        self.aliases = spec.get("aliases", [])
+        self.since = spec.get("since")
+        self.doc = spec.get("doc", "")
+        self.default = spec.get("default")
+
+    def keys(self):
+        return [self.name] + list(self.aliases)
+
+    def member(self):
+        """Member declaration with its default initializer."""
+        if self.type == "string":
+            value = self.default if self.default is not None else ""
+            if not isinstance(value, str) or len(value.encode("utf-8")) > self.size - 1:
+                raise SchemaError("%s: default must be a string of at most %d bytes" % (self.name, self.size - 1))
+            decl = "char %s[%d] = %s;" % (self.name, self.size, c_string(value))
+        elif self.count is not None:
+            values = self.default
+            if values is None:
+                values = []
+            elif not isinstance(values, list):
+                values = [values] * self.count
+            if len(values) > self.count:
+                raise SchemaError("%s: more defaults than elements" % self.name)
+            init = ", ".join(c_scalar(self.type, v, self.name) for v in values)
+            decl = "%s %s[%d] = {%s};" % (SCALARS[self.type][0], self.name, self.count, init)
+        else:
+            value = self.default
+            init = "{}" if value is None else " = " + c_scalar(self.type, value, self.name)
+            decl = "%s %s%s;" % (SCALARS[self.type][0], self.name, init)
+        return decl + ("  ///< " + self.doc if self.doc else "")
+
+    def max_value_size(self):
+        if self.type == "string":
+            return str_header_size(self.size - 1) + self.size - 1
+        if self.count is not None:
+            return container_header_size(self.count) + self.count * SCALARS[self.type][1]
+        return SCALARS[self.type][1]
+
+    def decode_stmt(self):
+        if self.type == "string":
+            return "NVSCodec::readString(value, %s, sizeof(%s));" % (self.name, self.name)
+        if self.count is not None:
+            return "NVSCodec::readArray(value, v, end, %s);" % self.name
+        return "NVSCodec::read(value, %s);" % self.name
+
+    def encode_stmt(self):
+        if self.type == "string":
+            return "NVSCodec::writeString(w, %s, sizeof(%s));" % (self.name, self.name)
+        if self.count is not None:
+            return "NVSCodec::writeArray(w, %s);" % self.name
+        return "NVSCodec::write(w, %s);" % self.name
+
+
+def load_schema(path):
+    with open(path, "r", encoding="utf-8") as f:
+        schema = json.load(f)
+    module = schema.get("module", "")
+    if not re.match(r"^[A-Za-z0-9_-]{1,12}$", module):
+        raise SchemaError("module must be 1..12 characters [A-Za-z0-9_-]")
+    version = schema.get("version", 1)
+    if not isinstance(version, int) or not 1 <= version <= 0xFFFF:
+        raise SchemaError("version must be an integer 1..65535")
+    struct = schema.get("struct") or "".join(p[:1].upper() + p[1:] for p in re.split(r"[_-]", module)) + "Config"
+    if not IDENT.match(struct):
+        raise SchemaError("struct name %r is not a C++ identifier" % struct)
+    version_key = schema.get("versionKey", "schema_version")
+    fields = [Field(spec) for spec in schema.get("fields", [])]
+    if not fields:
+        raise SchemaError("schema has no fields")
+    keys = [version_key]
+    for field in fields:
+        keys += field.keys()
+    if len(set(keys)) != len(keys):
+        raise SchemaError("duplicate field name or alias")
+    if len(set(f.name for f in fields) & {"encode", "decode", "load", "save", "migrate"}):
+        raise SchemaError("field names must not clash with the generated methods")
+    return module, struct, version, version_key, fields
+
+
+def generate_header(source, module, struct, version, version_key, fields):
+    max_size = container_header_size(len(fields) + 1)
+    max_size += str_header_size(len(version_key.encode("utf-8"))) + len(version_key.encode("utf-8")) + 3
+    for field in fields:
+        key = field.name.encode("utf-8")
+        max_size += str_header_size(len(key)) + len(key) + field.max_value_size()
+
+    out = []
+    emit = out.append
+    emit("// Generated by schema2cpp.py from %s - do not edit" % os.path.basename(source))
+    emit("#pragma once")
+    emit("")
+    emit("#include <NVSConfigBus.h>")
+    emit("#include <NVSCodec.h>")
+    emit("")
+    emit("/**")
+    emit(" * @brief Typed configuration of module \"%s\" (schema version %d)" % (module, version))
+    emit(" *")
+    emit(" * Members start with their schema defaults. load() overwrites the ones")
+    emit(" * stored in NVS and calls migrate() for blobs of an older schema version;")
+    emit(" * save() stores all members as one MessagePack module. After an Unreadable")
+    emit(" * load(), a save() would replace the stored module with the defaults.")
+    emit(" */")
+    emit("struct %s {" % struct)
+    emit("  static constexpr const char* kModuleId = %s;" % c_string(module))
+    emit("  static constexpr uint16_t kSchemaVersion = %d;" % version)
+    emit("  static constexpr size_t kMaxEncodedSize = %d;  ///< encode() never needs more" % max_size)
+    emit("")
+    for field in fields:
+        emit("  " + field.member())
+    emit("")
+    emit("  /**")
+    emit("   * @brief Encode all members as a MessagePack map")
+    emit("   * @return Bytes written, 0 if @p bufSize is too small")
+    emit("   */")
+    emit("  size_t encode(uint8_t* buf, size_t bufSize) const;")
+    emit("")
+    emit("  /**")
+    emit("   * @brief Overwrite the members present in a MessagePack map")
+    emit("   * @param version Receives the stored schema version (0 if absent)")
+    emit("   * @return false if the data is not a well-formed map")
+    emit("   */")
+    emit("  bool decode(const uint8_t* data, size_t len, uint16_t& version);")
+    emit("")
+    emit("  /**")
+    emit("   * @brief Load from NVS (members keep their defaults unless Loaded)")
+    emit("   * @return Loaded, NotStored, or Unreadable if the module exists but could")
+    emit("   *         not be read or decoded; do not save() over it in that case")
+    emit("   */")
+    emit("  NVSCodec::LoadResult load(NVSConfigBus& bus);")
+    emit("")
+    emit("  /** @brief Save all members to NVS */")
+    emit("  bool save(NVSConfigBus& bus) const;")
+    emit("")
+    emit("  /**")
+    emit("   * @brief Upgrade members decoded from an older schema version")
+    emit("   *")
+    emit("   * Implemented in %s_migrate.cpp (generated once, then maintained by hand)." % module)
+    emit("   */")
+    emit("  void migrate(uint16_t fromVersion);")
+    emit("};")
+    emit("")
+
+    emit("inline size_t %s::encode(uint8_t* buf, size_t bufSize) const {" % struct)
+    emit("  NVSMsgPack::BufferWriter w(buf, bufSize);")
+    emit("  w.writeMapHeader(%d);" % (len(fields) + 1))
+    entries = [(version_key, "w.writeUInt(kSchemaVersion);")] + [(f.name, f.encode_stmt()) for f in fields]
+    for key, stmt in entries:
+        emit("  w.writeStr(%s, %d);" % (c_string(key), len(key.encode("utf-8"))))
+        emit("  " + stmt)
+    emit("  return w.overflowed() ? 0 : w.size();")
+    emit("}")
+    emit("")
+
+    # Keys are matched by length first, so most keys cost one integer compare
+    by_length = {}
+    for key, stmt in [(version_key, "NVSCodec::read(value, version);")] + \
+            [(k, f.decode_stmt()) for f in fields for k in f.keys()]:
+        by_length.setdefault(len(key.encode("utf-8")), []).append((key, stmt))
+
+    emit("inline bool %s::decode(const uint8_t* data, size_t len, uint16_t& version) {" % struct)
+    emit("  const uint8_t* p = data;")
+    emit("  const uint8_t* end = data + len;")
+    emit("  NVSMsgPack::Token map;")
+    emit("  version = 0;")
+    emit("  if (!NVSMsgPack::readToken(p, end, map) || map.type != NVSMsgPack::Type::Map) {")
+    emit("    return false;")
+    emit("  }")
+    emit("  for (uint32_t i = 0; i < map.length; i++) {")
+    emit("    NVSMsgPack::Token key;")
+    emit("    NVSMsgPack::Token value;")
+    emit("    if (!NVSMsgPack::readToken(p, end, key)) {")
+    emit("      return false;")
+    emit("    }")
+    emit("    const uint8_t* v = p;")
+    emit("    if (!NVSMsgPack::readToken(v, end, value) || !NVSMsgPack::skipValue(p, end)) {")
+    emit("      return false;")
+    emit("    }")
+    emit("    if (key.type != NVSMsgPack::Type::Str) {")
+    emit("      continue;")
+    emit("    }")
+    emit("    switch (key.length) {")
+    for length in sorted(by_length):
+        emit("      case %d:" % length)
+        for n, (key, stmt) in enumerate(by_length[length]):
+            emit("        %sif (NVSCodec::keyIs(key, %s, %d)) {" % ("} else " if n else "", c_string(key), length))
+            emit("          " + stmt)
+        emit("        }")
+        emit("        break;")
+    emit("      default:")
+    emit("        break;  // Unknown member (e.g. written by a newer firmware)")
+    emit("    }")
+    if not any(f.count is not None for f in fields):
+        emit("    (void)v;")
+    emit("  }")
+    emit("  return true;")
+    emit("}")
+    emit("")
+
+    emit("inline NVSCodec::LoadResult %s::load(NVSConfigBus& bus) {" % struct)
+    emit("  // The stored bytes bound the merged document, which may hold more members")
+    emit("  // than kMaxEncodedSize (newer firmware); sizeOf() is 0 for modules the")
+    emit("  // directory cannot size, which get the largest module buffer")
+    emit("  size_t stored = bus.sizeOf(kModuleId);")
+    emit("  NVSScratchBuffer buf(bus.memoryBudget(), bus.allocator(),")
+    emit("                       stored > 0 ? stored : NVS_CFG_MAX_MODULE_SIZE);")
+    emit("  size_t len = buf ? bus.readModuleMsgPack(kModuleId, buf.data(), buf.size()) : 0;")
+    emit("  %s loaded;" % struct)
+    emit("  uint16_t version;")
+    emit("  if (len == 0 && !bus.exists(kModuleId)) {")
+    emit("    return NVSCodec::LoadResult::NotStored;")
+    emit("  }")
+    emit("  if (len == 0 || !loaded.decode(buf.data(), len, version)) {")
+    emit("    NVS_CFG_LOG(\"%s: stored module unreadable\");" % struct)
+    emit("    return NVSCodec::LoadResult::Unreadable;")
+    emit("  }")
+    emit("  if (version < kSchemaVersion) {")
+    emit("    loaded.migrate(version);")
+    emit("  }")
+    emit("  *this = loaded;")
+    emit("  return NVSCodec::LoadResult::Loaded;")
+    emit("}")
+    emit("")
+    emit("inline bool %s::save(NVSConfigBus& bus) const {" % struct)
+    emit("  uint8_t buf[2 * kMaxEncodedSize];  // Second half: scratch for hot fields / journal records")
+    emit("  size_t len = encode(buf, kMaxEncodedSize);")
+    emit("  return len > 0 && bus.saveModuleMsgPack(kModuleId, buf, len, sizeof(buf));")
+    emit("}")
+    emit("")
+    return "\n".join(out)
+
+
+def generate_migrate_stub(module, struct, version, fields):
+    out = []
+    emit = out.append
+    emit("// Schema migration for %s - generated once by schema2cpp.py, then edited by hand" % struct)
+    emit("#include \"%s_config.h\"" % module)
+    emit("")
+    emit("void %s::migrate(uint16_t fromVersion) {" % struct)
+    emit("  // Members missing from the stored blob already hold their defaults, and")
+    emit("  // renamed keys are read through their aliases. Convert values whose")
+    emit("  // meaning changed here. fromVersion is 0 for blobs without a version.")
+    added = {}
+    for field in fields:
+        if isinstance(field.since, int) and field.since > 1:
+            added.setdefault(field.since, []).append(field.name)
+    for since in sorted(added):
+        emit("  if (fromVersion < %d) {" % since)
+        emit("    // Added in version %d: %s" % (since, ", ".join(added[since])))
+        emit("  }")
+    emit("  (void)fromVersion;")
+    emit("}")
+    emit("")
+    return "\n".join(out)
+
+
+def write_if_changed(path, text):
+    """Keep the timestamp of an unchanged header so nothing is rebuilt."""
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            if f.read() == text:
+                return
+    except OSError:
+        pass
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("schema", help="module schema (JSON)")
+    parser.add_argument("-d", "--out-dir", default=".", help="output directory (default: current)")
+    args = parser.parse_args(argv)
+
+    try:
+        module, struct, version, version_key, fields = load_schema(args.schema)
+        header = generate_header(args.schema, module, struct, version, version_key, fields)
+    except (OSError, ValueError, SchemaError) as e:
+        print("schema2cpp: %s" % e, file=sys.stderr)
+        return 1
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    write_if_changed(os.path.join(args.out_dir, module + "_config.h"), header)
+    stub = os.path.join(args.out_dir, module + "_migrate.cpp")
+    if not os.path.exists(stub):
+        with open(stub, "w", encoding="utf-8") as f:
+            f.write(generate_migrate_stub(module, struct, version, fields))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())